@@ -0,0 +1,198 @@
+// Benchmark of ObstacleManager::handleCollisions from 10 to 10,000 bodies.
+//
+// Places alternating disks and movable rectangles on a jittered lattice with random
+// velocities, over a domain that grows with the body count (constant density, so the
+// number of contacts per body stays the same), then times update() + handleCollisions()
+// per step with the spatial-hash broadphase, serially and over a --threads pool, and with
+// the all-pairs loop. The pool solves the same islands as the serial run, so same checks
+// their position checksums are equal; all-pairs visits each island's pairs in the same
+// order, so match checks that the two end up equal too, which holds until a push reaches
+// across islands: those are merged and go on from where they were, while all-pairs walks
+// them together from the start. merged is the number of islands the last step merged.
+// All-pairs is skipped above --brute-max bodies.
+//
+// --active F gives only that share of the bodies a velocity; the others start at rest and
+// fall asleep after ObstacleManager::sleepDelay, until something runs into them (awake is
+// the count after the last timed step). --no-sleep keeps every body awake.
+//
+// --pull G accelerates every body towards the domain centre (which keeps them all awake)
+// and packs them into a pile whose contacts persist from step to step, the case that
+// --iterations and the warm start matter for; warm is the number of contacts of the last
+// step that started from the impulse cached the step before. overlap is the mean over the
+// timed steps of the summed overlap the last of the --iterations passes still found.
+// allocs counts heap allocations per timed step after 50 untimed ones, the larger of the
+// serial and the pooled run; a step must not allocate, so the bench fails when it does.
+//
+//   CollisionBench [--counts 10,100,...] [--steps K] [--brute-max K] [--threads K]
+//                  [--iterations K] [--pull G] [--active F] [--no-sleep]
+#include "ObstacleManager.h"
+#include "MovableRectObstacle.h"
+#include "DiskObstacle.h"
+#include "ObstacleVisitor.h"
+#include "Timer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+// Every heap allocation in the process goes through here
+static long g_allocs = 0;
+void* operator new(std::size_t n) {
+    ++g_allocs;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Options {
+    std::vector<int> counts{10, 100, 1000, 10000};
+    int steps = 20;
+    int bruteMax = 2000;
+    int iterations = -1; // ObstacleManager's defaults when < 0
+    float pull = 0.f;
+    float active = 1.f;
+    bool sleeping = true;
+    int threads = 4;
+};
+
+// Sum of the body positions, to check that both paths end in the same state.
+struct PositionSum : ObstacleVisitor {
+    double sum = 0;
+    void visit(const MovableRectObstacle& r) override { sum += r.getCenter().x + 3.0 * r.getCenter().y; }
+    void visit(const DiskObstacle& d) override       { sum += d.getCenter().x + 3.0 * d.getCenter().y; }
+};
+
+struct Result {
+    double ms = 0, checksum = 0, overlap = 0, allocs = 0;
+    CollisionStats stats;
+};
+
+Result run(int count, bool broadphase, const Options& opt, ThreadPool* pool = nullptr) {
+    // One body per 12x12 cell lattice site, jittered; bodies start apart and collide as
+    // they drift.
+    const int spacing = 12;
+    int cols = static_cast<int>(std::ceil(std::sqrt(double(count))));
+    int N = cols * spacing;
+    ObstacleManager manager(N);
+    manager.broadphase = broadphase;
+    if (opt.iterations >= 0) manager.collisionIterations = opt.iterations;
+    manager.sleeping = opt.sleeping;
+
+    unsigned seed = 12345u;
+    auto rnd = [&]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.f / 16777216.f); };
+    std::vector<int> centre;
+    std::vector<MovableObstacle*> bodies;
+    for (int k = 0; k < count; ++k) {
+        int x = (k % cols) * spacing + spacing / 2 + static_cast<int>(4 * rnd()) - 2;
+        int y = (k / cols) * spacing + spacing / 2 + static_cast<int>(4 * rnd()) - 2;
+        if (k % 2 == 0) manager.addDisk(x, y, 3, 6, 6);
+        else            manager.addMovableRect(x - 2, y - 3, 4, 7);
+        centre.push_back(x); centre.push_back(y);
+    }
+    for (int k = 0; k < count; ++k)
+        if (MovableObstacle* m = manager.findMovableAt(centre[2*k], centre[2*k+1])) {
+            float vx = 20.f * (rnd() - 0.5f), vy = 20.f * (rnd() - 0.5f);
+            if (rnd() < opt.active) m->setVelocity(vx, vy);
+            bodies.push_back(m);
+        }
+
+    Result res;
+    const float dt = 0.1f;
+    auto step = [&]() {
+        for (MovableObstacle* m : bodies) {
+            if (opt.pull == 0.f) break;
+            Vec2 d = Vec2(N / 2.f, N / 2.f) - m->getPosition();
+            float len = d.len(), vx, vy;
+            if (len < 1e-3f) continue;
+            m->getVelocity(vx, vy);
+            m->setVelocity(vx + opt.pull * dt * d.x / len, vy + opt.pull * dt * d.y / len);
+        }
+        manager.update(dt);
+        if (pool) manager.handleCollisions(*pool);
+        else      manager.handleCollisions();
+    };
+    for (int s = 0; s < 50; ++s) step(); // warm up: the first contacts, sizes the arrays
+    long allocs0 = g_allocs;
+    for (int s = 0; s < opt.steps; ++s) {
+        {
+            ScopedTimer t(&res.ms);
+            step();
+        }
+        res.overlap += manager.collisionStats().overlap;
+    }
+    res.allocs = double(g_allocs - allocs0) / opt.steps;
+    res.ms /= opt.steps;
+    res.overlap /= opt.steps;
+    res.stats = manager.collisionStats();
+    PositionSum sum;
+    manager.accept(sum);
+    res.checksum = sum.sum;
+    return res;
+}
+
+std::vector<int> splitInts(const char* s) {
+    std::vector<int> out;
+    for (const char* p = s; *p; ) {
+        out.push_back(std::atoi(p));
+        while (*p && *p != ',') ++p;
+        if (*p) ++p;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int a = 1; a < argc; ++a) {
+        const char* val = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        if      (val && !std::strcmp(argv[a], "--counts"))    opt.counts = splitInts(val);
+        else if (val && !std::strcmp(argv[a], "--steps"))     opt.steps = std::atoi(val);
+        else if (val && !std::strcmp(argv[a], "--brute-max")) opt.bruteMax = std::atoi(val);
+        else if (val && !std::strcmp(argv[a], "--iterations")) opt.iterations = std::atoi(val);
+        else if (val && !std::strcmp(argv[a], "--pull"))      opt.pull = static_cast<float>(std::atof(val));
+        else if (val && !std::strcmp(argv[a], "--active"))    opt.active = static_cast<float>(std::atof(val));
+        else if (val && !std::strcmp(argv[a], "--threads"))   opt.threads = std::atoi(val);
+        else if (!std::strcmp(argv[a], "--no-sleep"))         { opt.sleeping = false; continue; }
+        else {
+            std::fprintf(stderr, "usage: %s [--counts 10,100,...] [--steps K] [--brute-max K] [--threads K] "
+                                 "[--iterations K] [--pull G] [--active F] [--no-sleep]\n", argv[0]);
+            return 1;
+        }
+        ++a;
+    }
+    if (opt.threads < 1) { std::fprintf(stderr, "Error: --threads must be at least 1.\n"); return 1; }
+    ThreadPool pool(opt.threads);
+
+    std::printf("bodies,awake,islands,pairs,contacts,touching,warm,reboxed,merged,overlap,allocs,"
+                "grid_ms,pool_ms,same,brute_ms,speedup,match\n");
+    for (int count : opt.counts) {
+        if (count < 2) { std::fprintf(stderr, "Error: need at least 2 bodies, got %d.\n", count); return 1; }
+        Result grid = run(count, true, opt);
+        Result pooled = run(count, true, opt, &pool);
+        const CollisionStats& st = grid.stats;
+        double allocs = std::max(grid.allocs, pooled.allocs);
+        std::printf("%d,%d,%d,%d,%d,%d,%d,%d,%d,%.1f,%.1f,%.4f,%.4f,%d,", count, st.awake, st.islands, st.pairs,
+                    st.contacts, st.touching, st.warm, st.reboxed, st.merged, grid.overlap, allocs, grid.ms,
+                    pooled.ms, int(pooled.checksum == grid.checksum));
+        if (count <= opt.bruteMax) {
+            Result brute = run(count, false, opt);
+            std::printf("%.4f,%.1f,%d\n", brute.ms, brute.ms / grid.ms, int(brute.checksum == grid.checksum));
+        } else {
+            std::printf("-,-,-\n");
+        }
+        std::fflush(stdout);
+        if (allocs > 0) {
+            std::fprintf(stderr, "Error: %d bodies: %g heap allocations per step\n", count, allocs);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Microbenchmark of the density colormap in Colormap.h.
+//
+// Colours a (N+1) x (N+1) texture from a density and temperature field with each
+// instruction set this CPU has and prints the time per frame and the texel rate. The fields
+// run past both ends of [0,1] so the clamping is exercised; every instruction set must give
+// the same bytes as the scalar kernel, which the match column checks. Needs no GL.
+//
+//   ColormapBench [--sizes 64,255,...] [--frames K]
+#include "Colormap.h"
+#include "Timer.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::vector<int> sizes{64, 255, 512, 1024};
+    int frames = 50;
+};
+
+void run(int N, const Options& opt) {
+    Field dens(fieldSize(N)), temp(fieldSize(N));
+    for (int j = 0; j <= N + 1; ++j)
+        for (int i = 0; i <= N + 1; ++i) {
+            dens[IX(i, j, N)] = 0.5f + std::sin(0.05f * i) * std::cos(0.07f * j);
+            temp[IX(i, j, N)] = std::sin(0.03f * (i + j));
+        }
+
+    size_t bytes = 4 * size_t(N + 1) * (N + 1);
+    std::vector<uint8_t> reference(bytes), rgba(bytes);
+    ColormapIsa best = colormapIsa();
+    forceColormapIsa(ColormapIsa::Scalar);
+    colormapDensity(N, dens.data(), temp.data(), reference.data());
+
+    for (int k = 0; k <= int(best); ++k) {
+        ColormapIsa isa = ColormapIsa(k);
+        forceColormapIsa(isa);
+        std::fill(rgba.begin(), rgba.end(), uint8_t(0));
+        colormapDensity(N, dens.data(), temp.data(), rgba.data()); // warm up, touches every page
+        bool match = rgba == reference;
+        double ms = 0;
+        {
+            ScopedTimer t(&ms);
+            for (int f = 0; f < opt.frames; ++f) colormapDensity(N, dens.data(), temp.data(), rgba.data());
+        }
+        double perFrame = ms / opt.frames;
+        std::printf("%s,%d,%.4f,%.1f,%d\n", colormapIsaName(isa), N, perFrame,
+                    double(N + 1) * (N + 1) / (perFrame * 1e3), match ? 1 : 0);
+        std::fflush(stdout);
+    }
+    forceColormapIsa(best);
+}
+
+std::vector<int> splitInts(const char* s) {
+    std::vector<int> out;
+    for (const char* p = s; *p; ) {
+        out.push_back(std::atoi(p));
+        while (*p && *p != ',') ++p;
+        if (*p) ++p;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int a = 1; a < argc; ++a) {
+        const char* val = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        if      (val && !std::strcmp(argv[a], "--sizes"))  opt.sizes = splitInts(val);
+        else if (val && !std::strcmp(argv[a], "--frames")) opt.frames = std::atoi(val);
+        else { std::fprintf(stderr, "usage: %s [--sizes 64,255,...] [--frames K]\n", argv[0]); return 1; }
+        ++a;
+    }
+
+    std::printf("isa,N,ms_per_frame,mtexels_per_s,match\n");
+    for (int N : opt.sizes) {
+        if (N < 8) { std::fprintf(stderr, "Error: grid size %d is too small.\n", N); return 1; }
+        run(N, opt);
+    }
+    return 0;
+}
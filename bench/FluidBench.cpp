@@ -0,0 +1,400 @@
+// Headless throughput benchmark for FluidSolver::step().
+//
+// Runs scripted scenarios for a fixed number of steps at a range of grid sizes and prints
+// the wall time per step together with the per-phase breakdown from SolverTimings. A size
+// is N for an N x N grid or NxM for an N wide, M high one.
+//
+//   FluidBench [--scenario inject|obstacles|plume|all] [--sizes 64,128,256x64,...]
+//              [--steps K] [--warmup K] [--bodies K] [--pressure gs|mg|cg] [--threads K]
+//              [--advect scalar|reference|fast] [--isa sse2|avx2|avx512] [--gs sweeps|wavefront]
+//              [--forces fused|separate] [--scalars K] [--tiles on|off] [--format csv|json]
+//              [--checkpoint-every K] [--checkpoint PATH] [--record-every K] [--record PATH]
+//
+// Besides timings, each row reports the pressure solver's work (iterations per projection
+// and the relative residual of the last projection) and the fraction of scalar tiles that
+// were occupied after the last step (FluidSolver::active_tiles).
+//
+// With --checkpoint-every, a checkpoint is saved through a CheckpointWriter every K timed
+// steps; the capture counts towards the step time, and what the writer did goes to stderr.
+// --record-every does the same with a FieldRecorder, one frame every K timed steps.
+//
+// With --advect reference, the SIMD kernels are first checked against the scalar one on
+// every instruction set up to the selected one; any bit that differs is an error.
+#include "FluidGrid.h"
+#include "FluidSolver.h"
+#include "ObstacleManager.h"
+#include "Checkpoint.h"
+#include "FieldRecorder.h"
+#include "Timer.h"
+#include "AdvectKernels.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct GridSize { int nx, ny; };
+
+struct Options {
+    std::vector<std::string> scenarios{"inject", "obstacles", "plume"};
+    std::vector<GridSize> sizes{{64, 64}, {128, 128}, {256, 256}, {512, 512}, {1024, 1024}, {2048, 2048}};
+    int  steps  = 50;
+    int  warmup = 5;
+    int  bodies = 32;
+    bool json   = false;
+    PressureSolverType pressure = PressureSolverType::GaussSeidel;
+    int  threads = 0; // 0: solver default (hardware concurrency)
+    AdvectPath advect = AdvectPath::Fast;
+    bool wavefront = true;
+    bool fusedForces = true;
+    int  scalars = 2; // density and temperature, plus dye channels beyond that
+    bool activeTiles = true;
+    int  checkpointEvery = 0; // steps, 0: none
+    std::string checkpointPath = "FluidBench.ckpt";
+    int  recordEvery = 0;     // steps, 0: none
+    std::string recordPath = "FluidBench.rec";
+};
+
+struct Result {
+    std::string   scenario;
+    int           Nx = 0, Ny = 0;
+    int           steps = 0;
+    double        wall = 0;   // ms, whole step including the rigid-body update
+    double        bodies = 0; // ms, updateObstacles + update + handleCollisions
+    SolverTimings phases;
+    double        pressureIters = 0; // summed over steps, last projection of each step
+    float         residual = 0;
+    double        tileFraction = 1;
+};
+
+// One simulation instance, set up the same way FluidToy drives it from idle().
+class Scenario {
+public:
+    Scenario(const std::string& name, GridSize size, int bodies, PressureSolverType pressure, int threads,
+             AdvectPath advect, bool wavefront, bool fusedForces, int scalars, bool activeTiles)
+        : m_name(name), m_Nx(size.nx), m_Ny(size.ny), m_grid(size.nx, size.ny),
+          m_manager(new ObstacleManager(size.nx, size.ny)),
+          m_solver(m_grid, m_manager.get())
+    {
+        m_solver.dt = 0.1f; m_solver.diff = 0.f; m_solver.visc = 0.f; m_solver.vort = 5.f;
+        m_solver.buoyancy_on = (name == "plume");
+        m_solver.pressure_solver = pressure;
+        m_solver.advect_path = advect;
+        m_solver.gs_wavefront = wavefront;
+        m_solver.fused_forces = fusedForces;
+        m_solver.active_tiles = activeTiles;
+        if (threads > 0) m_solver.setThreadCount(threads);
+        if (name == "obstacles") placeBodies(bodies);
+        for (int k = m_grid.scalarCount(); k < scalars; ++k) m_grid.addScalar("dye" + std::to_string(k - 1));
+    }
+
+    // Steady sources along the bottom of the domain, refreshed every step like getFromUI().
+    // Sizes follow the shorter side.
+    void inject() {
+        m_grid.clearSources();
+
+        int N = m_Nx, Ny = m_Ny, r = std::max(1, std::min(N, Ny) / 32);
+        int ci = N / 2, cj = std::max(1, Ny / 8);
+        for (int j = cj - r; j <= cj + r; ++j)
+            for (int i = ci - r; i <= ci + r; ++i) {
+                if (i < 1 || i > N || j < 1 || j > Ny) continue;
+                if (m_name == "plume") {
+                    m_grid.tempPrev()[IX(i, j, N)] = 200.f;
+                    m_grid.densPrev()[IX(i, j, N)] = 50.f;
+                } else {
+                    m_grid.densPrev()[IX(i, j, N)] = 100.f;
+                    m_grid.vPrev()[IX(i, j, N)]    = 20.f;
+                }
+                // dye channels enter side by side across the source
+                for (int k = FluidGrid::Temperature + 1; k < m_grid.scalarCount(); ++k)
+                    if ((i + k) % (m_grid.scalarCount() - 1) == 0) m_grid.scalarSource(k)[IX(i, j, N)] = 100.f;
+            }
+    }
+
+    void step(Result& res) {
+        inject();
+        ScopedTimer wall(&res.wall);
+        if (m_name == "obstacles") {
+            ScopedTimer t(&res.bodies);
+            m_manager->updateObstacles(m_grid, m_solver.dt, m_solver.threadPool());
+            m_manager->update(m_solver.dt);
+            m_manager->handleCollisions(m_solver.threadPool());
+        }
+        m_solver.step();
+        res.pressureIters += m_solver.pressureStats().iterations;
+        res.residual = m_solver.pressureStats().residual;
+    }
+
+    FluidSolver& solver() { return m_solver; }
+    FluidGrid&   grid()   { return m_grid; }
+    ObstacleManager& obstacles() { return *m_manager; }
+
+private:
+    // A lattice of alternating disks and movable rectangles across the upper part of the domain.
+    void placeBodies(int count) {
+        int cols = 8, rows = (count + cols - 1) / cols;
+        int placed = 0;
+        for (int r = 0; r < rows && placed < count; ++r)
+            for (int c = 0; c < cols && placed < count; ++c, ++placed) {
+                int x = (2 * c + 1) * m_Nx / (2 * cols);
+                int y = m_Ny / 4 + (2 * r + 1) * (3 * m_Ny / 4) / (2 * rows);
+                int s = std::max(2, std::min(m_Nx, m_Ny) / 40);
+                if (placed % 2 == 0) m_manager->addDisk(x, y, s, 2 * s, 2 * s);
+                else                 m_manager->addMovableRect(x - s, y - s, 2 * s, 3 * s);
+            }
+    }
+
+    std::string m_name;
+    int m_Nx, m_Ny;
+    FluidGrid m_grid;
+    std::unique_ptr<ObstacleManager> m_manager;
+    FluidSolver m_solver;
+};
+
+Result run(const std::string& name, GridSize size, const Options& opt) {
+    Scenario sc(name, size, opt.bodies, opt.pressure, opt.threads, opt.advect, opt.wavefront, opt.fusedForces, opt.scalars,
+                opt.activeTiles);
+    Result res, discard;
+    for (int k = 0; k < opt.warmup; ++k) sc.step(discard);
+
+    sc.solver().timings.reset();
+    sc.solver().profile = true;
+    std::unique_ptr<CheckpointWriter> writer;
+    if (opt.checkpointEvery > 0) writer.reset(new CheckpointWriter());
+    std::unique_ptr<FieldRecorder> recorder;
+    if (opt.recordEvery > 0) {
+        RecorderOptions ro;
+        ro.pool = &sc.solver().threadPool();
+        recorder.reset(new FieldRecorder());
+        if (!recorder->open(opt.recordPath, size.nx, size.ny, ro)) {
+            std::fprintf(stderr, "Error: %s\n", recorder->error().c_str());
+            recorder.reset();
+        }
+    }
+    for (int k = 0; k < opt.steps; ++k) {
+        sc.step(res);
+        if (writer && (k + 1) % opt.checkpointEvery == 0) {
+            ScopedTimer t(&res.wall);
+            writer->save(sc.grid(), sc.solver(), &sc.obstacles(), opt.warmup + k + 1, opt.checkpointPath);
+        }
+        if (recorder && (k + 1) % opt.recordEvery == 0) {
+            ScopedTimer t(&res.wall);
+            recorder->record(sc.grid(), opt.warmup + k + 1);
+        }
+    }
+    if (writer) {
+        writer->wait();
+        CheckpointStats cs = writer->stats();
+        std::fprintf(stderr, "%s %dx%d checkpoints: %d written, %d skipped, %d failed, %llu bytes, "
+                     "capture %.3f ms, write %.3f ms each\n", name.c_str(), size.nx, size.ny, cs.written, cs.skipped, cs.failed,
+                     (unsigned long long)cs.bytes, cs.captureMs / std::max(1, cs.written + cs.failed),
+                     cs.writeMs / std::max(1, cs.written + cs.failed));
+        if (cs.failed) std::fprintf(stderr, "Error: %s\n", writer->lastError().c_str());
+    }
+    if (recorder) {
+        bool ok = recorder->close();
+        RecorderStats rs = recorder->stats();
+        int frames = std::max(1, rs.frames);
+        std::fprintf(stderr, "%s %dx%d recording: %d frames (%d keyframes), %llu of %llu bytes, capture %.3f ms, "
+                     "wait %.3f ms, encode %.3f ms, write %.3f ms each\n", name.c_str(), size.nx, size.ny, rs.frames, rs.keyframes,
+                     (unsigned long long)rs.storedBytes, (unsigned long long)rs.rawBytes, rs.captureMs / frames,
+                     rs.waitMs / frames, rs.encodeMs / frames, rs.writeMs / frames);
+        if (!ok) std::fprintf(stderr, "Error: %s\n", recorder->error().c_str());
+    }
+
+    res.scenario = name;
+    res.Nx = size.nx; res.Ny = size.ny;
+    res.steps = opt.steps;
+    res.phases = sc.solver().timings;
+    TileMap& tiles = sc.grid().scalarTiles();
+    res.tileFraction = double(tiles.activeCount()) / tiles.tileCount();
+    return res;
+}
+
+void printCsvHeader() {
+    std::printf("scenario,Nx,Ny,steps,ms_per_step,addSource,applyBuoyancy,confine,forces,diffuse,project,advect,obstacles,tiles,bodies,"
+                "pressure_iters,pressure_residual,active_tiles\n");
+}
+
+void printCsv(const Result& r) {
+    double s = r.steps > 0 ? 1.0 / r.steps : 0.0;
+    const SolverTimings& p = r.phases;
+    std::printf("%s,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.3g,%.3f\n",
+                r.scenario.c_str(), r.Nx, r.Ny, r.steps, r.wall * s,
+                p.addSource * s, p.buoyancy * s, p.confine * s, p.forces * s, p.diffuse * s,
+                p.project * s, p.advect * s, p.obstacles * s, p.tiles * s, r.bodies * s,
+                r.pressureIters * s, r.residual, r.tileFraction);
+    std::fflush(stdout);
+}
+
+void printJson(const std::vector<Result>& results) {
+    std::printf("[\n");
+    for (size_t k = 0; k < results.size(); ++k) {
+        const Result& r = results[k];
+        double s = r.steps > 0 ? 1.0 / r.steps : 0.0;
+        const SolverTimings& p = r.phases;
+        std::printf("  {\"scenario\": \"%s\", \"Nx\": %d, \"Ny\": %d, \"steps\": %d, \"ms_per_step\": %.4f, \"phases\": "
+                    "{\"addSource\": %.4f, \"applyBuoyancy\": %.4f, \"confine\": %.4f, \"forces\": %.4f, \"diffuse\": %.4f, "
+                    "\"project\": %.4f, \"advect\": %.4f, \"obstacles\": %.4f, \"tiles\": %.4f, \"bodies\": %.4f}, "
+                    "\"pressure_iters\": %.2f, \"pressure_residual\": %.3g, \"active_tiles\": %.3f}%s\n",
+                    r.scenario.c_str(), r.Nx, r.Ny, r.steps, r.wall * s,
+                    p.addSource * s, p.buoyancy * s, p.confine * s, p.forces * s, p.diffuse * s,
+                    p.project * s, p.advect * s, p.obstacles * s, p.tiles * s, r.bodies * s,
+                    r.pressureIters * s, r.residual, r.tileFraction,
+                    k + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+std::vector<std::string> split(const char* s) {
+    std::vector<std::string> out;
+    std::string cur;
+    for (; *s; ++s) {
+        if (*s == ',') { if (!cur.empty()) out.push_back(cur); cur.clear(); }
+        else cur += *s;
+    }
+    if (!cur.empty()) out.push_back(cur);
+    return out;
+}
+
+// Advects a swirl and a striped field once with AdvectPath::Scalar and once with Reference
+// on each ISA from SSE2 up to the current one, and counts the cells that differ.
+bool referenceMatchesScalar(GridSize g) {
+    int N = g.nx, Ny = g.ny;
+    Field u(fieldSize(N, Ny)), v(fieldSize(N, Ny)), d0(fieldSize(N, Ny)), ref(fieldSize(N, Ny)), d(fieldSize(N, Ny));
+    float ci = 0.5f * (N + 1), cj = 0.5f * (Ny + 1);
+    for (int j = 0; j <= Ny + 1; ++j)
+        for (int i = 0; i <= N + 1; ++i) {
+            u[IX(i,j,N)]  = -(j - cj) / N + 0.01f * std::sin(0.3f * i);
+            v[IX(i,j,N)]  =  (i - ci) / N + 0.01f * std::cos(0.2f * j);
+            d0[IX(i,j,N)] = std::sin(0.05f * i) * std::cos(0.07f * j);
+        }
+    float dt0 = 0.1f * std::max(N, Ny) + 0.37f;
+    advectRows(AdvectPath::Scalar, N, Ny, dt0, ref.data(), d0.data(), u.data(), v.data(), 1, Ny + 1);
+
+    AdvectIsa top = advectIsa();
+    bool ok = true;
+    for (AdvectIsa isa : {AdvectIsa::SSE2, AdvectIsa::AVX2, AdvectIsa::AVX512}) {
+        if (isa > top) break;
+        forceAdvectIsa(isa);
+        std::fill(d.begin(), d.end(), 0.f);
+        advectRows(AdvectPath::Reference, N, Ny, dt0, d.data(), d0.data(), u.data(), v.data(), 1, Ny + 1);
+        int diff = 0;
+        for (int j = 1; j <= Ny; ++j)
+            for (int i = 1; i <= N; ++i)
+                diff += std::memcmp(&d[IX(i,j,N)], &ref[IX(i,j,N)], sizeof(float)) != 0;
+        if (diff) {
+            std::fprintf(stderr, "Error: reference advection on %s differs from scalar in %d of %d cells (%dx%d).\n",
+                         advectIsaName(isa), diff, N * Ny, N, Ny);
+            ok = false;
+        }
+    }
+    forceAdvectIsa(top);
+    return ok;
+}
+
+void usage(const char* argv0) {
+    std::fprintf(stderr,
+        "usage: %s [--scenario inject|obstacles|plume|all] [--sizes 64,128,256x64,...]\n"
+        "          [--steps K] [--warmup K] [--bodies K] [--pressure gs|mg|cg] [--threads K]\n"
+        "          [--advect scalar|reference|fast] [--isa sse2|avx2|avx512] [--gs sweeps|wavefront]\n"
+        "          [--forces fused|separate] [--scalars K] [--tiles on|off] [--format csv|json]\n"
+        "          [--checkpoint-every K] [--checkpoint PATH] [--record-every K] [--record PATH]\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int a = 1; a < argc; ++a) {
+        const char* arg = argv[a];
+        const char* val = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        if (!val) { usage(argv[0]); return 1; }
+        if      (!std::strcmp(arg, "--scenario")) { if (std::strcmp(val, "all")) opt.scenarios = split(val); }
+        else if (!std::strcmp(arg, "--sizes")) {
+            opt.sizes.clear();
+            for (auto& s : split(val)) {
+                GridSize g{0, 0};
+                if (std::sscanf(s.c_str(), "%dx%d", &g.nx, &g.ny) < 2) g.ny = g.nx;
+                opt.sizes.push_back(g);
+            }
+        }
+        else if (!std::strcmp(arg, "--steps"))    opt.steps  = std::atoi(val);
+        else if (!std::strcmp(arg, "--warmup"))   opt.warmup = std::atoi(val);
+        else if (!std::strcmp(arg, "--bodies"))   opt.bodies = std::atoi(val);
+        else if (!std::strcmp(arg, "--threads"))  opt.threads = std::atoi(val);
+        else if (!std::strcmp(arg, "--scalars"))  opt.scalars = std::max(2, std::atoi(val));
+        else if (!std::strcmp(arg, "--format"))   opt.json   = !std::strcmp(val, "json");
+        else if (!std::strcmp(arg, "--checkpoint-every")) opt.checkpointEvery = std::atoi(val);
+        else if (!std::strcmp(arg, "--checkpoint"))       opt.checkpointPath = val;
+        else if (!std::strcmp(arg, "--record-every"))     opt.recordEvery = std::atoi(val);
+        else if (!std::strcmp(arg, "--record"))           opt.recordPath = val;
+        else if (!std::strcmp(arg, "--pressure")) {
+            if      (!std::strcmp(val, "gs")) opt.pressure = PressureSolverType::GaussSeidel;
+            else if (!std::strcmp(val, "mg")) opt.pressure = PressureSolverType::Multigrid;
+            else if (!std::strcmp(val, "cg")) opt.pressure = PressureSolverType::ConjugateGradient;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (!std::strcmp(arg, "--advect")) {
+            if      (!std::strcmp(val, "scalar"))    opt.advect = AdvectPath::Scalar;
+            else if (!std::strcmp(val, "reference")) opt.advect = AdvectPath::Reference;
+            else if (!std::strcmp(val, "fast"))      opt.advect = AdvectPath::Fast;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (!std::strcmp(arg, "--gs")) {
+            if      (!std::strcmp(val, "sweeps"))    opt.wavefront = false;
+            else if (!std::strcmp(val, "wavefront")) opt.wavefront = true;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (!std::strcmp(arg, "--forces")) {
+            if      (!std::strcmp(val, "fused"))    opt.fusedForces = true;
+            else if (!std::strcmp(val, "separate")) opt.fusedForces = false;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (!std::strcmp(arg, "--tiles")) {
+            if      (!std::strcmp(val, "on"))  opt.activeTiles = true;
+            else if (!std::strcmp(val, "off")) opt.activeTiles = false;
+            else { usage(argv[0]); return 1; }
+        }
+        else if (!std::strcmp(arg, "--isa")) {
+            if      (!std::strcmp(val, "sse2"))   forceAdvectIsa(AdvectIsa::SSE2);
+            else if (!std::strcmp(val, "avx2"))   forceAdvectIsa(AdvectIsa::AVX2);
+            else if (!std::strcmp(val, "avx512")) forceAdvectIsa(AdvectIsa::AVX512);
+            else { usage(argv[0]); return 1; }
+        }
+        else { usage(argv[0]); return 1; }
+        ++a;
+    }
+
+    for (auto& name : opt.scenarios) {
+        if (name != "inject" && name != "obstacles" && name != "plume") {
+            std::fprintf(stderr, "Error: unknown scenario '%s'.\n", name.c_str());
+            return 1;
+        }
+    }
+    for (GridSize g : opt.sizes) {
+        if (std::min(g.nx, g.ny) < 8) { std::fprintf(stderr, "Error: grid size %dx%d is too small.\n", g.nx, g.ny); return 1; }
+    }
+
+    std::fprintf(stderr, "advection kernels: %s\n", advectIsaName(advectIsa()));
+    if (opt.advect == AdvectPath::Reference) {
+        for (GridSize g : opt.sizes)
+            if (!referenceMatchesScalar(g)) return 1;
+        std::fprintf(stderr, "reference advection: bit-identical to scalar\n");
+    }
+    std::vector<Result> results;
+    if (!opt.json) printCsvHeader();
+    for (auto& name : opt.scenarios)
+        for (GridSize g : opt.sizes) {
+            results.push_back(run(name, g, opt));
+            if (!opt.json) printCsv(results.back());
+        }
+    if (opt.json) printJson(results);
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Microbenchmark of the field memory layouts in FieldLayout.h.
+//
+// Runs the advection step of FluidSolver (self-advection of u and v, then a density field)
+// on a swirling flow with each layout and prints the time per step. The kernel is the
+// scalar semi-Lagrangian one, written against the layout interface; the per-cell arithmetic
+// is identical for all layouts, so the checksums must match exactly; the bench exits
+// with an error when they do not.
+//
+//   LayoutBench [--sizes 256,512,...] [--steps K]
+#include "FieldLayout.h"
+#include "Timer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::vector<int> sizes{256, 512, 1024, 2048};
+    int steps = 20;
+};
+
+template<class L>
+class LayoutRun {
+public:
+    explicit LayoutRun(int N)
+        : m_N(N), m_vel(L::velSize(N)), m_vel0(L::velSize(N)), m_d(L::size(N)), m_d0(L::size(N))
+    {
+        // A vortex around the centre, fast enough to move a few cells per step, and a
+        // striped density field.
+        float c = 0.5f * (N + 1);
+        for (int j = 0; j <= N + 1; ++j)
+            for (int i = 0; i <= N + 1; ++i) {
+                m_vel[L::uAt(N, i, j)] = -(j - c) / N;
+                m_vel[L::vAt(N, i, j)] =  (i - c) / N;
+                m_d[L::at(N, i, j)]    = std::sin(0.05f * i) * std::cos(0.07f * j);
+            }
+        m_vel0 = m_vel; m_d0 = m_d;
+    }
+
+    void step(float dt0) {
+        m_vel.swap(m_vel0);
+        m_d.swap(m_d0);
+        int N = m_N;
+        const float* w0 = m_vel0.data(); const float* d0 = m_d0.data();
+        float* w = m_vel.data(); float* d = m_d.data();
+        L::forEachCell(N, [&](int i, int j) {
+            float x = i - dt0 * w0[L::uAt(N, i, j)], y = j - dt0 * w0[L::vAt(N, i, j)];
+            if (x < 0.5f) x = 0.5f;
+            if (x > N + 0.5f) x = N + 0.5f;
+            if (y < 0.5f) y = 0.5f;
+            if (y > N + 0.5f) y = N + 0.5f;
+            int i0 = int(x), i1 = i0 + 1, j0 = int(y), j1 = j0 + 1;
+            float s1 = x - i0, s0 = 1 - s1, t1 = y - j0, t0 = 1 - t1;
+            w[L::uAt(N, i, j)] = s0 * (t0 * w0[L::uAt(N, i0, j0)] + t1 * w0[L::uAt(N, i0, j1)]) +
+                                 s1 * (t0 * w0[L::uAt(N, i1, j0)] + t1 * w0[L::uAt(N, i1, j1)]);
+            w[L::vAt(N, i, j)] = s0 * (t0 * w0[L::vAt(N, i0, j0)] + t1 * w0[L::vAt(N, i0, j1)]) +
+                                 s1 * (t0 * w0[L::vAt(N, i1, j0)] + t1 * w0[L::vAt(N, i1, j1)]);
+            d[L::at(N, i, j)]  = s0 * (t0 * d0[L::at(N, i0, j0)] + t1 * d0[L::at(N, i0, j1)]) +
+                                 s1 * (t0 * d0[L::at(N, i1, j0)] + t1 * d0[L::at(N, i1, j1)]);
+        });
+    }
+
+    double checksum() const {
+        double sum = 0;
+        L::forEachCell(m_N, [&](int i, int j) {
+            sum += m_d[L::at(m_N, i, j)] + m_vel[L::uAt(m_N, i, j)] + m_vel[L::vAt(m_N, i, j)];
+        });
+        return sum;
+    }
+
+private:
+    int m_N;
+    Field m_vel, m_vel0, m_d, m_d0;
+};
+
+// Returns the checksum of the final state.
+template<class L>
+double run(int N, const Options& opt) {
+    LayoutRun<L> r(N);
+    float dt0 = 0.1f * N;
+    r.step(dt0); // warm up, touches every page
+    double ms = 0;
+    {
+        ScopedTimer t(&ms);
+        for (int k = 0; k < opt.steps; ++k) r.step(dt0);
+    }
+    double sum = r.checksum();
+    std::printf("%s,%d,%.4f,%.17g\n", L::name(), N, ms / opt.steps, sum);
+    std::fflush(stdout);
+    return sum;
+}
+
+std::vector<int> splitInts(const char* s) {
+    std::vector<int> out;
+    for (const char* p = s; *p; ) {
+        out.push_back(std::atoi(p));
+        while (*p && *p != ',') ++p;
+        if (*p) ++p;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int a = 1; a < argc; ++a) {
+        const char* val = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        if      (val && !std::strcmp(argv[a], "--sizes")) opt.sizes = splitInts(val);
+        else if (val && !std::strcmp(argv[a], "--steps")) opt.steps = std::atoi(val);
+        else { std::fprintf(stderr, "usage: %s [--sizes 256,512,...] [--steps K]\n", argv[0]); return 1; }
+        ++a;
+    }
+
+    std::printf("layout,N,ms_per_step,checksum\n");
+    bool failed = false;
+    for (int N : opt.sizes) {
+        if (N < 8) { std::fprintf(stderr, "Error: grid size %d is too small.\n", N); return 1; }
+        double ref = run<PlanarLayout>(N, opt);
+        double sums[] = { run<InterleavedUVLayout>(N, opt), run<TiledLayout<8>>(N, opt),
+                          run<TiledLayout<16>>(N, opt) };
+        for (double sum : sums)
+            if (sum != ref) {
+                std::fprintf(stderr, "Error: checksums differ at N=%d (%.17g vs %.17g).\n", N, sum, ref);
+                failed = true;
+            }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+// Benchmark of FieldRecorder (FieldRecorder.h) on a buoyant plume.
+//
+// Runs the plume per grid size R times recording every K-th step and R times without, then
+// once more while the last recording is read back in lockstep. The runs reproduce each
+// other exactly, so every decoded value can be checked against the field it came from: the
+// error must stay within half a quantization step. Prints the step time without and with
+// the recorder (from the median of R pairs of runs), the share the recorder took on the
+// stepping thread (copying, and waiting when the queue was full), the encoder's time per
+// frame, the compression ratio against plain floats, the worst error in quantization steps,
+// and whether seeking to the last keyframe reproduced its frame.
+//
+// Encoding runs on the recorder's own thread and the solver's pool; on a machine without a
+// core to spare for it, overhead_pct is about encode_ms over ms_per_step. --budget P makes
+// the bench fail when the time the recorder spent on both threads (caller_pct plus
+// writer_pct, what it costs step() without a spare core) comes out above P. overhead_pct is
+// what the wall clock made of it, and wanders by a few percent either way with the speed
+// of a shared machine.
+//
+//   RecorderBench [--sizes 128,256,...] [--steps K] [--every K] [--bits 8|16] [--keyframes K]
+//                 [--budget P] [--rounds R] [--out PATH]
+#include "FluidGrid.h"
+#include "FluidSolver.h"
+#include "FieldRecorder.h"
+#include "Timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::vector<int> sizes{128, 256, 512};
+    int steps = 60;
+    int every = 1;
+    int bits = 8;
+    int keyframes = 10;
+    float budget = 0.f; // percent of the step time, 0 for none
+    int rounds = 5;
+    std::string out = "RecorderBench.rec";
+};
+
+class Plume {
+public:
+    explicit Plume(int N) : m_N(N), m_grid(N), m_solver(m_grid, nullptr) {
+        m_solver.dt = 0.1f; m_solver.diff = 0.f; m_solver.visc = 0.f; m_solver.vort = 5.f;
+    }
+
+    void step() {
+        int N = m_N, r = std::max(1, N / 32), ci = N / 2, cj = std::max(1, N / 8);
+        m_grid.clearSources();
+        for (int j = cj - r; j <= cj + r; ++j)
+            for (int i = ci - r; i <= ci + r; ++i) {
+                m_grid.tempPrev()[IX(i, j, N)] = 200.f;
+                m_grid.densPrev()[IX(i, j, N)] = 50.f;
+            }
+        m_solver.step();
+    }
+
+    FluidGrid& grid() { return m_grid; }
+    FluidSolver& solver() { return m_solver; }
+
+private:
+    int m_N;
+    FluidGrid m_grid;
+    FluidSolver m_solver;
+};
+
+// Worst |decoded - original| of one field, in its frame's quantization steps; the range of
+// the field is recomputed the way the encoder does it.
+double worstError(const std::vector<float>& decoded, FluidGrid& grid, const float* field, int bits) {
+    int N = grid.nx(), Ny = grid.ny();
+    float lo = 0.f, hi = 0.f;
+    bool any = false;
+    for (int j = 1; j <= Ny; ++j)
+        for (int i = 1; i <= N; ++i) {
+            float x = field[IX(i, j, N)];
+            if (!any) { lo = hi = x; any = true; }
+            lo = std::min(lo, x); hi = std::max(hi, x);
+        }
+    double quantum = (double(hi) - lo) / ((1 << bits) - 1);
+    double worst = 0;
+    for (int j = 1; j <= Ny; ++j)
+        for (int i = 1; i <= N; ++i) {
+            double e = std::fabs(double(decoded[(i - 1) + (j - 1) * N]) - field[IX(i, j, N)]);
+            worst = std::max(worst, quantum > 0 ? e / quantum : e);
+        }
+    return worst;
+}
+
+// Runs the plume with the recorder into opt.out; ms is the time of its steps, record() included.
+bool recordPass(int N, const Options& opt, double& ms, RecorderStats& rs) {
+    Plume p(N);
+    RecorderOptions ro;
+    ro.bits = opt.bits;
+    ro.keyframeInterval = opt.keyframes;
+    ro.pool = &p.solver().threadPool();
+    FieldRecorder rec;
+    if (!rec.open(opt.out, N, ro)) { std::fprintf(stderr, "Error: %s\n", rec.error().c_str()); return false; }
+    for (int k = 1; k <= opt.steps; ++k) {
+        ScopedTimer t(&ms);
+        p.step();
+        if (k % opt.every == 0) rec.record(p.grid(), k);
+    }
+    if (!rec.close()) { std::fprintf(stderr, "Error: %s\n", rec.error().c_str()); return false; }
+    rs = rec.stats();
+    return true;
+}
+
+double plainPass(int N, const Options& opt) {
+    double ms = 0;
+    Plume p(N);
+    for (int k = 1; k <= opt.steps; ++k) {
+        ScopedTimer t(&ms);
+        p.step();
+    }
+    return ms;
+}
+
+// Runs the plume again, reading the recording back in lockstep.
+bool checkPass(int N, const Options& opt, const RecorderStats& rs, double& worst, bool& seek) {
+    FieldRecordingReader reader;
+    if (!reader.open(opt.out)) { std::fprintf(stderr, "Error: %s\n", reader.error().c_str()); return false; }
+    RecordedFrame frame, last;
+    int frames = 0;
+    Plume p(N);
+    for (int k = 1; k <= opt.steps; ++k) {
+        p.step();
+        if (k % opt.every != 0) continue;
+        if (!reader.next(frame)) {
+            std::fprintf(stderr, "Error: frame %d is missing %s\n", frames, reader.error().c_str());
+            return false;
+        }
+        if (frame.step != k) {
+            std::fprintf(stderr, "Error: frame for step %d is missing\n", k);
+            return false;
+        }
+        FluidGrid& g = p.grid();
+        worst = std::max({worst, worstError(frame.dens, g, g.dens(), opt.bits), worstError(frame.temp, g, g.temp(), opt.bits),
+                          worstError(frame.u, g, g.u(), opt.bits), worstError(frame.v, g, g.v(), opt.bits)});
+        if (frame.keyframe) last = frame;
+        ++frames;
+    }
+    if (frames != rs.frames) {
+        std::fprintf(stderr, "Error: read back %d of %d frames\n", frames, rs.frames);
+        return false;
+    }
+    seek = reader.keyframeCount() > 0 && reader.seekKeyframe(reader.keyframeCount() - 1) && reader.next(frame) &&
+           frame.step == last.step && frame.dens == last.dens && frame.v == last.v;
+    return true;
+}
+
+// Each round times a run with the recorder and one without back to back, and the round with
+// the median ratio of the two counts: on a busy machine the speed of the same run swings by
+// more than the budget from one run to the next, and less between neighbouring ones.
+bool run(int N, const Options& opt) {
+    std::vector<std::pair<double, double>> rounds; // (recorded, plain) ms
+    RecorderStats rs;
+    for (int k = 0; k < opt.rounds; ++k) {
+        double ms = 0;
+        if (!recordPass(N, opt, ms, rs)) return false;
+        rounds.emplace_back(ms, plainPass(N, opt));
+    }
+    std::sort(rounds.begin(), rounds.end(), [](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+        return a.first * b.second < b.first * a.second;
+    });
+    double recordedMs = rounds[rounds.size() / 2].first, plainMs = rounds[rounds.size() / 2].second;
+    double worst = 0;
+    bool seek = false;
+    if (!checkPass(N, opt, rs, worst, seek)) return false;
+
+    double plain = plainMs / opt.steps, recorded = recordedMs / opt.steps;
+    double overhead = 100.0 * (recorded - plain) / plain;
+    double caller = 100.0 * (rs.captureMs + rs.waitMs) / opt.steps / plain;
+    double writer = 100.0 * (rs.encodeMs + rs.writeMs) / opt.steps / plain;
+    std::printf("%d,%d,%d,%d,%.3f,%.3f,%.2f,%.2f,%.2f,%.3f,%.2f,%.3f,%d\n", N, opt.bits, opt.every, rs.frames,
+                plain, recorded, overhead, caller, writer, rs.encodeMs / std::max(1, rs.frames),
+                rs.storedBytes ? double(rs.rawBytes) / rs.storedBytes : 0.0, worst, seek ? 1 : 0);
+    std::fflush(stdout);
+    if (opt.budget > 0.f && caller + writer > opt.budget) {
+        std::fprintf(stderr, "Error: the recorder took %.2f%% of the step time at %d, over the %.2f%% budget\n",
+                     caller + writer, N, opt.budget);
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> splitInts(const char* s) {
+    std::vector<int> out;
+    for (const char* p = s; *p; ) {
+        out.push_back(std::atoi(p));
+        while (*p && *p != ',') ++p;
+        if (*p) ++p;
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int a = 1; a < argc; ++a) {
+        const char* val = (a + 1 < argc) ? argv[a + 1] : nullptr;
+        if      (val && !std::strcmp(argv[a], "--sizes"))     opt.sizes = splitInts(val);
+        else if (val && !std::strcmp(argv[a], "--steps"))     opt.steps = std::atoi(val);
+        else if (val && !std::strcmp(argv[a], "--every"))     opt.every = std::max(1, std::atoi(val));
+        else if (val && !std::strcmp(argv[a], "--bits"))      opt.bits = std::atoi(val);
+        else if (val && !std::strcmp(argv[a], "--keyframes")) opt.keyframes = std::max(1, std::atoi(val));
+        else if (val && !std::strcmp(argv[a], "--budget"))    opt.budget = float(std::atof(val));
+        else if (val && !std::strcmp(argv[a], "--rounds"))    opt.rounds = std::max(1, std::atoi(val));
+        else if (val && !std::strcmp(argv[a], "--out"))       opt.out = val;
+        else {
+            std::fprintf(stderr, "usage: %s [--sizes 128,256,...] [--steps K] [--every K] [--bits 8|16] [--keyframes K]\n"
+                                 "          [--budget P] [--rounds R] [--out PATH]\n", argv[0]);
+            return 1;
+        }
+        ++a;
+    }
+
+    std::printf("N,bits,every,frames,ms_per_step,ms_per_step_recording,overhead_pct,caller_pct,writer_pct,encode_ms,ratio,"
+                "max_error_steps,seek\n");
+    for (int N : opt.sizes) {
+        if (N < 8) { std::fprintf(stderr, "Error: grid size %d is too small.\n", N); return 1; }
+        if (!run(N, opt)) return 1;
+    }
+    std::remove(opt.out.c_str());
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Implementation used by FluidSolver::advect.
+enum class AdvectPath {
+    Scalar,    // plain C++ loop (the original kernel)
+    Reference, // SIMD with exactly the scalar operation order: bit-identical to Scalar
+    Fast       // SIMD with fused multiply-adds where the CPU has them
+};
+
+// Instruction sets the SIMD paths are dispatched to at run time.
+enum class AdvectIsa { Scalar, SSE2, AVX2, AVX512 };
+
+// Semi-Lagrangian backtrace and bilinear interpolation for cells i = 1..Nx of rows [j0, j1)
+// of an Nx x Ny grid. The backtrace and weights of a cell are computed once and applied to
+// all count fields: d[f] is interpolated from d0[f]. dt0 is the time step in cell units
+// (dt * FluidGrid::resolution()).
+void advectRows(AdvectPath path, int Nx, int Ny, float dt0, int count, float* const* d, const float* const* d0,
+                const float* u, const float* v, int j0, int j1);
+
+inline void advectRows(AdvectPath path, int Nx, int Ny, float dt0, float* d, const float* d0,
+                       const float* u, const float* v, int j0, int j1) {
+    advectRows(path, Nx, Ny, dt0, 1, &d, &d0, u, v, j0, j1);
+}
+
+// Same for cells i0..i1 of row j only.
+void advectSpan(AdvectPath path, int Nx, int Ny, float dt0, int count, float* const* d, const float* const* d0,
+                const float* u, const float* v, int j, int i0, int i1);
+
+// Best instruction set of this CPU, or the forced one if that is lower.
+AdvectIsa   advectIsa();
+// Caps the dispatch for benchmarks and verification; it never goes above what the CPU has.
+void        forceAdvectIsa(AdvectIsa isa);
+const char* advectIsaName(AdvectIsa isa);
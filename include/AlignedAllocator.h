@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// std::allocator replacement that returns Align-byte aligned blocks (64: one cache line,
+// one AVX-512 vector). C++14 has no aligned operator new, so this goes to the platform.
+template<class T, std::size_t Align = 64>
+struct AlignedAllocator {
+    using value_type = T;
+    template<class U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() = default;
+    template<class U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(std::size_t n) {
+        if (n == 0) return nullptr;
+        std::size_t bytes = (n * sizeof(T) + Align - 1) / Align * Align;
+#if defined(_WIN32)
+        void* p = _aligned_malloc(bytes, Align);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, Align, bytes) != 0) p = nullptr;
+#endif
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, std::size_t) {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+};
+
+template<class T, class U, std::size_t A>
+bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return true; }
+template<class T, class U, std::size_t A>
+bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return false; }
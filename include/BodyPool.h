@@ -0,0 +1,71 @@
+#pragma once
+#include "Vec2.h"
+#include "ContactCache.h"
+#include <vector>
+#include <cstdint>
+
+class MovableRectObstacle;
+class DiskObstacle;
+
+// The movables' state for the collision step, gathered per shape into one array per field,
+// so the narrowphase walks contiguous floats instead of obstacle pointers. Bodies are
+// numbered in the order they were added; each maps to a slot in its shape's pool. The pair
+// tests are picked from a table indexed by the two shape tags.
+class BodyPool {
+public:
+    enum Shape : uint8_t { Rect, Disk, ShapeCount };
+
+    void clear();
+    int addRect(const MovableRectObstacle& rect);
+    int addDisk(const DiskObstacle& disk);
+    // Re-reads a body's state from the obstacle it was added from.
+    void refreshRect(int body, const MovableRectObstacle& rect);
+    void refreshDisk(int body, const DiskObstacle& disk);
+
+    int size() const { return static_cast<int>(m_refs.size()); }
+    Shape shape(int body) const { return m_refs[body].shape; }
+    Vec2 position(int body) const;
+    void velocity(int body, float& vx, float& vy) const;
+    // Axis-aligned bounds at the current pose
+    void bounds(int body, Vec2& lo, Vec2& hi) const;
+
+    // Narrowphase: on overlap, mtv is the push from a towards b.
+    bool collide(int a, int b, Vec2& mtv) const;
+    // Pushes a and b apart along mtv and applies the normal impulse, accumulated in c and
+    // kept >= 0 over the step. On the pair's first touch of the step (fresh), c holds what
+    // the pair ended the last step with (or nothing): its impulse is applied up front as far
+    // as its normal still matches, and the velocity the pair aims for is set from the
+    // approach speed and from the depth, to be closed over the next dt.
+    void resolve(int a, int b, const Vec2& mtv, ContactCache::Contact& c, bool fresh, float dt);
+
+    // Fields shared by every shape; positions are the obstacles' own (the disk's centre,
+    // the rect's corner).
+    struct Kinematics {
+        std::vector<float> x, y, vx, vy, invMass;
+        void clear();
+        int add(const Vec2& pos, float vx, float vy, float invMass);
+    };
+    // The angle does not change during a collision step, so the rotated corners and the
+    // trig are computed once, when a rect is added or refreshed; its world vertices are then
+    // corner offsets plus its current centre.
+    struct Rects : Kinematics {
+        std::vector<float> hw, hh, angle; // half extents, degrees
+        std::vector<Vec2>  corners;       // 4 per rect, rotated, relative to the centre
+        std::vector<float> sinA, cosA;    // of the angle
+        std::vector<float> sinNeg, cosNeg; // of minus the angle (the point-in-rect test)
+    };
+    struct Disks : Kinematics {
+        std::vector<float> radius;
+    };
+    const Rects& rects() const { return m_rects; }
+    const Disks& disks() const { return m_disks; }
+
+private:
+    struct Ref { Shape shape; int slot; };
+    Kinematics& kinematics(Shape s) { return s == Rect ? static_cast<Kinematics&>(m_rects) : m_disks; }
+    const Kinematics& kinematics(Shape s) const { return s == Rect ? static_cast<const Kinematics&>(m_rects) : m_disks; }
+
+    std::vector<Ref> m_refs;
+    Rects m_rects;
+    Disks m_disks;
+};
@@ -1,5 +1,10 @@
 #pragma once
 class BoundarySolver {
 public:
-    static void setBounds(int N,int b,float* x);
+    // Ghost cells of an Nx x Ny field: b = 1 mirrors u with a sign flip at the side walls,
+    // b = 2 mirrors v at the bottom and top, b = 0 copies the edge cells (no flux).
+    static void setBounds(int Nx,int Ny,int b,float* x);
+    // The part of setBounds that depends on row j (its side ghosts, and the bottom/top ghost
+    // row for j==1/j==Ny). Corners are left alone.
+    static void setRowBounds(int Nx,int Ny,int b,int j,float* x);
 };
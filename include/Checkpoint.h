@@ -0,0 +1,205 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AlignedAllocator.h"
+
+class FluidGrid;
+class FluidSolver;
+class ObstacleManager;
+
+// ===== file layout ==========================================================
+// A checkpoint is one file holding everything a run needs to carry on: the grid arrays, the
+// solver and collision parameters, and the pose and velocity of every obstacle. Its layout is
+// the in-memory one, so a mapped file is used in place: the header, then the array table,
+// the obstacle records and the arrays. Every array starts on a CheckpointAlignment boundary
+// and has FluidGrid's layout (IX(i,j,Nx) with the stride recorded in the header), so a field
+// of a mapped checkpoint is read like the grid's own. Numbers are stored in the writer's byte
+// order; a reader with another one rejects the file.
+//
+// A new field goes at the end of a record and the version goes up; records carry their size
+// so readers can step over fields they do not know.
+
+static const uint32_t CheckpointVersion   = 1;
+static const uint32_t CheckpointAlignment = 64;   // bytes, for every array and record table
+static const uint32_t CheckpointByteOrder = 0x01020304;
+
+// FluidSolver's and ObstacleManager's run-time parameters.
+struct CheckpointParams {
+    float   dt, diff, visc, vort, force, source;
+    float   buoyancy_factor, temp_diffusivity;
+    float   pressure_tolerance, tile_threshold;
+    int32_t pressure_solver, pressure_max_iterations, advect_path;
+    uint8_t buoyancy_on, gs_wavefront, fused_forces, active_tiles;
+    uint8_t pressure_warm; // FluidSolver::pressureWarm
+    uint8_t pad[3];
+    // ObstacleManager, if the run had one
+    uint8_t hasObstacles, broadphase, sleeping, pad2;
+    float   sleepDelay;
+    int32_t collisionIterations;
+};
+
+struct CheckpointHeader {
+    char     magic[8];     // "FLUIDCKP"
+    uint32_t version;      // CheckpointVersion of the writer
+    uint32_t byteOrder;    // CheckpointByteOrder as the writer stores it
+    uint32_t headerBytes;  // sizeof(CheckpointHeader) of the writer
+    uint32_t arrayBytes;   // sizeof(CheckpointArray) of the writer
+    uint32_t bodyBytes;    // sizeof(CheckpointBody) of the writer
+    int32_t  N;            // grid width (Nx)
+    int32_t  Ny;           // grid height
+    int32_t  stride;       // FLUID_STRIDE(N) of the writer
+    uint32_t arrayCount;
+    uint32_t bodyCount;
+    uint32_t scalarCount;
+    int64_t  step;         // steps the run had taken
+    uint64_t fileBytes;
+    uint64_t arraysOffset; // CheckpointArray[arrayCount]
+    uint64_t bodiesOffset; // CheckpointBody[bodyCount]
+    CheckpointParams params;
+};
+
+// One array of the grid. Fields have fieldSize(Nx, Ny) floats; the scalar tile flags have one
+// byte per tile of FluidGrid::scalarTiles().
+struct CheckpointArray {
+    enum Kind : uint32_t { U, V, UPrev, VPrev, Vorticity, Pressure, Scalar, ScalarSource, ScalarTiles };
+    uint32_t kind;
+    int32_t  scalar;       // for Scalar and ScalarSource: its index in the grid, else -1
+    float    diffusivity;  // for Scalar: FluidGrid::scalarDiffusivity
+    uint32_t pad;
+    uint64_t offset;       // from the start of the file, a multiple of CheckpointAlignment
+    uint64_t bytes;
+    char     name[32];     // the scalar's name, or the array's, zero-terminated
+};
+
+// One obstacle, in the manager's order. Custom obstacles are not saved.
+struct CheckpointBody {
+    uint32_t type;         // ObstacleType
+    uint8_t  asleep, pad[3];
+    float    x, y;         // a rect's corner, a disk's centre
+    float    w, h;         // a disk's radius is w
+    float    angle;        // degrees
+    float    vx, vy, angularVelocity, restTime;
+};
+
+// ===== writing ==============================================================
+
+// The checkpoint file of one moment of a run, built in memory: capture() copies the state
+// in, write() puts the bytes on disk. Capturing again at the same sizes reuses the buffer.
+class CheckpointImage {
+public:
+    // FluidSolver::step() must not be running; obstacles may be null.
+    void capture(FluidGrid& grid, const FluidSolver& solver, const ObstacleManager* obstacles, long long step);
+    // Writes to path + ".tmp" and renames it over path, so an interrupted write leaves the
+    // previous checkpoint intact. On failure returns false and sets error.
+    bool write(const std::string& path, std::string& error) const;
+
+    const char* data() const { return m_bytes.data(); }
+    size_t      size() const { return m_bytes.size(); }
+
+private:
+    std::vector<char, AlignedAllocator<char>> m_bytes;
+    // capture()'s tables, kept so that checkpoints of a steady run do not allocate
+    std::vector<CheckpointArray> m_arrays;
+    std::vector<const float*> m_sources; // null for the tile flags
+    std::vector<CheckpointBody> m_bodies;
+};
+
+// What a CheckpointWriter has done so far. skipped counts save() calls that found the
+// writer still busy with two checkpoints and dropped theirs.
+struct CheckpointStats {
+    int written = 0, skipped = 0, failed = 0;
+    double captureMs = 0; // on the caller's thread, summed
+    double writeMs = 0;   // on the writer thread, summed
+    uint64_t bytes = 0;   // of the last checkpoint written
+};
+
+// Writes checkpoints on a thread of its own, so the step loop only pays for copying the
+// state: save() captures into one of two images and returns, and the writer thread puts it
+// on disk while the simulation carries on. save() is called from one thread at a time.
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter(); // finishes the checkpoint in flight
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // False (and nothing captured) while a checkpoint is being written and another waits.
+    bool save(FluidGrid& grid, const FluidSolver& solver, const ObstacleManager* obstacles, long long step,
+              const std::string& path);
+    // Returns once every saved checkpoint is on disk.
+    void wait();
+
+    CheckpointStats stats() const;
+    std::string     lastError() const;
+
+private:
+    void run();
+
+    CheckpointImage m_images[2];
+    std::string m_paths[2];
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    int  m_queued = -1;  // image waiting for the thread
+    int  m_writing = -1; // image the thread is writing
+    bool m_quit = false;
+    CheckpointStats m_stats;
+    std::string m_error;
+    std::thread m_thread;
+};
+
+// ===== reading ==============================================================
+
+// A checkpoint file mapped read-only. open() checks the header and that every table and
+// array lies inside the file; after that the arrays are read in place, without copying or
+// parsing anything. restore() loads the state back into a live simulation.
+class CheckpointFile {
+public:
+    CheckpointFile() = default;
+    ~CheckpointFile() { close(); }
+
+    CheckpointFile(const CheckpointFile&) = delete;
+    CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+    // On failure returns false and error() says why.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const              { return m_data != nullptr; }
+    const std::string& error() const { return m_error; }
+
+    const CheckpointHeader& header() const { return *reinterpret_cast<const CheckpointHeader*>(m_data); }
+    const CheckpointParams& params() const { return header().params; }
+    int  nx() const                        { return header().N; }
+    int  ny() const                        { return header().Ny; }
+    int  arrayCount() const                { return int(header().arrayCount); }
+    const CheckpointArray& array(int k) const {
+        return *reinterpret_cast<const CheckpointArray*>(m_data + header().arraysOffset + size_t(k) * header().arrayBytes);
+    }
+    int  bodyCount() const                 { return int(header().bodyCount); }
+    const CheckpointBody& body(int k) const {
+        return *reinterpret_cast<const CheckpointBody*>(m_data + header().bodiesOffset + size_t(k) * header().bodyBytes);
+    }
+    // The contents of an array, in the mapping.
+    const void* data(const CheckpointArray& a) const { return m_data + a.offset; }
+    // The field of the given kind (and scalar index), or null if the file has none.
+    const float* field(CheckpointArray::Kind kind, int scalar = -1) const;
+
+    // Replaces the grid's state, the solver's parameters and the manager's obstacles (if
+    // obstacles is not null) with the checkpoint's. The grid must have the checkpoint's size
+    // and row stride; scalars it lacks are added. On failure returns false, sets error() and
+    // leaves everything as it was.
+    bool restore(FluidGrid& grid, FluidSolver& solver, ObstacleManager* obstacles);
+
+private:
+    bool fail(const std::string& why);
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    std::vector<char, AlignedAllocator<char>> m_copy; // the file's bytes where mmap is missing
+    std::string m_error;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+// Instruction sets colormapDensity is dispatched to at run time. Every path gives the same
+// bytes as Scalar.
+enum class ColormapIsa { Scalar, SSE2, AVX2 };
+
+// The density view's colours as RGBA8 texels: red = dens + temp/2, green = dens and
+// blue = dens - temp/2, each clamped to [0,1] and rounded to 0..255, alpha 255. Texel (i,j)
+// is grid node (i,j) for i = 0..N and j = 0..Ny of an N x Ny grid, so a texture holds
+// (N+1) x (Ny+1) texels and row j starts at rgba + 4*(N+1)*j. Writes rows [j0, j1).
+// Headless: it needs no GL.
+void colormapDensity(int N, const float* dens, const float* temp, uint8_t* rgba, int j0, int j1);
+
+inline void colormapDensity(int Nx, int Ny, const float* dens, const float* temp, uint8_t* rgba) {
+    colormapDensity(Nx, dens, temp, rgba, 0, Ny + 1);
+}
+inline void colormapDensity(int N, const float* dens, const float* temp, uint8_t* rgba) {
+    colormapDensity(N, N, dens, temp, rgba);
+}
+
+// Best instruction set of this CPU, or the forced one if that is lower.
+ColormapIsa colormapIsa();
+// Caps the dispatch for benchmarks and verification; it never goes above what the CPU has.
+void        forceColormapIsa(ColormapIsa isa);
+const char* colormapIsaName(ColormapIsa isa);
@@ -0,0 +1,37 @@
+#pragma once
+#include "PoissonSolver.h"
+#include "Util.h"
+#include <vector>
+
+// Matrix-free conjugate gradient with a modified incomplete Cholesky (MIC(0)) preconditioner.
+// Iterates until the relative residual drops below the tolerance, not for a fixed count, and
+// stops early, keeping its best iterate, if the residual stops being finite or grows tenfold.
+// With a pool, the rows of every pass are split over it and the preconditioner runs as a
+// pipeline of column strips; the iterates do not depend on the number of threads.
+class ConjugateGradientSolver : public PoissonSolver {
+public:
+    explicit ConjugateGradientSolver(int N) : ConjugateGradientSolver(N, N) {}
+    ConjugateGradientSolver(int Nx, int Ny);
+
+    int nx() const override { return m_Nx; }
+    int ny() const override { return m_Ny; }
+    PressureStats solve(float* p, float* div, float tol, int maxIterations) override;
+
+    float tau   = 0.97f; // MIC blend: 0 = incomplete Cholesky, 1 = fully modified
+    float sigma = 0.25f; // safety bound against tiny pivots
+
+private:
+    void buildPreconditioner();
+    double applyA(const float* x, float* out); // out = A x; returns x.out
+    void   applyPreconditioner(const float* r, float* z);
+    double dot(const float* a, const float* b);
+    double sumRows() const;                      // of m_rowSum[1..Ny], in row order
+
+    int m_Nx, m_Ny;
+    float m_builtTau = -1.f, m_builtSigma = -1.f; // parameters m_precon was built with
+    bool  m_builtSolid = false;                   // ... and whether there were solids
+    Field m_precon, m_r, m_z, m_s, m_q;
+    Field m_best;                                 // last saved iterate, see solve()
+    std::vector<uint8_t> m_nearRow;               // row j-1, j or j+1 holds a solid cell
+    std::vector<double>  m_rowSum;                // per-row partials of the last dot product
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include "Vec2.h"
+#include <vector>
+#include <cstdint>
+
+// Touching body pairs of this collision step and the last one, in two open-addressing tables
+// swapped by beginStep(). A pair's accumulated normal impulse carries over to the step after,
+// so a contact that persists (a resting stack) starts from the impulse that held it last
+// time instead of from zero. The tables only grow, so a steady scene does not allocate.
+// previous() only reads, so the islands of a step can look up their pairs concurrently and
+// add() their contacts afterwards; a serial step can also add() as it goes and find them
+// again with current().
+class ContactCache {
+public:
+    struct Contact {
+        Vec2 normal;         // unit, from a to b
+        float impulse = 0.f; // accumulated along normal, >= 0
+        float bias = 0.f;    // normal velocity the pair aims for: its bounce, or closing its depth
+    };
+
+    // This step's contacts become last step's; this step starts empty.
+    void beginStep();
+    // Last step's and this step's contact for bodies a < b, or null.
+    const Contact* previous(int a, int b) const;
+    Contact* current(int a, int b);
+    // Records this step's contact for a < b (once per pair). The reference lasts until the
+    // next add().
+    Contact& add(int a, int b, const Contact& c);
+    void clear();
+    // Room for count contacts per step in both tables.
+    void reserve(int count);
+
+    // Calls f(a, b, contact) for each of this step's contacts.
+    template<class F>
+    void forEachCurrent(F f) const {
+        for (const Entry& e : m_cur.slots)
+            if (e.key != 0) f(int(e.key >> 32) - 1, int(e.key & 0xffffffffu) - 1, e.c);
+    }
+
+    int size() const { return m_cur.size; }
+    int previousSize() const { return m_prev.size; }
+
+private:
+    struct Entry { uint64_t key; Contact c; };
+    struct Table {
+        std::vector<Entry> slots; // key 0 = empty; size is a power of two
+        int size = 0;
+        const Entry* find(uint64_t key) const;
+        Entry& insert(uint64_t key); // key must be absent
+        void grow();
+        void reserve(int count);
+        void reset();
+    };
+    static uint64_t key(int a, int b) { return (uint64_t(uint32_t(a) + 1) << 32) | (uint32_t(b) + 1); }
+
+    Table m_cur, m_prev;
+};
@@ -7,9 +7,8 @@ public:
     ~DiskObstacle() override = default;
 
     // --- Obstacle Interface ---
-    void apply(FluidGrid& grid) const override;
-    void draw() const override;
-    void updateFromFluid(FluidGrid& grid, float dt) override;
+    ObstacleType type() const override { return ObstacleType::Disk; }
+    void accept(ObstacleVisitor& visitor) const override;
 
     // --- MovableObstacle Interface ---
     bool contains(int x, int y) const override;
@@ -18,6 +17,10 @@ public:
     float getRadius() const;
     Vec2 getCenter() const;
 
+protected:
+    // Cells whose centre lies strictly inside the disk
+    void computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const override;
+
 private:
     int m_radius;
     int m_w, m_h;
@@ -0,0 +1,60 @@
+#pragma once
+#include "Util.h"
+#include <algorithm>
+
+// Ways to map cell (i,j), i,j in 0..N+1, of an N x N grid to memory. FluidGrid and all the
+// solver kernels use PlanarLayout. The other two are alternatives that bench/LayoutBench.cpp
+// times against it on the advection access pattern, so the choice can be checked per
+// machine before any kernel is rewritten for it.
+//
+// Each layout gives the size of a scalar field and of a velocity buffer, and where (i,j)
+// lives in them. forEachCell visits the interior in the layout's natural memory order.
+
+// One array per field, row-major with the padded stride (IX).
+struct PlanarLayout {
+    static const char* name() { return "planar"; }
+    static std::size_t size(int N)                { return fieldSize(N); }
+    static std::size_t at(int N, int i, int j)    { return IX(i, j, N); }
+    static std::size_t velSize(int N)             { return 2 * size(N); }
+    static std::size_t uAt(int N, int i, int j)   { return at(N, i, j); }
+    static std::size_t vAt(int N, int i, int j)   { return size(N) + at(N, i, j); }
+
+    template<class F> static void forEachCell(int N, F f) {
+        for (int j = 1; j <= N; ++j) for (int i = 1; i <= N; ++i) f(i, j);
+    }
+};
+
+// Scalars planar, velocity as (u,v) pairs: one cache line serves both components.
+struct InterleavedUVLayout {
+    static const char* name() { return "interleaved-uv"; }
+    static std::size_t size(int N)                { return fieldSize(N); }
+    static std::size_t at(int N, int i, int j)    { return IX(i, j, N); }
+    static std::size_t velSize(int N)             { return 2 * size(N); }
+    static std::size_t uAt(int N, int i, int j)   { return 2 * at(N, i, j); }
+    static std::size_t vAt(int N, int i, int j)   { return 2 * at(N, i, j) + 1; }
+
+    template<class F> static void forEachCell(int N, F f) { PlanarLayout::forEachCell(N, f); }
+};
+
+// Block-linear: T x T tiles stored contiguously, tiles row-major. The four taps of a bilinear
+// gather come from at most four tiles, however large N is.
+template<int T>
+struct TiledLayout {
+    static const char* name() { return T == 8 ? "tiled-8" : T == 16 ? "tiled-16" : "tiled"; }
+    static int         tiles(int N)               { return (N + 2 + T - 1) / T; }
+    static std::size_t size(int N)                { return std::size_t(tiles(N)) * tiles(N) * T * T; }
+    static std::size_t at(int N, int i, int j) {
+        return (std::size_t(j / T) * tiles(N) + i / T) * (T * T) + (j % T) * T + i % T;
+    }
+    static std::size_t velSize(int N)             { return 2 * size(N); }
+    static std::size_t uAt(int N, int i, int j)   { return at(N, i, j); }
+    static std::size_t vAt(int N, int i, int j)   { return size(N) + at(N, i, j); }
+
+    template<class F> static void forEachCell(int N, F f) {
+        for (int tj = 0; tj < tiles(N); ++tj)
+            for (int ti = 0; ti < tiles(N); ++ti)
+                for (int j = std::max(1, tj * T); j < std::min(N + 1, (tj + 1) * T); ++j)
+                    for (int i = std::max(1, ti * T); i < std::min(N + 1, (ti + 1) * T); ++i)
+                        f(i, j);
+    }
+};
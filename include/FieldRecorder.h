@@ -0,0 +1,225 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FluidGrid;
+class ThreadPool;
+
+// ===== file layout ==========================================================
+// A recording is a time series of the interior cells of dens, temp, u and v. The header is
+// followed by one frame per record() call and, once the recording is closed, an index of
+// its keyframes and a trailer pointing at it. A recording that was cut short has no index;
+// the reader then finds the keyframes by walking the frame headers.
+//
+// Each field of a frame is quantized to 8 or 16 bits over its own range in that frame and
+// stored as residuals against a prediction: the quantized cell to its left in a keyframe,
+// the previous frame's decoded value (quantized with this frame's range) otherwise. Residuals
+// are zigzag coded and bit-packed in blocks of 16, each block a byte w (the bits its largest
+// residual needs) and w bit planes of 2 bytes, bit k of plane b being bit b of residual k;
+// the last block of a field is padded with zeros. Decoding the previous frame is needed to
+// decode a delta frame, so reading starts at a keyframe.
+
+static const uint32_t RecordingVersion = 1;
+
+enum RecordField : uint32_t {
+    RecordDensity = 1, RecordTemperature = 2, RecordU = 4, RecordV = 8,
+    RecordAll = 15
+};
+
+struct RecordingHeader {
+    char     magic[8];         // "FLUIDREC"
+    uint32_t version;
+    uint32_t headerBytes;      // sizeof(RecordingHeader) of the writer
+    int32_t  N;                // grid width (Nx)
+    int32_t  Ny;               // grid height
+    uint32_t fields;           // RecordField bits; frames hold them in bit order
+    uint32_t bits;             // 8 or 16
+    uint32_t keyframeInterval; // frames
+};
+
+struct RecordingFrameHeader {
+    enum Flags : uint32_t { Keyframe = 1 };
+    uint32_t magic;        // FrameMagic
+    uint32_t flags;
+    int64_t  step;         // the simulation step it was recorded at
+    uint32_t index;        // frames before it in the recording
+    uint32_t payloadBytes; // the fields' blocks, one field after the other
+    // Per field slot (RecordField bit order): the bytes of its blocks, and
+    // value = lo + q*quantum, q = (value-lo)*scale
+    uint32_t fieldBytes[4];
+    float lo[4], quantum[4], scale[4];
+
+    static const uint32_t FrameMagic = 0x4d415246; // "FRAM"
+};
+
+struct RecordingIndexEntry {
+    uint64_t offset;       // of the keyframe's header
+    int64_t  step;
+    uint32_t frame;
+    uint32_t pad;
+};
+
+struct RecordingTrailer {
+    uint64_t indexOffset;  // RecordingIndexEntry[count]
+    uint32_t count;
+    uint32_t magic;        // IndexMagic
+
+    static const uint32_t IndexMagic = 0x5844494b; // "KIDX"
+};
+
+// ===== recording ============================================================
+
+struct RecorderOptions {
+    int      bits = 8;              // 8 or 16 per value
+    int      keyframeInterval = 30; // frames between keyframes
+    uint32_t fields = RecordAll;
+    int      queueFrames = 4;       // frames copied but not yet written, at most
+    bool     dropWhenFull = false;  // drop a frame instead of waiting for a free slot
+    // Encodes the fields of a frame in parallel on it, e.g. FluidSolver::threadPool(); it
+    // must outlive close(). Null: the writer thread encodes them one after the other.
+    ThreadPool* pool = nullptr;
+};
+
+// What a FieldRecorder has done so far. rawBytes is what the frames would take as plain
+// floats; the times are summed over frames.
+struct RecorderStats {
+    int frames = 0, keyframes = 0, dropped = 0;
+    uint64_t rawBytes = 0, storedBytes = 0;
+    double captureMs = 0; // copying the fields and finding their ranges, on the caller's thread
+    double waitMs = 0;    // waiting for a free slot, on the caller's thread
+    double encodeMs = 0;  // quantizing, delta coding and packing, on the writer thread
+    double writeMs = 0;   // on the writer thread
+};
+
+// Records every frame handed to record() on a thread of its own: record() copies the
+// interior of the fields into a free slot of a bounded queue and returns; the writer thread
+// encodes and writes the slots in order. With the queue full, record() waits for the writer
+// (or, with dropWhenFull, drops the frame). Called from one thread at a time.
+//
+// The stepping thread only pays for the copy. Encoding is one pass over each field that
+// quantizes, predicts and packs a row at a time, so where the writer has no core to itself
+// a recorded step costs a few percent more than a plain one, besides the file writes.
+class FieldRecorder {
+public:
+    FieldRecorder() = default;
+    ~FieldRecorder() { close(); }
+
+    FieldRecorder(const FieldRecorder&) = delete;
+    FieldRecorder& operator=(const FieldRecorder&) = delete;
+
+    // Creates path for an Nx x Ny grid. On failure returns false and error() says why.
+    bool open(const std::string& path, int Nx, int Ny, const RecorderOptions& options = RecorderOptions());
+    bool open(const std::string& path, int N, const RecorderOptions& options = RecorderOptions()) {
+        return open(path, N, N, options);
+    }
+    // Queues the grid's fields as the next frame; false if it was dropped or not recording.
+    bool record(FluidGrid& grid, long long step);
+    // Writes what is queued and the keyframe index, and closes the file. False if anything
+    // failed to write since open().
+    bool close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    RecorderStats stats() const;
+    std::string   error() const;
+
+private:
+    struct Slot {
+        long long step = 0;
+        std::vector<float> values; // the recorded fields' interiors, one after the other
+        float lo[4], hi[4];        // their ranges
+    };
+
+    // Per recorded field, on the writer thread or the pool
+    struct FieldCoder {
+        // The last frame as the reader decodes it: value = prevLo + q*prevStep; 8-bit
+        // values are stored as bytes, as are the residuals
+        std::vector<uint16_t> prevQ;
+        float prevLo = 0.f, prevStep = 0.f;
+        std::vector<uint16_t> row;   // residuals not packed yet: part of a block, then a row
+        std::vector<uint8_t> blocks; // this frame's
+    };
+
+    void run();
+    void encode(const Slot& slot, bool keyframe, RecordingFrameHeader& h);
+    void encodeField(const Slot& slot, bool keyframe, int f, RecordingFrameHeader& h);
+
+    RecorderOptions m_opt;
+    int m_Nx = 0, m_Ny = 0, m_fieldCount = 0;
+    std::FILE* m_file = nullptr;
+
+    // Queue: slots cycle free -> filled (record) -> written (run) -> free
+    std::vector<Slot> m_slots;
+    std::vector<int> m_free, m_filled; // m_filled in recording order
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake, m_freed;
+    bool m_quit = false;
+    std::thread m_thread;
+    RecorderStats m_stats;
+    std::string m_error;
+
+    // Writer thread only
+    std::vector<FieldCoder> m_coders;
+    std::vector<RecordingIndexEntry> m_index;
+    uint64_t m_offset = 0;
+    uint32_t m_frames = 0;
+};
+
+// ===== reading ==============================================================
+
+// One decoded frame. A field is Nx*Ny values, cell (i,j) at (i-1) + (j-1)*Nx, and empty if
+// the recording does not have it.
+struct RecordedFrame {
+    long long step = 0;
+    int  index = 0;
+    bool keyframe = false;
+    std::vector<float> dens, temp, u, v;
+};
+
+// Streams the frames of a recording in order, from the start or from a keyframe.
+class FieldRecordingReader {
+public:
+    FieldRecordingReader() = default;
+    ~FieldRecordingReader() { close(); }
+
+    FieldRecordingReader(const FieldRecordingReader&) = delete;
+    FieldRecordingReader& operator=(const FieldRecordingReader&) = delete;
+
+    // On failure returns false and error() says why.
+    bool open(const std::string& path);
+    void close();
+    const std::string& error() const { return m_error; }
+
+    int      nx() const      { return m_header.N; }
+    int      ny() const      { return m_header.Ny; }
+    uint32_t fields() const  { return m_header.fields; }
+    int      bits() const    { return int(m_header.bits); }
+
+    int       keyframeCount() const    { return int(m_index.size()); }
+    long long keyframeStep(int k) const { return m_index[k].step; }
+    // The next frame read is keyframe k.
+    bool seekKeyframe(int k);
+    // Decodes the next frame; false at the end of the recording, or on a damaged frame
+    // (error() is then set).
+    bool next(RecordedFrame& frame);
+
+private:
+    bool fail(const std::string& why);
+    bool readIndex();
+    void scanIndex();
+
+    std::FILE* m_file = nullptr;
+    RecordingHeader m_header = RecordingHeader();
+    int m_fieldCount = 0;
+    uint64_t m_end = 0; // where the frames end
+    std::vector<RecordingIndexEntry> m_index;
+    bool m_havePrevious = false;
+    std::vector<float> m_recon;
+    std::vector<uint8_t> m_payload;
+    std::vector<uint16_t> m_residuals; // of one field
+    std::string m_error;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+class FluidGrid;
+struct FieldSnapshot;
+
+// OpenGL drawing of the grid fields over the unit square; an Nx x Ny grid has cells of
+// 1/max(Nx,Ny) and covers [0,Nx/max] x [0,Ny/max] of it. The static functions draw in
+// immediate mode, from the grid itself or from a snapshot of it. An instance draws a
+// snapshot the cheap way: the density view is coloured on the CPU (see Colormap.h) into a
+// texture that is updated with one glTexSubImage2D per frame and drawn as a single quad,
+// and the velocity view draws one glyph every glyphStride cells. An instance must be used
+// and destroyed while its GL context is current.
+class FieldRenderer {
+public:
+    static void drawDensity(FluidGrid& grid);
+    static void drawVelocity(FluidGrid& grid);
+    static void drawDensity(const FieldSnapshot& snapshot);
+    static void drawVelocity(const FieldSnapshot& snapshot);
+
+    FieldRenderer() = default;
+    ~FieldRenderer();
+    FieldRenderer(const FieldRenderer&) = delete;
+    FieldRenderer& operator=(const FieldRenderer&) = delete;
+
+    void drawDensityTexture(const FieldSnapshot& snapshot);
+    void drawVelocityGlyphs(const FieldSnapshot& snapshot);
+
+    int glyphStride = 4; // cells between velocity glyphs in each direction; 1 draws them all
+
+private:
+    static void drawDensity(int Nx, int Ny, const float* dens, const float* temp);
+    static void drawVelocity(int Nx, int Ny, const float* u, const float* v);
+
+    unsigned int m_texture = 0; // GL texture name, 0 until the first draw
+    int m_textureW = 0, m_textureH = 0; // texels the texture was allocated with
+    std::vector<uint8_t> m_pixels;
+};
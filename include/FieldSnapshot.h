@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include "Util.h"
+#include "Vec2.h"
+#include "Obstacle.h"
+
+class FluidGrid;
+class ObstacleManager;
+
+// What the renderer draws, copied out of the simulation after a step: the density,
+// temperature and velocity fields (with FluidGrid's layout, so IX(i,j,Nx) applies) and the
+// outlines of the obstacles. Handed from the simulation thread to the renderer through a
+// TripleBuffer; capture() reuses the arrays of a slot as long as the size stays the same.
+struct FieldSnapshot {
+    struct Shape {
+        ObstacleType type = ObstacleType::Custom;
+        Vec2  pos;           // in cells: a fixed rect's corner, the centre of the others
+        float w = 0.f, h = 0.f; // a disk's radius is w
+        float angle = 0.f;   // degrees
+        bool  selected = false;
+    };
+
+    int Nx = 0, Ny = 0;      // 0 until the first capture
+    long long step = 0;      // steps the simulation had taken
+    Field dens, temp, u, v;
+    std::vector<Shape> shapes;
+
+    void capture(FluidGrid& grid, const ObstacleManager* obstacles, long long step);
+};
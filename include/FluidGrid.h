@@ -1,32 +1,113 @@
 #pragma once
 #include <vector>
+#include <string>
 #include <cstddef>
+#include <cstdint>
 #include "Util.h"
+#include "TileMap.h"
 
 class FluidGrid {
 public:
-    explicit FluidGrid(int N);
+    // Passive scalars are registered in order; density and temperature always come first.
+    static const int Density = 0, Temperature = 1;
 
-    int    size() const           { return m_N; }
+    // An Nx x Ny grid of square cells; the longer side spans unit length (see resolution()).
+    explicit FluidGrid(int N) : FluidGrid(N, N) {}
+    FluidGrid(int Nx, int Ny);
+
+    int    nx() const             { return m_Nx; } // cells per row
+    int    ny() const             { return m_Ny; } // rows
+    // Cells per unit length, 1/h: the larger of nx() and ny(). Time steps, diffusion and
+    // pressure are scaled by it, so a square grid behaves as it always has and a 4:1 grid
+    // is the middle quarter of one, with the same cell size.
+    float  resolution() const     { return float(m_Nx > m_Ny ? m_Nx : m_Ny); }
+    // Carries the state over to an Nx x Ny grid of the same domain: velocity, pressure and
+    // every scalar are resampled conservatively (Resample.h), so mass and momentum stay
+    // what they were. Sources, vorticity and the solid mask start empty (boundaries
+    // rasterize again at the next step), and all scalar tiles are active. Arrays keep their
+    // capacity, so shrinking does not allocate and growing back to an earlier size neither.
+    // A different aspect ratio stretches the fields with the domain.
+    void   resize(int Nx, int Ny);
+    void   resize(int N)          { resize(N, N); }
     float* u()                    { return m_u.data(); }
     float* v()                    { return m_v.data(); }
-    float* dens()                 { return m_dens.data(); }
+    float* dens()                 { return scalar(Density); }
     float* vort()                 { return m_vort.data(); }
-    float* temp()                 { return m_temp.data(); } // New
+    float* temp()                 { return scalar(Temperature); } // New
+    float* pressure()             { return m_pressure.data(); } // kept between steps for warm starts
     void   reset();
 
+    // Sources for the next step, added by FluidSolver::step() scaled by dt. step() also uses
+    // these arrays as scratch, so they have to be cleared (or rewritten) before every step.
+    float* uPrev()                { return m_uPrev.data(); }
+    float* vPrev()                { return m_vPrev.data(); }
+    float* densPrev()             { return scalarSource(Density); }
+    float* tempPrev()             { return scalarSource(Temperature); }
+    void   clearSources();
+
+    // Passive scalar registry: every scalar is carried by the flow, diffused with its own
+    // diffusivity and advected together with the others. Adding a scalar invalidates
+    // pointers previously returned for scalars or their sources.
+    int         addScalar(const std::string& name, float diffusivity = 0.f);
+    int         scalarCount() const            { return static_cast<int>(m_scalars.size()); }
+    float*      scalar(int k)                  { return m_scalars[k].value.data(); }
+    float*      scalarSource(int k)            { return m_scalars[k].source.data(); }
+    const std::string& scalarName(int k) const { return m_scalars[k].name; }
+    float       scalarDiffusivity(int k) const { return m_scalars[k].diffusivity; }
+    void        setScalarDiffusivity(int k, float d) { m_scalars[k].diffusivity = d; }
+
+    // Tiles that may hold scalar content: outside them every scalar is exactly zero (see
+    // FluidSolver::active_tiles). Code that writes scalar() directly has to mark the cells it
+    // touches (markCell) or fill() the map; sources need nothing, step() scans them.
+    TileMap&    scalarTiles()                  { return m_scalarTiles; }
+
+    // Solid cells, kept up to date by the SolidBoundary objects of FluidSolver. The mask
+    // persists between steps: boundaries only rewrite the cells that changed.
+    // solid()[IX(i,j,nx())] is 0 for fluid, otherwise the id of the solid covering the cell,
+    // whose velocity is solidU/solidV(id). Ghost cells are never solid. At most 65535 ids
+    // are live at once; addSolid then returns 0 and the solid is left out.
+    const uint16_t* solid() const          { return m_solid.data(); }
+    bool        hasSolids() const          { return m_solidCells != 0; }
+    bool        rowHasSolid(int j) const   { return m_solidRow[j] != 0; }
+    int         addSolid(float u, float v);
+    void        releaseSolid(int id)       { m_freeSolids.push_back(id); }
+    void        setSolidVelocity(int id, float u, float v) { m_solidVel[2*id] = u; m_solidVel[2*id+1] = v; }
+    void        setSolid(int i, int j, int id) {
+        uint16_t& s = m_solid[IX(i,j,m_Nx)];
+        int d = (id != 0) - (s != 0);
+        m_solidRow[j] += d; m_solidCells += d;
+        s = uint16_t(id);
+    }
+    float       solidU(int id) const       { return m_solidVel[2*id]; }
+    float       solidV(int id) const       { return m_solidVel[2*id+1]; }
+    // Empties the mask and drops every id. Boundaries notice by the changed epoch and
+    // rasterize from scratch.
+    void        clearSolids();
+    unsigned    solidEpoch() const         { return m_solidEpoch; }
+
 private:
-    // CORRECT ORDER: Size variables are now declared before ANYTHING that uses them.
-    int m_N;
+    struct Scalar {
+        std::string name;
+        float diffusivity;
+        Field value, source;
+    };
+
+    int m_Nx, m_Ny;
     size_t m_arrSz;
 
-    // These vectors depend on m_arrSz, so they come after.
-    std::vector<float> m_u, m_v, m_dens, m_vort;
-    std::vector<float> m_temp; // New
+    Field m_u, m_v, m_vort;
+    Field m_pressure;
+    Field m_uPrev, m_vPrev;
+    std::vector<Scalar> m_scalars;
+    TileMap m_scalarTiles;
 
-public:
-    // These vectors also depend on m_arrSz, so they must also come after.
-    // Making them public is fine, but their declaration order is what matters.
-    std::vector<float> m_uPrev, m_vPrev, m_densPrev;
-    std::vector<float> m_tempPrev; // New
-};
\ No newline at end of file
+    std::vector<uint16_t> m_solid;
+    std::vector<int>      m_solidRow;   // solid cells per row
+    std::vector<float>    m_solidVel;   // (u,v) per id, id 0 unused
+    std::vector<int>      m_freeSolids; // released ids, reused first
+    long long m_solidCells = 0;
+    unsigned  m_solidEpoch = 0;
+
+    Field m_resizeCopy;                 // resize(): the field being resampled
+    std::vector<float> m_resizeScratch;
+};
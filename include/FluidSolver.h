@@ -3,8 +3,34 @@
 #include "BoundarySolver.h"
 #include "SolidBoundary.h"
 #include "ObstacleManager.h"
+#include "PoissonSolver.h"
+#include "ThreadPool.h"
+#include "AdvectKernels.h"
 #include <vector>
 #include <memory>
+#include <cstdint>
+
+struct SolveMask;
+
+// Accumulated wall time (ms) per solver phase, filled in while FluidSolver::profile is set.
+struct SolverTimings {
+    double addSource = 0, buoyancy = 0, confine = 0;
+    double diffuse = 0, project = 0, advect = 0;
+    double forces = 0;    // fused addSource + buoyancy + confine (FluidSolver::fused_forces)
+    double obstacles = 0; // rasterizing the solid boundaries
+    double tiles = 0;     // active-tile bookkeeping (FluidSolver::active_tiles)
+    int    steps = 0;
+
+    double total() const { return addSource + buoyancy + confine + forces + diffuse + project + advect + obstacles + tiles; }
+    void   reset()       { *this = SolverTimings(); }
+};
+
+// How project() solves for the pressure.
+enum class PressureSolverType {
+    GaussSeidel,       // fixed 20 sweeps from p = 0 (the original Stam solver)
+    Multigrid,         // V-cycles until pressure_tolerance, warm-started from the last pressure
+    ConjugateGradient  // MIC(0)-preconditioned CG until pressure_tolerance, warm-started
+};
 
 class FluidSolver {
 public:
@@ -14,7 +40,24 @@ public:
     void addDensity(int i,int j,float amount);
     void addTemperature(int i, int j, float amount); // New
     void addVelocity(int i,int j,float u,float v);
+    // Further solid boundaries, rasterized every step like the constructor's ObstacleManager
     void addBoundary(SolidBoundary* b);
+    // Carries the run over to an Nx x Ny grid (FluidGrid::resize). A warm pressure solver stays
+    // warm: its next solve starts from the resampled pressure rather than from scratch. The
+    // obstacles are the caller's to move (ObstacleManager::rescale).
+    void resize(int Nx, int Ny);
+    void resize(int N) { resize(N, N); }
+
+    // Threads used by the row-parallel kernels and the concurrent stages of step() (defaults
+    // to the hardware concurrency). The pool is persistent and can be shared with other work
+    // between steps, e.g. ObstacleManager::updateObstacles.
+    void setThreadCount(int n);
+    // Uses pool in place of a pool of its own. Several solvers may share one and step on
+    // different threads at once: their parallel loops interleave on it, and a thread that is
+    // done with one solver's work picks up chunks of another's.
+    void setThreadPool(std::shared_ptr<ThreadPool> pool);
+    int  threadCount() const { return m_pool->size(); }
+    ThreadPool& threadPool() { return *m_pool; }
 
     // run-time parameters
     float force  = 5.f;
@@ -25,16 +68,72 @@ public:
     bool  buoyancy_on = true;
     float buoyancy_factor = 1.0f;
     float temp_diffusivity = 0.f;
+    // Other passive scalars use FluidGrid::scalarDiffusivity().
+
+    // Pressure solve
+    PressureSolverType pressure_solver = PressureSolverType::GaussSeidel;
+    float pressure_tolerance      = 1e-3f; // relative residual
+    int   pressure_max_iterations = 200; // V-cycles or CG iterations
+    // Of the last project(); Gauss-Seidel only measures its residual while profiling.
+    const PressureStats& pressureStats() const { return m_pressureStats; }
+    // Whether the pressure solver takes the grid's pressure as its last solution (see
+    // PoissonSolver::warm). Saved with a checkpoint so a restored run solves like the
+    // original one.
+    bool pressureWarm() const;
+    void setPressureWarm(bool warm);
+
+    // Advection kernel; Reference reproduces the scalar results exactly
+    AdvectPath advect_path = AdvectPath::Fast;
+    // Run the Gauss-Seidel sweeps of diffuse/project as a cache-blocked wavefront (same
+    // result as plain sweeps, far less memory traffic on large grids)
+    bool gs_wavefront = true;
+    // Apply sources, buoyancy and vorticity confinement in one pass over the grid
+    bool fused_forces = true;
+    // Run scalar sources, buoyancy, diffusion and advection only over the tiles of
+    // FluidGrid::scalarTiles(), grown by the distance content can travel in one step.
+    // Tiles whose scalars all fall to tile_threshold or below are zeroed and dropped.
+    bool  active_tiles = true;
+    float tile_threshold = 1e-5f;
+
+    // Per-phase profiling (off by default, see SolverTimings)
+    bool          profile = false;
+    SolverTimings timings;
 
 private:
-    void diffuse (int b,float* x,float* x0,float diff);
-    void project (float* u,float* v,float* p,float* div);
-    void advect  (int b,float* d,float* d0,float* u,float* v);
+    double* timer(double& phase) { return profile ? &phase : nullptr; }
+
+    void diffuse (int b,float* x,float* x0,float diff,const TileMap* tiles=nullptr);
+    void project (float* u,float* v,float* p,float* div,float* rowSpeed=nullptr);
+    void advect  (int count,float* const* d,const float* const* d0,const int* b,const float* u,const float* v,
+                  const TileMap* tiles=nullptr,bool solids=false);
+    float scalarDiffusivity(int k) const;
 
     void confine (float* u, float* v, float* w);
     void applyBuoyancy(float* v, float* temp); // New
+    void applyForces(float* u,float* v,float* w,const float* u0,const float* v0);
+
+    void rasterizeSolids();
+    void fillSolids(int b,float* x);
+    SolveMask solveMask(const TileMap* tiles,bool neumann) const;
+
+    void markSourceTiles();
+    void growScalarRegion();
+    void retireScalarTiles();
 
     FluidGrid* g;  
-    std::vector<SolidBoundary*> m_boundaries;
-    ObstacleManager* m_obstacleManager; 
+    std::vector<SolidBoundary*> m_boundaries; // rasterized every step; includes the manager
+    const uint16_t* m_solid = nullptr;        // this step's solid mask, null without solids
+    std::vector<uint8_t> m_solidNear;         // rows with a solid cell in rows j-1..j+1
+    std::vector<float*> m_scalars, m_scalarSources; // this step's scalar fields, see step()
+    const TileMap* m_tiles = nullptr; // this step's occupied scalar tiles, null when not used
+    TileMap m_scalarRegion;           // ... grown by one step of diffusion and advection
+    std::vector<float> m_rowSpeed; // max |u|,|v| per row after the last project()
+    std::vector<uint32_t> m_tileMax;
+
+    std::shared_ptr<ThreadPool> m_pool;
+
+    PoissonSolver* pressureSolver();
+    std::unique_ptr<PoissonSolver> m_poisson;
+    PressureSolverType m_poissonType = PressureSolverType::GaussSeidel;
+    PressureStats m_pressureStats;
 };
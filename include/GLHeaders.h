@@ -0,0 +1,6 @@
+#pragma once
+// OpenGL headers for the render library; <windows.h> must come first on Windows.
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
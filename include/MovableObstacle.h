@@ -10,8 +10,40 @@ public:
     ~MovableObstacle() override = default;
 
     // --- Obstacle Interface ---
-    // update is implemented here as it's common to all movable objects.
+    // update is implemented here as it's common to all movable objects. A sleeping body
+    // does not move.
     void update(float dt) override;
+    void solidVelocity(float& u, float& v) const override { u = m_vx; v = m_vy; }
+    // Drags the body towards the mean velocity of the fluid around it (flowAround()). The
+    // covered cells hold the body's own velocity (see FluidSolver), so they take no part.
+    void updateFromFluid(FluidGrid& grid, float dt) override;
+
+    // Drag of the flow: per time unit, updateFromFluid() closes couplingStrength / mass of
+    // the gap between the body's velocity and the flow's.
+    float couplingStrength = 50.f;
+
+    // --- Sleeping ---
+    // Bodies slower than RestSpeed (cells per time unit, and degrees per time unit for the
+    // spin) count as resting. ObstacleManager puts groups of touching bodies that have all
+    // rested long enough to sleep; a contact, fluid over the body faster than RestSpeed, or
+    // any of the setters below wakes a body up.
+    static const float RestSpeed;
+    bool isAsleep() const { return m_asleep; }
+    float restTime() const { return m_restTime; } // time at rest so far
+    void sleep();
+    void wake();
+
+    // --- Checkpointing ---
+    // What changes as the body moves. setState() on a body of the same shape gives back the
+    // body state() was taken from (not selected), asleep or awake as it was.
+    struct State {
+        float x, y, angle;
+        float vx, vy, angularVelocity;
+        float restTime;
+        bool  asleep;
+    };
+    State state() const;
+    void setState(const State& s);
 
     // --- Movable-specific Interface (implemented here) ---
     void setVelocity(float vx, float vy);
@@ -26,8 +58,12 @@ public:
     // --- Getters for the physics system ---
     Vec2 getPosition() const;
     float getInverseMass() const;
+    float getAngle() const { return m_angle; } // degrees
+    bool isSelected() const { return m_isSelected; }
 
 protected:
+    PoseKey poseKey() const override;
+
     // Common properties accessible by derived classes (Rect, Disk, etc.)
     float m_x, m_y;
     float m_vx = 0.f, m_vy = 0.f;
@@ -37,4 +73,18 @@ protected:
     float m_inverseMass;
     
     bool m_isSelected = false;
+    bool m_asleep = false;
+    float m_restTime = 0.f;
+
+    // Whether fluid moving at (u, v) over a sleeping body wakes it; wakes it if so.
+    bool wakeByFluid(float u, float v);
+
+    // Mean velocity of the fluid next to the body: over every face between a covered cell
+    // and a fluid cell of the grid's solid mask, so a cell touching the body on two faces
+    // counts twice. The covered cells themselves carry the body's own velocity and say
+    // nothing about the flow. False if no face borders fluid.
+    bool flowAround(FluidGrid& grid, float& u, float& v) const;
+
+private:
+    mutable std::vector<uint8_t> m_covered; // flowAround(): coverage over its box plus a border
 };
\ No newline at end of file
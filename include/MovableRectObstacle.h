@@ -8,9 +8,8 @@ public:
     ~MovableRectObstacle() override = default;
 
     // --- Obstacle Interface ---
-    void apply(FluidGrid& grid) const override;
-    void draw() const override;
-    void updateFromFluid(FluidGrid& grid, float dt) override;
+    ObstacleType type() const override { return ObstacleType::MovableRect; }
+    void accept(ObstacleVisitor& visitor) const override;
 
     // --- MovableObstacle Interface ---
     void updatePosition(int newX, int newY); // For legacy mouse dragging
@@ -22,6 +21,10 @@ public:
     int getWidth() const { return m_w; }
     int getHeight() const { return m_h; }
 
+protected:
+    // Cells that contains() accepts at the quantized pose
+    void computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const override;
+
 private:
     int m_w, m_h;
     int m_gridN;
@@ -0,0 +1,55 @@
+#pragma once
+#include "PoissonSolver.h"
+#include "Util.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Cell-centred geometric multigrid (V-cycles, FMG for a cold start) with red-black
+// Gauss-Seidel smoothing. The grid is halved, rounding up, down to a shorter side of 4 or
+// less, whose level is then solved by plain smoothing: on an elongated grid that level keeps
+// the aspect ratio, so it gets coarse_sweeps times the ratio of its sides. An odd side ends
+// in a coarse cell with a single child across.
+// With solids every level gets a mask: a coarse cell is solid only when all of its children
+// are, so thin walls coarsen away and only the fine levels see them.
+class MultigridSolver : public PoissonSolver {
+public:
+    explicit MultigridSolver(int N) : MultigridSolver(N, N) {}
+    MultigridSolver(int Nx, int Ny);
+
+    int nx() const override { return m_levels.front().Nx; }
+    int ny() const override { return m_levels.front().Ny; }
+    PressureStats solve(float* p, float* div, float tol, int maxCycles) override;
+    bool warm() const override     { return !m_cold; }
+    void setWarm(bool warm) override { m_cold = !warm; }
+
+    int levels() const { return static_cast<int>(m_levels.size()); }
+
+    int pre_sweeps    = 2;
+    int post_sweeps   = 2;
+    int coarse_sweeps = 40;
+
+private:
+    struct Level {
+        int Nx, Ny;
+        float *x, *b;                     // point into the storage below (or the caller's arrays)
+        Field xs, bs, r;
+        std::vector<double> rowNorm2;     // per-row residual norms, summed in order
+        std::vector<uint8_t> mask;        // 1 = solid, IX layout
+        std::vector<uint8_t> nearRow;     // row j, j-1 or j+1 holds a solid cell
+        const uint8_t* solid = nullptr;   // mask.data() while solids are set, else null
+    };
+
+    void   buildMasks();
+    void   vcycle(std::size_t l);
+    void   fmg();
+    void   smooth(Level& L, int sweeps);
+    int    coarseSweeps() const;
+    double residual(Level& L);            // fills L.r, returns its squared 2-norm
+    void   restrictResidual(const Level& fine, Level& coarse);
+    void   prolongAdd(Level& coarse, Level& fine);
+    void   prolongCopy(Level& coarse, Level& fine);
+
+    std::vector<Level> m_levels;
+    bool m_cold = true;
+};
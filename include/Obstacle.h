@@ -1,12 +1,74 @@
 #pragma once
+#include <vector>
+#include <cstdint>
 class FluidGrid;
+struct ObstacleVisitor;
+
+// Cells of 1..Nx x 1..Ny covered by an obstacle, as row runs in increasing j, and their bounding
+// rect (empty when i0 > i1). version changes whenever the set of cells does.
+struct CellCoverage {
+    struct Run { int j, i0, i1; };
+    std::vector<Run> runs;
+    int i0 = 1, j0 = 1, i1 = 0, j1 = 0;
+    unsigned version = 0;
+
+    bool empty() const { return i0 > i1; }
+};
+
+// The kinds ObstacleManager knows natively. Anything else is Custom: it is rasterized and
+// coupled to the fluid through the virtual interface, but takes no part in collisions or
+// picking.
+enum class ObstacleType : uint8_t { FixedRect, MovableRect, Disk, Custom };
 
 class Obstacle {
 public:
+    // Poses are quantized to 1/PoseSteps of a cell (and of a degree) for the coverage cache.
+    static const int PoseSteps = 32;
+
     virtual ~Obstacle() = default;
-    virtual void apply(FluidGrid& grid) const = 0;
-    virtual void draw() const = 0;
+    virtual ObstacleType type() const { return ObstacleType::Custom; }
+    virtual void accept(ObstacleVisitor& visitor) const = 0;
     virtual void update(float dt) { };
     virtual void updateFromFluid(FluidGrid& grid, float dt) = 0;
-    
+
+    // Velocity the covered cells move with.
+    virtual void solidVelocity(float& u, float& v) const { u = v = 0.f; }
+
+    // Covered cells of an Nx x Ny grid at the current pose. Recomputed only when the quantized
+    // pose (or the grid size) changes, and the version only moves if the cells differ, so a
+    // body at rest costs a key comparison per call.
+    const CellCoverage& coverage(int Nx, int Ny) const;
+    const CellCoverage& coverage(int N) const { return coverage(N, N); }
+
+protected:
+    struct PoseKey {
+        int32_t x = 0, y = 0, angle = 0;
+        bool operator==(const PoseKey& o) const { return x == o.x && y == o.y && angle == o.angle; }
+    };
+    static int32_t quantize(float x);
+    static float   dequantize(int32_t q) { return float(q) / PoseSteps; }
+
+    // Appends the runs of cells (i,j) in [i0,i1] x [j0,j1] for which inside(i,j) holds.
+    template<class Inside>
+    static void scanRuns(int i0, int i1, int j0, int j1, Inside inside, std::vector<CellCoverage::Run>& runs) {
+        for (int j = j0; j <= j1; ++j) {
+            int start = -1;
+            for (int i = i0; i <= i1; ++i) {
+                bool in = inside(i, j);
+                if (in && start < 0) start = i;
+                if (!in && start >= 0) { runs.push_back({j, start, i - 1}); start = -1; }
+            }
+            if (start >= 0) runs.push_back({j, start, i1});
+        }
+    }
+
+    virtual PoseKey poseKey() const = 0;
+    // Cells covered at the quantized pose key, in row order.
+    virtual void computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const = 0;
+
+private:
+    mutable CellCoverage m_coverage;
+    mutable std::vector<CellCoverage::Run> m_scratch;
+    mutable PoseKey m_key;
+    mutable int m_coverageNx = -1, m_coverageNy = -1;
 };
@@ -1,42 +1,206 @@
 #pragma once
 #include "SolidBoundary.h"
+#include "SpatialHash.h"
+#include "BodyPool.h"
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include "Vec2.h"
 
 class Obstacle;
 class MovableObstacle; // Use the new base class
-class MovableRectObstacle;
-class DiskObstacle;
 class FluidGrid;
-struct Vec2;
+struct ObstacleVisitor;
+class ThreadPool;
+
+// What the last handleCollisions() did: movable bodies and those of them awake after the
+// step, candidate pairs from the index and the islands they form, resolved contacts over
+// all iterations, and bodies re-boxed (with their extra candidate pairs) after a push moved
+// them past their margin. merged counts the islands formed after a re-boxed body reached
+// another island (or a body outside any), which then went on as one; islands counts those
+// that made the result. touching counts the distinct touching pairs, warm those of them
+// that started from the impulse they had the step before; overlap is the summed depth of
+// the contacts the last iteration of each island's solve still found.
+struct CollisionStats {
+    int bodies = 0, awake = 0, islands = 0, pairs = 0, contacts = 0, reboxed = 0, merged = 0;
+    int touching = 0, warm = 0;
+    float overlap = 0.f;
+};
 
 class ObstacleManager : public SolidBoundary {
 public:
-    explicit ObstacleManager(int gridN);
+    explicit ObstacleManager(int gridN) : ObstacleManager(gridN, gridN) {}
+    ObstacleManager(int gridNx, int gridNy);
     ~ObstacleManager() override;
 
-    void applyTo(FluidGrid& grid) override;
+    // Incremental: only obstacles whose covered cells changed are re-rasterized, inside the
+    // rects they left and entered, together with whatever else overlaps those rects.
+    void rasterize(FluidGrid& grid) override;
     void update(float dt);
+    // Pushes overlapping movables apart, working on their BodyPool copy and writing the
+    // result back. Candidate pairs come from a SpatialHash over their bounds grown by a
+    // margin, wider for a body the faster it moves and the further the last step pushed it;
+    // pairs of two sleeping bodies are skipped. The pairs split into islands
+    // (connected groups of bodies) that are solved independently, each with its pairs in
+    // the global order, and a body that a push moves past its margin gets its new
+    // candidates within the island added on the spot. A candidate in another island (or in
+    // none) merges the two, which go on from where they were: the merged island walks only
+    // the pairs the pushes across spread to, until no push leaves its island. With
+    // broadphase off, all pairs are walked as one island, which gives the same result as
+    // long as no push reaches out of its island. Normal impulses
+    // accumulate per touching pair in a ContactCache and warm-start the pair's next step,
+    // and the depth left over is closed through a velocity bias over the next update(dt)
+    // (see BodyPool::resolve). A sleeping body touched by an awake one wakes up; a group of
+    // touching bodies that have all rested for sleepDelay goes to sleep.
     void handleCollisions();
-    void updateObstacles(FluidGrid& grid, float dt);
+    // Same, with the islands spread over a pool; the result does not depend on its size.
+    void handleCollisions(ThreadPool& pool);
+    const CollisionStats& collisionStats() const { return m_collisionStats; }
+    bool broadphase = true;
+    int collisionIterations = 3; // passes over the pairs per step
+    bool sleeping = true;
+    float sleepDelay = 0.5f;     // time a group must rest before it sleeps
+    void updateObstacles(FluidGrid& grid, float dt) override;
+    // Same, with the obstacles spread over a pool (they are independent here).
+    void updateObstacles(FluidGrid& grid, float dt, ThreadPool& pool);
 
+    // Takes any Obstacle subclass; see ObstacleType for what a Custom one takes part in.
+    void addObstacle(std::unique_ptr<Obstacle> obstacle);
     void addFixedRect(int x, int y, int w, int h);
     void addMovableRect(int x, int y, int w, int h);
     void addDisk(int x, int y, int r, int w, int h); // New method
 
     MovableObstacle* findMovableAt(int x, int y); // Returns the new base class
-    void draw() const;
+    void accept(ObstacleVisitor& visitor) const;
     void clear();
+    // Moves every obstacle onto an Nx x Ny grid of the same domain, for FluidGrid::resize:
+    // positions, sizes and velocities scale per axis by the new size over the old one (sizes
+    // rounded, at least a cell; a disk radius by the geometric mean of the two factors),
+    // angles and spins stay, and sleeping bodies keep sleeping. Custom obstacles are kept as
+    // they are. Obstacles are replaced, so pointers to them go stale, and cached contacts are
+    // dropped.
+    void rescale(int Nx, int Ny);
+    void rescale(int N) { rescale(N, N); }
 
 private:
-    // Collision checking helpers
-    bool checkCollision(MovableRectObstacle* a, MovableRectObstacle* b, Vec2& mtv);
-    bool checkCollision(DiskObstacle* a, DiskObstacle* b, Vec2& mtv);
-    bool checkCollision(MovableRectObstacle* rect, DiskObstacle* disk, Vec2& mtv);
+    // One worker's state for solveIsland(), kept between steps so they do not allocate.
+    struct IslandScratch {
+        std::vector<std::pair<int,int>> extraPairs;     // sorted, not in the island's pairs
+        std::vector<ContactCache::Contact> extraContacts; // parallel to extraPairs
+        std::vector<uint8_t> extraTouched;
+        std::vector<int> moved;                         // the island's re-boxed bodies
+        std::vector<int> hits, restHits;
+        // Touching extra pairs of the islands solved, with their island, for m_contacts
+        struct Touched { int island; std::pair<int,int> pair; ContactCache::Contact contact; };
+        std::vector<Touched> touched;
+        std::vector<int> reboxed;                // bodies re-boxed, of the islands solved
+        std::vector<std::pair<int,int>> reached; // (re-boxed body, body outside its island) found
+        void reserve(size_t bodies);
+    };
+    // What solving an island gave, besides its pairs' contacts.
+    struct IslandResult {
+        double overlap = 0;
+        int extraPairs = 0, contacts = 0, reboxed = 0, warm = 0;
+        bool merged = false; // its pairs went on in a later island
+    };
+
+    void collideAll(ThreadPool* pool);
+    void gatherBodies();
+    void reserveForBodies();
+    void buildIndex();
+    void rebuildRest();
+    // Bodies whose box overlaps box, in increasing order; tmp is scratch.
+    void queryBodies(const SpatialHash::Box& box, std::vector<int>& out, std::vector<int>& tmp) const;
+    void findPairs();
+    void buildIslands();
+    void solveIsland(int island, IslandScratch& s);
+    void solveIslands(ThreadPool* pool, int first, int last);
+    void findReached();
+    bool mergeReached();
+    int findIsland(int island);
+    void solveAllPairs();
+    void sleepResting();
+    SpatialHash::Box boxOf(int body) const; // its bounds grown by its margin
+    bool movedPastMargin(int body) const;
+    void rebox(int body, int island, std::pair<int,int> current, size_t& extraPos, IslandScratch& s);
+    void touchBody(int body) { if (m_asleep[body]) { m_asleep[body] = 0; m_woken[body] = 1; } }
+    int findRoot(int body);
 
-    // Collision resolution helper
-    void resolveCollision(MovableObstacle* a, MovableObstacle* b, const Vec2& mtv);
+    struct Rect { int i0, j0, i1, j1; };
+    // What an obstacle has written into the grid's solid mask.
+    struct Stamp {
+        int id = 0;             // solid id, 0 while it has none
+        unsigned version = 0;   // CellCoverage::version the mask holds
+        bool stamped = false;
+        Rect rect{1, 1, 0, 0};
+    };
+    void addDirty(const Rect& r);
 
-    int m_gridN;
+    int m_gridNx, m_gridNy;
     std::vector<std::unique_ptr<Obstacle>> m_obstacles;
+
+    // Broadphase over the movables; invalid once anything may have moved. A sleeping body
+    // keeps the BodyPool state and box it had when it fell asleep, in m_restHash, which is
+    // only rebuilt once enough bodies have woken or fallen asleep since; the other bodies
+    // are read again at every build, into m_hash.
+    std::vector<MovableObstacle*> m_bodies; // body k of m_pool
+    bool m_bodiesValid = false;             // m_bodies matches m_obstacles
+    BodyPool m_pool;
+    std::vector<SpatialHash::Box> m_boxes;  // per body
+    std::vector<Vec2> m_indexedAt;   // body positions the boxes were built from
+    std::vector<float> m_margin;     // per body: what its box is grown by
+    std::vector<float> m_shift;      // per body: how far the last collision step pushed it
+    std::vector<uint8_t> m_settled;  // per body: pool state read while asleep, still current
+    SpatialHash m_hash;              // over m_dynIds
+    std::vector<int> m_dynIds;       // bodies not in m_restHash, increasing
+    std::vector<SpatialHash::Box> m_dynBoxes;
+    SpatialHash m_restHash;          // over m_restIds
+    std::vector<int> m_restIds;
+    std::vector<SpatialHash::Box> m_restBoxes;
+    std::vector<uint8_t> m_inRest;   // per body: asleep in m_restHash, cleared when it wakes
+    int m_restStale = 0;             // entries of m_restHash that have woken since its build
+    std::vector<uint8_t> m_asleep;   // per body, as of the index; cleared when woken
+    std::vector<uint8_t> m_woken;    // woken by a contact this step
+    std::vector<std::pair<int,int>> m_pairs; // candidates with an awake body, sorted
+    std::vector<int> m_hits, m_restHits;
+    bool m_indexValid = false;
+
+    // Islands: union-find over the pairs, then the pairs grouped per island (in order).
+    std::vector<int> m_parent;
+    std::vector<int> m_islandOf;     // per body, -1 outside any pair
+    std::vector<int> m_islandStart;  // into m_islandPairs, one past the end for the last
+    std::vector<std::pair<int,int>> m_islandPairs;
+    std::vector<ContactCache::Contact> m_pairContacts; // parallel to m_islandPairs
+    std::vector<uint8_t> m_pairTouched;
+    std::vector<IslandResult> m_islandResults;
+    std::vector<uint8_t> m_moved;    // re-boxed this step; the box is then in m_newBoxes
+    std::vector<SpatialHash::Box> m_newBoxes;
+    std::vector<SpatialHash::Box> m_sweptBoxes; // of a re-boxed body: all its boxes this step
+    std::vector<IslandScratch> m_scratch;
+    int m_workers = 0;               // of m_scratch, in use this step
+    std::vector<Vec2> m_startedAt;   // body positions at the start of the step
+    // Merging: the bodies re-boxed this step, the (body, body outside its island) pairs whose
+    // boxes met, a union-find over the islands, per island the merged one it becomes (-1 for
+    // none), the merged islands' pairs being gathered, and per body whether a merged
+    // island's walk has reached it. Islands from m_firstMerged on are merged ones.
+    std::vector<int> m_reboxed;
+    std::vector<std::pair<int,int>> m_reached;
+    std::vector<int> m_islandParent;
+    std::vector<int> m_mergedInto;
+    struct Merging { int island; std::pair<int,int> pair; ContactCache::Contact contact; uint8_t touched; };
+    std::vector<Merging> m_merging;
+    std::vector<uint8_t> m_active;
+    int m_firstMerged = 0;
+    std::vector<uint8_t> m_groupRests;
+
+    ContactCache m_contacts;
+    CollisionStats m_collisionStats;
+    float m_dt = 0.f;                 // of the last update(), for the contacts' velocity bias
+
+    std::vector<Stamp>   m_stamps;    // parallel to m_obstacles
+    std::vector<Rect>    m_dirty;     // this rasterize's rects to redo
+    std::vector<int>     m_released;  // ids of removed obstacles, freed at the next rasterize
+    std::vector<uint8_t> m_ownsId;    // ids in the mask that belong to this manager
+    const FluidGrid* m_grid = nullptr;
+    unsigned m_solidEpoch = 0;        // FluidGrid::solidEpoch the stamps refer to
 };
\ No newline at end of file
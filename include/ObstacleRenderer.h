@@ -0,0 +1,24 @@
+#pragma once
+#include "ObstacleVisitor.h"
+#include "FieldSnapshot.h"
+
+// Immediate-mode OpenGL renderer for the built-in obstacle types, drawn from the obstacles
+// themselves or from a snapshot's shapes.
+// Expects a projection that maps the unit square onto the simulation viewport; gridN is the
+// longer side of the grid, whose cells are 1/gridN wide (see FieldRenderer).
+class ObstacleRenderer : public ObstacleVisitor {
+public:
+    explicit ObstacleRenderer(int gridN);
+
+    void visit(const RectObstacle& obs) override;
+    void visit(const MovableRectObstacle& obs) override;
+    void visit(const DiskObstacle& obs) override;
+    void draw(const FieldSnapshot::Shape& shape);
+
+private:
+    void drawFixedRect(float x, float y, float w, float h);
+    void drawMovableRect(const Vec2& center, float w, float h, float angle, bool selected);
+    void drawDisk(const Vec2& center, float radius, bool selected);
+
+    int m_gridN;
+};
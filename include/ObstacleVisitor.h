@@ -0,0 +1,13 @@
+#pragma once
+class RectObstacle;
+class MovableRectObstacle;
+class DiskObstacle;
+
+// Double-dispatch hook over the concrete obstacle types. Lets code outside the core
+// (rendering, serialisation, ...) inspect obstacles without the core depending on it.
+struct ObstacleVisitor {
+    virtual ~ObstacleVisitor() = default;
+    virtual void visit(const RectObstacle&) {}
+    virtual void visit(const MovableRectObstacle&) {}
+    virtual void visit(const DiskObstacle&) {}
+};
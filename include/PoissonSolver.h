@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+class ThreadPool;
+
+// Outcome of one pressure solve: iterations (or cycles) used and the final relative residual.
+struct PressureStats {
+    int   iterations = 0;
+    float residual   = 0.f;
+};
+
+// Connected components of the fluid cells of a solid mask (neighbours through a fluid face
+// inside the grid). Solids can cut the domain into several; each is a Neumann problem of its
+// own, only solvable when div sums to zero over it.
+struct FluidRegions {
+    struct Run { int j, i0, i1, region; }; // fluid cells i0..i1 of row j, in row order
+    std::vector<Run> runs;
+    int count = 0;
+
+    void build(int Nx, int Ny, const uint16_t* solid);
+
+    // removeMean() scratch, per region
+    std::vector<double> sum;
+    std::vector<long long> cells;
+    std::vector<float> mean;
+
+private:
+    int find(int k);
+    std::vector<int> m_parent; // union-find over runs
+};
+
+// Iterative solver for the pressure Poisson equation 4p - (sum of neighbours) = div on the
+// ghost-celled IX layout, with the pure Neumann (b=0) walls of BoundarySolver.
+// p is used as the initial guess, so callers can warm-start from the previous solve.
+// Solid cells (FluidGrid::solid) are left out: they have no pressure, and their faces are
+// Neumann walls like the domain's. div must be zero in them.
+class PoissonSolver {
+public:
+    virtual ~PoissonSolver() = default;
+    // Grid the solver was built for: Nx x Ny interior cells
+    virtual int nx() const = 0;
+    virtual int ny() const = 0;
+    virtual PressureStats solve(float* p, float* div, float tol, int maxIterations) = 0;
+    // Whether the next solve() takes p as a previous solution. A solver that starts
+    // differently without one (MultigridSolver's FMG) is cold until its first solve;
+    // setWarm(true) makes it use a p that was restored from elsewhere.
+    virtual bool warm() const    { return true; }
+    virtual void setWarm(bool)   {}
+
+    // Optional pool for row-parallel kernels; results do not depend on its size.
+    void setThreadPool(ThreadPool* pool) { m_pool = pool; }
+    // Solid mask for the next solve(), null for none. Set before every solve; the mask
+    // changes from step to step.
+    void setSolids(const uint16_t* solid) { m_solid = solid; }
+
+    // ||r|| / ||div|| for r = div - Ap, both with their mean removed (per fluid region). Used
+    // to measure solvers that do not track their own residual.
+    static float relativeResidual(int Nx, int Ny, const float* p, const float* div, const uint16_t* solid = nullptr);
+
+protected:
+    // The Neumann problem only has a solution for a zero-mean right-hand side, so the
+    // (physically meaningless) mean of div is dropped: over the whole grid without regions,
+    // else over each fluid region, solid cells left alone. Returns the squared 2-norm left over.
+    static double removeMean(int Nx, int Ny, float* b, FluidRegions* regions = nullptr);
+    // m_regions for the current m_solid, or null without solids. Call at the start of solve().
+    FluidRegions* findRegions(int Nx, int Ny);
+
+    ThreadPool* m_pool = nullptr;
+    const uint16_t* m_solid = nullptr;
+    FluidRegions m_regions;
+};
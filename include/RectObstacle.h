@@ -4,10 +4,19 @@
 class RectObstacle : public Obstacle {
 public:
     RectObstacle(int x, int y, int w, int h, int gridN);
-    void apply(FluidGrid& grid) const override;
-    void draw() const override;
+    ObstacleType type() const override { return ObstacleType::FixedRect; }
+    void accept(ObstacleVisitor& visitor) const override;
     void updateFromFluid(FluidGrid& grid, float dt) override;
 
+    float getX() const      { return m_x; }
+    float getY() const      { return m_y; }
+    float getWidth() const  { return m_w; }
+    float getHeight() const { return m_h; }
+
+protected:
+    PoseKey poseKey() const override { return PoseKey(); } // never moves
+    void computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const override;
+
 private:
     float m_x, m_y, m_w, m_h;
     float m_vx = 0.f, m_vy = 0.f;
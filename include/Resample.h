@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+
+// Conservative resampling of a grid field onto another resolution of the same domain, for
+// FluidGrid::resize. Cells are 1/Nx by 1/Ny of the domain along each axis. Each source cell is reconstructed as
+// linear along each axis, with the slope limited by minmod against its neighbours (flat at
+// the walls), and each destination cell takes the average of that reconstruction over its
+// area. So restriction averages the fine cells a coarse one covers, prolongation splits a
+// coarse cell along its neighbours' gradient, and in both directions the sum of value times
+// cell area is kept and no new extrema appear: a non-negative density stays non-negative.
+// Any ratio of sizes works, independently along x and y.
+//
+// Reads the interior cells of src (IX layout of an srcNx x srcNy grid) and writes those of
+// dst (dstNx x dstNy); ghost cells are left to BoundarySolver. The pass is separable, rows
+// first: scratch holds the intermediate dstNx x srcNy field and keeps its capacity between
+// calls.
+void resampleField(int srcNx, int srcNy, const float* src, int dstNx, int dstNy, float* dst,
+                   std::vector<float>& scratch);
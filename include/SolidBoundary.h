@@ -1,6 +1,12 @@
 #pragma once
 class FluidGrid;
-struct SolidBoundary{ 
-    virtual ~SolidBoundary()=default; virtual void applyTo(FluidGrid&)=0;
+
+// Something that puts solid cells into the fluid. FluidSolver calls rasterize() for each of
+// its boundaries once per step; the kernels then read the mask instead of asking the
+// boundaries per cell. The mask persists, so rasterize() only has to bring the boundary's
+// own cells (and solid velocities) up to date, unless FluidGrid::solidEpoch() has changed.
+struct SolidBoundary{
+    virtual ~SolidBoundary()=default;
+    virtual void rasterize(FluidGrid& grid)=0;
     virtual void updateObstacles(FluidGrid& grid, float dt)=0;
 };
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <utility>
+
+// Uniform-grid broadphase over axis-aligned boxes. build() bins the boxes into square
+// buckets with a counting sort (the arrays are reused between builds), sized from the mean
+// box extent over the boxes' overall bounds; pairs() and query() then only look at the
+// buckets a box or a point falls into. Queries only read, so they may run concurrently.
+class SpatialHash {
+public:
+    struct Box { float x0, y0, x1, y1; };
+    static bool overlaps(const Box& a, const Box& b) {
+        return !(a.x1 < b.x0 || b.x1 < a.x0 || a.y1 < b.y0 || b.y1 < a.y0);
+    }
+
+    void build(const std::vector<Box>& boxes);
+
+    // Every pair a < b of overlapping boxes, once, in increasing (a,b) order.
+    void pairs(std::vector<std::pair<int,int>>& out) const;
+    // Boxes containing (x,y), in increasing index order.
+    void query(float x, float y, std::vector<int>& out) const;
+    // Boxes overlapping box, in increasing index order.
+    void query(const Box& box, std::vector<int>& out) const;
+
+    int bucketsX() const { return m_nx; }
+    int bucketsY() const { return m_ny; }
+
+private:
+    int bucketX(float x) const;
+    int bucketY(float y) const;
+
+    std::vector<Box> m_boxes;
+    float m_x0 = 0.f, m_y0 = 0.f, m_inv = 1.f; // origin and 1 / bucket size
+    int m_nx = 0, m_ny = 0;
+    std::vector<int> m_start;  // bucket b holds m_items[m_start[b] .. m_start[b+1])
+    std::vector<int> m_items;  // box indices, increasing within a bucket
+    std::vector<int> m_range;  // bx0, by0, bx1, by1 per box
+};
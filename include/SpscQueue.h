@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue from one producer thread to one consumer thread: a ring of
+// slots with a head and a tail index that each side only reads from the other. Neither
+// side ever blocks; push() fails when the ring is full and pop() when it is empty.
+template<class T>
+class SpscQueue {
+public:
+    // Capacity is rounded up to a power of two.
+    explicit SpscQueue(std::size_t capacity) {
+        std::size_t n = 1;
+        while (n < capacity) n *= 2;
+        m_items.resize(n);
+        m_mask = n - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side
+    bool push(const T& item) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+        m_items[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item) {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+        item = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> m_items;
+    std::size_t m_mask = 0;
+    // On separate cache lines, so the two sides do not invalidate each other's index
+    std::atomic<std::size_t> m_head{0}; // next to pop
+    char m_pad[64];
+    std::atomic<std::size_t> m_tail{0}; // next to push
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "FluidSolver.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+class FluidGrid;
+class ObstacleManager;
+class ThreadPool;
+
+// ===== sweep spec ===========================================================
+// A sweep spec gives values for the parameters of a run, one "key = value, value, ..." per
+// line, and every combination of the values listed is one run; the first key varies
+// slowest. A value may also be a range "first:last:count" of count evenly spaced values.
+// "#" starts a comment. A line holding only "---" ends a block of keys, and the next block
+// starts from the defaults again. Keys:
+//   scenario                 inject | plume | obstacles (the FluidBench scenarios)
+//   N, steps, bodies         bodies: of the obstacles scenario
+//   Nx, Ny                   a rectangular grid: override N for one side
+//   dt, diff, visc, vort, buoyancy_factor, temp_diffusivity
+//   pressure                 gs | mg | cg
+
+struct SweepRun {
+    int   id = 0;      // position in the spec
+    std::string scenario = "plume";
+    int   N = 128;
+    int   Nx = 0, Ny = 0; // 0: N
+    int   width() const  { return Nx > 0 ? Nx : N; }
+    int   height() const { return Ny > 0 ? Ny : N; }
+    int   steps = 100;
+    int   bodies = 32;
+    float dt = 0.1f, diff = 0.f, visc = 0.f, vort = 5.f;
+    float buoyancy_factor = 1.f, temp_diffusivity = 0.f;
+    PressureSolverType pressure = PressureSolverType::GaussSeidel;
+};
+
+// Appends the runs of spec to runs, numbering them on from runs.size(). On failure returns
+// false, leaves runs as it was and error says which line is wrong.
+bool parseSweepSpec(const std::string& spec, std::vector<SweepRun>& runs, std::string& error);
+
+// ===== running ==============================================================
+
+// The state of a run after its last step, over the interior cells.
+struct SweepResult {
+    SweepRun run;
+    int    worker = 0;    // runner thread, 0 being the one that called SweepRunner::run
+    double setupMs = 0;   // building the grid, solver and obstacles
+    double stepMs = 0;    // every step, sources and obstacles included
+    double mass = 0;      // sum of the density
+    double energy = 0;    // sum of (u^2 + v^2) / 2
+    double maxSpeed = 0;
+    double height = 0;    // mean (j - 0.5) / Ny weighted by density: how far the smoke rose
+    bool   finite = true; // no NaN or infinity in dens, u or v
+};
+
+// The setup every run of one scenario and grid size starts from: the cells its sources
+// feed every step and the obstacles it places. Built once and then only read, by any
+// number of runs at once.
+class SweepScene {
+public:
+    SweepScene(const std::string& scenario, int Nx, int Ny, int bodies);
+
+    bool buoyant() const   { return m_buoyant; }
+    bool hasBodies() const { return !m_bodies.empty(); }
+    // Replaces the grid's sources with the scene's.
+    void inject(FluidGrid& grid) const;
+    void placeBodies(ObstacleManager& manager) const;
+
+private:
+    struct Cell { int index; float dens, temp, v; };
+    struct Body { bool disk; int x, y, w, h; };
+
+    std::vector<Cell> m_cells;
+    std::vector<Body> m_bodies;
+    bool m_buoyant = false;
+};
+
+struct SweepOptions {
+    int  threads = 0;         // runs going at once; 0: the hardware concurrency
+    bool shareThreads = true; // solvers share one pool, see SweepRunner; false: one thread each
+};
+
+// Runs many independent simulations in one process. Runner threads (the calling thread and
+// threads - 1 more) each take the next run as soon as they are done with one, largest first
+// by Nx*Ny*steps, so the long runs do not start last. Every run gets its own grid and
+// solver, created when it starts and freed when it ends, and the SweepScene of its scenario
+// and grid size.
+//
+// With shareThreads, all solvers use one work-stealing ThreadPool of threads participants
+// instead of each running its own, and the runners other than the calling thread are tasks
+// on it, so the pool's workers are the runners and no more than threads threads work at
+// once. While every runner is busy its row loops mostly run on its own thread; a runner out
+// of runs goes back to the pool and takes chunks of the large runs still going. A runner
+// waiting for its own chunks can also pick up a runner task not yet started and run it
+// first.
+class SweepRunner {
+public:
+    explicit SweepRunner(const SweepOptions& options = SweepOptions());
+
+    int threads() const { return m_threads; }
+
+    // Runs them all and returns when they are done. done is called as each run ends, on the
+    // thread that ran it, one call at a time.
+    void run(const std::vector<SweepRun>& runs, const std::function<void(const SweepResult&)>& done);
+
+private:
+    std::shared_ptr<const SweepScene> scene(const SweepRun& run);
+    SweepResult runOne(const SweepRun& run, int worker);
+
+    SweepOptions m_opt;
+    int m_threads;
+    std::shared_ptr<ThreadPool> m_pool;
+    std::mutex m_mutex;
+    std::map<std::tuple<std::string, int, int, int>, std::shared_ptr<const SweepScene>> m_scenes;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include "AlignedAllocator.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing pool. Threads are created once and park between bursts of work,
+// so a solver can issue hundreds of short parallel loops and tasks per step without
+// spawning threads.
+//
+// Each pool thread has a task queue: it pushes and pops its own tasks at the back, and idle
+// threads steal from the front of the others. Threads outside the pool (the one calling
+// FluidSolver::step, say) share one more queue. Waiting for tasks never blocks: the waiting
+// thread runs queued tasks until its own are done, so tasks may start parallel loops and
+// task groups of their own.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads); // total participants, including the calling thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // Calls fn(lo, hi) over contiguous chunks covering [begin, end) and returns when all are
+    // done. The caller works on chunks too. Chunks are started in increasing order (a chunk
+    // is only picked up once all earlier ones have been), so a chunk may wait for an earlier
+    // one to make progress. Ranges shorter than 2*grain run inline.
+    void parallelFor(int begin, int end, const std::function<void(int, int)>& fn, int grain = 16);
+
+    // Independent tasks that are waited for together. The destructor waits as well.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool& pool) : m_pool(pool) {}
+        ~TaskGroup() { wait(); }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(std::function<void()> fn);
+        void wait();
+
+    private:
+        ThreadPool& m_pool;
+        std::deque<std::function<void()>> m_fns; // stable addresses for queued tasks
+        std::atomic<int> m_pending{0};
+    };
+
+private:
+    struct Task {
+        void (*invoke)(void* ctx);
+        void* ctx;
+        std::atomic<int>* pending;
+    };
+    // One cache line each; allocated through AlignedAllocator, since before C++17 new[]
+    // does not honour alignas(64).
+    struct alignas(64) Queue {
+        std::mutex m;
+        // count tasks in a ring from head; the ring only grows, so bursts of work no larger
+        // than earlier ones do not allocate
+        std::vector<Task> ring; // size a power of two
+        size_t head = 0, count = 0;
+        void pushBack(const Task* tasks, int n);
+        Task popBack() { --count; return ring[(head + count) & (ring.size() - 1)]; }
+        Task popFront() {
+            Task t = ring[head];
+            head = (head + 1) & (ring.size() - 1);
+            --count;
+            return t;
+        }
+    };
+
+    int  self() const; // queue of the calling thread: its worker index, or 0 for outsiders
+    void push(const Task* tasks, int count);
+    bool pop(int q, Task& t);
+    bool steal(int q, Task& t);
+    bool findTask(int q, Task& t) { return pop(q, t) || steal(q, t); }
+    static void execute(const Task& t);
+    void helpUntilDone(std::atomic<int>& pending);
+    void workerLoop(int index);
+
+    std::vector<std::thread> m_workers;
+    std::vector<Queue, AlignedAllocator<Queue>> m_queues; // [0]: outside threads, [k]: worker k
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<uint64_t> m_epoch{0};  // bumped on every push, for parked workers
+    std::atomic<int>      m_sleepers{0};
+    bool m_stop = false;
+};
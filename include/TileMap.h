@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Coarse occupancy map of the interior of an Nx x Ny grid, in Size x Size cell tiles (the
+// last tile row and column may be partial). FluidGrid keeps one for its passive scalars, and
+// FluidSolver only runs the scalar kernels over the cells of active tiles.
+//
+// set()/markCell() only flip the tile flag, so they may run concurrently for different
+// tiles; update() rebuilds the row spans afterwards. Everything else updates them itself.
+class TileMap {
+public:
+    static const int Size = 16;
+
+    // Active cells i0..i1 (inclusive) of a row; adjacent active tiles are merged.
+    struct Span { int i0, i1; };
+
+    explicit TileMap(int N = 0) : TileMap(N, N) {}
+    TileMap(int Nx, int Ny);
+
+    int  gridWidth() const            { return m_Nx; }
+    int  gridHeight() const           { return m_Ny; }
+    int  tilesX() const               { return m_Tx; } // per row
+    int  tilesY() const               { return m_Ty; } // per column
+    int  tileCount() const            { return m_Tx*m_Ty; }
+    bool active(int ti, int tj) const { return m_on[ti + m_Tx*tj] != 0; }
+    int  activeCount() const;
+
+    void set(int ti, int tj)          { m_on[ti + m_Tx*tj] = 1; }
+    void reset(int ti, int tj)        { m_on[ti + m_Tx*tj] = 0; }
+    // Cell (i,j) in 0..Nx+1 x 0..Ny+1; ghost cells belong to the outermost tiles.
+    void markCell(int i, int j)       { set(tileOfI(i), tileOfJ(j)); }
+    void update();
+
+    void fill();
+    void clear();
+    // Grows the active set by radius tiles in every direction (diagonals included).
+    void dilate(int radius);
+
+    // Tile of column i / row j, and the cells of tile t along x / y.
+    int  tileOfI(int i) const;
+    int  tileOfJ(int j) const;
+    int  firstCell(int t) const       { return 1 + t*Size; }
+    int  lastCellI(int ti) const;
+    int  lastCellJ(int tj) const;
+
+    // Spans of tile row tj, or of the tile row holding grid row j (1..Ny).
+    const std::vector<Span>& tileRowSpans(int tj) const { return m_spans[tj]; }
+    const std::vector<Span>& rowSpans(int j) const      { return m_spans[tileOfJ(j)]; }
+
+private:
+    int m_Nx, m_Ny, m_Tx, m_Ty;
+    std::vector<uint8_t> m_on, m_tmp;
+    std::vector<std::vector<Span>> m_spans;
+};
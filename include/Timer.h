@@ -0,0 +1,22 @@
+#pragma once
+#include <chrono>
+
+// Adds the wall time spent in the enclosing scope (in milliseconds) to *acc.
+// A null accumulator turns the timer into a no-op, so profiling can be switched off cheaply.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(double* acc) : m_acc(acc) {
+        if (m_acc) m_start = clock::now();
+    }
+    ~ScopedTimer() {
+        if (m_acc) *m_acc += std::chrono::duration<double, std::milli>(clock::now() - m_start).count();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    using clock = std::chrono::steady_clock;
+    double* m_acc;
+    clock::time_point m_start;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+
+// Lock-free handoff of the latest value from one writer thread to one reader thread. The
+// writer fills back() and publish()es it; the reader acquire()s the newest published value
+// into front(). Three slots are swapped through one atomic index, so neither side waits for
+// the other: the reader always holds a complete value (values published in between are
+// skipped) and the writer always has a slot of its own to fill. A slot that comes back to a
+// side holds whatever was last written into it, so its storage can be reused.
+template<class T>
+class TripleBuffer {
+public:
+    // Writer side
+    T& back() { return m_slots[m_back]; }
+    void publish() {
+        m_back = m_middle.exchange(m_back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // Reader side: true if front() changed.
+    bool acquire() {
+        if (!(m_middle.load(std::memory_order_relaxed) & kFresh)) return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+    const T& front() const { return m_slots[m_front]; }
+
+private:
+    static const int kIndex = 3, kFresh = 4;
+
+    T m_slots[3];
+    int m_back = 0, m_front = 1;     // each owned by its side
+    std::atomic<int> m_middle{2};    // slot index, | kFresh when unread
+};
@@ -1,3 +1,30 @@
 #pragma once
-// Grid index helper – matches Stam’s IX macro
-#define IX(i,j,N) ((i) + ((N)+2) * (j))
+#include <cstddef>
+#include <vector>
+#include "AlignedAllocator.h"
+
+// Rows are padded to a multiple of FLUID_ROW_ALIGN floats (16 = 64 bytes), so with an aligned
+// base every row starts on a cache line. Build with FLUID_ROW_ALIGN=1 for the plain N+2 stride.
+#ifndef FLUID_ROW_ALIGN
+#define FLUID_ROW_ALIGN 16
+#endif
+#define FLUID_STRIDE(N) (((N)+2+FLUID_ROW_ALIGN-1)/FLUID_ROW_ALIGN*FLUID_ROW_ALIGN)
+
+// Grid index helper – matches Stam’s IX macro, with the padded row stride. N is the row
+// length: on an Nx x Ny grid it is Nx.
+#define IX(i,j,N) ((i) + FLUID_STRIDE(N) * (j))
+
+// Floats in one field of an Nx x Ny grid with ghost cells (Ny+2 rows of FLUID_STRIDE(Nx)).
+inline std::size_t fieldSize(int Nx, int Ny){ return std::size_t(FLUID_STRIDE(Nx))*(Ny+2); }
+inline std::size_t fieldSize(int N){ return fieldSize(N, N); }
+
+// assign() that grows the capacity by half again, not to the exact size, so an array whose
+// size creeps up from one step to the next does not reallocate at every step.
+template<class T, class A>
+void assignGrowing(std::vector<T, A>& v, std::size_t n, const typename std::vector<T, A>::value_type& value) {
+    if (n > v.capacity()) v.reserve(n + n / 2);
+    v.assign(n, value);
+}
+
+// Storage of one grid field: 64-byte aligned, so with the padded stride every row is too.
+using Field = std::vector<float, AlignedAllocator<float>>;
@@ -0,0 +1,218 @@
+#include "AdvectKernels.h"
+#include "Util.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+// ===== scalar kernel ========================================================
+// Backtrace and weights are computed once per cell and applied to each of the count fields.
+// N is the row length Nx; backtraces are clamped to the Nx x Ny interior plus half a cell.
+static inline void advectCell(int N,int Ny,int i,int j,float dt0,int count,float* const* d,const float* const* d0,
+                              const float* u,const float* v){
+    float x=i-dt0*u[IX(i,j,N)], y=j-dt0*v[IX(i,j,N)];
+    // !(x>=0.5f) also catches NaN, which the SIMD max clamps to 0.5 too: a velocity that
+    // blew up must not index outside the grid.
+    if(!(x>=0.5f)) x=0.5f;
+    if(x>N+0.5f) x=N+0.5f;
+    if(!(y>=0.5f)) y=0.5f;
+    if(y>Ny+0.5f) y=Ny+0.5f;
+    int i0=int(x), i1=i0+1, j0=int(y), j1=j0+1;
+    float s1=x-i0, s0=1-s1, t1=y-j0, t0=1-t1;
+    for(int f=0;f<count;++f){
+        const float* src=d0[f];
+        d[f][IX(i,j,N)] =
+            s0*(t0*src[IX(i0,j0,N)]+t1*src[IX(i0,j1,N)]) +
+            s1*(t0*src[IX(i1,j0,N)]+t1*src[IX(i1,j1,N)]);
+    }
+}
+
+// Cells i..i1 of row j.
+static void rowScalar(int N,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                      const float* u,const float* v,int j,int i,int i1){
+    for(;i<=i1;++i) advectCell(N,Ny,i,j,dt0,count,d,d0,u,v);
+}
+
+#ifdef FLUID_X86_DISPATCH
+// ===== SIMD kernels =========================================================
+// Each vector kernel mirrors advectCell lane by lane. With Fused=false every multiply and
+// add is rounded separately in the same order as the scalar code, so results match it bit
+// for bit; Fused=true contracts them into FMAs. The remainder of a row goes to rowScalar.
+// This relies on the compiler not contracting on its own: the file is built with
+// -ffp-contract=off (see CMakeLists.txt).
+
+__attribute__((target("sse2")))
+static void rowSSE2(int N,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                    const float* u,const float* v,int j,int i,int i1){
+    const int S=IX(0,1,N), row=IX(0,j,N);
+    const __m128 vdt0=_mm_set1_ps(dt0), lo=_mm_set1_ps(0.5f), hi=_mm_set1_ps(N+0.5f), one=_mm_set1_ps(1.f);
+    const __m128 hiy=_mm_set1_ps(Ny+0.5f);
+    const __m128 yj=_mm_set1_ps(float(j));
+    const __m128i lane=_mm_setr_epi32(0,1,2,3);
+    alignas(16) int ii[4], jj[4], kk[4];
+    alignas(16) float a[4], b[4], c[4], e[4];
+    for(;i+3<=i1;i+=4){
+        __m128 xi=_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i),lane));
+        __m128 x=_mm_sub_ps(xi,_mm_mul_ps(vdt0,_mm_loadu_ps(u+row+i)));
+        __m128 y=_mm_sub_ps(yj,_mm_mul_ps(vdt0,_mm_loadu_ps(v+row+i)));
+        x=_mm_min_ps(_mm_max_ps(x,lo),hi);
+        y=_mm_min_ps(_mm_max_ps(y,lo),hiy);
+        __m128i i0=_mm_cvttps_epi32(x), j0=_mm_cvttps_epi32(y);
+        __m128 s1=_mm_sub_ps(x,_mm_cvtepi32_ps(i0)), s0=_mm_sub_ps(one,s1);
+        __m128 t1=_mm_sub_ps(y,_mm_cvtepi32_ps(j0)), t0=_mm_sub_ps(one,t1);
+        // no gather (or 32-bit multiply) in SSE2: fetch the four taps per lane
+        _mm_store_si128((__m128i*)ii,i0); _mm_store_si128((__m128i*)jj,j0);
+        for(int l=0;l<4;++l) kk[l]=ii[l]+S*jj[l];
+        for(int f=0;f<count;++f){
+            const float* src=d0[f];
+            for(int l=0;l<4;++l){
+                int k=kk[l];
+                a[l]=src[k]; b[l]=src[k+S]; c[l]=src[k+1]; e[l]=src[k+S+1];
+            }
+            __m128 L=_mm_add_ps(_mm_mul_ps(t0,_mm_load_ps(a)),_mm_mul_ps(t1,_mm_load_ps(b)));
+            __m128 R=_mm_add_ps(_mm_mul_ps(t0,_mm_load_ps(c)),_mm_mul_ps(t1,_mm_load_ps(e)));
+            _mm_storeu_ps(d[f]+row+i,_mm_add_ps(_mm_mul_ps(s0,L),_mm_mul_ps(s1,R)));
+        }
+    }
+    rowScalar(N,Ny,dt0,count,d,d0,u,v,j,i,i1);
+}
+
+template<bool Fused>
+__attribute__((target("avx2,fma")))
+static void rowAVX2(int N,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                    const float* u,const float* v,int j,int i,int i1){
+    const int S=IX(0,1,N), row=IX(0,j,N);
+    const __m256 vdt0=_mm256_set1_ps(dt0), lo=_mm256_set1_ps(0.5f), hi=_mm256_set1_ps(N+0.5f), one=_mm256_set1_ps(1.f);
+    const __m256 hiy=_mm256_set1_ps(Ny+0.5f);
+    const __m256 yj=_mm256_set1_ps(float(j));
+    const __m256i lane=_mm256_setr_epi32(0,1,2,3,4,5,6,7), vS=_mm256_set1_epi32(S), ione=_mm256_set1_epi32(1);
+    for(;i+7<=i1;i+=8){
+        __m256 xi=_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i),lane));
+        __m256 uu=_mm256_loadu_ps(u+row+i), vv=_mm256_loadu_ps(v+row+i);
+        __m256 x,y;
+        if(Fused){ x=_mm256_fnmadd_ps(vdt0,uu,xi); y=_mm256_fnmadd_ps(vdt0,vv,yj); }
+        else     { x=_mm256_sub_ps(xi,_mm256_mul_ps(vdt0,uu)); y=_mm256_sub_ps(yj,_mm256_mul_ps(vdt0,vv)); }
+        x=_mm256_min_ps(_mm256_max_ps(x,lo),hi);
+        y=_mm256_min_ps(_mm256_max_ps(y,lo),hiy);
+        __m256i i0=_mm256_cvttps_epi32(x), j0=_mm256_cvttps_epi32(y);
+        __m256 s1=_mm256_sub_ps(x,_mm256_cvtepi32_ps(i0)), s0=_mm256_sub_ps(one,s1);
+        __m256 t1=_mm256_sub_ps(y,_mm256_cvtepi32_ps(j0)), t0=_mm256_sub_ps(one,t1);
+        __m256i k00=_mm256_add_epi32(i0,_mm256_mullo_epi32(j0,vS));
+        __m256i k01=_mm256_add_epi32(k00,vS), k10=_mm256_add_epi32(k00,ione), k11=_mm256_add_epi32(k01,ione);
+        for(int f=0;f<count;++f){
+            const float* src=d0[f];
+            __m256 a=_mm256_i32gather_ps(src,k00,4);
+            __m256 b=_mm256_i32gather_ps(src,k01,4);
+            __m256 c=_mm256_i32gather_ps(src,k10,4);
+            __m256 e=_mm256_i32gather_ps(src,k11,4);
+            __m256 res;
+            if(Fused){
+                __m256 L=_mm256_fmadd_ps(t0,a,_mm256_mul_ps(t1,b));
+                __m256 R=_mm256_fmadd_ps(t0,c,_mm256_mul_ps(t1,e));
+                res=_mm256_fmadd_ps(s0,L,_mm256_mul_ps(s1,R));
+            } else {
+                __m256 L=_mm256_add_ps(_mm256_mul_ps(t0,a),_mm256_mul_ps(t1,b));
+                __m256 R=_mm256_add_ps(_mm256_mul_ps(t0,c),_mm256_mul_ps(t1,e));
+                res=_mm256_add_ps(_mm256_mul_ps(s0,L),_mm256_mul_ps(s1,R));
+            }
+            _mm256_storeu_ps(d[f]+row+i,res);
+        }
+    }
+    rowScalar(N,Ny,dt0,count,d,d0,u,v,j,i,i1);
+}
+
+template<bool Fused>
+__attribute__((target("avx512f")))
+static void rowAVX512(int N,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                      const float* u,const float* v,int j,int i,int i1){
+    const int S=IX(0,1,N), row=IX(0,j,N);
+    const __m512 vdt0=_mm512_set1_ps(dt0), lo=_mm512_set1_ps(0.5f), hi=_mm512_set1_ps(N+0.5f), one=_mm512_set1_ps(1.f);
+    const __m512 hiy=_mm512_set1_ps(Ny+0.5f);
+    const __m512 yj=_mm512_set1_ps(float(j));
+    const __m512i lane=_mm512_setr_epi32(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+    const __m512i vS=_mm512_set1_epi32(S), ione=_mm512_set1_epi32(1);
+    for(;i+15<=i1;i+=16){
+        __m512 xi=_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(i),lane));
+        __m512 uu=_mm512_loadu_ps(u+row+i), vv=_mm512_loadu_ps(v+row+i);
+        __m512 x,y;
+        if(Fused){ x=_mm512_fnmadd_ps(vdt0,uu,xi); y=_mm512_fnmadd_ps(vdt0,vv,yj); }
+        else     { x=_mm512_sub_ps(xi,_mm512_mul_ps(vdt0,uu)); y=_mm512_sub_ps(yj,_mm512_mul_ps(vdt0,vv)); }
+        x=_mm512_min_ps(_mm512_max_ps(x,lo),hi);
+        y=_mm512_min_ps(_mm512_max_ps(y,lo),hiy);
+        __m512i i0=_mm512_cvttps_epi32(x), j0=_mm512_cvttps_epi32(y);
+        __m512 s1=_mm512_sub_ps(x,_mm512_cvtepi32_ps(i0)), s0=_mm512_sub_ps(one,s1);
+        __m512 t1=_mm512_sub_ps(y,_mm512_cvtepi32_ps(j0)), t0=_mm512_sub_ps(one,t1);
+        __m512i k00=_mm512_add_epi32(i0,_mm512_mullo_epi32(j0,vS));
+        __m512i k01=_mm512_add_epi32(k00,vS), k10=_mm512_add_epi32(k00,ione), k11=_mm512_add_epi32(k01,ione);
+        for(int f=0;f<count;++f){
+            const float* src=d0[f];
+            __m512 a=_mm512_i32gather_ps(k00,src,4);
+            __m512 b=_mm512_i32gather_ps(k01,src,4);
+            __m512 c=_mm512_i32gather_ps(k10,src,4);
+            __m512 e=_mm512_i32gather_ps(k11,src,4);
+            __m512 res;
+            if(Fused){
+                __m512 L=_mm512_fmadd_ps(t0,a,_mm512_mul_ps(t1,b));
+                __m512 R=_mm512_fmadd_ps(t0,c,_mm512_mul_ps(t1,e));
+                res=_mm512_fmadd_ps(s0,L,_mm512_mul_ps(s1,R));
+            } else {
+                __m512 L=_mm512_add_ps(_mm512_mul_ps(t0,a),_mm512_mul_ps(t1,b));
+                __m512 R=_mm512_add_ps(_mm512_mul_ps(t0,c),_mm512_mul_ps(t1,e));
+                res=_mm512_add_ps(_mm512_mul_ps(s0,L),_mm512_mul_ps(s1,R));
+            }
+            _mm512_storeu_ps(d[f]+row+i,res);
+        }
+    }
+    rowScalar(N,Ny,dt0,count,d,d0,u,v,j,i,i1);
+}
+
+static AdvectIsa detectIsa(){
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return AdvectIsa::AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return AdvectIsa::AVX2;
+    if(__builtin_cpu_supports("sse2")) return AdvectIsa::SSE2;
+    return AdvectIsa::Scalar;
+}
+#else
+static AdvectIsa detectIsa(){ return AdvectIsa::Scalar; }
+#endif
+
+// ===== dispatch =============================================================
+static const AdvectIsa s_supported=detectIsa();
+static AdvectIsa s_isa=s_supported;
+
+AdvectIsa advectIsa(){ return s_isa; }
+
+void forceAdvectIsa(AdvectIsa isa){
+    s_isa=std::min(isa,s_supported);
+}
+
+const char* advectIsaName(AdvectIsa isa){
+    switch(isa){
+        case AdvectIsa::SSE2:   return "sse2";
+        case AdvectIsa::AVX2:   return "avx2";
+        case AdvectIsa::AVX512: return "avx512";
+        default:                return "scalar";
+    }
+}
+
+void advectSpan(AdvectPath path,int Nx,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                const float* u,const float* v,int j,int i0,int i1){
+    AdvectIsa isa = path==AdvectPath::Scalar ? AdvectIsa::Scalar : s_isa;
+    bool fused = path==AdvectPath::Fast;
+    switch(isa){
+#ifdef FLUID_X86_DISPATCH
+        case AdvectIsa::AVX512: if(fused) rowAVX512<true>(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1); else rowAVX512<false>(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1); break;
+        case AdvectIsa::AVX2:   if(fused) rowAVX2<true>(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1);   else rowAVX2<false>(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1);   break;
+        case AdvectIsa::SSE2:   rowSSE2(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1); break;
+#endif
+        default:                rowScalar(Nx,Ny,dt0,count,d,d0,u,v,j,i0,i1); break;
+    }
+}
+
+void advectRows(AdvectPath path,int Nx,int Ny,float dt0,int count,float* const* d,const float* const* d0,
+                const float* u,const float* v,int j0,int j1){
+    for(int j=j0;j<j1;++j) advectSpan(path,Nx,Ny,dt0,count,d,d0,u,v,j,1,Nx);
+}
@@ -0,0 +1,299 @@
+#include "BodyPool.h"
+#include "MovableRectObstacle.h"
+#include "DiskObstacle.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define PI 3.1415926535f
+
+void BodyPool::Kinematics::clear() {
+    x.clear(); y.clear(); vx.clear(); vy.clear(); invMass.clear();
+}
+
+int BodyPool::Kinematics::add(const Vec2& pos, float vx_, float vy_, float invMass_) {
+    x.push_back(pos.x); y.push_back(pos.y);
+    vx.push_back(vx_);  vy.push_back(vy_);
+    invMass.push_back(invMass_);
+    return static_cast<int>(x.size()) - 1;
+}
+
+void BodyPool::clear() {
+    m_refs.clear();
+    m_rects.clear(); m_rects.hw.clear(); m_rects.hh.clear(); m_rects.angle.clear();
+    m_rects.corners.clear();
+    m_rects.sinA.clear(); m_rects.cosA.clear(); m_rects.sinNeg.clear(); m_rects.cosNeg.clear();
+    m_disks.clear(); m_disks.radius.clear();
+}
+
+int BodyPool::addRect(const MovableRectObstacle& rect) {
+    int slot = m_rects.add(Vec2(), 0.f, 0.f, 0.f);
+    for (auto* field : {&m_rects.hw, &m_rects.hh, &m_rects.angle, &m_rects.sinA, &m_rects.cosA,
+                        &m_rects.sinNeg, &m_rects.cosNeg})
+        field->push_back(0.f);
+    m_rects.corners.resize(m_rects.corners.size() + 4);
+    m_refs.push_back({Rect, slot});
+    refreshRect(size() - 1, rect);
+    return size() - 1;
+}
+
+int BodyPool::addDisk(const DiskObstacle& disk) {
+    int slot = m_disks.add(Vec2(), 0.f, 0.f, 0.f);
+    m_disks.radius.push_back(0.f);
+    m_refs.push_back({Disk, slot});
+    refreshDisk(size() - 1, disk);
+    return size() - 1;
+}
+
+void BodyPool::refreshRect(int body, const MovableRectObstacle& rect) {
+    int s = m_refs[body].slot;
+    Vec2 pos = rect.getPosition();
+    m_rects.x[s] = pos.x; m_rects.y[s] = pos.y;
+    rect.getVelocity(m_rects.vx[s], m_rects.vy[s]);
+    m_rects.invMass[s] = rect.getInverseMass();
+    float hw = rect.getWidth() / 2.f, hh = rect.getHeight() / 2.f;
+    m_rects.hw[s] = hw;
+    m_rects.hh[s] = hh;
+    m_rects.angle[s] = rect.getAngle();
+
+    float rads = rect.getAngle() * PI / 180.0f;
+    float sn = std::sin(rads), cs = std::cos(rads);
+    m_rects.sinA[s] = sn; m_rects.cosA[s] = cs;
+    m_rects.sinNeg[s] = std::sin(-rads); m_rects.cosNeg[s] = std::cos(-rads);
+    const Vec2 local[4] = { Vec2(-hw, -hh), Vec2(hw, -hh), Vec2(hw, hh), Vec2(-hw, hh) };
+    for (int k = 0; k < 4; ++k)
+        m_rects.corners[4 * size_t(s) + k] = Vec2(local[k].x * cs - local[k].y * sn, local[k].x * sn + local[k].y * cs);
+}
+
+void BodyPool::refreshDisk(int body, const DiskObstacle& disk) {
+    int s = m_refs[body].slot;
+    Vec2 pos = disk.getPosition();
+    m_disks.x[s] = pos.x; m_disks.y[s] = pos.y;
+    disk.getVelocity(m_disks.vx[s], m_disks.vy[s]);
+    m_disks.invMass[s] = disk.getInverseMass();
+    m_disks.radius[s] = disk.getRadius();
+}
+
+Vec2 BodyPool::position(int body) const {
+    const Kinematics& k = kinematics(m_refs[body].shape);
+    int s = m_refs[body].slot;
+    return {k.x[s], k.y[s]};
+}
+
+void BodyPool::velocity(int body, float& vx, float& vy) const {
+    const Kinematics& k = kinematics(m_refs[body].shape);
+    int s = m_refs[body].slot;
+    vx = k.vx[s]; vy = k.vy[s];
+}
+
+// ===== shapes =====
+// Same arithmetic as the obstacle classes' own getCenter/getVertices/contains, so a pooled
+// step gives the obstacles the exact positions they would have computed themselves.
+
+static Vec2 rectCenter(const BodyPool::Rects& r, int s) {
+    return Vec2(r.x[s], r.y[s]) + Vec2(r.hw[s], r.hh[s]);
+}
+
+static void rectVertices(const BodyPool::Rects& r, int s, Vec2 (&v)[4]) {
+    Vec2 center = rectCenter(r, s);
+    const Vec2* corner = &r.corners[4 * size_t(s)];
+    for (int i = 0; i < 4; ++i) v[i] = Vec2(corner[i].x + center.x, corner[i].y + center.y);
+}
+
+static bool rectContains(const BodyPool::Rects& r, int s, int x, int y) {
+    Vec2 center = rectCenter(r, s);
+    float tx = static_cast<float>(x) - center.x;
+    float ty = static_cast<float>(y) - center.y;
+    float sin_angle = r.sinNeg[s];
+    float cos_angle = r.cosNeg[s];
+    float rotated_x = tx * cos_angle - ty * sin_angle;
+    float rotated_y = tx * sin_angle + ty * cos_angle;
+    return std::abs(rotated_x) <= r.hw[s] && std::abs(rotated_y) <= r.hh[s];
+}
+
+void BodyPool::bounds(int body, Vec2& lo, Vec2& hi) const {
+    int s = m_refs[body].slot;
+    if (m_refs[body].shape == Disk) {
+        float r = m_disks.radius[s];
+        Vec2 c(m_disks.x[s], m_disks.y[s]);
+        lo = c - Vec2(r, r);
+        hi = c + Vec2(r, r);
+        return;
+    }
+    float sn = std::abs(m_rects.sinA[s]), cs = std::abs(m_rects.cosA[s]);
+    Vec2 half(m_rects.hw[s] * cs + m_rects.hh[s] * sn, m_rects.hw[s] * sn + m_rects.hh[s] * cs);
+    lo = rectCenter(m_rects, s) - half;
+    hi = rectCenter(m_rects, s) + half;
+}
+
+// ===== narrowphase =====
+
+// Rect-Rect (SAT)
+static bool rectRect(const BodyPool& pool, int a, int b, Vec2& mtv) {
+    const BodyPool::Rects& r = pool.rects();
+    Vec2 verticesA[4], verticesB[4], axes[8];
+    rectVertices(r, a, verticesA);
+    rectVertices(r, b, verticesB);
+    for (int i = 0; i < 4; ++i) {
+        axes[2 * i]     = (verticesA[(i + 1) % 4] - verticesA[i]).perpendicular().normalized();
+        axes[2 * i + 1] = (verticesB[(i + 1) % 4] - verticesB[i]).perpendicular().normalized();
+    }
+
+    float min_overlap = std::numeric_limits<float>::max();
+    for (const Vec2& axis : axes) {
+        float minA = std::numeric_limits<float>::max(), maxA = -std::numeric_limits<float>::max();
+        for (const Vec2& v : verticesA) { float p = v.dot(axis); minA = std::min(minA, p); maxA = std::max(maxA, p); }
+        float minB = std::numeric_limits<float>::max(), maxB = -std::numeric_limits<float>::max();
+        for (const Vec2& v : verticesB) { float p = v.dot(axis); minB = std::min(minB, p); maxB = std::max(maxB, p); }
+
+        if (maxA < minB || maxB < minA) return false;
+
+        float overlap = std::min(maxA, maxB) - std::max(minA, minB);
+        if (overlap < min_overlap) {
+            min_overlap = overlap;
+            mtv = axis;
+        }
+    }
+
+    // Point mtv from a to b, then give it its length
+    Vec2 dir = rectCenter(r, b) - rectCenter(r, a);
+    if (dir.dot(mtv) < 0) mtv = -mtv;
+    mtv = mtv.normalized() * min_overlap;
+    return true;
+}
+
+// Disk-Disk
+static bool diskDisk(const BodyPool& pool, int a, int b, Vec2& mtv) {
+    const BodyPool::Disks& d = pool.disks();
+    Vec2 distVec = Vec2(d.x[b], d.y[b]) - Vec2(d.x[a], d.y[a]);
+    float distSq = distVec.lenSq();
+    float totalRadius = d.radius[a] + d.radius[b];
+
+    if (distSq >= totalRadius * totalRadius) return false;
+
+    float dist = std::sqrt(distSq);
+    float overlap = totalRadius - dist;
+    // Coincident centres: push apart along x
+    mtv = dist > 0 ? (distVec / dist) * overlap : Vec2(overlap, 0);
+    return true;
+}
+
+// Rect-Disk
+static bool rectDisk(const BodyPool& pool, int rect, int disk, Vec2& mtv) {
+    const BodyPool::Rects& r = pool.rects();
+    const BodyPool::Disks& d = pool.disks();
+    Vec2 vertices[4];
+    rectVertices(r, rect, vertices);
+    Vec2 diskCenter(d.x[disk], d.y[disk]);
+    float diskRadius = d.radius[disk];
+
+    // Closest point on the rect's edges to the disk centre...
+    Vec2 closestPoint = diskCenter;
+    float minDistSq = std::numeric_limits<float>::max();
+    for (int i = 0; i < 4; ++i) {
+        Vec2 p1 = vertices[i];
+        Vec2 edge = vertices[(i + 1) % 4] - p1;
+        Vec2 pointVec = diskCenter - p1;
+
+        float t = edge.dot(pointVec) / edge.lenSq();
+        t = std::max(0.f, std::min(1.f, t));
+
+        Vec2 currentClosest = p1 + edge * t;
+        float distSq = (diskCenter - currentClosest).lenSq();
+        if (distSq < minDistSq) {
+            minDistSq = distSq;
+            closestPoint = currentClosest;
+        }
+    }
+    // ... or the centre itself when it is inside the rect
+    if (rectContains(r, rect, static_cast<int>(diskCenter.x), static_cast<int>(diskCenter.y))) {
+        closestPoint = diskCenter;
+    }
+
+    Vec2 delta = diskCenter - closestPoint;
+    float distSq = delta.lenSq();
+    if (distSq >= diskRadius * diskRadius) return false;
+
+    float dist = std::sqrt(distSq);
+    float overlap = diskRadius - dist;
+    // Centre on the boundary: fall back to the direction between the centres
+    mtv = dist > 0 ? (delta / dist) * overlap : (diskCenter - rectCenter(r, rect)).normalized() * overlap;
+    return true;
+}
+
+static bool diskRect(const BodyPool& pool, int disk, int rect, Vec2& mtv) {
+    if (!rectDisk(pool, rect, disk, mtv)) return false;
+    mtv = -mtv;
+    return true;
+}
+
+typedef bool (*PairTest)(const BodyPool&, int, int, Vec2&);
+static const PairTest kPairTests[BodyPool::ShapeCount][BodyPool::ShapeCount] = {
+    { rectRect, rectDisk },
+    { diskRect, diskDisk },
+};
+
+bool BodyPool::collide(int a, int b, Vec2& mtv) const {
+    const Ref& ra = m_refs[a];
+    const Ref& rb = m_refs[b];
+    return kPairTests[ra.shape][rb.shape](*this, ra.slot, rb.slot, mtv);
+}
+
+// ===== resolution =====
+
+// Sequential impulses: every visit moves the pair's accumulated normal impulse towards the
+// one that brings their normal velocity to c.bias, clamped at 0. Overlap is taken out in two
+// ways that leave the contact in place for the next step: a small push, straight on the
+// positions, and a separation speed in the bias that closes a share of the depth over the
+// next dt. A full push per visit would leave gaps that the next approach turns into speed.
+void BodyPool::resolve(int a, int b, const Vec2& mtv, ContactCache::Contact& c, bool fresh, float dt) {
+    Kinematics& ka = kinematics(m_refs[a].shape);
+    Kinematics& kb = kinematics(m_refs[b].shape);
+    int sa = m_refs[a].slot, sb = m_refs[b].slot;
+    float invMassA = ka.invMass[sa];
+    float invMassB = kb.invMass[sb];
+    float totalInvMass = invMassA + invMassB;
+
+    if (totalInvMass == 0) return;
+
+    const float push = 0.2f;        // share of the depth pushed out per visit
+    const float baumgarte = 0.2f;   // share of the depth the bias closes over the next dt
+    const float slop = 0.01f;       // depth left alone, so a resting contact stays touching
+    const float restitution = 0.3f; // Bounciness. 0 = no bounce, 1 = perfect bounce.
+    const float bounceSpeed = 1.f;  // slower approaches come to rest instead of bouncing
+
+    // mtv points from a to b: a moves back along it, b forward.
+    float depth = mtv.len();
+    Vec2 normal = mtv.normalized();
+    if (depth > slop) {
+        Vec2 correction = normal * (push * (depth - slop) / totalInvMass);
+        ka.x[sa] -= correction.x * invMassA; ka.y[sa] -= correction.y * invMassA;
+        kb.x[sb] += correction.x * invMassB; kb.y[sb] += correction.y * invMassB;
+    }
+
+    Vec2 velA(ka.vx[sa], ka.vy[sa]);
+    Vec2 velB(kb.vx[sb], kb.vy[sb]);
+    if (fresh) {
+        // Warm start with what held the pair last step, as far as the contact still faces
+        // the same way (the SAT axis can flip between steps), then aim for a bounce off the
+        // approach speed that is left, or for closing the depth.
+        c.impulse *= std::max(c.normal.dot(normal), 0.f);
+        Vec2 warm = normal * c.impulse;
+        velA -= warm * invMassA;
+        velB += warm * invMassB;
+        float approach = (velB - velA).dot(normal);
+        c.bias = approach < -bounceSpeed ? -restitution * approach : 0.f;
+        if (dt > 0) c.bias = std::max(c.bias, baumgarte * std::max(depth - slop, 0.f) / dt);
+    }
+    c.normal = normal;
+
+    // The impulse that brings the normal velocity to the bias, clamped so that the total
+    // over the step never pulls the bodies together.
+    float velAlongNormal = (velB - velA).dot(normal);
+    float total = std::max(c.impulse + (c.bias - velAlongNormal) / totalInvMass, 0.f);
+    Vec2 impulse = normal * (total - c.impulse);
+    c.impulse = total;
+
+    ka.vx[sa] = velA.x - impulse.x * invMassA; ka.vy[sa] = velA.y - impulse.y * invMassA;
+    kb.vx[sb] = velB.x + impulse.x * invMassB; kb.vy[sb] = velB.y + impulse.y * invMassB;
+}
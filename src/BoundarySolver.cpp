@@ -1,15 +1,26 @@
 #include "BoundarySolver.h"
 #include "Util.h"
 
-void BoundarySolver::setBounds(int N,int b,float* x){
-    for(int i=1;i<=N;++i){
-        x[IX(0 ,i,N)] = b==1? -x[IX(1 ,i,N)] : x[IX(1 ,i,N)];
-        x[IX(N+1,i,N)] = b==1? -x[IX(N,i,N)]  : x[IX(N,i,N)];
+void BoundarySolver::setBounds(int Nx,int Ny,int b,float* x){
+    const int N=Nx; // row length for IX
+    for(int j=1;j<=Ny;++j){
+        x[IX(0 ,j,N)] = b==1? -x[IX(1 ,j,N)] : x[IX(1 ,j,N)];
+        x[IX(Nx+1,j,N)] = b==1? -x[IX(Nx,j,N)]  : x[IX(Nx,j,N)];
+    }
+    for(int i=1;i<=Nx;++i){
         x[IX(i,0 ,N)] = b==2? -x[IX(i,1 ,N)] : x[IX(i,1 ,N)];
-        x[IX(i,N+1,N)] = b==2? -x[IX(i,N ,N)] : x[IX(i,N ,N)];
+        x[IX(i,Ny+1,N)] = b==2? -x[IX(i,Ny ,N)] : x[IX(i,Ny ,N)];
     }
     x[IX(0 ,0 ,N)]       = .5f*(x[IX(1 ,0 ,N)]+x[IX(0 ,1 ,N)]);
-    x[IX(0 ,N+1,N)]     = .5f*(x[IX(1 ,N+1,N)]+x[IX(0 ,N ,N)]);
-    x[IX(N+1,0 ,N)]     = .5f*(x[IX(N ,0 ,N)]+x[IX(N+1,1 ,N)]);
-    x[IX(N+1,N+1,N)]   = .5f*(x[IX(N ,N+1,N)]+x[IX(N+1,N ,N)]);
+    x[IX(0 ,Ny+1,N)]     = .5f*(x[IX(1 ,Ny+1,N)]+x[IX(0 ,Ny ,N)]);
+    x[IX(Nx+1,0 ,N)]     = .5f*(x[IX(Nx ,0 ,N)]+x[IX(Nx+1,1 ,N)]);
+    x[IX(Nx+1,Ny+1,N)]   = .5f*(x[IX(Nx ,Ny+1,N)]+x[IX(Nx+1,Ny ,N)]);
+}
+
+void BoundarySolver::setRowBounds(int Nx,int Ny,int b,int j,float* x){
+    const int N=Nx;
+    x[IX(0 ,j,N)] = b==1? -x[IX(1 ,j,N)] : x[IX(1 ,j,N)];
+    x[IX(Nx+1,j,N)] = b==1? -x[IX(Nx,j,N)]  : x[IX(Nx,j,N)];
+    if(j==1)  for(int i=1;i<=Nx;++i) x[IX(i,0 ,N)] = b==2? -x[IX(i,1 ,N)] : x[IX(i,1 ,N)];
+    if(j==Ny) for(int i=1;i<=Nx;++i) x[IX(i,Ny+1,N)] = b==2? -x[IX(i,Ny ,N)] : x[IX(i,Ny ,N)];
 }
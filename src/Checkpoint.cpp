@@ -0,0 +1,478 @@
+#include "Checkpoint.h"
+#include "FluidGrid.h"
+#include "FluidSolver.h"
+#include "ObstacleManager.h"
+#include "ObstacleVisitor.h"
+#include "RectObstacle.h"
+#include "MovableRectObstacle.h"
+#include "DiskObstacle.h"
+#include "Timer.h"
+#include "Util.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char Magic[8] = {'F', 'L', 'U', 'I', 'D', 'C', 'K', 'P'};
+
+uint64_t alignUp(uint64_t n) {
+    return (n + CheckpointAlignment - 1) / CheckpointAlignment * CheckpointAlignment;
+}
+
+struct BodyCollector : ObstacleVisitor {
+    std::vector<CheckpointBody>& out;
+    explicit BodyCollector(std::vector<CheckpointBody>& bodies) : out(bodies) {}
+
+    static CheckpointBody movable(ObstacleType type, const MovableObstacle& m) {
+        CheckpointBody b = CheckpointBody();
+        MovableObstacle::State s = m.state();
+        b.type = uint32_t(type);
+        b.asleep = s.asleep;
+        b.x = s.x; b.y = s.y; b.angle = s.angle;
+        b.vx = s.vx; b.vy = s.vy; b.angularVelocity = s.angularVelocity;
+        b.restTime = s.restTime;
+        return b;
+    }
+
+    void visit(const RectObstacle& r) override {
+        CheckpointBody b = CheckpointBody();
+        b.type = uint32_t(ObstacleType::FixedRect);
+        b.x = r.getX(); b.y = r.getY(); b.w = r.getWidth(); b.h = r.getHeight();
+        out.push_back(b);
+    }
+    void visit(const MovableRectObstacle& r) override {
+        CheckpointBody b = movable(ObstacleType::MovableRect, r);
+        b.w = float(r.getWidth()); b.h = float(r.getHeight());
+        out.push_back(b);
+    }
+    void visit(const DiskObstacle& d) override {
+        CheckpointBody b = movable(ObstacleType::Disk, d);
+        b.w = d.getRadius();
+        out.push_back(b);
+    }
+};
+
+CheckpointArray makeArray(CheckpointArray::Kind kind, const char* name, int scalar = -1, float diffusivity = 0.f) {
+    CheckpointArray a = CheckpointArray();
+    a.kind = kind;
+    a.scalar = scalar;
+    a.diffusivity = diffusivity;
+    std::strncpy(a.name, name, sizeof(a.name) - 1);
+    return a;
+}
+
+// Names are zero-terminated unless the file is damaged
+std::string arrayName(const CheckpointArray& a) {
+    return std::string(a.name, std::find(a.name, a.name + sizeof(a.name), '\0'));
+}
+
+MovableObstacle::State bodyState(const CheckpointBody& b) {
+    return MovableObstacle::State{b.x, b.y, b.angle, b.vx, b.vy, b.angularVelocity, b.restTime, b.asleep != 0};
+}
+
+} // namespace
+
+// ===== CheckpointImage ======================================================
+
+void CheckpointImage::capture(FluidGrid& grid, const FluidSolver& solver, const ObstacleManager* obstacles,
+                              long long step) {
+    const int N = grid.nx(), Ny = grid.ny();
+    const uint64_t fieldBytes = fieldSize(N, Ny) * sizeof(float);
+    TileMap& tiles = grid.scalarTiles();
+    const int Tx = tiles.tilesX(), Ty = tiles.tilesY();
+
+    // The arrays and where their contents come from
+    std::vector<CheckpointArray>& arrays = m_arrays;
+    std::vector<const float*>& sources = m_sources;
+    arrays.clear(); sources.clear();
+    auto field = [&](CheckpointArray a, const float* src) {
+        a.bytes = fieldBytes;
+        arrays.push_back(a); sources.push_back(src);
+    };
+    field(makeArray(CheckpointArray::U, "u"), grid.u());
+    field(makeArray(CheckpointArray::V, "v"), grid.v());
+    field(makeArray(CheckpointArray::UPrev, "u_prev"), grid.uPrev());
+    field(makeArray(CheckpointArray::VPrev, "v_prev"), grid.vPrev());
+    field(makeArray(CheckpointArray::Vorticity, "vorticity"), grid.vort());
+    field(makeArray(CheckpointArray::Pressure, "pressure"), grid.pressure());
+    for (int k = 0; k < grid.scalarCount(); ++k) {
+        const char* name = grid.scalarName(k).c_str();
+        field(makeArray(CheckpointArray::Scalar, name, k, grid.scalarDiffusivity(k)), grid.scalar(k));
+        field(makeArray(CheckpointArray::ScalarSource, name, k), grid.scalarSource(k));
+    }
+    CheckpointArray tileArray = makeArray(CheckpointArray::ScalarTiles, "scalar_tiles");
+    tileArray.bytes = uint64_t(Tx) * Ty;
+    arrays.push_back(tileArray); sources.push_back(nullptr);
+
+    std::vector<CheckpointBody>& bodies = m_bodies;
+    bodies.clear();
+    if (obstacles) {
+        BodyCollector collector(bodies);
+        obstacles->accept(collector);
+    }
+
+    // Layout
+    CheckpointHeader h = CheckpointHeader();
+    std::memcpy(h.magic, Magic, sizeof(Magic));
+    h.version = CheckpointVersion;
+    h.byteOrder = CheckpointByteOrder;
+    h.headerBytes = sizeof(CheckpointHeader);
+    h.arrayBytes = sizeof(CheckpointArray);
+    h.bodyBytes = sizeof(CheckpointBody);
+    h.N = N;
+    h.Ny = Ny;
+    h.stride = FLUID_STRIDE(N);
+    h.arrayCount = uint32_t(arrays.size());
+    h.bodyCount = uint32_t(bodies.size());
+    h.scalarCount = uint32_t(grid.scalarCount());
+    h.step = step;
+    h.arraysOffset = alignUp(sizeof(CheckpointHeader));
+    h.bodiesOffset = alignUp(h.arraysOffset + arrays.size() * sizeof(CheckpointArray));
+    uint64_t end = alignUp(h.bodiesOffset + bodies.size() * sizeof(CheckpointBody));
+    for (CheckpointArray& a : arrays) {
+        a.offset = end;
+        end = alignUp(end + a.bytes);
+    }
+    h.fileBytes = end;
+
+    CheckpointParams& p = h.params;
+    p.dt = solver.dt; p.diff = solver.diff; p.visc = solver.visc; p.vort = solver.vort;
+    p.force = solver.force; p.source = solver.source;
+    p.buoyancy_factor = solver.buoyancy_factor; p.temp_diffusivity = solver.temp_diffusivity;
+    p.pressure_tolerance = solver.pressure_tolerance; p.tile_threshold = solver.tile_threshold;
+    p.pressure_solver = int32_t(solver.pressure_solver);
+    p.pressure_max_iterations = solver.pressure_max_iterations;
+    p.advect_path = int32_t(solver.advect_path);
+    p.buoyancy_on = solver.buoyancy_on; p.gs_wavefront = solver.gs_wavefront;
+    p.fused_forces = solver.fused_forces; p.active_tiles = solver.active_tiles;
+    p.pressure_warm = solver.pressureWarm();
+    if (obstacles) {
+        p.hasObstacles = 1;
+        p.sleepDelay = obstacles->sleepDelay;
+        p.collisionIterations = obstacles->collisionIterations;
+        p.broadphase = obstacles->broadphase; p.sleeping = obstacles->sleeping;
+    }
+
+    // Same size as last time: overwrite in place (the padding is still zero)
+    if (m_bytes.size() != end) m_bytes.assign(size_t(end), 0);
+    char* out = m_bytes.data();
+    std::memcpy(out, &h, sizeof(h));
+    std::memcpy(out + h.arraysOffset, arrays.data(), arrays.size() * sizeof(CheckpointArray));
+    if (!bodies.empty()) std::memcpy(out + h.bodiesOffset, bodies.data(), bodies.size() * sizeof(CheckpointBody));
+    for (size_t k = 0; k < arrays.size(); ++k) {
+        if (sources[k]) { std::memcpy(out + arrays[k].offset, sources[k], size_t(arrays[k].bytes)); continue; }
+        uint8_t* flags = reinterpret_cast<uint8_t*>(out + arrays[k].offset);
+        for (int tj = 0; tj < Ty; ++tj)
+            for (int ti = 0; ti < Tx; ++ti) flags[ti + Tx * tj] = tiles.active(ti, tj);
+    }
+}
+
+bool CheckpointImage::write(const std::string& path, std::string& error) const {
+    std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) { error = "cannot create " + tmp + ": " + std::strerror(errno); return false; }
+    bool ok = std::fwrite(m_bytes.data(), 1, m_bytes.size(), f) == m_bytes.size() && std::fflush(f) == 0;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(f)) == 0; // on disk before it replaces the old checkpoint
+#endif
+    if (std::fclose(f) != 0) ok = false;
+    if (!ok) { error = "cannot write " + tmp + ": " + std::strerror(errno); std::remove(tmp.c_str()); return false; }
+#ifdef _WIN32
+    std::remove(path.c_str()); // rename() does not replace an existing file there
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        error = "cannot rename " + tmp + " to " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// ===== CheckpointWriter =====================================================
+
+CheckpointWriter::CheckpointWriter() : m_thread([this] { run(); }) {}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+// The image to capture into is the one neither queued nor being written; the thread never
+// touches it, so the copy runs without the lock.
+bool CheckpointWriter::save(FluidGrid& grid, const FluidSolver& solver, const ObstacleManager* obstacles,
+                            long long step, const std::string& path) {
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queued >= 0) { ++m_stats.skipped; return false; }
+        slot = m_writing == 0 ? 1 : 0;
+    }
+    double ms = 0;
+    {
+        ScopedTimer t(&ms);
+        m_images[slot].capture(grid, solver, obstacles, step);
+    }
+    m_paths[slot] = path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.captureMs += ms;
+        m_queued = slot;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void CheckpointWriter::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_queued < 0 && m_writing < 0; });
+}
+
+CheckpointStats CheckpointWriter::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string CheckpointWriter::lastError() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+// Writes queued images until asked to quit; one queued at that point is still written.
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_quit || m_queued >= 0; });
+        if (m_queued < 0) return;
+        m_writing = m_queued;
+        m_queued = -1;
+        lock.unlock();
+
+        const CheckpointImage& image = m_images[m_writing];
+        std::string error;
+        double ms = 0;
+        bool ok;
+        {
+            ScopedTimer t(&ms);
+            ok = image.write(m_paths[m_writing], error);
+        }
+
+        lock.lock();
+        m_stats.writeMs += ms;
+        if (ok) { ++m_stats.written; m_stats.bytes = image.size(); }
+        else    { ++m_stats.failed; m_error = error; }
+        m_writing = -1;
+        m_done.notify_all();
+    }
+}
+
+// ===== CheckpointFile =======================================================
+
+bool CheckpointFile::fail(const std::string& why) {
+    close();
+    m_error = why;
+    return false;
+}
+
+bool CheckpointFile::open(const std::string& path) {
+    close();
+    m_error.clear();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail("cannot open " + path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) { ::close(fd); return fail("cannot stat " + path + ": " + std::strerror(errno)); }
+    m_size = size_t(st.st_size);
+    if (m_size < sizeof(CheckpointHeader)) { ::close(fd); return fail(path + " is too short for a checkpoint"); }
+    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file
+    if (p == MAP_FAILED) { m_size = 0; return fail("cannot map " + path + ": " + std::strerror(errno)); }
+    m_data = static_cast<const char*>(p);
+#else
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return fail("cannot open " + path + ": " + std::strerror(errno));
+    std::fseek(f, 0, SEEK_END);
+    long n = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    m_copy.assign(size_t(std::max(n, 0L)), 0);
+    bool ok = n >= long(sizeof(CheckpointHeader)) && std::fread(m_copy.data(), 1, m_copy.size(), f) == m_copy.size();
+    std::fclose(f);
+    if (!ok) return fail("cannot read " + path);
+    m_data = m_copy.data();
+    m_size = m_copy.size();
+#endif
+
+    // Check everything the accessors rely on, so nothing past this point reads out of bounds
+    const CheckpointHeader& h = header();
+    if (std::memcmp(h.magic, Magic, sizeof(Magic)) != 0) return fail(path + " is not a checkpoint");
+    if (h.byteOrder != CheckpointByteOrder) return fail(path + " was written with another byte order");
+    if (h.version < 1 || h.headerBytes < sizeof(CheckpointHeader) || h.arrayBytes < sizeof(CheckpointArray) ||
+        h.bodyBytes < sizeof(CheckpointBody))
+        return fail(path + " has an unknown checkpoint version " + std::to_string(h.version));
+    if (h.fileBytes > m_size) return fail(path + " is truncated");
+    if (h.N < 1 || h.Ny < 1 || h.stride < h.N + 2) return fail(path + " has a bad grid size");
+    if (h.arraysOffset > h.fileBytes || h.arrayCount > (h.fileBytes - h.arraysOffset) / h.arrayBytes ||
+        h.bodiesOffset > h.fileBytes || h.bodyCount > (h.fileBytes - h.bodiesOffset) / h.bodyBytes)
+        return fail(path + " has tables past its end");
+    for (int k = 0; k < arrayCount(); ++k) {
+        const CheckpointArray& a = array(k);
+        if (a.offset % CheckpointAlignment != 0 || a.offset > h.fileBytes || a.bytes > h.fileBytes - a.offset)
+            return fail(path + " has a misplaced array");
+    }
+    return true;
+}
+
+void CheckpointFile::close() {
+#ifndef _WIN32
+    if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+    m_copy.clear();
+    m_copy.shrink_to_fit();
+    m_data = nullptr;
+    m_size = 0;
+}
+
+const float* CheckpointFile::field(CheckpointArray::Kind kind, int scalar) const {
+    for (int k = 0; k < arrayCount(); ++k) {
+        const CheckpointArray& a = array(k);
+        if (a.kind == uint32_t(kind) && a.scalar == scalar) return static_cast<const float*>(data(a));
+    }
+    return nullptr;
+}
+
+bool CheckpointFile::restore(FluidGrid& grid, FluidSolver& solver, ObstacleManager* obstacles) {
+    if (!isOpen()) { m_error = "no checkpoint is open"; return false; }
+    const CheckpointHeader& h = header();
+    const int N = grid.nx(), Ny = grid.ny();
+    if (h.N != N || ny() != Ny) {
+        m_error = "the checkpoint is for a " + std::to_string(h.N) + "x" + std::to_string(ny()) + " grid, the grid is "
+                + std::to_string(N) + "x" + std::to_string(Ny);
+        return false;
+    }
+    if (h.stride != FLUID_STRIDE(N)) { m_error = "the checkpoint's rows are padded differently (FLUID_ROW_ALIGN)"; return false; }
+
+    // Validate every array before touching anything
+    const uint64_t fieldBytes = fieldSize(N, Ny) * sizeof(float);
+    const int Tx = grid.scalarTiles().tilesX(), Ty = grid.scalarTiles().tilesY();
+    const CheckpointArray* tiles = nullptr;
+    for (int k = 0; k < arrayCount(); ++k) {
+        const CheckpointArray& a = array(k);
+        bool scalar = a.kind == CheckpointArray::Scalar || a.kind == CheckpointArray::ScalarSource;
+        if (a.kind == CheckpointArray::ScalarTiles) {
+            if (a.bytes != uint64_t(Tx) * Ty) { m_error = "the checkpoint's tile map has the wrong size"; return false; }
+            tiles = &a;
+        } else if (a.kind > CheckpointArray::ScalarTiles) {
+            continue; // from a later version
+        } else if (a.bytes != fieldBytes || (scalar && (a.scalar < 0 || a.scalar >= int(h.scalarCount)))) {
+            m_error = "the checkpoint's array " + arrayName(a) + " does not fit the grid";
+            return false;
+        }
+    }
+    for (int k = 0; k < bodyCount(); ++k) {
+        uint32_t type = body(k).type;
+        if (type != uint32_t(ObstacleType::FixedRect) && type != uint32_t(ObstacleType::MovableRect) &&
+            type != uint32_t(ObstacleType::Disk)) {
+            m_error = "the checkpoint has an obstacle of unknown type " + std::to_string(type);
+            return false;
+        }
+    }
+
+    // Grid: scalars it lacks are added under the checkpoint's names
+    grid.reset();
+    while (grid.scalarCount() < int(h.scalarCount)) {
+        int s = grid.scalarCount();
+        std::string name = "scalar" + std::to_string(s);
+        for (int k = 0; k < arrayCount(); ++k)
+            if (array(k).kind == CheckpointArray::Scalar && array(k).scalar == s) name = arrayName(array(k));
+        grid.addScalar(name);
+    }
+    for (int k = 0; k < arrayCount(); ++k) {
+        const CheckpointArray& a = array(k);
+        float* dst = nullptr;
+        switch (a.kind) {
+            case CheckpointArray::U:            dst = grid.u(); break;
+            case CheckpointArray::V:            dst = grid.v(); break;
+            case CheckpointArray::UPrev:        dst = grid.uPrev(); break;
+            case CheckpointArray::VPrev:        dst = grid.vPrev(); break;
+            case CheckpointArray::Vorticity:    dst = grid.vort(); break;
+            case CheckpointArray::Pressure:     dst = grid.pressure(); break;
+            case CheckpointArray::ScalarSource: dst = grid.scalarSource(a.scalar); break;
+            case CheckpointArray::Scalar:
+                grid.setScalarDiffusivity(a.scalar, a.diffusivity);
+                dst = grid.scalar(a.scalar);
+                break;
+            default: break;
+        }
+        if (dst) std::memcpy(dst, data(a), size_t(a.bytes));
+    }
+    TileMap& map = grid.scalarTiles();
+    if (tiles) {
+        const uint8_t* flags = static_cast<const uint8_t*>(data(*tiles));
+        for (int tj = 0; tj < Ty; ++tj)
+            for (int ti = 0; ti < Tx; ++ti) {
+                if (flags[ti + Tx * tj]) map.set(ti, tj); else map.reset(ti, tj);
+            }
+        map.update();
+    } else {
+        map.fill();
+    }
+
+    // Parameters
+    const CheckpointParams& p = params();
+    solver.dt = p.dt; solver.diff = p.diff; solver.visc = p.visc; solver.vort = p.vort;
+    solver.force = p.force; solver.source = p.source;
+    solver.buoyancy_factor = p.buoyancy_factor; solver.temp_diffusivity = p.temp_diffusivity;
+    solver.pressure_tolerance = p.pressure_tolerance; solver.tile_threshold = p.tile_threshold;
+    solver.pressure_solver = PressureSolverType(p.pressure_solver);
+    solver.pressure_max_iterations = p.pressure_max_iterations;
+    solver.advect_path = AdvectPath(p.advect_path);
+    solver.buoyancy_on = p.buoyancy_on != 0; solver.gs_wavefront = p.gs_wavefront != 0;
+    solver.fused_forces = p.fused_forces != 0; solver.active_tiles = p.active_tiles != 0;
+    solver.setPressureWarm(p.pressure_warm != 0);
+
+    // Obstacles, in their saved order. The grid's solid mask was cleared with the reset, so
+    // the manager rasterizes them from scratch at the next step.
+    if (obstacles) {
+        obstacles->clear();
+        if (p.hasObstacles) {
+            obstacles->sleepDelay = p.sleepDelay;
+            obstacles->collisionIterations = p.collisionIterations;
+            obstacles->broadphase = p.broadphase != 0; obstacles->sleeping = p.sleeping != 0;
+        }
+        for (int k = 0; k < bodyCount(); ++k) {
+            const CheckpointBody& b = body(k);
+            switch (ObstacleType(b.type)) {
+                case ObstacleType::FixedRect:
+                    obstacles->addObstacle(std::unique_ptr<Obstacle>(
+                        new RectObstacle(int(b.x), int(b.y), int(b.w), int(b.h), N)));
+                    break;
+                case ObstacleType::MovableRect: {
+                    std::unique_ptr<MovableRectObstacle> r(new MovableRectObstacle(0, 0, int(b.w), int(b.h), N));
+                    r->setState(bodyState(b));
+                    obstacles->addObstacle(std::move(r));
+                    break;
+                }
+                case ObstacleType::Disk: {
+                    std::unique_ptr<DiskObstacle> d(new DiskObstacle(0, 0, int(b.w), 0, 0, N));
+                    d->setState(bodyState(b));
+                    obstacles->addObstacle(std::move(d));
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+    return true;
+}
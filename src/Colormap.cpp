@@ -0,0 +1,114 @@
+#include "Colormap.h"
+#include "Util.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+// ===== scalar kernel ========================================================
+static inline uint32_t channel(float c){
+    c=std::min(1.f,std::max(0.f,c));
+    return uint32_t(int(c*255.f+0.5f));
+}
+
+// Nodes i..N of row j; texels are written as little-endian words R | G<<8 | B<<16 | A<<24.
+static void rowScalar(int N,const float* dens,const float* temp,uint8_t* rgba,int j,int i){
+    const int row=IX(0,j,N);
+    uint8_t* out=rgba+4*size_t(N+1)*j;
+    for(;i<=N;++i){
+        float d=dens[row+i], h=temp[row+i]*0.5f;
+        uint32_t px=channel(d+h) | channel(d)<<8 | channel(d-h)<<16 | 0xff000000u;
+        out[4*i]=uint8_t(px); out[4*i+1]=uint8_t(px>>8); out[4*i+2]=uint8_t(px>>16); out[4*i+3]=uint8_t(px>>24);
+    }
+}
+
+#ifdef FLUID_X86_DISPATCH
+// ===== SIMD kernels =========================================================
+// Same operations as channel() lane by lane, so the bytes match the scalar kernel. Each
+// lane's three channels are shifted into one 32-bit texel and a vector of texels stored.
+
+__attribute__((target("sse2")))
+static inline __m128i channelSSE2(__m128 c){
+    c=_mm_min_ps(_mm_max_ps(c,_mm_setzero_ps()),_mm_set1_ps(1.f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c,_mm_set1_ps(255.f)),_mm_set1_ps(0.5f)));
+}
+
+__attribute__((target("sse2")))
+static void rowSSE2(int N,const float* dens,const float* temp,uint8_t* rgba,int j){
+    const int row=IX(0,j,N);
+    uint8_t* out=rgba+4*size_t(N+1)*j;
+    const __m128 half=_mm_set1_ps(0.5f);
+    const __m128i alpha=_mm_set1_epi32(int(0xff000000u));
+    int i=0;
+    for(;i+3<=N;i+=4){
+        __m128 d=_mm_loadu_ps(dens+row+i), h=_mm_mul_ps(_mm_loadu_ps(temp+row+i),half);
+        __m128i px=_mm_or_si128(channelSSE2(_mm_add_ps(d,h)),_mm_slli_epi32(channelSSE2(d),8));
+        px=_mm_or_si128(_mm_or_si128(px,_mm_slli_epi32(channelSSE2(_mm_sub_ps(d,h)),16)),alpha);
+        _mm_storeu_si128((__m128i*)(out+4*i),px);
+    }
+    rowScalar(N,dens,temp,rgba,j,i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i channelAVX2(__m256 c){
+    c=_mm256_min_ps(_mm256_max_ps(c,_mm256_setzero_ps()),_mm256_set1_ps(1.f));
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c,_mm256_set1_ps(255.f)),_mm256_set1_ps(0.5f)));
+}
+
+__attribute__((target("avx2")))
+static void rowAVX2(int N,const float* dens,const float* temp,uint8_t* rgba,int j){
+    const int row=IX(0,j,N);
+    uint8_t* out=rgba+4*size_t(N+1)*j;
+    const __m256 half=_mm256_set1_ps(0.5f);
+    const __m256i alpha=_mm256_set1_epi32(int(0xff000000u));
+    int i=0;
+    for(;i+7<=N;i+=8){
+        __m256 d=_mm256_loadu_ps(dens+row+i), h=_mm256_mul_ps(_mm256_loadu_ps(temp+row+i),half);
+        __m256i px=_mm256_or_si256(channelAVX2(_mm256_add_ps(d,h)),_mm256_slli_epi32(channelAVX2(d),8));
+        px=_mm256_or_si256(_mm256_or_si256(px,_mm256_slli_epi32(channelAVX2(_mm256_sub_ps(d,h)),16)),alpha);
+        _mm256_storeu_si256((__m256i*)(out+4*i),px);
+    }
+    rowScalar(N,dens,temp,rgba,j,i);
+}
+
+static ColormapIsa detectIsa(){
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return ColormapIsa::AVX2;
+    if(__builtin_cpu_supports("sse2")) return ColormapIsa::SSE2;
+    return ColormapIsa::Scalar;
+}
+#else
+static ColormapIsa detectIsa(){ return ColormapIsa::Scalar; }
+#endif
+
+// ===== dispatch =============================================================
+static const ColormapIsa s_supported=detectIsa();
+static ColormapIsa s_isa=s_supported;
+
+ColormapIsa colormapIsa(){ return s_isa; }
+
+void forceColormapIsa(ColormapIsa isa){
+    s_isa=std::min(isa,s_supported);
+}
+
+const char* colormapIsaName(ColormapIsa isa){
+    switch(isa){
+        case ColormapIsa::SSE2: return "sse2";
+        case ColormapIsa::AVX2: return "avx2";
+        default:                return "scalar";
+    }
+}
+
+void colormapDensity(int N,const float* dens,const float* temp,uint8_t* rgba,int j0,int j1){
+    for(int j=j0;j<j1;++j){
+        switch(s_isa){
+#ifdef FLUID_X86_DISPATCH
+            case ColormapIsa::AVX2: rowAVX2(N,dens,temp,rgba,j); break;
+            case ColormapIsa::SSE2: rowSSE2(N,dens,temp,rgba,j); break;
+#endif
+            default:                rowScalar(N,dens,temp,rgba,j,0); break;
+        }
+    }
+}
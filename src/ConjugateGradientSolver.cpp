@@ -0,0 +1,248 @@
+#include "ConjugateGradientSolver.h"
+#include "BoundarySolver.h"
+#include "ThreadPool.h"
+#include "AlignedAllocator.h"
+#include "Util.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+// Residual growth (squared) over the best one so far at which the iteration is abandoned.
+static const double kGrowth=100.0;
+// Cells per float partial of a dot product, and the narrowest column strip of the
+// preconditioner's pipeline.
+static const int kDotChunk=32;
+static const int kMinStrip=64;
+
+// Rows 1..Ny, split over the pool when there is one. Every kernel below writes disjoint rows,
+// and dot products are summed per row, then over the rows in order, so the split never
+// changes the result.
+template<class F>
+static void forRows(ThreadPool* pool,int Ny,const F& fn){
+    if(pool) pool->parallelFor(1,Ny+1,fn); else fn(1,Ny+1);
+}
+
+// a.b over n cells: each chunk of kDotChunk cells is summed in eight float lanes, which the
+// compiler vectorizes, and the chunks in double.
+static double rowDot(const float* a,const float* b,int n){
+    double sum=0;
+    int i=0;
+    for(;i+kDotChunk<=n;i+=kDotChunk){
+        float lane[8]={0,0,0,0,0,0,0,0};
+        for(int k=i;k<i+kDotChunk;k+=8)
+            for(int l=0;l<8;++l) lane[l]+=a[k+l]*b[k+l];
+        sum+=double(((lane[0]+lane[1])+(lane[2]+lane[3]))+((lane[4]+lane[5])+(lane[6]+lane[7])));
+    }
+    for(;i<n;++i) sum+=double(a[i])*b[i];
+    return sum;
+}
+
+double ConjugateGradientSolver::sumRows() const {
+    double sum=0;
+    for(int j=1;j<=m_Ny;++j) sum+=m_rowSum[j];
+    return sum;
+}
+
+double ConjugateGradientSolver::dot(const float* a,const float* b){
+    int N=m_Nx;
+    forRows(m_pool,m_Ny,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j) m_rowSum[j]=rowDot(a+IX(1,j,N),b+IX(1,j,N),N);
+    });
+    return sumRows();
+}
+
+ConjugateGradientSolver::ConjugateGradientSolver(int Nx,int Ny)
+    :m_Nx(Nx),m_Ny(Ny){
+    size_t sz=fieldSize(Nx,Ny);
+    m_precon.assign(sz,0.f); m_r.assign(sz,0.f); m_z.assign(sz,0.f); m_s.assign(sz,0.f); m_q.assign(sz,0.f);
+    m_best.assign(sz,0.f);
+    m_rowSum.assign(Ny+2,0.0);
+}
+
+// The matrix is the Neumann Laplacian over the fluid cells: diagonal = number of fluid
+// neighbours inside the grid, and -1 towards each of them. Aplusi/Aplusj below are the
+// off-diagonals towards i+1 / j+1. Solid cells get a zero row (and precon 0), so they stay
+// at zero in every vector; a fluid cell with no fluid neighbour gets the identity.
+void ConjugateGradientSolver::buildPreconditioner(){
+    int N=m_Nx, Nx=m_Nx, Ny=m_Ny; float* pc=m_precon.data(); const uint16_t* solid=m_solid;
+    auto fluid=[&](int i,int j){ return !solid || !solid[IX(i,j,N)]; };
+    for(int j=1;j<=Ny;++j) for(int i=1;i<=Nx;++i){
+        if(!fluid(i,j)){ pc[IX(i,j,N)]=0.f; continue; }
+        float diag=float((i>1 && fluid(i-1,j))+(i<Nx && fluid(i+1,j))+(j>1 && fluid(i,j-1))+(j<Ny && fluid(i,j+1)));
+        if(diag==0){ pc[IX(i,j,N)]=1.f; continue; } // walled-in pocket: identity row
+        float e=diag;
+        if(i>1){
+            float pi=pc[IX(i-1,j,N)];                  // Aplusi(i-1,j) = -1 (0 if solid)
+            e-=pi*pi;
+            if(j<Ny && fluid(i-1,j+1)) e-=tau*pi*pi;    // Aplusi(i-1,j)*Aplusj(i-1,j)
+        }
+        if(j>1){
+            float pj=pc[IX(i,j-1,N)];                  // Aplusj(i,j-1) = -1 (0 if solid)
+            e-=pj*pj;
+            if(i<Nx && fluid(i+1,j-1)) e-=tau*pj*pj;    // Aplusj(i,j-1)*Aplusi(i,j-1)
+        }
+        if(e<sigma*diag) e=diag;
+        pc[IX(i,j,N)]=1.f/std::sqrt(e);
+    }
+    m_builtTau=tau; m_builtSigma=sigma; m_builtSolid=solid!=nullptr;
+}
+
+static inline float applyCell(int N,int Ny,int i,int j,const float* x,const uint16_t* solid){
+    auto fluid=[&](int i,int j){ return !solid || !solid[IX(i,j,N)]; };
+    if(!fluid(i,j)) return 0.f;
+    float sum=0; int n=0;
+    if(i>1  && fluid(i-1,j)){ sum+=x[IX(i-1,j,N)]; ++n; }
+    if(i<N  && fluid(i+1,j)){ sum+=x[IX(i+1,j,N)]; ++n; }
+    if(j>1  && fluid(i,j-1)){ sum+=x[IX(i,j-1,N)]; ++n; }
+    if(j<Ny && fluid(i,j+1)){ sum+=x[IX(i,j+1,N)]; ++n; }
+    return n ? n*x[IX(i,j,N)]-sum : x[IX(i,j,N)];
+}
+
+// out = A x; returns x.Ax. Rows 2..Ny-1 clear of solids take the plain interior stencil
+// between their two end cells.
+double ConjugateGradientSolver::applyA(const float* x,float* out){
+    int N=m_Nx, Ny=m_Ny, S=IX(0,1,N); const uint16_t* solid=m_solid;
+    forRows(m_pool,Ny,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j){
+            float* o=out+IX(0,j,N);
+            if(j==1 || j==Ny || (solid && m_nearRow[j])){
+                for(int i=1;i<=N;++i) o[i]=applyCell(N,Ny,i,j,x,solid);
+            }else{
+                const float* xr=x+IX(0,j,N);
+                o[1]=applyCell(N,Ny,1,j,x,solid);
+                for(int i=2;i<N;++i) o[i]=4*xr[i]-(((xr[i-1]+xr[i+1])+xr[i-S])+xr[i+S]);
+                o[N]=applyCell(N,Ny,N,j,x,solid);
+            }
+            m_rowSum[j]=rowDot(x+IX(1,j,N),o+1,N);
+        }
+    });
+    return sumRows();
+}
+
+// z = (L L^T)^-1 r with L from the MIC(0) factorisation; m_q holds the intermediate L^-1 r.
+// The ghost cells of m_precon, m_q and z are zero, so the neighbours outside the grid drop
+// out without a test, as do solid ones (precon 0). Each row is done in two passes: the
+// neighbour in the next row over, which vectorizes, then the recurrence along the row.
+// A cell of the forward solve needs its left and lower neighbours, one of the backward solve
+// its right and upper ones, so rows cannot be split between threads, but columns can: with a
+// pool the grid is cut into column strips that follow each other as a pipeline (level
+// scheduling by blocks), a strip doing row j once the strip before it has. Every cell sees
+// the same values as in a serial solve.
+void ConjugateGradientSolver::applyPreconditioner(const float* r,float* z){
+    int N=m_Nx, Ny=m_Ny, S=IX(0,1,N); const float* pc=m_precon.data(); float* q=m_q.data();
+    auto forward=[&](int j,int i0,int i1){
+        float* qr=q+IX(0,j,N); const float* rr=r+IX(0,j,N); const float* pr=pc+IX(0,j,N);
+        for(int i=i0;i<=i1;++i) qr[i]=rr[i]+pr[i-S]*qr[i-S];
+        for(int i=i0;i<=i1;++i) qr[i]=(qr[i]+pr[i-1]*qr[i-1])*pr[i];
+    };
+    auto backward=[&](int j,int i0,int i1){
+        float* zr=z+IX(0,j,N); const float* qr=q+IX(0,j,N); const float* pr=pc+IX(0,j,N);
+        for(int i=i0;i<=i1;++i) zr[i]=qr[i]+pr[i]*zr[i+S];
+        for(int i=i1;i>=i0;--i) zr[i]=(zr[i]+pr[i]*zr[i+1])*pr[i];
+    };
+    int strips=m_pool ? std::min(m_pool->size(),std::max(1,N/kMinStrip)) : 1;
+    if(strips==1){
+        for(int j=1;j<=Ny;++j) forward(j,1,N);
+        for(int j=Ny;j>=1;--j) backward(j,1,N);
+    }else{
+        // One cache line per strip; a plain vector would not honour alignas(64) before C++17.
+        struct alignas(64) Progress { std::atomic<int> rows; };
+        std::vector<Progress,AlignedAllocator<Progress>> done(strips);
+        for(int pass=0;pass<2;++pass){
+            for(auto& d : done) d.rows.store(0,std::memory_order_relaxed);
+            // Stage s runs strip s forwards, strip strips-1-s backwards: the strip it waits
+            // for is always an earlier stage, which the pool has started already.
+            auto stage=[&](int s){
+                int k=pass==0 ? s : strips-1-s, i0=1+N*k/strips, i1=N*(k+1)/strips;
+                for(int t=1;t<=Ny;++t){
+                    if(s>0) while(done[s-1].rows.load(std::memory_order_acquire)<t) std::this_thread::yield();
+                    if(pass==0) forward(t,i0,i1); else backward(Ny+1-t,i0,i1);
+                    done[s].rows.store(t,std::memory_order_release);
+                }
+            };
+            m_pool->parallelFor(0,strips,[&](int s0,int s1){ for(int s=s0;s<s1;++s) stage(s); },1);
+        }
+    }
+    // Keep the search direction out of the null space of the Neumann operator: a constant
+    // on each fluid region.
+    removeMean(N,Ny,z,m_solid ? &m_regions : nullptr);
+}
+
+PressureStats ConjugateGradientSolver::solve(float* p,float* div,float tol,int maxIterations){
+    int N=m_Nx, Nx=m_Nx, Ny=m_Ny;
+    float *r=m_r.data(), *z=m_z.data(), *s=m_s.data(), *q=m_q.data();
+
+    // The solid mask moves every step, so with solids the factorisation is redone each time.
+    if(m_solid){
+        m_nearRow.assign(Ny+2,0);
+        for(int j=1;j<=Ny;++j)
+            for(int i=1;i<=Nx;++i)
+                if(m_solid[IX(i,j,N)]){ m_nearRow[j-1]=m_nearRow[j]=m_nearRow[j+1]=1; break; }
+    }
+    if(tau!=m_builtTau || sigma!=m_builtSigma || m_solid || m_builtSolid) buildPreconditioner();
+
+    PressureStats st;
+    double b2=removeMean(Nx,Ny,div,findRegions(Nx,Ny));
+    if(b2>0){
+        double tol2=double(tol)*tol*b2;
+        // Solid cells start (and so stay) at zero in p's updates
+        if(m_solid) for(int j=1;j<=Ny;++j) for(int i=1;i<=Nx;++i) if(m_solid[IX(i,j,N)]) p[IX(i,j,N)]=0;
+        applyA(p,q);
+        forRows(m_pool,Ny,[&](int j0,int j1){
+            for(int j=j0;j<j1;++j){
+                float *rr=r+IX(0,j,N); const float *dr=div+IX(0,j,N), *qr=q+IX(0,j,N);
+                for(int i=1;i<=Nx;++i) rr[i]=dr[i]-qr[i];
+                m_rowSum[j]=rowDot(rr+1,rr+1,Nx);
+            }
+        });
+        double r2=sumRows();
+        // p is saved whenever the residual has halved since the last save. Rounding can make
+        // the iteration stall or blow up on a nearly singular system; it then stops and goes
+        // back to the saved p, which is within a factor 2 of the best residual seen.
+        double savedR2=r2, minR2=r2;
+        std::copy(p,p+fieldSize(Nx,Ny),m_best.begin());
+        if(r2>tol2){
+            applyPreconditioner(r,z);
+            std::copy(z,z+fieldSize(Nx,Ny),s);
+            double rho=dot(z,r);
+            while(st.iterations<maxIterations){
+                double sq=applyA(s,q);
+                if(sq<=0) break;
+                float alpha=float(rho/sq);
+                forRows(m_pool,Ny,[&](int j0,int j1){
+                    for(int j=j0;j<j1;++j){
+                        float *pr=p+IX(0,j,N), *rr=r+IX(0,j,N);
+                        const float *sr=s+IX(0,j,N), *qr=q+IX(0,j,N);
+                        for(int i=1;i<=Nx;++i){ pr[i]+=alpha*sr[i]; rr[i]-=alpha*qr[i]; }
+                        m_rowSum[j]=rowDot(rr+1,rr+1,Nx);
+                    }
+                });
+                ++st.iterations;
+                r2=sumRows();
+                if(!std::isfinite(r2) || r2>kGrowth*minR2){
+                    std::copy(m_best.begin(),m_best.end(),p);
+                    r2=savedR2;
+                    break;
+                }
+                minR2=std::min(minR2,r2);
+                if(r2<=tol2) break;
+                if(r2<0.25*savedR2){ std::copy(p,p+fieldSize(Nx,Ny),m_best.begin()); savedR2=r2; }
+
+                applyPreconditioner(r,z);
+                double rhoNew=dot(z,r);
+                float beta=float(rhoNew/rho);
+                rho=rhoNew;
+                forRows(m_pool,Ny,[&](int j0,int j1){
+                    for(int j=j0;j<j1;++j){
+                        float* sr=s+IX(0,j,N); const float* zr=z+IX(0,j,N);
+                        for(int i=1;i<=Nx;++i) sr[i]=zr[i]+beta*sr[i];
+                    }
+                });
+            }
+        }
+        st.residual=float(std::sqrt(r2/b2));
+    }
+    BoundarySolver::setBounds(Nx,Ny,0,p);
+    return st;
+}
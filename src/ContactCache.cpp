@@ -0,0 +1,76 @@
+#include "ContactCache.h"
+#include <algorithm>
+#include <utility>
+
+static size_t slotOf(uint64_t key, size_t mask) {
+    key ^= key >> 29; key *= 0xbf58476d1ce4e5b9ull; key ^= key >> 32;
+    return static_cast<size_t>(key) & mask;
+}
+
+const ContactCache::Entry* ContactCache::Table::find(uint64_t k) const {
+    if (slots.empty()) return nullptr;
+    size_t mask = slots.size() - 1;
+    for (size_t s = slotOf(k, mask); ; s = (s + 1) & mask) {
+        if (slots[s].key == k) return &slots[s];
+        if (slots[s].key == 0) return nullptr;
+    }
+}
+
+ContactCache::Entry& ContactCache::Table::insert(uint64_t k) {
+    if (2 * (size + 1) > static_cast<int>(slots.size())) grow();
+    size_t mask = slots.size() - 1;
+    size_t s = slotOf(k, mask);
+    while (slots[s].key != 0) s = (s + 1) & mask;
+    ++size;
+    slots[s].key = k;
+    slots[s].c = Contact();
+    return slots[s];
+}
+
+void ContactCache::Table::grow() {
+    std::vector<Entry> old(std::max<size_t>(64, 2 * slots.size()), Entry{0, Contact()});
+    old.swap(slots);
+    size = 0;
+    for (const Entry& e : old)
+        if (e.key != 0) insert(e.key).c = e.c;
+}
+
+void ContactCache::Table::reserve(int count) {
+    while (2 * count > static_cast<int>(slots.size())) grow();
+}
+
+void ContactCache::Table::reset() {
+    for (Entry& e : slots) e.key = 0;
+    size = 0;
+}
+
+void ContactCache::beginStep() {
+    std::swap(m_cur, m_prev);
+    m_cur.reset();
+}
+
+void ContactCache::reserve(int count) {
+    m_cur.reserve(count);
+    m_prev.reserve(count);
+}
+
+const ContactCache::Contact* ContactCache::previous(int a, int b) const {
+    const Entry* e = m_prev.find(key(a, b));
+    return e ? &e->c : nullptr;
+}
+
+ContactCache::Contact* ContactCache::current(int a, int b) {
+    const Entry* e = m_cur.find(key(a, b));
+    return e ? const_cast<Contact*>(&e->c) : nullptr;
+}
+
+ContactCache::Contact& ContactCache::add(int a, int b, const Contact& c) {
+    Contact& added = m_cur.insert(key(a, b)).c;
+    added = c;
+    return added;
+}
+
+void ContactCache::clear() {
+    m_cur.reset();
+    m_prev.reset();
+}
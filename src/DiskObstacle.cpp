@@ -1,7 +1,5 @@
 #include "DiskObstacle.h"
-#include "FluidGrid.h"
-#include "Util.h"
-#include <GL/glut.h>
+#include "ObstacleVisitor.h"
 #include <cmath>
 #include <algorithm>
 
@@ -15,89 +13,21 @@ DiskObstacle::DiskObstacle(int x, int y, int radius, int w, int h, int gridN)
     m_inverseMass = (m_mass > 0) ? 1.0f / m_mass : 0.f;
 }
 
-void DiskObstacle::apply(FluidGrid& grid) const {
-    float* u = grid.u();
-    float* v = grid.v();
-    int N = grid.size();
-
-    Vec2 center = getCenter();
+void DiskObstacle::computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const {
+    Vec2 center(dequantize(key.x), dequantize(key.y));
     int i_min = std::max(1, static_cast<int>(center.x - m_radius));
-    int i_max = std::min(N, static_cast<int>(center.x + m_radius));
+    int i_max = std::min(Nx, static_cast<int>(center.x + m_radius));
     int j_min = std::max(1, static_cast<int>(center.y - m_radius));
-    int j_max = std::min(N, static_cast<int>(center.y + m_radius));
+    int j_max = std::min(Ny, static_cast<int>(center.y + m_radius));
 
-    for (int i = i_min; i <= i_max; ++i) {
-        for (int j = j_min; j <= j_max; ++j) {
-            Vec2 cell_pos(static_cast<float>(i), static_cast<float>(j));
-            if ((cell_pos - center).lenSq() < m_radius * m_radius) {
-                u[IX(i, j, N)] = m_vx;
-                v[IX(i, j, N)] = m_vy;
-            }
-        }
-    }
+    scanRuns(i_min, i_max, j_min, j_max, [&](int i, int j) {
+        Vec2 cell_pos(static_cast<float>(i), static_cast<float>(j));
+        return (cell_pos - center).lenSq() < m_radius * m_radius;
+    }, runs);
 }
 
-void DiskObstacle::updateFromFluid(FluidGrid& grid, float dt) {
-    float* u = grid.u();
-    float* v = grid.v();
-    int N = grid.size();
-
-    float sumU = 0.f;
-    float sumV = 0.f;
-    int count = 0;
-
-    Vec2 center = getCenter();
-    int i_min = std::max(1, static_cast<int>(center.x - m_radius));
-    int i_max = std::min(N, static_cast<int>(center.x + m_radius));
-    int j_min = std::max(1, static_cast<int>(center.y - m_radius));
-    int j_max = std::min(N, static_cast<int>(center.y + m_radius));
-
-    for (int i = i_min; i <= i_max; ++i) {
-        for (int j = j_min; j <= j_max; ++j) {
-            Vec2 cell_pos(static_cast<float>(i), static_cast<float>(j));
-            if ((cell_pos - center).lenSq() < m_radius * m_radius) {
-                int idx = IX(i, j, N);
-                sumU += u[idx];
-                sumV += v[idx];
-                ++count;
-            }
-        }
-    }
-
-    if (count == 0) return;
-
-    float avgU = sumU / count;
-    float avgV = sumV / count;
-
- 
-    float coupling_strength = 50.0f;
-    m_vx += (avgU - m_vx) * coupling_strength * m_inverseMass * dt;
-    m_vy += (avgV - m_vy) * coupling_strength * m_inverseMass * dt;
-}
-
-void DiskObstacle::draw() const {
-    if (m_isSelected) {
-        glColor3f(0.2f, 0.8f, 0.8f); // Cyan when selected
-    } else {
-        glColor3f(0.2f, 0.5f, 0.8f); // Blue for movable
-    }
-
-    float h = 1.0f / m_gridN;
-    Vec2 center = getCenter();
-    float cx = h * center.x;
-    float cy = h * center.y;
-    float r = h * m_radius;
-
-    int segments = 24;
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(cx, cy); // Center of circle
-    for(int i = 0; i <= segments; i++) {
-        float angle = 2.0f * PI * static_cast<float>(i) / static_cast<float>(segments);
-        float dx = r * std::cos(angle);
-        float dy = r * std::sin(angle);
-        glVertex2f(cx + dx, cy + dy);
-    }
-    glEnd();
+void DiskObstacle::accept(ObstacleVisitor& visitor) const {
+    visitor.visit(*this);
 }
 
 bool DiskObstacle::contains(int x, int y) const {
@@ -0,0 +1,825 @@
+#include "FieldRecorder.h"
+#include "FluidGrid.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "Util.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const char Magic[8] = {'F', 'L', 'U', 'I', 'D', 'R', 'E', 'C'};
+
+int fieldCount(uint32_t fields) {
+    int n = 0;
+    for (uint32_t f = fields & RecordAll; f; f &= f - 1) ++n;
+    return n;
+}
+
+// The grid's fields in RecordField bit order.
+float* gridField(FluidGrid& grid, int bit) {
+    switch (bit) {
+        case 0:  return grid.dens();
+        case 1:  return grid.temp();
+        case 2:  return grid.u();
+        default: return grid.v();
+    }
+}
+
+std::vector<float>& frameField(RecordedFrame& frame, int bit) {
+    switch (bit) {
+        case 0:  return frame.dens;
+        case 1:  return frame.temp;
+        case 2:  return frame.u;
+        default: return frame.v;
+    }
+}
+
+// ===== quantization =========================================================
+// The encoder and the reader run the same float operations on the same inputs here, so
+// their predictions agree exactly.
+
+inline uint32_t quantize(float x, float lo, float scale, uint32_t maxQ) {
+    float t = (x - lo) * scale + 0.5f;
+    t = t > 0.f ? t : 0.f; // NaN too; selects rather than branches, so the loops vectorize
+    t = t < float(maxQ) ? t : float(maxQ);
+    return uint32_t(int32_t(t)); // t <= 65535: the signed conversion is the cheap one
+}
+
+// (q - p) modulo 2^bits read as a signed number, folded so small magnitudes come out small
+inline uint32_t zigzag(uint32_t q, uint32_t p, int bits) {
+    int32_t s = int32_t((q - p) << (32 - bits)) >> (32 - bits);
+    return (uint32_t(s) << 1) ^ uint32_t(s >> 31);
+}
+inline uint32_t unzigzag(uint32_t z, uint32_t p, uint32_t mask) {
+    int32_t s = int32_t(z >> 1) ^ -int32_t(z & 1);
+    return (p + uint32_t(s)) & mask;
+}
+
+// The range of the values of a field, found a row at a time while the row just copied is
+// still in cache. NaNs are left out; with no other values the range is [0, 0].
+struct RangeScan {
+    float l[8], h[8];
+
+    RangeScan() {
+        for (int j = 0; j < 8; ++j) { l[j] = HUGE_VALF; h[j] = -HUGE_VALF; }
+    }
+
+    void add(const float* x, size_t n) {
+        // Eight bounds side by side in locals, so the compares vectorize
+        float lo[8], hi[8];
+        for (int j = 0; j < 8; ++j) { lo[j] = l[j]; hi[j] = h[j]; }
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8)
+            for (int j = 0; j < 8; ++j) {
+                lo[j] = x[k + j] < lo[j] ? x[k + j] : lo[j]; // false for NaN, so the bound stays
+                hi[j] = x[k + j] > hi[j] ? x[k + j] : hi[j];
+            }
+        for (; k < n; ++k) {
+            lo[0] = x[k] < lo[0] ? x[k] : lo[0];
+            hi[0] = x[k] > hi[0] ? x[k] : hi[0];
+        }
+        for (int j = 0; j < 8; ++j) { l[j] = lo[j]; h[j] = hi[j]; }
+    }
+
+    void result(float& lo, float& hi) const {
+        lo = l[0]; hi = h[0];
+        for (int j = 1; j < 8; ++j) {
+            lo = l[j] < lo ? l[j] : lo;
+            hi = h[j] > hi ? h[j] : hi;
+        }
+        if (lo > hi) lo = hi = 0.f;
+    }
+};
+
+// ===== residual blocks ======================================================
+// See the file layout in FieldRecorder.h. A block of zero residuals, the common case in the
+// still parts of a delta frame, is just its width byte.
+
+const int BlockValues = 16;
+
+size_t blockCount(size_t n) { return (n + BlockValues - 1) / BlockValues; }
+// The most the blocks of n residuals take
+size_t blockBound(size_t n, int bits) { return blockCount(n) * size_t(1 + 2 * bits); }
+
+template <int Bits> struct ResidualType       { typedef uint8_t  type; };
+template <>         struct ResidualType<16>   { typedef uint16_t type; };
+
+// Cells i.. of a row: z gets the residuals, pq the quantized values. The previous frame is
+// pq as it was, decoded with prevLo and prevStep the way the reader decodes it.
+template <int Bits, bool Keyframe>
+void residualRowScalar(const float* x, typename ResidualType<Bits>::type* pq, float prevLo, float prevStep, int Nx,
+                       float lo, float scale, typename ResidualType<Bits>::type* z, int i) {
+    typedef typename ResidualType<Bits>::type V;
+    const uint32_t maxQ = (1u << Bits) - 1;
+    for (; i < Nx; ++i) {
+        uint32_t q = quantize(x[i], lo, scale, maxQ);
+        uint32_t p = !Keyframe ? quantize(prevLo + float(pq[i]) * prevStep, lo, scale, maxQ)
+                   : i         ? quantize(x[i - 1], lo, scale, maxQ) : 0;
+        z[i] = V(zigzag(q, p, Bits));
+        pq[i] = V(q);
+    }
+}
+
+// The planes of a block, four to a word, as stored: the width byte, then the planes below
+// it. All the planes are written (in host order, as the headers are) and the ones from the
+// width up left to be overwritten, so out needs room for a full block.
+uint8_t* putBlock(const uint64_t* words, int count, uint8_t* out) {
+    int w = 0;
+    for (int k = 0; k < count; ++k) {
+        uint64_t v = words[k];
+        int top = v >> 48 ? 4 : v >> 32 ? 3 : v >> 16 ? 2 : v ? 1 : 0;
+        w = top ? 4 * k + top : w;
+    }
+    out[0] = uint8_t(w);
+    std::memcpy(out + 1, words, size_t(count) * sizeof(uint64_t));
+    return out + 1 + 2 * w;
+}
+
+template <typename V>
+uint8_t* packBlocksScalar(const V* z, size_t blocks, uint8_t* out) {
+    const int count = int(sizeof(V)) * 2;
+    for (size_t k = 0; k < blocks; ++k, z += BlockValues) {
+        uint64_t words[4] = {};
+        for (int b = 0; b < 4 * count; ++b)
+            for (int i = 0; i < BlockValues; ++i) words[b / 4] |= uint64_t(z[i] >> b & 1) << (16 * (b % 4) + i);
+        out = putBlock(words, count, out);
+    }
+    return out;
+}
+
+// Reads a block into z; null if it runs past end or is wider than bits.
+const uint8_t* unpackBlock(const uint8_t* in, const uint8_t* end, int bits, uint16_t* z) {
+    if (in == end || *in > bits || end - in - 1 < 2 * *in) return nullptr;
+    int w = *in++;
+    for (int k = 0; k < BlockValues; ++k) z[k] = 0;
+    for (int b = 0; b < w; ++b, in += 2) {
+        uint32_t m = uint32_t(in[0]) | uint32_t(in[1]) << 8;
+        for (int k = 0; k < BlockValues; ++k) z[k] |= uint16_t((m >> k & 1) << b);
+    }
+    return in;
+}
+
+#ifdef FLUID_X86_DISPATCH
+// ===== SIMD kernels =========================================================
+// Lane by lane the same float operations as quantize() and the reader's reconstruction, so
+// the predictions agree exactly whichever kernel the encoder ran. The left neighbour of a
+// keyframe cell is quantized again rather than carried over, so no lane waits for the one
+// before. The remainder of a row goes to residualRowScalar.
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+Isa detectIsa() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+    return Isa::Scalar;
+}
+
+const Isa s_isa = detectIsa();
+
+struct Consts4 {
+    __m128 lo, scale, half, maxQ, prevLo, prevStep;
+};
+
+__attribute__((target("sse2")))
+inline __m128i quantize4(__m128 x, const Consts4& c) {
+    __m128 t = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, c.lo), c.scale), c.half);
+    t = _mm_max_ps(t, _mm_setzero_ps()); // the second operand for NaN, as in quantize()
+    return _mm_cvttps_epi32(_mm_min_ps(t, c.maxQ));
+}
+
+// Zigzag residuals of cells i..i+3 against the cell to the left, or the previous frame's
+// quantized values pq (widened to 32 bits) decoded; q gets the cells' quantized values.
+template <int Bits, bool Keyframe>
+__attribute__((target("sse2")))
+inline __m128i residual4(const float* x, int i, __m128i pq, const Consts4& c, __m128i& q) {
+    q = quantize4(_mm_loadu_ps(x + i), c);
+    __m128i p = Keyframe ? quantize4(_mm_loadu_ps(x + i - 1), c)
+                         : quantize4(_mm_add_ps(c.prevLo, _mm_mul_ps(_mm_cvtepi32_ps(pq), c.prevStep)), c);
+    __m128i d = _mm_srai_epi32(_mm_slli_epi32(_mm_sub_epi32(q, p), 32 - Bits), 32 - Bits);
+    return _mm_xor_si128(_mm_slli_epi32(d, 1), _mm_srai_epi32(d, 31));
+}
+
+// Eight values below 2^16 to 16 bits: sign-extended first, so the signed pack keeps them
+__attribute__((target("sse2")))
+inline __m128i pack16(__m128i a, __m128i b) {
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+template <int Bits, bool Keyframe>
+__attribute__((target("sse2")))
+void residualRowSSE2(const float* x, typename ResidualType<Bits>::type* pq, float prevLo, float prevStep, int Nx,
+                     float lo, float scale, typename ResidualType<Bits>::type* z) {
+    const Consts4 c = {_mm_set1_ps(lo), _mm_set1_ps(scale), _mm_set1_ps(0.5f), _mm_set1_ps(float((1u << Bits) - 1)),
+                       _mm_set1_ps(prevLo), _mm_set1_ps(prevStep)};
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    if (Keyframe) { residualRowScalar<Bits, Keyframe>(x, pq, prevLo, prevStep, 1, lo, scale, z, 0); i = 1; }
+    const int width = Bits == 8 ? 16 : 8;
+    for (; i + width <= Nx; i += width) {
+        __m128i p = Keyframe ? zero : _mm_loadu_si128(reinterpret_cast<const __m128i*>(pq + i));
+        __m128i q[4], r[4];
+        if (Bits == 8) {
+            __m128i p16[2] = {_mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero)};
+            for (int k = 0; k < 4; ++k) {
+                __m128i p32 = k & 1 ? _mm_unpackhi_epi16(p16[k / 2], zero) : _mm_unpacklo_epi16(p16[k / 2], zero);
+                r[k] = residual4<Bits, Keyframe>(x, i + 4 * k, p32, c, q[k]);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i),
+                             _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3])));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pq + i),
+                             _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+        } else {
+            r[0] = residual4<Bits, Keyframe>(x, i, _mm_unpacklo_epi16(p, zero), c, q[0]);
+            r[1] = residual4<Bits, Keyframe>(x, i + 4, _mm_unpackhi_epi16(p, zero), c, q[1]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), pack16(r[0], r[1]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pq + i), pack16(q[0], q[1]));
+        }
+    }
+    residualRowScalar<Bits, Keyframe>(x, pq, prevLo, prevStep, Nx, lo, scale, z, i);
+}
+
+// The width of a block from its planes, eight to a vector: one past the last plane that
+// is not zero.
+__attribute__((target("sse2")))
+inline int planeWidth(__m128i lo, __m128i hi) {
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t nonzero = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi16(lo, zero)) |
+                                 _mm_movemask_epi8(_mm_cmpeq_epi16(hi, zero)) << 16);
+    return nonzero ? (31 - __builtin_clz(nonzero)) / 2 + 1 : 0;
+}
+
+// Plane b is the sign bits after a shift that moves bit b of each value to the top. The
+// 16-bit shifts carry bits of a low byte into the high one only below its top bit; the
+// signed pack of 16-bit values saturates, which keeps the sign. All the planes are stored
+// and the ones from the width up left to be overwritten, so out needs room for a full block.
+__attribute__((target("sse2")))
+uint8_t* packBlocksSSE2(const uint8_t* z, size_t blocks, uint8_t* out) {
+    for (size_t k = 0; k < blocks; ++k, z += BlockValues) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z));
+        __m128i p = _mm_setzero_si128();
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 7)), 0);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 6)), 1);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 5)), 2);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 4)), 3);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 3)), 4);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 2)), 5);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(_mm_slli_epi16(v, 1)), 6);
+        p = _mm_insert_epi16(p, _mm_movemask_epi8(v), 7);
+        int w = planeWidth(p, _mm_setzero_si128());
+        out[0] = uint8_t(w);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1), p);
+        out += 1 + 2 * w;
+    }
+    return out;
+}
+
+template <int B>
+__attribute__((target("sse2")))
+inline int plane16(__m128i a, __m128i c) {
+    return _mm_movemask_epi8(_mm_packs_epi16(_mm_slli_epi16(a, 15 - B), _mm_slli_epi16(c, 15 - B)));
+}
+
+__attribute__((target("sse2")))
+uint8_t* packBlocksSSE2(const uint16_t* z, size_t blocks, uint8_t* out) {
+    for (size_t k = 0; k < blocks; ++k, z += BlockValues) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z + 8));
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        lo = _mm_insert_epi16(lo, plane16<0>(a, c), 0);   hi = _mm_insert_epi16(hi, plane16<8>(a, c), 0);
+        lo = _mm_insert_epi16(lo, plane16<1>(a, c), 1);   hi = _mm_insert_epi16(hi, plane16<9>(a, c), 1);
+        lo = _mm_insert_epi16(lo, plane16<2>(a, c), 2);   hi = _mm_insert_epi16(hi, plane16<10>(a, c), 2);
+        lo = _mm_insert_epi16(lo, plane16<3>(a, c), 3);   hi = _mm_insert_epi16(hi, plane16<11>(a, c), 3);
+        lo = _mm_insert_epi16(lo, plane16<4>(a, c), 4);   hi = _mm_insert_epi16(hi, plane16<12>(a, c), 4);
+        lo = _mm_insert_epi16(lo, plane16<5>(a, c), 5);   hi = _mm_insert_epi16(hi, plane16<13>(a, c), 5);
+        lo = _mm_insert_epi16(lo, plane16<6>(a, c), 6);   hi = _mm_insert_epi16(hi, plane16<14>(a, c), 6);
+        lo = _mm_insert_epi16(lo, plane16<7>(a, c), 7);   hi = _mm_insert_epi16(hi, plane16<15>(a, c), 7);
+        int w = planeWidth(lo, hi);
+        out[0] = uint8_t(w);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 17), hi);
+        out += 1 + 2 * w;
+    }
+    return out;
+}
+
+struct Consts8 {
+    __m256 lo, scale, half, maxQ, prevLo, prevStep;
+};
+
+__attribute__((target("avx2")))
+inline __m256i quantize8(__m256 x, const Consts8& c) {
+    __m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(x, c.lo), c.scale), c.half);
+    t = _mm256_max_ps(t, _mm256_setzero_ps());
+    return _mm256_cvttps_epi32(_mm256_min_ps(t, c.maxQ));
+}
+
+template <int Bits, bool Keyframe>
+__attribute__((target("avx2")))
+inline __m256i residual8(const float* x, int i, __m256i pq, const Consts8& c, __m256i& q) {
+    q = quantize8(_mm256_loadu_ps(x + i), c);
+    __m256i p = Keyframe ? quantize8(_mm256_loadu_ps(x + i - 1), c)
+                         : quantize8(_mm256_add_ps(c.prevLo, _mm256_mul_ps(_mm256_cvtepi32_ps(pq), c.prevStep)), c);
+    __m256i d = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_sub_epi32(q, p), 32 - Bits), 32 - Bits);
+    return _mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31));
+}
+
+// The packs work within 128-bit lanes; the permutes put their results back in order
+__attribute__((target("avx2")))
+inline __m256i pack8x4(const __m256i* v) {
+    __m256i p = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+    return _mm256_permutevar8x32_epi32(p, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+__attribute__((target("avx2")))
+inline __m256i pack16x2(__m256i a, __m256i b) {
+    __m256i p = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+    return _mm256_permute4x64_epi64(p, 0xd8);
+}
+
+template <int Bits, bool Keyframe>
+__attribute__((target("avx2")))
+void residualRowAVX2(const float* x, typename ResidualType<Bits>::type* pq, float prevLo, float prevStep, int Nx,
+                     float lo, float scale, typename ResidualType<Bits>::type* z) {
+    const Consts8 c = {_mm256_set1_ps(lo), _mm256_set1_ps(scale), _mm256_set1_ps(0.5f),
+                       _mm256_set1_ps(float((1u << Bits) - 1)), _mm256_set1_ps(prevLo), _mm256_set1_ps(prevStep)};
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    if (Keyframe) { residualRowScalar<Bits, Keyframe>(x, pq, prevLo, prevStep, 1, lo, scale, z, 0); i = 1; }
+    const int width = Bits == 8 ? 32 : 16;
+    for (; i + width <= Nx; i += width) {
+        __m256i q[4], r[4];
+        if (Bits == 8) {
+            for (int k = 0; k < 4; ++k) {
+                __m256i p = Keyframe ? zero : _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pq + i + 8 * k)));
+                r[k] = residual8<Bits, Keyframe>(x, i + 8 * k, p, c, q[k]);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), pack8x4(r));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pq + i), pack8x4(q));
+        } else {
+            for (int k = 0; k < 2; ++k) {
+                __m256i p = Keyframe ? zero : _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pq + i + 8 * k)));
+                r[k] = residual8<Bits, Keyframe>(x, i + 8 * k, p, c, q[k]);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), pack16x2(r[0], r[1]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pq + i), pack16x2(q[0], q[1]));
+        }
+    }
+    _mm256_zeroupper(); // the scalar code after it is not VEX encoded
+    residualRowScalar<Bits, Keyframe>(x, pq, prevLo, prevStep, Nx, lo, scale, z, i);
+}
+
+// The block in both lanes, and a multiply by a power of two standing in for a shift that
+// differs between them: one movemask gives plane 2m in its low half and 2m+1 in its high one.
+__attribute__((target("avx2")))
+uint8_t* packBlocksAVX2(const uint8_t* z, size_t blocks, uint8_t* out) {
+    const __m256i s0 = _mm256_setr_m128i(_mm_set1_epi16(1 << 7), _mm_set1_epi16(1 << 6));
+    const __m256i s1 = _mm256_setr_m128i(_mm_set1_epi16(1 << 5), _mm_set1_epi16(1 << 4));
+    const __m256i s2 = _mm256_setr_m128i(_mm_set1_epi16(1 << 3), _mm_set1_epi16(1 << 2));
+    const __m256i s3 = _mm256_setr_m128i(_mm_set1_epi16(1 << 1), _mm_set1_epi16(1 << 0));
+    for (size_t k = 0; k < blocks; ++k, z += BlockValues) {
+        __m256i v = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(z)));
+        __m128i p = _mm_cvtsi32_si128(_mm256_movemask_epi8(_mm256_mullo_epi16(v, s0)));
+        p = _mm_insert_epi32(p, _mm256_movemask_epi8(_mm256_mullo_epi16(v, s1)), 1);
+        p = _mm_insert_epi32(p, _mm256_movemask_epi8(_mm256_mullo_epi16(v, s2)), 2);
+        p = _mm_insert_epi32(p, _mm256_movemask_epi8(_mm256_mullo_epi16(v, s3)), 3);
+        int w = planeWidth(p, _mm_setzero_si128());
+        out[0] = uint8_t(w);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1), p);
+        out += 1 + 2 * w;
+    }
+    return out;
+}
+
+__attribute__((target("avx2")))
+uint8_t* packBlocksAVX2(const uint16_t* z, size_t blocks, uint8_t* out) {
+    return packBlocksSSE2(z, blocks, out);
+}
+#endif
+
+template <int Bits, bool Keyframe, typename V>
+void residualRow(const float* x, V* pq, float prevLo, float prevStep, int Nx, float lo, float scale, V* z) {
+#ifdef FLUID_X86_DISPATCH
+    if (s_isa == Isa::AVX2) return residualRowAVX2<Bits, Keyframe>(x, pq, prevLo, prevStep, Nx, lo, scale, z);
+    if (s_isa == Isa::SSE2) return residualRowSSE2<Bits, Keyframe>(x, pq, prevLo, prevStep, Nx, lo, scale, z);
+#endif
+    residualRowScalar<Bits, Keyframe>(x, pq, prevLo, prevStep, Nx, lo, scale, z, 0);
+}
+
+template <typename V>
+uint8_t* packBlocks(const V* z, size_t blocks, uint8_t* out) {
+#ifdef FLUID_X86_DISPATCH
+    if (s_isa == Isa::AVX2) return packBlocksAVX2(z, blocks, out);
+    if (s_isa == Isa::SSE2) return packBlocksSSE2(z, blocks, out);
+#endif
+    return packBlocksScalar(z, blocks, out);
+}
+
+// The blocks of one field of a frame. Each row is packed as soon as its residuals are
+// computed, while they are still in cache; row holds what is left of a block between rows,
+// then the next row. pq holds the previous frame's quantized values (see
+// residualRowScalar) and becomes this one's. Returns the bytes written to out, which needs
+// room for blockBound().
+template <int Bits, bool Keyframe, typename V>
+size_t encodeResiduals(const float* x, V* pq, float prevLo, float prevStep, int Nx, int Ny, float lo, float scale,
+                       V* row, uint8_t* out) {
+    uint8_t* op = out;
+    size_t have = 0;
+    for (int j = 0; j < Ny; ++j) {
+        size_t at = size_t(j) * Nx;
+        residualRow<Bits, Keyframe>(x + at, pq + at, prevLo, prevStep, Nx, lo, scale, row + have);
+        have += size_t(Nx);
+        size_t packed = have / BlockValues * BlockValues;
+        op = packBlocks(row, packed / BlockValues, op);
+        std::copy(row + packed, row + have, row);
+        have -= packed;
+    }
+    if (have) {
+        std::fill(row + have, row + BlockValues, V(0));
+        op = packBlocks(row, 1, op);
+    }
+    return size_t(op - out);
+}
+
+template <int Bits, bool Keyframe>
+void decodeResiduals(const uint16_t* z, float* recon, int Nx, int Ny, float lo, float scale, float step) {
+    const uint32_t maxQ = (1u << Bits) - 1;
+    const size_t n = size_t(Nx) * Ny;
+    for (size_t row = 0; row < n; row += Nx) {
+        uint32_t left = 0;
+        for (size_t k = row; k < row + size_t(Nx); ++k) {
+            uint32_t q = unzigzag(z[k], Keyframe ? left : quantize(recon[k], lo, scale, maxQ), maxQ);
+            recon[k] = lo + float(q) * step;
+            left = q;
+        }
+    }
+}
+
+} // namespace
+
+// ===== FieldRecorder ========================================================
+
+bool FieldRecorder::open(const std::string& path, int Nx, int Ny, const RecorderOptions& options) {
+    close();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats = RecorderStats();
+    m_error.clear();
+    if (options.bits != 8 && options.bits != 16) { m_error = "values must have 8 or 16 bits"; return false; }
+    if (Nx < 1 || Ny < 1 || options.keyframeInterval < 1 || options.queueFrames < 1 || !fieldCount(options.fields)) {
+        m_error = "bad recorder options";
+        return false;
+    }
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) { m_error = "cannot create " + path + ": " + std::strerror(errno); return false; }
+
+    m_opt = options;
+    m_opt.fields &= RecordAll;
+    m_Nx = Nx; m_Ny = Ny;
+    m_fieldCount = fieldCount(m_opt.fields);
+    RecordingHeader h = RecordingHeader();
+    std::memcpy(h.magic, Magic, sizeof(Magic));
+    h.version = RecordingVersion;
+    h.headerBytes = sizeof(RecordingHeader);
+    h.N = Nx;
+    h.Ny = Ny;
+    h.fields = m_opt.fields;
+    h.bits = uint32_t(m_opt.bits);
+    h.keyframeInterval = uint32_t(m_opt.keyframeInterval);
+    if (std::fwrite(&h, sizeof(h), 1, m_file) != 1) {
+        m_error = "cannot write " + path + ": " + std::strerror(errno);
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_offset = sizeof(h);
+    m_frames = 0;
+    m_index.clear();
+
+    // Everything a frame needs is allocated here, so recording does not allocate
+    size_t n = size_t(Nx) * Ny;
+    m_slots.assign(size_t(m_opt.queueFrames), Slot());
+    m_free.clear(); m_filled.clear();
+    m_filled.reserve(m_slots.size());
+    for (int k = int(m_slots.size()) - 1; k >= 0; --k) { m_slots[k].values.resize(n * m_fieldCount); m_free.push_back(k); }
+    m_coders.assign(size_t(m_fieldCount), FieldCoder());
+    for (FieldCoder& c : m_coders) {
+        c.prevQ.assign(n, 0);
+        c.prevLo = c.prevStep = 0.f;
+        c.row.resize(size_t(Nx) + BlockValues);
+        c.blocks.resize(blockBound(n, m_opt.bits));
+    }
+
+    m_quit = false;
+    m_thread = std::thread([this] { run(); });
+    return true;
+}
+
+bool FieldRecorder::record(FluidGrid& grid, long long step) {
+    if (!m_file || grid.nx() != m_Nx || grid.ny() != m_Ny) return false;
+    int slot;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+            if (m_opt.dropWhenFull) { ++m_stats.dropped; return false; }
+            double ms = 0;
+            {
+                ScopedTimer t(&ms);
+                m_freed.wait(lock, [this] { return !m_free.empty(); });
+            }
+            m_stats.waitMs += ms;
+        }
+        slot = m_free.back();
+        m_free.pop_back();
+    }
+
+    double ms = 0;
+    {
+        ScopedTimer t(&ms);
+        const int N = m_Nx, Ny = m_Ny;
+        Slot& s = m_slots[slot];
+        s.step = step;
+        float* out = s.values.data();
+        for (int bit = 0, k = 0; bit < 4; ++bit) {
+            if (!(m_opt.fields & (1u << bit))) continue;
+            const float* f = gridField(grid, bit);
+            RangeScan r; // on the way, rather than in another pass over the copy
+            for (int j = 1; j <= Ny; ++j, out += N) {
+                std::memcpy(out, f + IX(1, j, N), N * sizeof(float));
+                r.add(out, size_t(N));
+            }
+            r.result(s.lo[k], s.hi[k]);
+            ++k;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.captureMs += ms;
+        m_filled.push_back(slot);
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+bool FieldRecorder::close() {
+    if (!m_file) return m_error.empty();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RecordingTrailer t = RecordingTrailer();
+    t.indexOffset = m_offset;
+    t.count = uint32_t(m_index.size());
+    t.magic = RecordingTrailer::IndexMagic;
+    bool ok = (m_index.empty() || std::fwrite(m_index.data(), sizeof(RecordingIndexEntry), m_index.size(), m_file) == m_index.size()) &&
+              std::fwrite(&t, sizeof(t), 1, m_file) == 1;
+    if (std::fclose(m_file) != 0) ok = false;
+    m_file = nullptr;
+    if (!ok && m_error.empty()) m_error = std::string("cannot write the keyframe index: ") + std::strerror(errno);
+    return m_error.empty();
+}
+
+RecorderStats FieldRecorder::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string FieldRecorder::error() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+// Writes filled slots in order until closed; the ones queued by then are still written.
+void FieldRecorder::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_quit || !m_filled.empty(); });
+        if (m_filled.empty()) return;
+        int slot = m_filled.front();
+        m_filled.erase(m_filled.begin());
+        lock.unlock();
+
+        bool keyframe = m_frames % uint32_t(m_opt.keyframeInterval) == 0;
+        RecordingFrameHeader h = RecordingFrameHeader();
+        double encodeMs = 0, writeMs = 0;
+        {
+            ScopedTimer t(&encodeMs);
+            encode(m_slots[slot], keyframe, h);
+        }
+        bool ok;
+        {
+            ScopedTimer t(&writeMs);
+            ok = std::fwrite(&h, sizeof(h), 1, m_file) == 1;
+            for (int f = 0; f < m_fieldCount && ok; ++f)
+                ok = std::fwrite(m_coders[f].blocks.data(), 1, h.fieldBytes[f], m_file) == h.fieldBytes[f];
+        }
+        if (keyframe) m_index.push_back(RecordingIndexEntry{m_offset, h.step, h.index, 0});
+        m_offset += sizeof(h) + h.payloadBytes;
+        ++m_frames;
+
+        lock.lock();
+        m_stats.encodeMs += encodeMs;
+        m_stats.writeMs += writeMs;
+        if (ok) {
+            ++m_stats.frames;
+            m_stats.keyframes += keyframe;
+            m_stats.rawBytes += m_slots[slot].values.size() * sizeof(float);
+            m_stats.storedBytes += sizeof(h) + h.payloadBytes;
+        } else if (m_error.empty()) {
+            m_error = std::string("cannot write a frame: ") + std::strerror(errno);
+        }
+        m_free.push_back(slot);
+        m_freed.notify_one();
+    }
+}
+
+// Fills h and the coders' blocks with the frame; the coders move on to it.
+void FieldRecorder::encode(const Slot& slot, bool keyframe, RecordingFrameHeader& h) {
+    h.magic = RecordingFrameHeader::FrameMagic;
+    h.flags = keyframe ? uint32_t(RecordingFrameHeader::Keyframe) : 0u;
+    h.step = slot.step;
+    h.index = m_frames;
+
+    struct Frame { const Slot* slot; RecordingFrameHeader* h; bool keyframe; } frame{&slot, &h, keyframe};
+    // Two pointers, which std::function holds without allocating
+    auto fields = [this, &frame](int f0, int f1) {
+        for (int f = f0; f < f1; ++f) encodeField(*frame.slot, frame.keyframe, f, *frame.h);
+    };
+    if (m_opt.pool) m_opt.pool->parallelFor(0, m_fieldCount, fields, 1);
+    else            fields(0, m_fieldCount);
+
+    h.payloadBytes = 0;
+    for (int f = 0; f < m_fieldCount; ++f) h.payloadBytes += h.fieldBytes[f];
+}
+
+// Field slot f of the frame; touches only what belongs to f.
+void FieldRecorder::encodeField(const Slot& slot, bool keyframe, int f, RecordingFrameHeader& h) {
+    const int Nx = m_Nx, Ny = m_Ny, bits = m_opt.bits;
+    const size_t n = size_t(Nx) * Ny;
+    const uint32_t maxQ = (1u << bits) - 1;
+    const float* x = slot.values.data() + f * n;
+    FieldCoder& c = m_coders[f];
+    const float lo = slot.lo[f], hi = slot.hi[f];
+    float scale = hi > lo ? float(maxQ) / (hi - lo) : 0.f;
+    float step  = hi > lo ? (hi - lo) / float(maxQ) : 0.f;
+    h.lo[f] = lo; h.quantum[f] = step; h.scale[f] = scale;
+
+    const float pl = c.prevLo, ps = c.prevStep;
+    uint8_t* out = c.blocks.data();
+    size_t bytes;
+    if (bits == 8) {
+        uint8_t* pq = reinterpret_cast<uint8_t*>(c.prevQ.data());
+        uint8_t* row = reinterpret_cast<uint8_t*>(c.row.data());
+        bytes = keyframe ? encodeResiduals<8, true>(x, pq, pl, ps, Nx, Ny, lo, scale, row, out)
+                         : encodeResiduals<8, false>(x, pq, pl, ps, Nx, Ny, lo, scale, row, out);
+    } else {
+        uint16_t* pq = c.prevQ.data();
+        bytes = keyframe ? encodeResiduals<16, true>(x, pq, pl, ps, Nx, Ny, lo, scale, c.row.data(), out)
+                         : encodeResiduals<16, false>(x, pq, pl, ps, Nx, Ny, lo, scale, c.row.data(), out);
+    }
+    c.prevLo = lo; c.prevStep = step;
+    h.fieldBytes[f] = uint32_t(bytes);
+}
+
+// ===== FieldRecordingReader =================================================
+
+bool FieldRecordingReader::fail(const std::string& why) {
+    m_error = why;
+    return false;
+}
+
+bool FieldRecordingReader::open(const std::string& path) {
+    close();
+    m_error.clear();
+    m_file = std::fopen(path.c_str(), "rb");
+    if (!m_file) return fail("cannot open " + path + ": " + std::strerror(errno));
+    RecordingHeader& h = m_header;
+    if (std::fread(&h, sizeof(h), 1, m_file) != 1 || std::memcmp(h.magic, Magic, sizeof(Magic)) != 0) {
+        close();
+        return fail(path + " is not a field recording");
+    }
+    m_fieldCount = fieldCount(h.fields);
+    if (h.version < 1 || h.headerBytes < sizeof(RecordingHeader) || (h.bits != 8 && h.bits != 16) || h.N < 1 || h.Ny < 1 ||
+        !m_fieldCount || h.keyframeInterval < 1) {
+        close();
+        return fail(path + " has an unknown recording version " + std::to_string(h.version));
+    }
+    if (!readIndex()) scanIndex();
+    if (m_index.empty()) { close(); return fail(path + " holds no frames"); }
+    size_t n = size_t(h.N) * h.Ny;
+    m_recon.assign(n * m_fieldCount, 0.f);
+    m_residuals.resize(blockCount(n) * BlockValues);
+    return seekKeyframe(0);
+}
+
+void FieldRecordingReader::close() {
+    if (m_file) std::fclose(m_file);
+    m_file = nullptr;
+    m_header = RecordingHeader();
+    m_index.clear();
+    m_havePrevious = false;
+}
+
+// The index written by FieldRecorder::close(), if the file has one that fits.
+bool FieldRecordingReader::readIndex() {
+    if (std::fseek(m_file, 0, SEEK_END) != 0) return false;
+    long size = std::ftell(m_file);
+    RecordingTrailer t;
+    if (size < long(m_header.headerBytes + sizeof(t)) || std::fseek(m_file, size - long(sizeof(t)), SEEK_SET) != 0 ||
+        std::fread(&t, sizeof(t), 1, m_file) != 1 || t.magic != RecordingTrailer::IndexMagic ||
+        t.indexOffset < m_header.headerBytes ||
+        t.indexOffset + uint64_t(t.count) * sizeof(RecordingIndexEntry) + sizeof(t) != uint64_t(size))
+        return false;
+    m_index.resize(t.count);
+    if (std::fseek(m_file, long(t.indexOffset), SEEK_SET) != 0 ||
+        (t.count && std::fread(m_index.data(), sizeof(RecordingIndexEntry), t.count, m_file) != t.count)) {
+        m_index.clear();
+        return false;
+    }
+    m_end = t.indexOffset;
+    return true;
+}
+
+// A recording that was not closed: walk the frame headers up to the first incomplete one.
+void FieldRecordingReader::scanIndex() {
+    m_index.clear();
+    uint64_t pos = m_header.headerBytes;
+    RecordingFrameHeader h;
+    while (std::fseek(m_file, long(pos), SEEK_SET) == 0 && std::fread(&h, sizeof(h), 1, m_file) == 1 &&
+           h.magic == RecordingFrameHeader::FrameMagic) {
+        uint64_t next = pos + sizeof(h) + h.payloadBytes;
+        if (std::fseek(m_file, long(next), SEEK_SET) != 0) break;
+        // the payload must be all there: peek at its last byte
+        if (h.payloadBytes && (std::fseek(m_file, long(next) - 1, SEEK_SET) != 0 || std::fgetc(m_file) == EOF)) break;
+        if (h.flags & RecordingFrameHeader::Keyframe) m_index.push_back(RecordingIndexEntry{pos, h.step, h.index, 0});
+        pos = next;
+    }
+    m_end = pos;
+}
+
+bool FieldRecordingReader::seekKeyframe(int k) {
+    if (!m_file || k < 0 || k >= keyframeCount()) return fail("no keyframe " + std::to_string(k));
+    if (std::fseek(m_file, long(m_index[k].offset), SEEK_SET) != 0) return fail("cannot seek in the recording");
+    m_havePrevious = false;
+    return true;
+}
+
+bool FieldRecordingReader::next(RecordedFrame& frame) {
+    if (!m_file) return false;
+    long pos = std::ftell(m_file);
+    if (pos < 0 || uint64_t(pos) + sizeof(RecordingFrameHeader) > m_end) return false;
+    RecordingFrameHeader h;
+    if (std::fread(&h, sizeof(h), 1, m_file) != 1 || h.magic != RecordingFrameHeader::FrameMagic)
+        return fail("damaged frame header");
+    const int Nx = m_header.N, Ny = m_header.Ny, bits = int(m_header.bits);
+    const size_t n = size_t(Nx) * Ny;
+    uint64_t bytes = 0;
+    for (int f = 0; f < m_fieldCount; ++f) bytes += h.fieldBytes[f];
+    if (bytes != h.payloadBytes || h.payloadBytes > m_end - uint64_t(pos) - sizeof(h) ||
+        h.payloadBytes > uint64_t(m_fieldCount) * blockBound(n, bits))
+        return fail("damaged frame " + std::to_string(h.index));
+    bool keyframe = (h.flags & RecordingFrameHeader::Keyframe) != 0;
+    if (!keyframe && !m_havePrevious) return fail("frame " + std::to_string(h.index) + " needs the frames before it");
+
+    m_payload.resize(h.payloadBytes);
+    if (h.payloadBytes && std::fread(m_payload.data(), 1, h.payloadBytes, m_file) != h.payloadBytes)
+        return fail("truncated frame " + std::to_string(h.index));
+
+    const uint8_t* in = m_payload.data();
+    int f = 0;
+    for (int bit = 0; bit < 4; ++bit) {
+        std::vector<float>& out = frameField(frame, bit);
+        if (!(m_header.fields & (1u << bit))) { out.clear(); continue; }
+        const uint8_t* end = in + h.fieldBytes[f];
+        for (size_t k = 0; k < m_residuals.size() && in; k += BlockValues) in = unpackBlock(in, end, bits, &m_residuals[k]);
+        if (in != end) {
+            m_havePrevious = false;
+            return fail("damaged frame " + std::to_string(h.index));
+        }
+        out.resize(n);
+        float* recon = m_recon.data() + f * n;
+        float lo = h.lo[f], step = h.quantum[f], scale = h.scale[f];
+        const uint16_t* z = m_residuals.data();
+        if (bits == 8) (keyframe ? decodeResiduals<8, true> : decodeResiduals<8, false>)(z, recon, Nx, Ny, lo, scale, step);
+        else           (keyframe ? decodeResiduals<16, true> : decodeResiduals<16, false>)(z, recon, Nx, Ny, lo, scale, step);
+        std::memcpy(out.data(), recon, n * sizeof(float));
+        ++f;
+    }
+    frame.step = h.step;
+    frame.index = int(h.index);
+    frame.keyframe = keyframe;
+    m_havePrevious = true;
+    return true;
+}
@@ -0,0 +1,96 @@
+#include "FieldRenderer.h"
+#include "FluidGrid.h"
+#include "FieldSnapshot.h"
+#include "GLHeaders.h"
+#include "Colormap.h"
+#include <algorithm>
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F // OpenGL 1.2; <GL/gl.h> on Windows stops at 1.1
+#endif
+
+void FieldRenderer::drawVelocity(FluidGrid& grid){ drawVelocity(grid.nx(), grid.ny(), grid.u(), grid.v()); }
+void FieldRenderer::drawDensity(FluidGrid& grid){ drawDensity(grid.nx(), grid.ny(), grid.dens(), grid.temp()); }
+
+void FieldRenderer::drawVelocity(const FieldSnapshot& s){
+    if (s.Nx > 0) drawVelocity(s.Nx, s.Ny, s.u.data(), s.v.data());
+}
+void FieldRenderer::drawDensity(const FieldSnapshot& s){
+    if (s.Nx > 0) drawDensity(s.Nx, s.Ny, s.dens.data(), s.temp.data());
+}
+
+void FieldRenderer::drawVelocity(int N, int Ny, const float* uf, const float* vf){
+    float h = 1.0f/std::max(N,Ny); glColor3f(1,1,1); glLineWidth(1.0f); glBegin(GL_LINES);
+    for(int j=1;j<=Ny;++j){ float y=(j-0.5f)*h; for(int i=1;i<=N;++i){ float x=(i-0.5f)*h; float u=uf[IX(i,j,N)]; float v=vf[IX(i,j,N)]; glVertex2f(x,y); glVertex2f(x+u, y+v); } }
+    glEnd();
+}
+
+void FieldRenderer::drawDensity(int N, int Ny, const float* dens, const float* temp){
+    float h = 1.0f/std::max(N,Ny); glBegin(GL_QUADS);
+    for(int j=0; j<Ny; j++){ float y = j*h; for(int i=0; i<N; i++){ float x = i*h;
+            float d00 = dens[IX(i,j,N)],     t00 = temp[IX(i,j,N)];
+            float d10 = dens[IX(i+1,j,N)],   t10 = temp[IX(i+1,j,N)];
+            float d11 = dens[IX(i+1,j+1,N)], t11 = temp[IX(i+1,j+1,N)];
+            float d01 = dens[IX(i,j+1,N)],   t01 = temp[IX(i,j+1,N)];
+            
+            glColor3f(std::min(1.f, d00 + t00*0.5f), std::min(1.f, d00), std::max(0.f, d00 - t00*0.5f)); glVertex2f(x,y);
+            glColor3f(std::min(1.f, d10 + t10*0.5f), std::min(1.f, d10), std::max(0.f, d10 - t10*0.5f)); glVertex2f(x+h,y);
+            glColor3f(std::min(1.f, d11 + t11*0.5f), std::min(1.f, d11), std::max(0.f, d11 - t11*0.5f)); glVertex2f(x+h,y+h);
+            glColor3f(std::min(1.f, d01 + t01*0.5f), std::min(1.f, d01), std::max(0.f, d01 - t01*0.5f)); glVertex2f(x,y+h);
+    }} glEnd();
+}
+
+// ===== texture path =========================================================
+
+FieldRenderer::~FieldRenderer(){
+    if (m_texture) glDeleteTextures(1, &m_texture);
+}
+
+void FieldRenderer::drawDensityTexture(const FieldSnapshot& s){
+    if (s.Nx <= 0) return;
+    const int N = s.Nx, Ny = s.Ny, W = N + 1, H = Ny + 1; // one texel per node
+    m_pixels.resize(4*size_t(W)*H);
+    colormapDensity(N, Ny, s.dens.data(), s.temp.data(), m_pixels.data());
+
+    if (!m_texture) glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (m_textureW != W || m_textureH != H) { // (re)allocate only when the grid size changes
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, W, H, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        m_textureW = W; m_textureH = H;
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, m_pixels.data());
+
+    // Node i sits at x = i*h and at the centre of texel i, so the quad's corners map to the
+    // centres of the edge texels and bilinear filtering blends like the per-vertex colours.
+    float h = 1.0f/std::max(N,Ny), x1 = N*h, y1 = Ny*h;
+    float s0 = 0.5f/W, s1 = (N + 0.5f)/W, t0 = 0.5f/H, t1 = (Ny + 0.5f)/H;
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glTexCoord2f(s0,t0); glVertex2f(0,0);
+    glTexCoord2f(s1,t0); glVertex2f(x1,0);
+    glTexCoord2f(s1,t1); glVertex2f(x1,y1);
+    glTexCoord2f(s0,t1); glVertex2f(0,y1);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void FieldRenderer::drawVelocityGlyphs(const FieldSnapshot& s){
+    if (s.Nx <= 0) return;
+    const int N = s.Nx, Ny = s.Ny, k = std::max(1, glyphStride);
+    const float* uf = s.u.data(); const float* vf = s.v.data();
+    // Each glyph stands for k x k cells: it starts at the block's centre and is scaled by k
+    // so the arrows stay as long relative to their spacing as the full view's.
+    float h = 1.0f/std::max(N,Ny), scale = float(k);
+    glColor3f(1,1,1); glLineWidth(1.0f); glBegin(GL_LINES);
+    for(int j=1+k/2;j<=Ny;j+=k){ float y=(j-0.5f)*h; for(int i=1+k/2;i<=N;i+=k){ float x=(i-0.5f)*h;
+        float u=uf[IX(i,j,N)]*scale, v=vf[IX(i,j,N)]*scale;
+        glVertex2f(x,y); glVertex2f(x+u, y+v); } }
+    glEnd();
+}
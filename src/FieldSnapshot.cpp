@@ -0,0 +1,60 @@
+#include "FieldSnapshot.h"
+#include "FluidGrid.h"
+#include "ObstacleManager.h"
+#include "ObstacleVisitor.h"
+#include "RectObstacle.h"
+#include "MovableRectObstacle.h"
+#include "DiskObstacle.h"
+
+namespace {
+
+struct ShapeCollector : ObstacleVisitor {
+    std::vector<FieldSnapshot::Shape>& out;
+    explicit ShapeCollector(std::vector<FieldSnapshot::Shape>& shapes) : out(shapes) {}
+
+    void visit(const RectObstacle& r) override {
+        FieldSnapshot::Shape s;
+        s.type = ObstacleType::FixedRect;
+        s.pos = Vec2(r.getX(), r.getY());
+        s.w = r.getWidth(); s.h = r.getHeight();
+        out.push_back(s);
+    }
+    void visit(const MovableRectObstacle& r) override {
+        FieldSnapshot::Shape s;
+        s.type = ObstacleType::MovableRect;
+        s.pos = r.getCenter();
+        s.w = static_cast<float>(r.getWidth()); s.h = static_cast<float>(r.getHeight());
+        s.angle = r.getAngle();
+        s.selected = r.isSelected();
+        out.push_back(s);
+    }
+    void visit(const DiskObstacle& d) override {
+        FieldSnapshot::Shape s;
+        s.type = ObstacleType::Disk;
+        s.pos = d.getCenter();
+        s.w = d.getRadius();
+        s.selected = d.isSelected();
+        out.push_back(s);
+    }
+};
+
+void copyField(Field& dst, const float* src, size_t n) {
+    dst.assign(src, src + n); // keeps the capacity, so a same-sized copy does not allocate
+}
+
+} // namespace
+
+void FieldSnapshot::capture(FluidGrid& grid, const ObstacleManager* obstacles, long long stepCount) {
+    Nx = grid.nx(); Ny = grid.ny();
+    step = stepCount;
+    size_t n = fieldSize(Nx, Ny);
+    copyField(dens, grid.dens(), n);
+    copyField(temp, grid.temp(), n);
+    copyField(u, grid.u(), n);
+    copyField(v, grid.v(), n);
+    shapes.clear();
+    if (obstacles) {
+        ShapeCollector collector(shapes);
+        obstacles->accept(collector);
+    }
+}
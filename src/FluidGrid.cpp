@@ -1,18 +1,91 @@
 #include "FluidGrid.h"
+#include "BoundarySolver.h"
+#include "Resample.h"
 #include <algorithm>
 
-FluidGrid::FluidGrid(int N):m_N(N),m_arrSz(size_t(N+2)*(N+2)),
-    m_u(m_arrSz),m_v(m_arrSz),m_dens(m_arrSz),m_vort(m_arrSz),m_temp(m_arrSz),
-    m_uPrev(m_arrSz),m_vPrev(m_arrSz),m_densPrev(m_arrSz),m_tempPrev(m_arrSz){}
+FluidGrid::FluidGrid(int Nx,int Ny):m_Nx(Nx),m_Ny(Ny),m_arrSz(fieldSize(Nx,Ny)),
+    m_u(m_arrSz),m_v(m_arrSz),m_vort(m_arrSz),m_pressure(m_arrSz),
+    m_uPrev(m_arrSz),m_vPrev(m_arrSz),m_scalarTiles(Nx,Ny),
+    m_solid(m_arrSz,0),m_solidRow(Ny+2,0),m_solidVel(2,0.f){
+    addScalar("density");
+    addScalar("temperature"); // New
+}
+
+int FluidGrid::addScalar(const std::string& name, float diffusivity){
+    m_scalars.push_back(Scalar{name, diffusivity, Field(m_arrSz), Field(m_arrSz)});
+    return scalarCount()-1;
+}
+
+int FluidGrid::addSolid(float u, float v){
+    int id;
+    if(!m_freeSolids.empty()){ id=m_freeSolids.back(); m_freeSolids.pop_back(); }
+    else {
+        id=int(m_solidVel.size()/2);
+        if(id>0xffff) return 0;
+        m_solidVel.resize(m_solidVel.size()+2);
+    }
+    setSolidVelocity(id,u,v);
+    return id;
+}
+
+// Only the rows holding solids need clearing.
+void FluidGrid::clearSolids(){
+    for(int j=1;j<=m_Ny;++j)
+        if(m_solidRow[j]){
+            std::fill(m_solid.begin()+IX(0,j,m_Nx), m_solid.begin()+IX(0,j+1,m_Nx), uint16_t(0));
+            m_solidRow[j]=0;
+        }
+    m_solidCells=0;
+    m_solidVel.resize(2);
+    m_freeSolids.clear();
+    ++m_solidEpoch;
+}
+
+void FluidGrid::clearSources(){
+    std::fill(m_uPrev.begin(), m_uPrev.end(), 0.f);
+    std::fill(m_vPrev.begin(), m_vPrev.end(), 0.f);
+    for(auto& s : m_scalars) std::fill(s.source.begin(), s.source.end(), 0.f);
+}
 
 void FluidGrid::reset(){
     std::fill(m_u.begin(), m_u.end(), 0.f);
     std::fill(m_v.begin(), m_v.end(), 0.f);
-    std::fill(m_dens.begin(), m_dens.end(), 0.f);
     std::fill(m_vort.begin(), m_vort.end(), 0.f);
-    std::fill(m_temp.begin(), m_temp.end(), 0.f); // New
-    std::fill(m_uPrev.begin(), m_uPrev.end(), 0.f);
-    std::fill(m_vPrev.begin(), m_vPrev.end(), 0.f);
-    std::fill(m_densPrev.begin(), m_densPrev.end(), 0.f);
-    std::fill(m_tempPrev.begin(), m_tempPrev.end(), 0.f); // New
-}
\ No newline at end of file
+    std::fill(m_pressure.begin(), m_pressure.end(), 0.f);
+    for(auto& s : m_scalars) std::fill(s.value.begin(), s.value.end(), 0.f);
+    m_scalarTiles.clear();
+    clearSolids();
+    clearSources();
+}
+
+void FluidGrid::resize(int Nx,int Ny){
+    if(Nx==m_Nx && Ny==m_Ny) return;
+    int oldNx=m_Nx, oldNy=m_Ny;
+    size_t sz=fieldSize(Nx,Ny);
+    // b of each resampled field for BoundarySolver
+    auto resample=[&](Field& f,int b){
+        m_resizeCopy.assign(f.begin(),f.end());
+        f.resize(sz);
+        resampleField(oldNx,oldNy,m_resizeCopy.data(),Nx,Ny,f.data(),m_resizeScratch);
+        BoundarySolver::setBounds(Nx,Ny,b,f.data());
+    };
+    resample(m_u,1);
+    resample(m_v,2);
+    resample(m_pressure,0);
+    for(auto& s : m_scalars){
+        resample(s.value,0);
+        s.source.assign(sz,0.f);
+    }
+    m_vort.assign(sz,0.f);
+    m_uPrev.assign(sz,0.f);
+    m_vPrev.assign(sz,0.f);
+
+    m_Nx=Nx; m_Ny=Ny; m_arrSz=sz;
+    m_scalarTiles=TileMap(Nx,Ny);
+    m_solid.assign(sz,0);
+    m_solidRow.assign(Ny+2,0);
+    m_solidCells=0;
+    m_solidVel.resize(2);
+    m_freeSolids.clear();
+    ++m_solidEpoch;
+}
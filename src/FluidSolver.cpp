@@ -1,115 +1,378 @@
 #include "FluidSolver.h"
 #include "Util.h" 
+#include "Timer.h"
+#include "MultigridSolver.h"
+#include "ConjugateGradientSolver.h"
+#include "AdvectKernels.h"
+#include "AlignedAllocator.h"
+#include <atomic>
 #include <cstring>
 #include <cmath>
 #include <algorithm> 
+#include <vector>
 #include <iostream>
+#include <thread>
 
 FluidSolver::FluidSolver(FluidGrid& grid, ObstacleManager* manager)
-    :g(&grid),m_obstacleManager(manager){} 
+    :g(&grid),
+     m_pool(new ThreadPool(std::max(1u, std::thread::hardware_concurrency()))){
+    if (manager) m_boundaries.push_back(manager);
+}
+
+void FluidSolver::setThreadCount(int n) {
+    m_pool.reset(new ThreadPool(std::max(1, n)));
+    if (m_poisson) m_poisson->setThreadPool(m_pool.get());
+}
+
+void FluidSolver::setThreadPool(std::shared_ptr<ThreadPool> pool) {
+    m_pool = std::move(pool);
+    if (m_poisson) m_poisson->setThreadPool(m_pool.get());
+}
 
 void FluidSolver::addBoundary(SolidBoundary* b) {
     m_boundaries.push_back(b);
 }
 
+void FluidSolver::resize(int Nx, int Ny) {
+    bool warm = pressureWarm();
+    g->resize(Nx, Ny);
+    if (warm) setPressureWarm(true); // builds the solver for Nx x Ny, taking the resampled pressure
+}
+
 // ===== public helpers =====================================================
 void FluidSolver::addDensity(int i,int j,float amount){
-    g->dens()[IX(i,j,g->size())]+=amount;
+    g->dens()[IX(i,j,g->nx())]+=amount;
+    g->scalarTiles().markCell(i,j);
 }
 // New method to add temperature
 void FluidSolver::addTemperature(int i, int j, float amount) {
-    g->temp()[IX(i, j, g->size())] += amount;
+    g->temp()[IX(i, j, g->nx())] += amount;
+    g->scalarTiles().markCell(i, j);
 }
 void FluidSolver::addVelocity(int i,int j,float uu,float vv){
-    int N=g->size();
+    int N=g->nx();
     g->u()[IX(i,j,N)]+=uu;
     g->v()[IX(i,j,N)]+=vv;
 }
 
+// Calls fn(i0,i1) for the interior of row j (N cells long), or only for its active spans.
+template<class F>
+static inline void forRowSpans(const TileMap* tiles,int N,int j,const F& fn){
+    if(!tiles){ fn(1,N); return; }
+    for(const auto& sp : tiles->rowSpans(j)) fn(sp.i0,sp.i1);
+}
+
 // ===== source/force application ===========================================
-static void addSource(int N,float* x,const float* s,float dt){
-    int size=(N+2)*(N+2);
-    for(int i=0;i<size;++i) x[i]+=dt*s[i];
+static void addSource(int N,int Ny,float* x,const float* s,float dt){
+    std::size_t size=fieldSize(N,Ny);
+    for(std::size_t i=0;i<size;++i) x[i]+=dt*s[i];
+}
+// Only over the active tiles; the sources are zero everywhere else.
+static void addSource(int N,int Ny,float* x,const float* s,float dt,const TileMap& tiles){
+    for(int j=1;j<=Ny;++j)
+        forRowSpans(&tiles,N,j,[&](int i0,int i1){
+            for(int k=IX(i0,j,N);k<=IX(i1,j,N);++k) x[k]+=dt*s[k];
+        });
 }
 
 // ===== Gauss-Seidel linear solver =========================================
-static void linSolve(int N,int b,float* x,float* x0,float a,float c){
-    for(int k=0;k<20;++k){
-        for(int i=1;i<=N;++i)
-            for(int j=1;j<=N;++j)
-                x[IX(i,j,N)]=(x0[IX(i,j,N)]+
-                a*(x[IX(i-1,j,N)]+x[IX(i+1,j,N)]+x[IX(i,j-1,N)]+x[IX(i,j+1,N)]))/c;
-        BoundarySolver::setBounds(N,b,x);
+// Red-black ordering: a cell of one colour only reads cells of the other colour, so each
+// half-sweep can be split over rows in any way and the result is independent of the
+// number of threads.
+static const int kSweeps=20;
+
+static inline void relaxRow(int N,int j,int color,float* x,const float* x0,float a,float c,int i0,int i1){
+    int S=IX(0,1,N); float* xr=x+IX(0,j,N); const float* br=x0+IX(0,j,N);
+    for(int i=i0+(((j+i0)^color)&1);i<=i1;i+=2)
+        xr[i]=(br[i]+a*(xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S]))/c;
+}
+// Cells a solve is restricted to: the active tiles (null: all; cells outside are zero and
+// stay zero) minus the solid cells, which are never updated. near[j] is set for rows with a
+// solid cell in rows j-1..j+1; only those take the masked kernel. Next to a solid the field
+// either keeps the solid's value (Dirichlet: the solid cells hold it already, as for
+// velocity) or has no flux into it (Neumann: the solid neighbour acts as the cell itself, as
+// for pressure and scalars).
+struct SolveMask {
+    const TileMap*  tiles   = nullptr;
+    const uint16_t* solid   = nullptr;
+    const uint8_t*  near    = nullptr;
+    bool            neumann = false;
+};
+
+static inline void relaxRowSolid(int N,int j,int color,float* x,const float* x0,float a,float c,int i0,int i1,
+                                 const SolveMask& m){
+    int S=IX(0,1,N); float* xr=x+IX(0,j,N); const float* br=x0+IX(0,j,N); const uint16_t* sr=m.solid+IX(0,j,N);
+    for(int i=i0+(((j+i0)^color)&1);i<=i1;i+=2){
+        if(sr[i]) continue;
+        if(!m.neumann){ xr[i]=(br[i]+a*(xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S]))/c; continue; }
+        float sum=0; int k=0;
+        if(sr[i-1]) ++k; else sum+=xr[i-1];
+        if(sr[i+1]) ++k; else sum+=xr[i+1];
+        if(sr[i-S]) ++k; else sum+=xr[i-S];
+        if(sr[i+S]) ++k; else sum+=xr[i+S];
+        float d=c-a*k;
+        if(d>0) xr[i]=(br[i]+a*sum)/d; // d == 0: a pocket walled in on all sides
+    }
+}
+
+static inline void relaxRow(int N,int j,int color,float* x,const float* x0,float a,float c,const SolveMask& m){
+    bool solid=m.solid && m.near[j];
+    forRowSpans(m.tiles,N,j,[&](int i0,int i1){
+        if(solid) relaxRowSolid(N,j,color,x,x0,a,c,i0,i1,m);
+        else      relaxRow(N,j,color,x,x0,a,c,i0,i1);
+    });
+}
+
+static void linSolveSweeps(ThreadPool& pool,int N,int Ny,int b,float* x,const float* x0,float a,float c,
+                           const SolveMask& m){
+    for(int k=0;k<kSweeps;++k){
+        for(int color=0;color<2;++color)
+            pool.parallelFor(1,Ny+1,[&](int j0,int j1){
+                for(int j=j0;j<j1;++j) relaxRow(N,j,color,x,x0,a,c,m);
+            });
+        BoundarySolver::setBounds(N,Ny,b,x);
     }
 }
+
+// Temporally blocked version of linSolveSweeps. Half-sweep h (colour h&1 of sweep h/2) of
+// row r only needs half-sweep h-1 of rows r-1..r+1, so instead of streaming the whole grid
+// 40 times the half-sweeps run as a wavefront: at step t, half-sweep h is applied to row
+// t-h, in increasing h. Only about 40 rows are live at once and they stay in cache. The ghosts
+// of a row are refreshed right after its second colour, which is when the full sweep would
+// have done it, so every cell sees the same values and the result is bit-identical.
+// With several threads the half-sweeps are cut into consecutive stages that follow each
+// other down the grid as a pipeline: stage s starts row r once stage s-1 has finished r+1.
+static void linSolveWavefront(ThreadPool& pool,int N,int Ny,int b,float* x,const float* x0,float a,float c,
+                              const SolveMask& m){
+    const int H=2*kSweeps;
+    int stages=std::min(pool.size(),kSweeps);
+    // One cache line per stage; a plain vector would not honour alignas(64) before C++17.
+    struct alignas(64) Progress { std::atomic<int> rows; };
+    std::vector<Progress,AlignedAllocator<Progress>> done(stages);
+    for(auto& d : done) d.rows.store(0,std::memory_order_relaxed);
+
+    auto stage=[&](int s){
+        int h0=H*s/stages, h1=H*(s+1)/stages;
+        for(int t=1;t<=Ny+(h1-1-h0);++t){
+            if(s>0){
+                int need=std::min(t+1,Ny);
+                while(done[s-1].rows.load(std::memory_order_acquire)<need) std::this_thread::yield();
+            }
+            for(int h=h0;h<h1;++h){
+                int r=t-(h-h0);
+                if(r<1) break;
+                if(r>Ny) continue;
+                relaxRow(N,r,h&1,x,x0,a,c,m);
+                if(h&1) BoundarySolver::setRowBounds(N,Ny,b,r,x);
+            }
+            int finished=t-(h1-1-h0);
+            if(finished>=1) done[s].rows.store(finished,std::memory_order_release);
+        }
+    };
+    if(stages==1) stage(0);
+    else pool.parallelFor(0,stages,[&](int s0,int s1){ for(int s=s0;s<s1;++s) stage(s); },1);
+    BoundarySolver::setBounds(N,Ny,b,x);
+}
+
+static void linSolve(ThreadPool& pool,bool wavefront,int N,int Ny,int b,float* x,const float* x0,float a,float c,
+                     const SolveMask& m){
+    if(wavefront) linSolveWavefront(pool,N,Ny,b,x,x0,a,c,m);
+    else          linSolveSweeps(pool,N,Ny,b,x,x0,a,c,m);
+}
 // ===== private steps ======================================================
-void FluidSolver::diffuse(int b,float* x,float* x0,float diffc){
-    int N=g->size(); float a=dt*diffc*N*N;
-    linSolve(N,b,x,x0,a,1+4*a);
-}
-void FluidSolver::advect(int b,float* d,float* d0,float* u,float* v){
-    int N=g->size(); float dt0=dt*N;
-    for(int i=1;i<=N;++i)for(int j=1;j<=N;++j){
-        float x=i-dt0*u[IX(i,j,N)], y=j-dt0*v[IX(i,j,N)];
-        if(x<0.5f) x=0.5f; if(x>N+0.5f) x=N+0.5f; int i0=int(x); int i1=i0+1;
-        if(y<0.5f) y=0.5f; if(y>N+0.5f) y=N+0.5f; int j0=int(y); int j1=j0+1;
-        float s1=x-i0, s0=1-s1, t1=y-j0, t0=1-t1;
-        d[IX(i,j,N)] =
-            s0*(t0*d0[IX(i0,j0,N)]+t1*d0[IX(i0,j1,N)]) +
-            s1*(t0*d0[IX(i1,j0,N)]+t1*d0[IX(i1,j1,N)]);
-    }
-    BoundarySolver::setBounds(N,b,d);
-}
-void FluidSolver::project(float* u,float* v,float* p,float* div){
-    int N=g->size();
-    for(int i=1;i<=N;++i)for(int j=1;j<=N;++j){
-        div[IX(i,j,N)]=-0.5f*(u[IX(i+1,j,N)]-u[IX(i-1,j,N)]
-                            + v[IX(i,j+1,N)]-v[IX(i,j-1,N)])/N;
-        p[IX(i,j,N)]=0;
-    }
-    BoundarySolver::setBounds(N,0,div); BoundarySolver::setBounds(N,0,p);
-    linSolve(N,0,p,div,1,4);
-    for(int i=1;i<=N;++i)for(int j=1;j<=N;++j){
-        u[IX(i,j,N)]-=0.5f*N*(p[IX(i+1,j,N)]-p[IX(i-1,j,N)]);
-        v[IX(i,j,N)]-=0.5f*N*(p[IX(i,j+1,N)]-p[IX(i,j-1,N)]);
-    }
-    BoundarySolver::setBounds(N,1,u); BoundarySolver::setBounds(N,2,v);
+// Untimed: step() runs several of these as concurrent tasks and times the group.
+// With tiles, x and x0 must both be zero outside them. Velocity components (b = 1, 2) take
+// the solid velocity in solid cells, scalars (b = 0) do not flow into solids.
+void FluidSolver::diffuse(int b,float* x,float* x0,float diffc,const TileMap* tiles){
+    int N=g->nx(), Ny=g->ny();
+    // Without diffusion every sweep is x = x0, so just copy it.
+    if(diffc==0){
+        if(!tiles) std::memcpy(x,x0,fieldSize(N,Ny)*sizeof(float));
+        else for(int j=1;j<=Ny;++j)
+            forRowSpans(tiles,N,j,[&](int i0,int i1){
+                std::memcpy(x+IX(i0,j,N),x0+IX(i0,j,N),(i1-i0+1)*sizeof(float));
+            });
+        if(b!=0) fillSolids(b,x);
+        BoundarySolver::setBounds(N,Ny,b,x);
+        return;
+    }
+    float R=g->resolution();
+    float a=dt*diffc*R*R;
+    if(b!=0) fillSolids(b,x);
+    linSolve(*m_pool,gs_wavefront,N,Ny,b,x,x0,a,1+4*a,solveMask(tiles,b==0));
+}
+// The solid velocity component b (1: u, 2: v) into the solid cells of x.
+void FluidSolver::fillSolids(int b,float* x){
+    if(!m_solid) return;
+    int N=g->nx(), Ny=g->ny();
+    for(int j=1;j<=Ny;++j){
+        if(!g->rowHasSolid(j)) continue;
+        const uint16_t* sr=m_solid+IX(0,j,N); float* xr=x+IX(0,j,N);
+        for(int i=1;i<=N;++i)
+            if(sr[i]) xr[i] = b==1 ? g->solidU(sr[i]) : g->solidV(sr[i]);
+    }
+}
+SolveMask FluidSolver::solveMask(const TileMap* tiles,bool neumann) const {
+    SolveMask m;
+    m.tiles=tiles;
+    if(m_solid){ m.solid=m_solid; m.near=m_solidNear.data(); m.neumann=neumann; }
+    return m;
+}
+// Advects count fields through the same velocity; the backtrace and weights of each cell are
+// computed once for all of them. b[f] is the boundary type of field f (0 for all if null).
+// With tiles only their cells are written; the caller makes sure nothing else can change.
+// With solids (velocity only) the solid cells are not traced but set to the solid velocity.
+void FluidSolver::advect(int count,float* const* d,const float* const* d0,const int* b,const float* u,const float* v,
+                         const TileMap* tiles,bool solids){
+    ScopedTimer t(timer(timings.advect));
+    int N=g->nx(), Ny=g->ny(); float dt0=dt*g->resolution();
+    const uint16_t* solid = solids ? m_solid : nullptr;
+    m_pool->parallelFor(1,Ny+1,[&](int j0,int j1){
+        if(!tiles && !solid){ advectRows(advect_path,N,Ny,dt0,count,d,d0,u,v,j0,j1); return; }
+        for(int j=j0;j<j1;++j)
+            forRowSpans(tiles,N,j,[&](int i0,int i1){
+                if(!solid || !g->rowHasSolid(j)){ advectSpan(advect_path,N,Ny,dt0,count,d,d0,u,v,j,i0,i1); return; }
+                // runs of fluid cells go to the kernel, solid cells take their velocity
+                const uint16_t* sr=solid+IX(0,j,N);
+                for(int i=i0;i<=i1;){
+                    int k=i;
+                    if(sr[i]){
+                        for(;k<=i1 && sr[k];++k)
+                            for(int f=0;f<count;++f)
+                                if(b[f]) d[f][IX(k,j,N)] = b[f]==1 ? g->solidU(sr[k]) : g->solidV(sr[k]);
+                    } else {
+                        while(k<=i1 && !sr[k]) ++k;
+                        advectSpan(advect_path,N,Ny,dt0,count,d,d0,u,v,j,i,k-1);
+                    }
+                    i=k;
+                }
+            });
+    });
+    for(int f=0;f<count;++f) BoundarySolver::setBounds(N,Ny,b?b[f]:0,d[f]);
+}
+float FluidSolver::scalarDiffusivity(int k) const {
+    if(k==FluidGrid::Density)     return diff;
+    if(k==FluidGrid::Temperature) return temp_diffusivity;
+    return g->scalarDiffusivity(k);
+}
+// Lazily (re)creates the iterative pressure solver when the mode or grid size changes.
+PoissonSolver* FluidSolver::pressureSolver(){
+    int Nx=g->nx(), Ny=g->ny();
+    if(!m_poisson || m_poissonType!=pressure_solver || m_poisson->nx()!=Nx || m_poisson->ny()!=Ny){
+        if(pressure_solver==PressureSolverType::ConjugateGradient) m_poisson.reset(new ConjugateGradientSolver(Nx,Ny));
+        else                                                       m_poisson.reset(new MultigridSolver(Nx,Ny));
+        m_poisson->setThreadPool(m_pool.get());
+        m_poissonType=pressure_solver;
+    }
+    return m_poisson.get();
+}
+bool FluidSolver::pressureWarm() const {
+    return m_poisson && m_poissonType==pressure_solver && m_poisson->nx()==g->nx() && m_poisson->ny()==g->ny()
+        && m_poisson->warm();
+}
+void FluidSolver::setPressureWarm(bool warm){
+    if(pressure_solver!=PressureSolverType::GaussSeidel) pressureSolver()->setWarm(warm);
+}
+// rowSpeed, if given, receives max(|u|,|v|) of each row of the projected velocity.
+// Solid cells keep their velocity and have no divergence; a solid next to a fluid cell has
+// the pressure of that cell (no flow through the solid face).
+void FluidSolver::project(float* u,float* v,float* p,float* div,float* rowSpeed){
+    int N=g->nx(), Ny=g->ny(), S=IX(0,1,N);
+    float R=g->resolution();
+    bool warm = pressure_solver!=PressureSolverType::GaussSeidel;
+    const uint16_t* solid=m_solid;
+    {
+        ScopedTimer t(timer(timings.project));
+        m_pool->parallelFor(1,Ny+1,[&](int j0,int j1){
+            for(int j=j0;j<j1;++j)for(int i=1;i<=N;++i){
+                div[IX(i,j,N)]=-0.5f*(u[IX(i+1,j,N)]-u[IX(i-1,j,N)]
+                                    + v[IX(i,j+1,N)]-v[IX(i,j-1,N)])/R;
+                if(!warm) p[IX(i,j,N)]=0;
+            }
+            if(solid) for(int j=j0;j<j1;++j)
+                if(g->rowHasSolid(j))
+                    for(int i=1;i<=N;++i) if(solid[IX(i,j,N)]) div[IX(i,j,N)]=0;
+        });
+        BoundarySolver::setBounds(N,Ny,0,div); BoundarySolver::setBounds(N,Ny,0,p);
+        if(warm){
+            PoissonSolver* ps=pressureSolver();
+            ps->setSolids(solid);
+            m_pressureStats=ps->solve(p,div,pressure_tolerance,pressure_max_iterations);
+        } else {
+            linSolve(*m_pool,gs_wavefront,N,Ny,0,p,div,1,4,solveMask(nullptr,true));
+            m_pressureStats.iterations=kSweeps; m_pressureStats.residual=0.f;
+        }
+        m_pool->parallelFor(1,Ny+1,[&](int j0,int j1){
+            for(int j=j0;j<j1;++j){
+                if(solid && m_solidNear[j]){
+                    const uint16_t* sr=solid+IX(0,j,N); const float* pr=p+IX(0,j,N);
+                    for(int i=1;i<=N;++i){
+                        if(sr[i]) continue;
+                        float pc=pr[i];
+                        float pl=sr[i-1] ? pc : pr[i-1], pe=sr[i+1] ? pc : pr[i+1];
+                        float ps=sr[i-S] ? pc : pr[i-S], pn=sr[i+S] ? pc : pr[i+S];
+                        u[IX(i,j,N)]-=0.5f*R*(pe-pl);
+                        v[IX(i,j,N)]-=0.5f*R*(pn-ps);
+                    }
+                    continue;
+                }
+                for(int i=1;i<=N;++i){
+                    u[IX(i,j,N)]-=0.5f*R*(p[IX(i+1,j,N)]-p[IX(i-1,j,N)]);
+                    v[IX(i,j,N)]-=0.5f*R*(p[IX(i,j+1,N)]-p[IX(i,j-1,N)]);
+                }
+            }
+            if(rowSpeed) for(int j=j0;j<j1;++j){
+                float m=0;
+                for(int i=1;i<=N;++i) m=std::max(m,std::max(std::abs(u[IX(i,j,N)]),std::abs(v[IX(i,j,N)])));
+                rowSpeed[j]=m;
+            }
+        });
+        BoundarySolver::setBounds(N,Ny,1,u); BoundarySolver::setBounds(N,Ny,2,v);
+    }
+    // Measured outside the timer so profiling does not inflate the project phase.
+    if(!warm && profile) m_pressureStats.residual=PoissonSolver::relativeResidual(N,Ny,p,div,solid);
 }
 
 void FluidSolver::confine(float* u, float* v, float* w) {
-    int N = g->size();
-    float h  = 1.0f/N;
-    float h2 = 2.0f/N;
+    ScopedTimer t(timer(timings.confine));
+    int N = g->nx(), Ny = g->ny();
+    float h  = 1.0f/g->resolution();
+    float h2 = 2.0f/g->resolution();
 
-    for(int i=1;i<=N;++i)for(int j=1;j<=N;++j){
-        w[IX(i,j,N)]  = v[IX(i+1,j,N)] - v[IX(i-1,j,N)] - u[IX(i,j+1,N)] + u[IX(i,j-1,N)];
-        w[IX(i,j,N)] /= h2;
-    }
+    m_pool->parallelFor(1,Ny+1,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j)for(int i=1;i<=N;++i){
+            w[IX(i,j,N)]  = v[IX(i+1,j,N)] - v[IX(i-1,j,N)] - u[IX(i,j+1,N)] + u[IX(i,j-1,N)];
+            w[IX(i,j,N)] /= h2;
+        }
+    });
 
     // Calculate gradient using central difference method
-    for(int i=1;i<=N;++i)for(int j=1;j<=N;++j){
-        float gx = (std::abs(w[IX(i+1,j,N)]) - std::abs(w[IX(i-1,j,N)])) / h2;
-        float gy = (std::abs(w[IX(i,j+1,N)]) - std::abs(w[IX(i,j-1,N)])) / h2;
+    m_pool->parallelFor(1,Ny+1,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j)for(int i=1;i<=N;++i){
+            float gx = (std::abs(w[IX(i+1,j,N)]) - std::abs(w[IX(i-1,j,N)])) / h2;
+            float gy = (std::abs(w[IX(i,j+1,N)]) - std::abs(w[IX(i,j-1,N)])) / h2;
 
-        // normalize vector (gx, gy)
-        float dist = std::sqrt(gx*gx + gy*gy);
+            // normalize vector (gx, gy)
+            float dist = std::sqrt(gx*gx + gy*gy);
 
-        if (dist > 0) {
-            gx /= dist;
-            gy /= dist;
-        }
+            if (dist > 0) {
+                gx /= dist;
+                gy /= dist;
+            }
 
-        // N x w 
-        float fx = vort * h * gy * w[IX(i,j,N)];
-        float fy = vort * h * -gx * w[IX(i,j,N)];
+            // N x w 
+            float fx = vort * h * gy * w[IX(i,j,N)];
+            float fy = vort * h * -gx * w[IX(i,j,N)];
 
-        addVelocity(i,j,dt*fx,dt*fy);
-    }
+            addVelocity(i,j,dt*fx,dt*fy);
+        }
+    });
 }
 
 // New buoyancy force method
 void FluidSolver::applyBuoyancy(float* v, float* temp) {
-    int N = g->size();
+    ScopedTimer t(timer(timings.buoyancy));
+    int N = g->nx(), Ny = g->ny();
     float ambient_temp = 0.f; // Assume ambient temperature is 0
     
     // This is a force, so it should be scaled by dt
@@ -117,59 +380,278 @@ void FluidSolver::applyBuoyancy(float* v, float* temp) {
 
     if (scale == 0) return;
 
-    for (int i = 1; i <= N; ++i) {
-        for (int j = 1; j <= N; ++j) {
-            // We only need to affect vertical velocity 'v'
-            // Positive temperature -> upward force
-            if (temp[IX(i, j, N)] > ambient_temp) {
-                v[IX(i, j, N)] += scale * (temp[IX(i, j, N)] - ambient_temp);
+    for (int j = 1; j <= Ny; ++j) {
+        // With active tiles the temperature is zero outside them
+        forRowSpans(m_tiles, N, j, [&](int i0, int i1) {
+            for (int i = i0; i <= i1; ++i) {
+                // We only need to affect vertical velocity 'v'
+                // Positive temperature -> upward force
+                if (temp[IX(i, j, N)] > ambient_temp) {
+                    v[IX(i, j, N)] += scale * (temp[IX(i, j, N)] - ambient_temp);
+                }
+            }
+        });
+    }
+}
+
+// ===== fused force stage ===================================================
+// addSource on u/v and every scalar, buoyancy and vorticity confinement take several passes
+// over the grid when run one after the other. Here every row goes through three stages in a
+// rolling window instead: sources (row r), curl (row r-1, needs the sourced rows r-2..r) and
+// the confinement force (row r-2, needs the curl of rows r-3..r-1; no later curl reads its
+// u/v). Each value sees exactly the same operations as in the separate passes.
+struct ForceRows {
+    int N, Ny; float dt, scale, h, h2, vort;
+    float *u, *v, *w, *temp;
+    const float *u0, *v0;
+    int scalars; float* const* s; const float* const* s0;
+    const TileMap* tiles; // scalars only in these, see FluidSolver::active_tiles
+
+    // Cells k0..k1 of one row.
+    void scalarSources(int k0,int k1) const {
+        for(int f=0;f<scalars;++f){
+            float* x=s[f]; const float* x0=s0[f];
+            for(int k=k0;k<=k1;++k) x[k]+=dt*x0[k];
+        }
+    }
+    void buoyancy(int k0,int k1) const {
+        if(scale!=0)
+            for(int k=k0;k<=k1;++k) if(temp[k]>0.f) v[k]+=scale*temp[k];
+    }
+    void sources(int j) const {
+        int k0=IX(0,j,N), k1=IX(N+1,j,N);
+        for(int k=k0;k<=k1;++k){ u[k]+=dt*u0[k]; v[k]+=dt*v0[k]; }
+        if(!tiles){
+            scalarSources(k0,k1);
+            if(j>=1 && j<=Ny) buoyancy(k0+1,k1-1);
+        } else if(j>=1 && j<=Ny){
+            forRowSpans(tiles,N,j,[&](int i0,int i1){
+                scalarSources(IX(i0,j,N),IX(i1,j,N)); buoyancy(IX(i0,j,N),IX(i1,j,N));
+            });
+        }
+    }
+    void curl(int j) const {
+        for(int i=1;i<=N;++i){
+            float c = v[IX(i+1,j,N)] - v[IX(i-1,j,N)] - u[IX(i,j+1,N)] + u[IX(i,j-1,N)];
+            w[IX(i,j,N)] = c/h2;
+        }
+    }
+    void force(int j) const {
+        for(int i=1;i<=N;++i){
+            float gx = (std::abs(w[IX(i+1,j,N)]) - std::abs(w[IX(i-1,j,N)])) / h2;
+            float gy = (std::abs(w[IX(i,j+1,N)]) - std::abs(w[IX(i,j-1,N)])) / h2;
+            float dist = std::sqrt(gx*gx + gy*gy);
+            if (dist > 0) { gx /= dist; gy /= dist; }
+            float fx = vort * h * gy * w[IX(i,j,N)];
+            float fy = vort * h * -gx * w[IX(i,j,N)];
+            u[IX(i,j,N)] += dt*fx;
+            v[IX(i,j,N)] += dt*fy;
+        }
+    }
+};
+
+// The rows are cut into bands that run the window independently. Near a seam the curl and
+// force need rows of both bands in their pre-force state, so each band leaves its two rows
+// next to a seam without force (and its seam row without curl), and those few rows are
+// finished serially afterwards.
+void FluidSolver::applyForces(float* u,float* v,float* w,const float* u0,const float* v0){
+    ScopedTimer t(timer(timings.forces));
+    int Ny=g->ny(); float R=g->resolution();
+    ForceRows f{g->nx(), Ny, dt, buoyancy_on ? dt*buoyancy_factor : 0.f, 1.0f/R, 2.0f/R, vort,
+                u, v, w, g->temp(), u0, v0,
+                int(m_scalars.size()), m_scalars.data(), m_scalarSources.data(), m_tiles};
+
+    int bands=std::max(1,std::min(m_pool->size(),Ny/16));
+    auto bandStart=[&](int k){ return 1+int(int64_t(Ny)*k/bands); };
+    m_pool->parallelFor(0,bands,[&](int k0,int k1){
+        for(int k=k0;k<k1;++k){
+            int j0=bandStart(k), j1=bandStart(k+1)-1;
+            int aLo = k==0 ? 0 : j0,         aHi = k==bands-1 ? Ny+1 : j1;
+            int bLo = k==0 ? 1 : j0+1,       bHi = k==bands-1 ? Ny : j1-1;
+            int cLo = k==0 ? 1 : j0+2,       cHi = k==bands-1 ? Ny : j1-2;
+            for(int r=aLo;r<=aHi+2;++r){
+                if(r<=aHi) f.sources(r);
+                if(r-1>=bLo && r-1<=bHi) f.curl(r-1);
+                if(r-2>=cLo && r-2<=cHi) f.force(r-2);
             }
         }
+    },1);
+    for(int k=1;k<bands;++k){
+        int s=bandStart(k); // first row of band k
+        f.curl(s-1); f.curl(s);
+        for(int r=s-2;r<=s+1;++r) f.force(r);
+    }
+}
+
+// ===== active tiles ========================================================
+// FluidGrid::scalarTiles() holds the tiles with scalar content. A step adds the tiles with
+// sources, runs diffusion and advection over those tiles grown by how far content can travel
+// in one step (m_scalarRegion), and then drops the tiles that ended up empty.
+
+// Bit pattern of the largest |x[i]| for i = i0..i1. Non-negative floats order like their bits,
+// and the integer maximum vectorizes where the float one (with its NaN rules) does not.
+static inline uint32_t maxAbsBits(const float* x,int i0,int i1,uint32_t m=0){
+    for(int i=i0;i<=i1;++i){
+        uint32_t b; std::memcpy(&b,x+i,4); b&=0x7fffffffu;
+        m = b>m ? b : m;
     }
+    return m;
+}
+static inline uint32_t absBits(float t){ uint32_t b; std::memcpy(&b,&t,4); return b&0x7fffffffu; }
+
+// Each task owns whole tile rows, so the flags are set without races.
+void FluidSolver::markSourceTiles(){
+    ScopedTimer t(timer(timings.tiles));
+    TileMap& tiles=g->scalarTiles();
+    int N=g->nx(), Tx=tiles.tilesX(), Ty=tiles.tilesY(), ns=int(m_scalarSources.size());
+    m_pool->parallelFor(0,Ty,[&](int t0,int t1){
+        for(int tj=t0;tj<t1;++tj)
+            for(int f=0;f<ns;++f)
+                for(int j=tiles.firstCell(tj);j<=tiles.lastCellJ(tj);++j){
+                    const float* row=m_scalarSources[f]+IX(0,j,N);
+                    for(int ti=0;ti<Tx;++ti)
+                        if(!tiles.active(ti,tj) && maxAbsBits(row,tiles.firstCell(ti),tiles.lastCellI(ti)))
+                            tiles.set(ti,tj);
+                }
+    },1);
+    tiles.update();
+}
+
+// Advection moves content at most dt0*max(|u|,|v|) cells per axis, plus one for the bilinear
+// taps. Gauss-Seidel diffusion spreads it further, decaying by at least 4x per cell, so one
+// more tile of margin keeps what would leak past it far below any threshold. The speed comes
+// from the last project() of the step.
+void FluidSolver::growScalarRegion(){
+    ScopedTimer t(timer(timings.tiles));
+    float R=g->resolution();
+    float speed=*std::max_element(m_rowSpeed.begin(),m_rowSpeed.end());
+    bool diffusing=false;
+    for(int k=0;k<int(m_scalars.size());++k) diffusing = diffusing || scalarDiffusivity(k)!=0;
+
+    float cells=std::ceil(speed*dt*R)+1+(diffusing ? TileMap::Size : 0);
+    m_scalarRegion=g->scalarTiles();
+    if(!(cells<std::max(g->nx(),g->ny()))) m_scalarRegion.fill();
+    else           m_scalarRegion.dilate((int(cells)+TileMap::Size-1)/TileMap::Size);
+}
+
+// Only the region was written this step and everything outside it is zero, so only its tiles
+// are checked. A tile stays if any scalar is above tile_threshold there, otherwise the rest
+// of it is zeroed.
+void FluidSolver::retireScalarTiles(){
+    ScopedTimer t(timer(timings.tiles));
+    TileMap& tiles=g->scalarTiles();
+    const TileMap& region=m_scalarRegion;
+    int N=g->nx(), Ny=g->ny(), Tx=tiles.tilesX(), Ty=tiles.tilesY(), ns=int(m_scalars.size());
+    uint32_t threshold=absBits(tile_threshold);
+    m_tileMax.assign(size_t(Tx)*Ty,0);
+    m_pool->parallelFor(0,Ty,[&](int t0,int t1){
+        for(int tj=t0;tj<t1;++tj){
+            // Row by row along the tile row, so the fields stream through memory
+            uint32_t* m=m_tileMax.data()+size_t(Tx)*tj;
+            for(int f=0;f<ns;++f)
+                for(int j=tiles.firstCell(tj);j<=tiles.lastCellJ(tj);++j)
+                    for(const auto& sp : region.rowSpans(j))
+                        for(int ti=tiles.tileOfI(sp.i0);ti<=tiles.tileOfI(sp.i1);++ti)
+                            m[ti]=maxAbsBits(m_scalars[f]+IX(0,j,N),tiles.firstCell(ti),tiles.lastCellI(ti),m[ti]);
+            for(int ti=0;ti<Tx;++ti){
+                if(!region.active(ti,tj)) continue;
+                if(m[ti]>threshold){ tiles.set(ti,tj); continue; }
+                tiles.reset(ti,tj);
+                if(m[ti]){
+                    int i0=tiles.firstCell(ti), i1=tiles.lastCellI(ti);
+                    for(int f=0;f<ns;++f)
+                        for(int j=tiles.firstCell(tj);j<=tiles.lastCellJ(tj);++j)
+                            std::fill(m_scalars[f]+IX(i0,j,N),m_scalars[f]+IX(i1+1,j,N),0.f);
+                }
+            }
+        }
+    },1);
+    tiles.update();
+    for(int f=0;f<ns;++f) BoundarySolver::setBounds(N,Ny,0,m_scalars[f]);
+}
+
+// ===== solid cells =========================================================
+// The boundaries update FluidGrid's solid mask once per step; from then on the kernels only
+// read the mask.
+void FluidSolver::rasterizeSolids(){
+    ScopedTimer t(timer(timings.obstacles));
+    for (SolidBoundary* b : m_boundaries) b->rasterize(*g);
+    m_solid = g->hasSolids() ? g->solid() : nullptr;
+    if (!m_solid) return;
+    int Ny=g->ny();
+    m_solidNear.assign(Ny+2,0);
+    for (int j=1;j<=Ny;++j)
+        if (g->rowHasSolid(j)) m_solidNear[j-1]=m_solidNear[j]=m_solidNear[j+1]=1;
 }
 
 // ===== main solver tick ====================================================
 void FluidSolver::step(){
-    int N=g->size();
+    int N=g->nx(), Ny=g->ny();
     auto *u=g->u(), *v=g->v(), *w=g->vort(),
-         *temp=g->temp(), // New
-         *u0=g->m_uPrev.data(), *v0=g->m_vPrev.data(),
-         *dens=g->dens(), *dens0=g->m_densPrev.data(),
-         *temp0=g->m_tempPrev.data(); // New
-    
-    addSource(N, u, u0, dt);
-    addSource(N, v, v0, dt);
-    addSource(N, dens, dens0, dt);
-    addSource(N, temp, temp0, dt); // New
+         *u0=g->uPrev(), *v0=g->vPrev();
+    int ns=g->scalarCount();
+    m_scalars.resize(ns); m_scalarSources.resize(ns);
+    for(int k=0;k<ns;++k){ m_scalars[k]=g->scalar(k); m_scalarSources[k]=g->scalarSource(k); }
+
+    rasterizeSolids();
 
+    // Without active tiles the scalars can end up anywhere, so the map is reset to all.
+    m_tiles = nullptr;
+    if (active_tiles) { markSourceTiles(); m_tiles = &g->scalarTiles(); }
+    else              g->scalarTiles().fill();
+    
     // --- APPLY FORCES ---
-    if (buoyancy_on) {
-        applyBuoyancy(v, temp);
+    if (fused_forces) {
+        applyForces(u, v, w, u0, v0);
+    } else {
+        {
+            ScopedTimer t(timer(timings.addSource));
+            addSource(N, Ny, u, u0, dt);
+            addSource(N, Ny, v, v0, dt);
+            for (int k = 0; k < ns; ++k) {
+                if (m_tiles) addSource(N, Ny, m_scalars[k], m_scalarSources[k], dt, *m_tiles);
+                else         addSource(N, Ny, m_scalars[k], m_scalarSources[k], dt);
+            }
+        }
+        if (buoyancy_on) {
+            applyBuoyancy(v, g->temp());
+        }
+        confine(u, v, w);
     }
-    confine(u, v, w);
 
     // --- SOLVE VELOCITY ---
-    std::swap(u0, u); diffuse (1,u,u0,visc);
-    std::swap(v0, v); diffuse (2,v,v0,visc);
+    std::swap(u0, u); std::swap(v0, v);
+    {
+        ScopedTimer t(timer(timings.diffuse));
+        ThreadPool::TaskGroup tasks(*m_pool);
+        tasks.run([&]{ diffuse(1,u,u0,visc); });
+        tasks.run([&]{ diffuse(2,v,v0,visc); });
+    }
 
-    // Apply obstacle velocities before projection to make fluid flow around them
-    if (m_obstacleManager) m_obstacleManager->applyTo(*g);
-    project (u,v,u0,v0);
+    // The solid cells already hold their velocity (diffuse), project flows around them
+    project (u,v,g->pressure(),v0);
 
     std::swap(u0, u); std::swap(v0, v);
-    advect  (1,u,u0,u0,v0);
-    advect  (2,v,v0,u0,v0);
-    
-    // Apply obstacle velocities again before final projection
-    if (m_obstacleManager) m_obstacleManager->applyTo(*g);
-    project (u,v,u0,v0);
+    {
+        float* d[2]={u,v}; const float* d0[2]={u0,v0}; const int b[2]={1,2};
+        advect(2,d,d0,b,u0,v0,nullptr,true);
+    }
+    if (m_tiles) m_rowSpeed.assign(Ny+2, 0.f);
+    project (u,v,g->pressure(),v0,m_tiles ? m_rowSpeed.data() : nullptr);
 
     // --- SOLVE SCALARS ---
-    // Density
-    std::swap(dens0, dens); diffuse (0,dens,dens0,diff);
-    std::swap(dens0, dens); advect  (0,dens,dens0,u,v);
-    
-    // Temperature (behaves just like density)
-    std::swap(temp0, temp); diffuse (0,temp,temp0,temp_diffusivity);
-    std::swap(temp0, temp); advect  (0,temp,temp0,u,v);
+    // The scalars are diffused into their source arrays as independent tasks, then all of
+    // them are advected back together.
+    const TileMap* region = nullptr;
+    if (m_tiles) { growScalarRegion(); region = &m_scalarRegion; }
+    {
+        ScopedTimer t(timer(timings.diffuse));
+        ThreadPool::TaskGroup tasks(*m_pool);
+        for (int k = 0; k < ns; ++k)
+            tasks.run([this,k,region]{ diffuse(0, m_scalarSources[k], m_scalars[k], scalarDiffusivity(k), region); });
+    }
+    advect(ns, m_scalars.data(), m_scalarSources.data(), nullptr, u, v, region);
+    if (m_tiles) retireScalarTiles();
+
+    if (profile) ++timings.steps;
 }
\ No newline at end of file
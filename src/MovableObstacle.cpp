@@ -1,15 +1,101 @@
 #include "MovableObstacle.h"
+#include "FluidGrid.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
 
 MovableObstacle::MovableObstacle(float x, float y, float angle)
     : m_x(x), m_y(y), m_angle(angle), m_angularVelocity(0.f), m_mass(1.f), m_inverseMass(1.f) {}
 
+const float MovableObstacle::RestSpeed = 0.05f;
+
 void MovableObstacle::update(float dt) {
+    if (m_asleep) return;
     m_x += m_vx * dt;
     m_y += m_vy * dt;
     m_angle += m_angularVelocity * dt;
+
+    bool resting = m_vx * m_vx + m_vy * m_vy < RestSpeed * RestSpeed && std::abs(m_angularVelocity) < RestSpeed;
+    m_restTime = resting ? m_restTime + dt : 0.f;
+}
+
+void MovableObstacle::sleep() {
+    m_asleep = true;
+    m_vx = m_vy = 0.f;
+    m_angularVelocity = 0.f;
+}
+
+void MovableObstacle::wake() {
+    if (!m_asleep) return;
+    m_asleep = false;
+    m_restTime = 0.f;
+}
+
+bool MovableObstacle::wakeByFluid(float u, float v) {
+    if (u * u + v * v < RestSpeed * RestSpeed) return false;
+    wake();
+    return true;
+}
+
+void MovableObstacle::updateFromFluid(FluidGrid& grid, float dt) {
+    float avgU, avgV;
+    if (!flowAround(grid, avgU, avgV)) return;
+    if (m_asleep && !wakeByFluid(avgU, avgV)) return;
+
+    m_vx += (avgU - m_vx) * couplingStrength * m_inverseMass * dt;
+    m_vy += (avgV - m_vy) * couplingStrength * m_inverseMass * dt;
+}
+
+bool MovableObstacle::flowAround(FluidGrid& grid, float& u, float& v) const {
+    int N = grid.nx(), Ny = grid.ny();
+    const CellCoverage& c = coverage(N, Ny);
+    if (c.empty()) return false;
+
+    int W = c.i1 - c.i0 + 3, H = c.j1 - c.j0 + 3;
+    auto at = [&](int i, int j) { return (i - c.i0 + 1) + W * (j - c.j0 + 1); };
+    m_covered.assign(size_t(W) * H, 0);
+    for (const CellCoverage::Run& r : c.runs)
+        std::fill(m_covered.begin() + at(r.i0, r.j), m_covered.begin() + at(r.i1, r.j) + 1, uint8_t(1));
+
+    const float* gu = grid.u();
+    const float* gv = grid.v();
+    const uint16_t* solid = grid.solid();
+    float sumU = 0.f, sumV = 0.f;
+    int faces = 0;
+    auto sample = [&](int i, int j) {
+        if (i < 1 || i > N || j < 1 || j > Ny || m_covered[at(i, j)] || solid[IX(i, j, N)]) return;
+        sumU += gu[IX(i, j, N)];
+        sumV += gv[IX(i, j, N)];
+        ++faces;
+    };
+    for (const CellCoverage::Run& r : c.runs) {
+        sample(r.i0 - 1, r.j);
+        sample(r.i1 + 1, r.j);
+        for (int i = r.i0; i <= r.i1; ++i) {
+            sample(i, r.j - 1);
+            sample(i, r.j + 1);
+        }
+    }
+    if (faces == 0) return false;
+    u = sumU / faces;
+    v = sumV / faces;
+    return true;
+}
+
+MovableObstacle::State MovableObstacle::state() const {
+    return State{m_x, m_y, m_angle, m_vx, m_vy, m_angularVelocity, m_restTime, m_asleep};
+}
+
+void MovableObstacle::setState(const State& s) {
+    m_x = s.x; m_y = s.y; m_angle = s.angle;
+    m_vx = s.vx; m_vy = s.vy; m_angularVelocity = s.angularVelocity;
+    m_restTime = s.restTime;
+    m_asleep = s.asleep;
+    m_isSelected = false;
 }
 
 void MovableObstacle::setVelocity(float vx, float vy) {
+    wake();
     m_vx = vx;
     m_vy = vy;
 }
@@ -21,6 +107,7 @@ void MovableObstacle::getVelocity(float& vx, float& vy) const {
 }
 
 void MovableObstacle::setAngularVelocity(float degreesPerSecond) {
+    wake();
     m_angularVelocity = degreesPerSecond;
 }
 
@@ -29,10 +116,17 @@ void MovableObstacle::setSelected(bool selected) {
 }
 
 void MovableObstacle::updatePosition(const Vec2& newPos) {
+    wake();
     m_x = newPos.x;
     m_y = newPos.y;
 }
 
+Obstacle::PoseKey MovableObstacle::poseKey() const {
+    PoseKey k;
+    k.x = quantize(m_x); k.y = quantize(m_y); k.angle = quantize(m_angle);
+    return k;
+}
+
 Vec2 MovableObstacle::getPosition() const {
     return {m_x, m_y};
 }
@@ -1,7 +1,5 @@
 #include "MovableRectObstacle.h"
-#include "FluidGrid.h"
-#include "Util.h"
-#include <GL/glut.h>
+#include "ObstacleVisitor.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
@@ -34,96 +32,35 @@ bool MovableRectObstacle::contains(int x, int y) const {
     return std::abs(rotated_x) <= m_w / 2.f && std::abs(rotated_y) <= m_h / 2.f;
 }
 
-void MovableRectObstacle::apply(FluidGrid& grid) const {
-    float* u = grid.u();
-    float* v = grid.v();
-    int N = grid.size();
-
+// Same test as contains(), with the rotation computed once instead of per cell.
+void MovableRectObstacle::computeCoverage(int Nx, int Ny, const PoseKey& key, std::vector<CellCoverage::Run>& runs) const {
     float max_dim = std::sqrt(static_cast<float>(m_w*m_w + m_h*m_h)) / 2.f + 2.f;
-    Vec2 center = getCenter();
+    Vec2 center(dequantize(key.x) + m_w / 2.f, dequantize(key.y) + m_h / 2.f);
     int i_min = std::max(1, static_cast<int>(center.x - max_dim));
-    int i_max = std::min(N, static_cast<int>(center.x + max_dim));
+    int i_max = std::min(Nx, static_cast<int>(center.x + max_dim));
     int j_min = std::max(1, static_cast<int>(center.y - max_dim));
-    int j_max = std::min(N, static_cast<int>(center.y + max_dim));
-
-    for (int i = i_min; i <= i_max; ++i) {
-        for (int j = j_min; j <= j_max; ++j) {
-            if(contains(i, j)) {
-                u[IX(i, j, N)] = m_vx;
-                v[IX(i, j, N)] = m_vy;
-            }
-        }
-    }
-}
-
-void MovableRectObstacle::updateFromFluid(FluidGrid& grid, float dt) {
-    float* u = grid.u();
-    float* v = grid.v();
-    int N = grid.size();
-
-    float sumU = 0.f;
-    float sumV = 0.f;
-    int count = 0;
-    
-    float max_dim = std::sqrt(static_cast<float>(m_w*m_w + m_h*m_h)) / 2.f + 2.f;
-    Vec2 center = getCenter();
-    int i_min = std::max(1, static_cast<int>(center.x - max_dim));
-    int i_max = std::min(N, static_cast<int>(center.x + max_dim));
-    int j_min = std::max(1, static_cast<int>(center.y - max_dim));
-    int j_max = std::min(N, static_cast<int>(center.y + max_dim));
-
-    for (int i = i_min; i <= i_max; ++i) {
-        for (int j = j_min; j <= j_max; ++j) {
-            if(contains(i, j)) {
-                int idx = IX(i, j, N);
-                sumU += u[idx];
-                sumV += v[idx];
-                ++count;
-            }
-        }
-    }
-
-    if (count == 0) return;
+    int j_max = std::min(Ny, static_cast<int>(center.y + max_dim));
 
-    float avgU = sumU / count;
-    float avgV = sumV / count;
-
-    float coupling_strength = 50.0f; 
-    m_vx += (avgU - m_vx) * coupling_strength * m_inverseMass * dt;
-    m_vy += (avgV - m_vy) * coupling_strength * m_inverseMass * dt;
+    float rads = PI * dequantize(key.angle) / 180.0f;
+    float sin_angle = std::sin(-rads);
+    float cos_angle = std::cos(-rads);
+    float hw = m_w / 2.f, hh = m_h / 2.f;
+
+    scanRuns(i_min, i_max, j_min, j_max, [&](int i, int j) {
+        float tx = static_cast<float>(i) - center.x;
+        float ty = static_cast<float>(j) - center.y;
+        float rotated_x = tx * cos_angle - ty * sin_angle;
+        float rotated_y = tx * sin_angle + ty * cos_angle;
+        return std::abs(rotated_x) <= hw && std::abs(rotated_y) <= hh;
+    }, runs);
 }
 
-void MovableRectObstacle::draw() const {
-    if (m_isSelected) {
-        glColor3f(0.8f, 0.8f, 0.2f); // Yellow when selected
-    } else {
-        glColor3f(0.8f, 0.5f, 0.2f); // Orange for movable
-    }
-
-    float h = 1.0f / m_gridN;
-    
-    Vec2 center = getCenter();
-    float cx = h * center.x;
-    float cy = h * center.y;
-
-    float hw = h * (m_w / 2.f);
-    float hh = h * (m_h / 2.f);
-    
-    glPushMatrix();
-    glTranslatef(cx, cy, 0.f);
-    glRotatef(m_angle, 0.f, 0.f, 1.f);
-    
-    glBegin(GL_QUADS);
-    glVertex2f(-hw, -hh);
-    glVertex2f( hw, -hh);
-    glVertex2f( hw,  hh);
-    glVertex2f(-hw,  hh);
-    glEnd();
-
-    glPopMatrix();
+void MovableRectObstacle::accept(ObstacleVisitor& visitor) const {
+    visitor.visit(*this);
 }
 
 void MovableRectObstacle::updatePosition(int newX, int newY) {
+    wake();
     m_x = static_cast<float>(newX);
     m_y = static_cast<float>(newY);
 }
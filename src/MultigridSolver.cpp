@@ -0,0 +1,267 @@
+#include "MultigridSolver.h"
+#include "BoundarySolver.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+// Rows 1..Ny, split over the pool when there is one. Every kernel below writes disjoint rows
+// (or one colour per pass), so the split never changes the result.
+template<class F>
+static void forRows(ThreadPool* pool,int Ny,const F& fn){
+    if(pool) pool->parallelFor(1,Ny+1,fn); else fn(1,Ny+1);
+}
+
+// ===== stencil helpers =====================================================
+// Walls are Neumann: a neighbour outside the grid is the cell itself, so it simply drops out of
+// both the sum and the diagonal. Solid neighbours (m non-null) drop out the same way, and
+// solid cells themselves are skipped. These slow paths are only used on the outermost ring
+// and on rows next to a solid. A fluid cell walled in on all sides is left out as well.
+static inline float neighbourSum(int Nx,int Ny,int i,int j,const float* x,const uint8_t* m,int& n){
+    int k=IX(i,j,Nx), S=IX(0,1,Nx);
+    float sum=0; n=0;
+    if(i>1  && !(m && m[k-1])){ sum+=x[k-1]; ++n; }
+    if(i<Nx && !(m && m[k+1])){ sum+=x[k+1]; ++n; }
+    if(j>1  && !(m && m[k-S])){ sum+=x[k-S]; ++n; }
+    if(j<Ny && !(m && m[k+S])){ sum+=x[k+S]; ++n; }
+    return sum;
+}
+static inline void relaxCell(int Nx,int Ny,int i,int j,float* x,const float* b,const uint8_t* m=nullptr){
+    int k=IX(i,j,Nx);
+    if(m && m[k]) return;
+    int n; float sum=neighbourSum(Nx,Ny,i,j,x,m,n);
+    if(n) x[k]=(b[k]+sum)/n;
+}
+static inline float residualCell(int Nx,int Ny,int i,int j,const float* x,const float* b,const uint8_t* m=nullptr){
+    int k=IX(i,j,Nx);
+    if(m && m[k]) return 0.f;
+    int n; float sum=neighbourSum(Nx,Ny,i,j,x,m,n);
+    return n? b[k]-(n*x[k]-sum) : 0.f;
+}
+
+// Coarse cell (I,J) covers fine cells 2I-1..2I x 2J-1..2J. The unscaled operator grows by
+// (2h/h)^2 = 4 on the coarse grid, so four times the average, i.e. the sum, is restricted.
+// On an odd side the last coarse cell has only one child across; it gets the sum of the
+// children there are, which keeps the total (and so the solvability of the Neumann problem).
+static void restrictSum(ThreadPool* pool,int Nf,int Nyf,const float* f,int Nc,int Nyc,float* c){
+    int Ifull=Nf/2;                        // coarse cells with two children across
+    forRows(pool,Nyc,[&](int J0,int J1){
+        for(int J=J0;J<J1;++J){
+            int j=2*J-1;
+            if(j==Nyf){
+                for(int I=1;I<=Nc;++I){
+                    int i=2*I-1;
+                    c[IX(I,J,Nc)]=I<=Ifull ? f[IX(i,j,Nf)]+f[IX(i+1,j,Nf)] : f[IX(i,j,Nf)];
+                }
+                continue;
+            }
+            for(int I=1;I<=Ifull;++I){
+                int i=2*I-1;
+                c[IX(I,J,Nc)]=f[IX(i,j,Nf)]+f[IX(i+1,j,Nf)]+f[IX(i,j+1,Nf)]+f[IX(i+1,j+1,Nf)];
+            }
+            if(Ifull<Nc) c[IX(Nc,J,Nc)]=f[IX(Nf,j,Nf)]+f[IX(Nf,j+1,Nf)];
+        }
+    });
+}
+
+// Bilinear (9/16, 3/16, 3/16, 1/16) interpolation. The coarse ghost cells are filled with
+// BoundarySolver first, which gives the Neumann mirror values at the walls.
+template<bool Add>
+static void prolong(ThreadPool* pool,int Nc,int Nyc,float* c,int Nf,int Nyf,float* f){
+    BoundarySolver::setBounds(Nc,Nyc,0,c);
+    forRows(pool,Nyf,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j){
+            int J=(j+1)/2, J2=(j&1)? J-1 : J+1;
+            for(int i=1;i<=Nf;++i){
+                int I=(i+1)/2, I2=(i&1)? I-1 : I+1;
+                float e=0.5625f*c[IX(I,J,Nc)]
+                       +0.1875f*(c[IX(I2,J,Nc)]+c[IX(I,J2,Nc)])
+                       +0.0625f*c[IX(I2,J2,Nc)];
+                if(Add) f[IX(i,j,Nf)]+=e; else f[IX(i,j,Nf)]=e;
+            }
+        }
+    });
+}
+
+// ===== MultigridSolver ======================================================
+MultigridSolver::MultigridSolver(int Nx,int Ny){
+    for(int nx=Nx,ny=Ny;;nx=(nx+1)/2,ny=(ny+1)/2){
+        Level L;
+        L.Nx=nx; L.Ny=ny; L.x=nullptr; L.b=nullptr;
+        size_t sz=fieldSize(nx,ny);
+        L.r.assign(sz,0.f);
+        L.rowNorm2.assign(ny+2,0.0);
+        if(!m_levels.empty()){ L.xs.assign(sz,0.f); L.bs.assign(sz,0.f); }
+        m_levels.push_back(std::move(L));
+        if(std::min(nx,ny)<=4) break;
+    }
+    for(size_t l=1;l<m_levels.size();++l){
+        m_levels[l].x=m_levels[l].xs.data();
+        m_levels[l].b=m_levels[l].bs.data();
+    }
+}
+
+// Level 0 takes the solver's ids; coarser levels are solid where all their children are.
+void MultigridSolver::buildMasks(){
+    for(size_t l=0;l<m_levels.size();++l){
+        Level& L=m_levels[l];
+        int N=L.Nx, Ny=L.Ny;
+        L.mask.assign(fieldSize(N,Ny),0);
+        L.nearRow.assign(Ny+2,0);
+        uint8_t* m=L.mask.data();
+        if(l==0){
+            for(int j=1;j<=Ny;++j) for(int i=1;i<=N;++i) m[IX(i,j,N)]=m_solid[IX(i,j,N)]!=0;
+        } else {
+            int Nf=m_levels[l-1].Nx, Nyf=m_levels[l-1].Ny; const uint8_t* f=m_levels[l-1].mask.data();
+            for(int J=1;J<=Ny;++J) for(int I=1;I<=N;++I){
+                int i=2*I-1, j=2*J-1;
+                uint8_t s=f[IX(i,j,Nf)];
+                if(i<Nf)            s&=f[IX(i+1,j,Nf)];
+                if(j<Nyf)           s&=f[IX(i,j+1,Nf)];
+                if(i<Nf && j<Nyf)   s&=f[IX(i+1,j+1,Nf)];
+                m[IX(I,J,N)]=s;
+            }
+        }
+        for(int j=1;j<=Ny;++j){
+            bool any=false;
+            for(int i=1;i<=N && !any;++i) any=m[IX(i,j,N)]!=0;
+            if(any) for(int k=std::max(1,j-1);k<=std::min(Ny,j+1);++k) L.nearRow[k]=1;
+        }
+        L.solid=m;
+    }
+}
+
+// Red-black Gauss-Seidel: cells with (i+j)%2==c are updated in half-sweep c.
+void MultigridSolver::smooth(Level& L,int sweeps){
+    int N=L.Nx, Ny=L.Ny, S=IX(0,1,N); float* x=L.x; const float* b=L.b; const uint8_t* m=L.solid;
+    for(int s=0;s<sweeps;++s)
+        for(int c=0;c<2;++c)
+            forRows(m_pool,Ny,[&](int j0,int j1){
+                for(int j=j0;j<j1;++j){
+                    int i=1+(((j+1)^c)&1);
+                    if(j==1||j==Ny){ for(;i<=N;i+=2) relaxCell(N,Ny,i,j,x,b,m); continue; }
+                    if(m && L.nearRow[j]){
+                        float* xr=x+IX(0,j,N); const float* br=b+IX(0,j,N); const uint8_t* mr=m+IX(0,j,N);
+                        for(;i<=N;i+=2){
+                            if(i==1||i==N||(mr[i-1]|mr[i]|mr[i+1]|mr[i-S]|mr[i+S])) relaxCell(N,Ny,i,j,x,b,m);
+                            else xr[i]=(br[i]+xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S])*0.25f;
+                        }
+                        continue;
+                    }
+                    if(i==1){ relaxCell(N,Ny,1,j,x,b); i+=2; }
+                    float* xr=x+IX(0,j,N); const float* br=b+IX(0,j,N);
+                    for(;i<N;i+=2) xr[i]=(br[i]+xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S])*0.25f;
+                    if(i==N) relaxCell(N,Ny,N,j,x,b);
+                }
+            });
+}
+
+// Row norms are summed in row order afterwards so the total is the same for any thread count.
+double MultigridSolver::residual(Level& L){
+    int N=L.Nx, Ny=L.Ny, S=IX(0,1,N); const float* x=L.x; const float* b=L.b; float* r=L.r.data();
+    const uint8_t* m=L.solid;
+    double* rowNorm2=L.rowNorm2.data();
+    forRows(m_pool,Ny,[&](int j0,int j1){
+        for(int j=j0;j<j1;++j){
+            double norm2=0;
+            if(j==1||j==Ny){
+                for(int i=1;i<=N;++i){ float v=residualCell(N,Ny,i,j,x,b,m); r[IX(i,j,N)]=v; norm2+=double(v)*v; }
+                rowNorm2[j]=norm2;
+                continue;
+            }
+            if(m && L.nearRow[j]){
+                const float* xr=x+IX(0,j,N); const float* br=b+IX(0,j,N); const uint8_t* mr=m+IX(0,j,N);
+                for(int i=1;i<=N;++i){
+                    float w;
+                    if(i==1||i==N||(mr[i-1]|mr[i]|mr[i+1]|mr[i-S]|mr[i+S])) w=residualCell(N,Ny,i,j,x,b,m);
+                    else w=br[i]-(4*xr[i]-(xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S]));
+                    r[IX(i,j,N)]=w; norm2+=double(w)*w;
+                }
+                rowNorm2[j]=norm2;
+                continue;
+            }
+            float v=residualCell(N,Ny,1,j,x,b); r[IX(1,j,N)]=v; norm2+=double(v)*v;
+            const float* xr=x+IX(0,j,N); const float* br=b+IX(0,j,N); float* rr=r+IX(0,j,N);
+            for(int i=2;i<N;++i){
+                float w=br[i]-(4*xr[i]-(xr[i-1]+xr[i+1]+xr[i-S]+xr[i+S]));
+                rr[i]=w; norm2+=double(w)*w;
+            }
+            v=residualCell(N,Ny,N,j,x,b); r[IX(N,j,N)]=v; norm2+=double(v)*v;
+            rowNorm2[j]=norm2;
+        }
+    });
+    double norm2=0;
+    for(int j=1;j<=Ny;++j) norm2+=rowNorm2[j];
+    return norm2;
+}
+
+void MultigridSolver::restrictResidual(const Level& fine,Level& coarse){
+    restrictSum(m_pool,fine.Nx,fine.Ny,fine.r.data(),coarse.Nx,coarse.Ny,coarse.b);
+}
+void MultigridSolver::prolongAdd(Level& coarse,Level& fine){
+    prolong<true>(m_pool,coarse.Nx,coarse.Ny,coarse.x,fine.Nx,fine.Ny,fine.x);
+}
+void MultigridSolver::prolongCopy(Level& coarse,Level& fine){
+    prolong<false>(m_pool,coarse.Nx,coarse.Ny,coarse.x,fine.Nx,fine.Ny,fine.x);
+}
+
+// The coarsest level is as elongated as the finest; smoothing along its long side needs
+// about as many more sweeps.
+int MultigridSolver::coarseSweeps() const {
+    const Level& C=m_levels.back();
+    int lo=std::min(C.Nx,C.Ny), hi=std::max(C.Nx,C.Ny);
+    return coarse_sweeps*((hi+lo-1)/lo);
+}
+
+void MultigridSolver::vcycle(size_t l){
+    Level& L=m_levels[l];
+    if(l+1==m_levels.size()){ smooth(L,coarseSweeps()); return; }
+
+    Level& C=m_levels[l+1];
+    smooth(L,pre_sweeps);
+    residual(L);
+    restrictResidual(L,C);
+    std::fill(C.xs.begin(),C.xs.end(),0.f);
+    vcycle(l+1);
+    prolongAdd(C,L);
+    smooth(L,post_sweeps);
+}
+
+// Full multigrid: solve on the coarsest grid first and interpolate upwards, one V-cycle
+// per level. Only used when there is no previous pressure to start from.
+void MultigridSolver::fmg(){
+    for(size_t l=1;l<m_levels.size();++l)
+        restrictSum(m_pool,m_levels[l-1].Nx,m_levels[l-1].Ny,m_levels[l-1].b,m_levels[l].Nx,m_levels[l].Ny,m_levels[l].b);
+    Level& C=m_levels.back();
+    std::fill(C.x,C.x+fieldSize(C.Nx,C.Ny),0.f);
+    smooth(C,coarseSweeps());
+    for(size_t l=m_levels.size()-1;l-->0;){
+        prolongCopy(m_levels[l+1],m_levels[l]);
+        vcycle(l);
+    }
+}
+
+PressureStats MultigridSolver::solve(float* p,float* div,float tol,int maxCycles){
+    Level& F=m_levels.front();
+    int Nx=F.Nx, Ny=F.Ny;
+    F.x=p; F.b=div;
+
+    if(m_solid) buildMasks();
+    else for(Level& L : m_levels) L.solid=nullptr;
+
+    PressureStats st;
+    double b2=removeMean(Nx,Ny,div,findRegions(Nx,Ny));
+    if(b2>0){
+        double tol2=double(tol)*tol*b2;
+        if(m_cold){ fmg(); ++st.iterations; m_cold=false; }
+        double r2=residual(F);
+        while(r2>tol2 && st.iterations<maxCycles){
+            vcycle(0);
+            ++st.iterations;
+            r2=residual(F);
+        }
+        st.residual=float(std::sqrt(r2/b2));
+    }
+    BoundarySolver::setBounds(Nx,Ny,0,p);
+    return st;
+}
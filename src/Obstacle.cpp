@@ -0,0 +1,38 @@
+#include "Obstacle.h"
+#include <algorithm>
+#include <cmath>
+
+int32_t Obstacle::quantize(float x) {
+    return static_cast<int32_t>(std::floor(x * PoseSteps + 0.5f));
+}
+
+static bool sameRuns(const std::vector<CellCoverage::Run>& a, const std::vector<CellCoverage::Run>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t k = 0; k < a.size(); ++k)
+        if (a[k].j != b[k].j || a[k].i0 != b[k].i0 || a[k].i1 != b[k].i1) return false;
+    return true;
+}
+
+const CellCoverage& Obstacle::coverage(int Nx, int Ny) const {
+    PoseKey key = poseKey();
+    if (Nx == m_coverageNx && Ny == m_coverageNy && key == m_key) return m_coverage;
+
+    m_scratch.clear();
+    computeCoverage(Nx, Ny, key, m_scratch);
+    m_key = key;
+    bool resized = Nx != m_coverageNx || Ny != m_coverageNy;
+    m_coverageNx = Nx; m_coverageNy = Ny;
+    // A small move often covers the same cells; then nothing downstream needs redoing.
+    if (!resized && sameRuns(m_scratch, m_coverage.runs)) return m_coverage;
+
+    CellCoverage& c = m_coverage;
+    c.runs.swap(m_scratch);
+    c.i0 = Nx + 1; c.i1 = 0; c.j0 = Ny + 1; c.j1 = 0;
+    for (const CellCoverage::Run& r : c.runs) {
+        c.i0 = std::min(c.i0, r.i0); c.i1 = std::max(c.i1, r.i1);
+        c.j0 = std::min(c.j0, r.j);  c.j1 = std::max(c.j1, r.j);
+    }
+    if (c.runs.empty()) { c.i0 = c.j0 = 1; c.i1 = c.j1 = 0; }
+    ++c.version;
+    return c;
+}
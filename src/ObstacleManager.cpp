@@ -3,19 +3,89 @@
 #include "MovableRectObstacle.h"
 #include "DiskObstacle.h"
 #include "Vec2.h"
-#include <GL/glut.h>
+#include "ObstacleVisitor.h"
+#include "ThreadPool.h"
+#include "FluidGrid.h"
+#include "Util.h"
 #include <algorithm>
-#include <limits>
+#include <cmath>
+#include <numeric>
 
-#define PI 3.1415926535f
-
-ObstacleManager::ObstacleManager(int gridN) : m_gridN(gridN) {}
+ObstacleManager::ObstacleManager(int gridNx, int gridNy) : m_gridNx(gridNx), m_gridNy(gridNy) {}
 ObstacleManager::~ObstacleManager() = default; 
 
-void ObstacleManager::applyTo(FluidGrid& grid) {
-    for (const auto& obs : m_obstacles) {
-        obs->apply(grid);
+void ObstacleManager::addDirty(const Rect& r) {
+    if (r.i0 <= r.i1 && r.j0 <= r.j1) m_dirty.push_back(r);
+}
+
+static bool overlaps(int a0, int a1, int b0, int b1) { return a0 <= b1 && b0 <= a1; }
+
+void ObstacleManager::rasterize(FluidGrid& grid) {
+    int N = grid.nx(), Ny = grid.ny();
+    if (&grid != m_grid || grid.solidEpoch() != m_solidEpoch) {
+        // A new or wiped mask (FluidGrid::clearSolids): every id is gone, start over.
+        m_grid = &grid;
+        m_solidEpoch = grid.solidEpoch();
+        m_dirty.clear(); m_released.clear(); m_ownsId.clear();
+        for (Stamp& s : m_stamps) s = Stamp();
     }
+    m_stamps.resize(m_obstacles.size());
+
+    // Bodies at rest only refresh their velocity; the others dirty the rect they covered
+    // and the one they cover now.
+    for (size_t k = 0; k < m_obstacles.size(); ++k) {
+        const Obstacle& obs = *m_obstacles[k];
+        Stamp& s = m_stamps[k];
+        const CellCoverage& c = obs.coverage(N, Ny);
+        float u, v;
+        obs.solidVelocity(u, v);
+        if (s.id == 0) {
+            s.id = grid.addSolid(u, v);
+            if (s.id == 0) continue; // out of ids: the obstacle is left out of the mask
+            if (size_t(s.id) >= m_ownsId.size()) m_ownsId.resize(s.id + 1, 0);
+            m_ownsId[s.id] = 1;
+        } else {
+            grid.setSolidVelocity(s.id, u, v);
+        }
+        if (s.stamped && s.version == c.version) continue;
+        if (s.stamped) addDirty(s.rect);
+        s.rect = Rect{c.i0, c.j0, c.i1, c.j1};
+        addDirty(s.rect);
+        s.version = c.version;
+        s.stamped = true;
+    }
+    if (m_dirty.empty()) return;
+
+    // Clear our cells inside the dirty rects, then stamp every obstacle back into them in
+    // list order, so overlaps resolve exactly as a full rasterization would.
+    Rect all = m_dirty.front();
+    for (const Rect& r : m_dirty) {
+        all.i0 = std::min(all.i0, r.i0); all.i1 = std::max(all.i1, r.i1);
+        all.j0 = std::min(all.j0, r.j0); all.j1 = std::max(all.j1, r.j1);
+        for (int j = r.j0; j <= r.j1; ++j) {
+            if (!grid.rowHasSolid(j)) continue;
+            const uint16_t* row = grid.solid() + IX(0, j, N);
+            for (int i = r.i0; i <= r.i1; ++i)
+                if (row[i] && row[i] < m_ownsId.size() && m_ownsId[row[i]]) grid.setSolid(i, j, 0);
+        }
+    }
+    for (int id : m_released) { m_ownsId[id] = 0; grid.releaseSolid(id); }
+    m_released.clear();
+
+    for (size_t k = 0; k < m_obstacles.size(); ++k) {
+        const Stamp& s = m_stamps[k];
+        if (!s.stamped || s.id == 0) continue;
+        if (!overlaps(s.rect.i0, s.rect.i1, all.i0, all.i1) || !overlaps(s.rect.j0, s.rect.j1, all.j0, all.j1)) continue;
+        const CellCoverage& c = m_obstacles[k]->coverage(N, Ny);
+        for (const Rect& r : m_dirty) {
+            if (!overlaps(s.rect.i0, s.rect.i1, r.i0, r.i1) || !overlaps(s.rect.j0, s.rect.j1, r.j0, r.j1)) continue;
+            for (const CellCoverage::Run& run : c.runs) {
+                if (run.j < r.j0 || run.j > r.j1) continue;
+                for (int i = std::max(run.i0, r.i0); i <= std::min(run.i1, r.i1); ++i) grid.setSolid(i, run.j, s.id);
+            }
+        }
+    }
+    m_dirty.clear();
 }
 
 void ObstacleManager::updateObstacles(FluidGrid& grid, float dt) {
@@ -24,238 +94,676 @@ void ObstacleManager::updateObstacles(FluidGrid& grid, float dt) {
     }
 }
 
+void ObstacleManager::updateObstacles(FluidGrid& grid, float dt, ThreadPool& pool) {
+    pool.parallelFor(0, static_cast<int>(m_obstacles.size()), [&](int k0, int k1) {
+        for (int k = k0; k < k1; ++k) m_obstacles[k]->updateFromFluid(grid, dt);
+    }, 4);
+}
+
 void ObstacleManager::update(float dt) {
     for (auto& obs : m_obstacles) {
         obs->update(dt);
     }
+    m_dt = dt;
+    m_indexValid = false;
 }
 
-void ObstacleManager::handleCollisions() {
-    std::vector<MovableObstacle*> movables;
+// Bounds are grown by a margin (cells): a body pushed less than that by the resolutions
+// since the index was built is still covered by its box. It is kContactMargin plus what a
+// body can be expected to be pushed this step, up to kMaxMargin: half of what it runs into
+// something by in a step at its speed (the push takes out about half of a new contact's
+// depth in a step), and as far as the last step pushed it (deep in a pile, the same
+// contacts push it step after step).
+static const float kContactMargin = 0.5f;
+static const float kMaxMargin = 4.0f;
+
+void ObstacleManager::gatherBodies() {
+    m_bodies.clear();
+    m_pool.clear();
     for (auto& obs : m_obstacles) {
-        if (auto m = dynamic_cast<MovableObstacle*>(obs.get())) {
-            movables.push_back(m);
+        switch (obs->type()) {
+        case ObstacleType::MovableRect: m_pool.addRect(static_cast<const MovableRectObstacle&>(*obs)); break;
+        case ObstacleType::Disk:        m_pool.addDisk(static_cast<const DiskObstacle&>(*obs)); break;
+        default: continue;
         }
+        m_bodies.push_back(static_cast<MovableObstacle*>(obs.get()));
     }
+    size_t n = m_bodies.size();
+    m_boxes.resize(n);
+    m_indexedAt.resize(n);
+    assignGrowing(m_margin, n, kContactMargin);
+    assignGrowing(m_shift, n, 0.f);
+    assignGrowing(m_active, n, 0);
+    assignGrowing(m_settled, n, 0);
+    assignGrowing(m_inRest, n, 0);
+    m_restIds.clear();
+    m_restBoxes.clear();
+    m_restHash.build(m_restBoxes);
+    m_restStale = 0;
+    m_bodiesValid = true;
+    reserveForBodies();
+}
 
-    const int iterations = 5; // Use several iterations to better resolve multiple collisions
-    for (int k=0; k < iterations; ++k) {
-        for (size_t i = 0; i < movables.size(); ++i) {
-            for (size_t j = i + 1; j < movables.size(); ++j) {
-                MovableObstacle* a = movables[i];
-                MovableObstacle* b = movables[j];
-
-                auto rect_a = dynamic_cast<MovableRectObstacle*>(a);
-                auto rect_b = dynamic_cast<MovableRectObstacle*>(b);
-                auto disk_a = dynamic_cast<DiskObstacle*>(a);
-                auto disk_b = dynamic_cast<DiskObstacle*>(b);
+// Candidate pairs per body that the pair arrays have room for; a dense pile has about 4.
+static const size_t kPairsPerBody = 6;
+
+// Sizes the arrays of a step from the body count, so a step does not allocate as piles form
+// and break up: kPairsPerBody candidates a body, twice that in the island arrays, which
+// merged islands append to, and half that in contacts, the most a pile of bodies that do not
+// overlap has (its contact graph is planar).
+void ObstacleManager::reserveForBodies() {
+    size_t n = m_bodies.size(), pairs = kPairsPerBody * n;
+    for (std::vector<int>* v : {&m_dynIds, &m_restIds, &m_hits, &m_restHits, &m_reboxed, &m_islandParent, &m_mergedInto})
+        v->reserve(n);
+    m_dynBoxes.reserve(n);
+    m_restBoxes.reserve(n);
+    m_islandStart.reserve(n + 1);
+    m_islandResults.reserve(n);
+    m_pairs.reserve(pairs);
+    m_reached.reserve(pairs);
+    m_merging.reserve(pairs);
+    m_islandPairs.reserve(2 * pairs);
+    m_pairContacts.reserve(2 * pairs);
+    m_pairTouched.reserve(2 * pairs);
+    m_contacts.reserve(static_cast<int>(pairs / 2));
+    for (IslandScratch& s : m_scratch) s.reserve(n);
+}
 
-                Vec2 mtv;
-                bool collided = false;
-
-                if (rect_a && rect_b) {
-                    collided = checkCollision(rect_a, rect_b, mtv);
-                } else if (disk_a && disk_b) {
-                    collided = checkCollision(disk_a, disk_b, mtv);
-                } else if (rect_a && disk_b) {
-                    collided = checkCollision(rect_a, disk_b, mtv);
-                } else if (rect_b && disk_a) {
-                    collided = checkCollision(rect_b, disk_a, mtv);
-                    mtv = -mtv; 
-                }
+// A worker's re-boxes stay well under one extra pair and one reach per body.
+void ObstacleManager::IslandScratch::reserve(size_t bodies) {
+    extraPairs.reserve(bodies);
+    extraContacts.reserve(bodies);
+    extraTouched.reserve(bodies);
+    touched.reserve(bodies);
+    reached.reserve(bodies);
+    for (std::vector<int>* v : {&moved, &hits, &restHits, &reboxed}) v->reserve(bodies);
+}
 
-                if (collided) {
-                    resolveCollision(a, b, mtv);
-                }
-            }
+// Awake bodies, and sleeping ones not read since they fell asleep, are read from their
+// obstacles; the rest stay as they are.
+void ObstacleManager::buildIndex() {
+    if (!m_bodiesValid) gatherBodies();
+    int n = static_cast<int>(m_bodies.size());
+    m_asleep.resize(n);
+    m_dynIds.clear();
+    int outside = 0; // asleep, not in m_restHash
+    for (int b = 0; b < n; ++b) {
+        const MovableObstacle& body = *m_bodies[b];
+        bool asleep = body.isAsleep();
+        m_asleep[b] = asleep;
+        if (m_inRest[b] && !asleep) { m_inRest[b] = 0; ++m_restStale; }
+        if (!asleep || !m_settled[b]) {
+            if (body.type() == ObstacleType::MovableRect) m_pool.refreshRect(b, static_cast<const MovableRectObstacle&>(body));
+            else                                          m_pool.refreshDisk(b, static_cast<const DiskObstacle&>(body));
+            float vx, vy;
+            m_pool.velocity(b, vx, vy);
+            m_margin[b] = std::min(kMaxMargin, kContactMargin + 0.5f * std::max(std::abs(vx), std::abs(vy)) * m_dt + m_shift[b]);
+            m_boxes[b] = boxOf(b);
+            m_indexedAt[b] = m_pool.position(b);
+            m_settled[b] = asleep;
         }
+        if (!m_inRest[b]) { m_dynIds.push_back(b); outside += asleep; }
+    }
+    int rest = static_cast<int>(m_restIds.size());
+    if (outside > 16 + rest / 8 || m_restStale > 16 + rest / 2) {
+        rebuildRest();
+        m_dynIds.clear();
+        for (int b = 0; b < n; ++b)
+            if (!m_inRest[b]) m_dynIds.push_back(b);
     }
+    m_dynBoxes.clear();
+    for (int b : m_dynIds) m_dynBoxes.push_back(m_boxes[b]);
+    m_hash.build(m_dynBoxes);
+    m_indexValid = true;
 }
 
-void ObstacleManager::resolveCollision(MovableObstacle* a, MovableObstacle* b, const Vec2& mtv) {
-    float invMassA = a->getInverseMass();
-    float invMassB = b->getInverseMass();
-    float totalInvMass = invMassA + invMassB;
-
-    if (totalInvMass == 0) return;
-
-    // --- 1. Positional Correction (The part you already have) ---
-    // This pushes the objects apart so they no longer overlap.
-    const float percent = 0.8f; // Correction percentage to avoid sinking
-    const float slop = 0.01f;   // A small buffer to prevent immediate re-collision
-    Vec2 correction = mtv * (std::max(mtv.len() - slop, 0.0f) / totalInvMass) * percent;
-    a->updatePosition(a->getPosition() + correction * invMassA);
-    b->updatePosition(b->getPosition() - correction * invMassB);
-
-    // --- 2. Impulse Resolution (The new part) ---
-    // This changes their velocities so they bounce off each other.
-    Vec2 normal = mtv.normalized();
-    Vec2 velA = Vec2(0,0); a->getVelocity(velA.x, velA.y);
-    Vec2 velB = Vec2(0,0); b->getVelocity(velB.x, velB.y);
-    
-    Vec2 relativeVel = velB - velA;
-    float velAlongNormal = relativeVel.dot(normal);
-
-    // Do not resolve if velocities are separating
-    if (velAlongNormal > 0) {
-        return;
+void ObstacleManager::rebuildRest() {
+    m_restIds.clear();
+    m_restBoxes.clear();
+    for (int b = 0; b < static_cast<int>(m_bodies.size()); ++b) {
+        m_inRest[b] = m_asleep[b];
+        if (!m_asleep[b]) continue;
+        m_restIds.push_back(b);
+        m_restBoxes.push_back(m_boxes[b]);
     }
+    m_restHash.build(m_restBoxes);
+    m_restStale = 0;
+}
 
-    float restitution = 0.3f; // Bounciness. 0 = no bounce, 1 = perfect bounce.
-
-    // Calculate impulse scalar
-    float j = -(1 + restitution) * velAlongNormal;
-    j /= totalInvMass;
-
-    // Apply impulse
-    Vec2 impulse = normal * j;
-    a->setVelocity(velA.x - impulse.x * invMassA, velA.y - impulse.y * invMassA);
-    b->setVelocity(velB.x + impulse.x * invMassB, velB.y + impulse.y * invMassB);
+void ObstacleManager::queryBodies(const SpatialHash::Box& box, std::vector<int>& out, std::vector<int>& tmp) const {
+    m_hash.query(box, out);
+    for (int& k : out) k = m_dynIds[k];
+    if (m_restIds.empty()) return;
+    m_restHash.query(box, tmp);
+    size_t own = out.size();
+    for (int k : tmp)
+        if (m_inRest[m_restIds[k]]) out.push_back(m_restIds[k]);
+    if (out.size() > own) std::sort(out.begin(), out.end());
 }
 
+// Candidate pairs with at least one awake body: those among the bodies read this build,
+// and those of their awake ones with the sleeping bodies in m_restHash.
+void ObstacleManager::findPairs() {
+    m_hash.pairs(m_pairs);
+    for (auto& p : m_pairs) p = std::make_pair(m_dynIds[p.first], m_dynIds[p.second]);
+    m_pairs.erase(std::remove_if(m_pairs.begin(), m_pairs.end(), [&](const std::pair<int,int>& p) {
+        return m_asleep[p.first] && m_asleep[p.second];
+    }), m_pairs.end());
+    if (m_restIds.empty()) return;
+    size_t own = m_pairs.size();
+    for (size_t k = 0; k < m_dynIds.size(); ++k) {
+        int a = m_dynIds[k];
+        if (m_asleep[a]) continue;
+        m_restHash.query(m_dynBoxes[k], m_hits);
+        for (int r : m_hits) {
+            int c = m_restIds[r];
+            if (m_inRest[c]) m_pairs.emplace_back(std::min(a, c), std::max(a, c));
+        }
+    }
+    if (m_pairs.size() > own) std::sort(m_pairs.begin(), m_pairs.end());
+}
 
-// Rect-Rect Collision (SAT)
-bool ObstacleManager::checkCollision(MovableRectObstacle* a, MovableRectObstacle* b, Vec2& mtv) {
-    std::vector<Vec2> axes;
-    std::vector<Vec2> verticesA, verticesB;
-    a->getVertices(verticesA);
-    b->getVertices(verticesB);
+int ObstacleManager::findRoot(int body) {
+    while (m_parent[body] != body) body = m_parent[body] = m_parent[m_parent[body]];
+    return body;
+}
 
-    for (int i = 0; i < 4; ++i) {
-        axes.push_back((verticesA[(i + 1) % 4] - verticesA[i]).perpendicular().normalized());
-        axes.push_back((verticesB[(i + 1) % 4] - verticesB[i]).perpendicular().normalized());
+// Islands are the connected groups of the pairs, numbered in the order of their first
+// pair; m_islandPairs lists each island's pairs in their global order.
+void ObstacleManager::buildIslands() {
+    int n = m_pool.size();
+    m_parent.resize(n);
+    std::iota(m_parent.begin(), m_parent.end(), 0);
+    for (const auto& p : m_pairs) {
+        int ra = findRoot(p.first), rb = findRoot(p.second);
+        if (ra != rb) m_parent[std::max(ra, rb)] = std::min(ra, rb);
+    }
+    assignGrowing(m_islandOf, n, -1);
+    int islands = 0;
+    for (const auto& p : m_pairs) {
+        int& id = m_islandOf[findRoot(p.first)];
+        if (id < 0) id = islands++;
+        m_islandOf[p.first] = m_islandOf[p.second] = id;
     }
+    // Counting sort: count into start[k], sum to the ends, then fill backwards.
+    assignGrowing(m_islandStart, islands + 1, 0);
+    for (const auto& p : m_pairs) ++m_islandStart[m_islandOf[p.first]];
+    std::partial_sum(m_islandStart.begin(), m_islandStart.end() - 1, m_islandStart.begin());
+    m_islandStart[islands] = static_cast<int>(m_pairs.size());
+    m_islandPairs.resize(m_pairs.size());
+    for (size_t p = m_pairs.size(); p-- > 0; )
+        m_islandPairs[--m_islandStart[m_islandOf[m_pairs[p].first]]] = m_pairs[p];
+}
 
-    float min_overlap = std::numeric_limits<float>::max();
+SpatialHash::Box ObstacleManager::boxOf(int body) const {
+    Vec2 lo, hi;
+    m_pool.bounds(body, lo, hi);
+    float m = m_margin[body];
+    return {lo.x - m, lo.y - m, hi.x + m, hi.y + m};
+}
 
-    for (const auto& axis : axes) {
-        float minA = std::numeric_limits<float>::max(), maxA = -std::numeric_limits<float>::max();
-        for (const auto& v : verticesA) { float p = v.dot(axis); minA = std::min(minA, p); maxA = std::max(maxA, p); }
+bool ObstacleManager::movedPastMargin(int body) const {
+    Vec2 d = m_pool.position(body) - m_indexedAt[body];
+    return std::abs(d.x) >= m_margin[body] || std::abs(d.y) >= m_margin[body];
+}
 
-        float minB = std::numeric_limits<float>::max(), maxB = -std::numeric_limits<float>::max();
-        for (const auto& v : verticesB) { float p = v.dot(axis); minB = std::min(minB, p); maxB = std::max(maxB, p); }
-        
-        if (maxA < minB || maxB < minA) return false;
+// Gives body a box where it is now and adds the pairs with it that the island's walk
+// lacks. The index keeps the boxes it was built with, so the island's bodies re-boxed
+// earlier are checked at their new boxes instead. Pairs with a partner outside the island go
+// to s.reached, for mergeReached(); pairs of two bodies that were both asleep when the step
+// began are left out. Pairs before current in the walk wait for the next iteration;
+// extraPos is the walk's cursor into s.extraPairs and is kept on the same pair.
+void ObstacleManager::rebox(int body, int island, std::pair<int,int> current, size_t& extraPos, IslandScratch& s) {
+    SpatialHash::Box box = boxOf(body);
+    m_indexedAt[body] = m_pool.position(body);
+    m_newBoxes[body] = box;
+    SpatialHash::Box& swept = m_sweptBoxes[body];
+    if (!m_moved[body]) {
+        m_moved[body] = 1;
+        s.moved.push_back(body);
+        s.reboxed.push_back(body);
+        swept = m_boxes[body];
+    }
+    swept = {std::min(swept.x0, box.x0), std::min(swept.y0, box.y0), std::max(swept.x1, box.x1), std::max(swept.y1, box.y1)};
+    ++m_islandResults[island].reboxed;
+
+    const auto begin = m_islandPairs.begin() + m_islandStart[island];
+    const auto end = m_islandPairs.begin() + m_islandStart[island + 1];
+    auto add = [&](int c) {
+        if ((m_asleep[body] | m_woken[body]) && (m_asleep[c] | m_woken[c])) return;
+        std::pair<int,int> q(std::min(body, c), std::max(body, c));
+        if (std::binary_search(begin, end, q)) return;
+        auto at = std::lower_bound(s.extraPairs.begin(), s.extraPairs.end(), q);
+        if (at != s.extraPairs.end() && *at == q) return;
+        size_t k = at - s.extraPairs.begin();
+        s.extraPairs.insert(at, q);
+        s.extraContacts.insert(s.extraContacts.begin() + k, ContactCache::Contact());
+        s.extraTouched.insert(s.extraTouched.begin() + k, 0);
+        if (q < current) ++extraPos;
+    };
+    queryBodies(box, s.hits, s.restHits);
+    for (int c : s.hits) {
+        if (c == body) continue;
+        if (m_islandOf[c] != island) { s.reached.emplace_back(body, c); continue; }
+        if (!m_moved[c]) add(c);
+    }
+    for (int c : s.moved)
+        if (c != body && SpatialHash::overlaps(m_newBoxes[c], box)) add(c);
+}
 
-        float overlap = std::min(maxA, maxB) - std::max(minA, minB);
-        if (overlap < min_overlap) {
-            min_overlap = overlap;
-            mtv = axis; // Store just the axis, magnitude comes later
+// Runs the iterations over one island's pairs and the extra ones its pushes add, walked
+// as one sorted list. Touches only the island's bodies and pairs, so islands can be
+// solved concurrently. A merged island only walks the pairs of its active bodies, a pair
+// that touches making both active: the islands it was merged from are solved already, and
+// only the pushes that reached across need to spread.
+void ObstacleManager::solveIsland(int island, IslandScratch& s) {
+    s.extraPairs.clear(); s.extraContacts.clear(); s.extraTouched.clear();
+    s.moved.clear();
+    const bool merged = island >= m_firstMerged;
+    if (merged)
+        for (int b : m_reboxed)
+            if (m_islandOf[b] == island) s.moved.push_back(b);
+    const size_t p0 = m_islandStart[island], p1 = m_islandStart[island + 1];
+    IslandResult& res = m_islandResults[island];
+    double overlap = 0;
+    for (int k = 0; k < collisionIterations; ++k) {
+        overlap = 0;
+        for (size_t p = p0, e = 0; p < p1 || e < s.extraPairs.size(); ) {
+            bool fromMain = e == s.extraPairs.size() || (p < p1 && m_islandPairs[p] < s.extraPairs[e]);
+            size_t at = fromMain ? p++ : e++;
+            std::pair<int,int> pr = fromMain ? m_islandPairs[at] : s.extraPairs[at];
+            if (merged && !(m_active[pr.first] | m_active[pr.second])) continue;
+            Vec2 mtv;
+            if (!m_pool.collide(pr.first, pr.second, mtv)) continue;
+            if (merged) m_active[pr.first] = m_active[pr.second] = 1;
+            ContactCache::Contact& c = fromMain ? m_pairContacts[at] : s.extraContacts[at];
+            uint8_t& touched = fromMain ? m_pairTouched[at] : s.extraTouched[at];
+            bool fresh = !touched;
+            if (fresh) {
+                touched = 1;
+                const ContactCache::Contact* last = m_contacts.previous(pr.first, pr.second);
+                c = last ? *last : ContactCache::Contact();
+                if (c.impulse > 0) ++res.warm;
+                touchBody(pr.first);
+                touchBody(pr.second);
+            }
+            m_pool.resolve(pr.first, pr.second, mtv, c, fresh, m_dt);
+            overlap += mtv.len();
+            ++res.contacts;
+            if (movedPastMargin(pr.first))  rebox(pr.first, island, pr, e, s);
+            if (movedPastMargin(pr.second)) rebox(pr.second, island, pr, e, s);
         }
     }
+    res.overlap = overlap;
+    res.extraPairs = static_cast<int>(s.extraPairs.size());
+    for (size_t e = 0; e < s.extraPairs.size(); ++e)
+        if (s.extraTouched[e]) s.touched.push_back({island, s.extraPairs[e], s.extraContacts[e]});
+}
 
-    // Ensure mtv points from a to b
-    Vec2 dir = b->getCenter() - a->getCenter();
-    if (dir.dot(mtv) < 0) mtv = -mtv;
+// Islands first..last-1, each worker taking a run of them holding about the same number
+// of pairs.
+void ObstacleManager::solveIslands(ThreadPool* pool, int first, int last) {
+    int workers = pool ? std::max(1, std::min(pool->size(), last - first)) : 1;
+    for (int w = static_cast<int>(m_scratch.size()); w < workers; ++w) {
+        m_scratch.emplace_back();
+        m_scratch.back().reserve(m_bodies.size());
+    }
+    m_workers = std::max(m_workers, workers);
+    struct Runs {
+        ObstacleManager* self;
+        int first, last, workers;
+        int firstIsland(size_t pair) const {
+            const std::vector<int>& start = self->m_islandStart;
+            return static_cast<int>(std::lower_bound(start.begin() + first, start.begin() + last + 1,
+                                                     start[first] + static_cast<int>(pair)) - start.begin());
+        }
+    } runs{this, first, last, workers};
+    // One pointer, which std::function holds without allocating
+    auto solveRun = [&runs](int w0, int w1) {
+        const size_t P = runs.self->m_islandStart[runs.last] - runs.self->m_islandStart[runs.first];
+        for (int w = w0; w < w1; ++w) {
+            int i1 = runs.firstIsland(P * (w + 1) / runs.workers);
+            for (int i = runs.firstIsland(P * w / runs.workers); i < i1; ++i) runs.self->solveIsland(i, runs.self->m_scratch[w]);
+        }
+    };
+    if (pool) pool->parallelFor(0, workers, solveRun, 1);
+    else      solveRun(0, workers);
+}
 
-    // Re-apply magnitude
-    mtv = mtv.normalized() * min_overlap;
-    
-    return true;
+int ObstacleManager::findIsland(int island) {
+    while (m_islandParent[island] != island) island = m_islandParent[island] = m_islandParent[m_islandParent[island]];
+    return island;
 }
 
-// Disk-Disk Collision
-bool ObstacleManager::checkCollision(DiskObstacle* a, DiskObstacle* b, Vec2& mtv) {
-    Vec2 distVec = b->getCenter() - a->getCenter();
-    float distSq = distVec.lenSq();
-    float totalRadius = a->getRadius() + b->getRadius();
+// Gathers what the islands just solved reached. rebox() only sees the index, where a body
+// that another island re-boxed is still at its old box, so the re-boxed bodies of the step
+// are also checked against each other, at all the boxes each had (its swept box).
+void ObstacleManager::findReached() {
+    m_reached.clear();
+    for (int w = 0; w < m_workers; ++w) {
+        IslandScratch& s = m_scratch[w];
+        m_reached.insert(m_reached.end(), s.reached.begin(), s.reached.end());
+        m_reboxed.insert(m_reboxed.end(), s.reboxed.begin(), s.reboxed.end());
+        s.reached.clear();
+        s.reboxed.clear();
+    }
+    std::sort(m_reboxed.begin(), m_reboxed.end(), [&](int a, int b) { return m_sweptBoxes[a].x0 < m_sweptBoxes[b].x0; });
+    for (size_t k = 0; k < m_reboxed.size(); ++k) {
+        const SpatialHash::Box& box = m_sweptBoxes[m_reboxed[k]];
+        for (size_t l = k + 1; l < m_reboxed.size() && m_sweptBoxes[m_reboxed[l]].x0 <= box.x1; ++l) {
+            int a = m_reboxed[k], b = m_reboxed[l];
+            if (m_islandOf[a] != m_islandOf[b] && SpatialHash::overlaps(box, m_sweptBoxes[b]))
+                m_reached.emplace_back(a, b);
+        }
+    }
+}
 
-    if (distSq >= totalRadius * totalRadius) return false;
+// Joins every island that findReached() found reaching another (or a body outside any)
+// with it: the groups become new islands, appended in the order of their first island.
+// Nothing is undone: a new island holds its islands' pairs with the contacts they have
+// so far, their touching extra pairs, and the pairs that reached across, whose bodies start
+// out active (see solveIsland()). The old islands are marked merged. Returns false if
+// nothing was reached.
+bool ObstacleManager::mergeReached() {
+    const int islands = static_cast<int>(m_islandStart.size()) - 1;
+    m_islandParent.resize(islands);
+    std::iota(m_islandParent.begin(), m_islandParent.end(), 0);
+    findReached();
+    if (m_reached.empty()) return false;
+    for (auto& r : m_reached) {
+        int& other = m_islandOf[r.second];
+        if (other < 0) other = m_islandOf[r.first]; // joins r.first's group
+        int a = findIsland(m_islandOf[r.first]), b = findIsland(other);
+        if (a != b) m_islandParent[std::max(a, b)] = std::min(a, b);
+        r = std::make_pair(std::min(r.first, r.second), std::max(r.first, r.second));
+    }
 
-    float dist = std::sqrt(distSq);
-    float overlap = totalRadius - dist;
+    // -1: kept, -2: a group's first island until it gets the group's number
+    assignGrowing(m_mergedInto, islands, -1);
+    for (const auto& r : m_reached) m_mergedInto[findIsland(m_islandOf[r.first])] = -2;
+    int next = islands;
+    for (int i = 0; i < islands; ++i) {
+        int& id = m_mergedInto[findIsland(i)];
+        if (id == -1) continue;
+        if (id == -2) id = next++;
+        m_mergedInto[i] = id;
+    }
 
-    // Check for zero distance case (perfect overlap)
-    if (dist > 0) {
-        mtv = (distVec / dist) * overlap;
-    } else {
-        // Objects are at the exact same position, push them apart along an arbitrary axis (e.g., x-axis)
-        mtv = Vec2(overlap, 0);
+    m_merging.clear();
+    for (int i = 0; i < islands; ++i) {
+        if (m_mergedInto[i] < 0) continue;
+        m_islandResults[i].merged = true;
+        for (int p = m_islandStart[i]; p < m_islandStart[i + 1]; ++p)
+            m_merging.push_back({m_mergedInto[i], m_islandPairs[p], m_pairContacts[p], m_pairTouched[p]});
+    }
+    for (int w = 0; w < m_workers; ++w)
+        for (const auto& t : m_scratch[w].touched)
+            if (m_mergedInto[t.island] >= 0) m_merging.push_back({m_mergedInto[t.island], t.pair, t.contact, 1});
+    for (const auto& r : m_reached)
+        m_merging.push_back({m_mergedInto[m_islandOf[r.first]], r, ContactCache::Contact(), 0});
+    // A pair can reach across more than once; those copies have not touched yet
+    std::sort(m_merging.begin(), m_merging.end(), [](const Merging& a, const Merging& b) {
+        return a.island != b.island ? a.island < b.island : a.pair < b.pair;
+    });
+    m_merging.erase(std::unique(m_merging.begin(), m_merging.end(), [](const Merging& a, const Merging& b) {
+        return a.island == b.island && a.pair == b.pair;
+    }), m_merging.end());
+
+    m_islandStart.resize(next + 1);
+    m_islandResults.resize(next);
+    int island = islands;
+    for (const Merging& m : m_merging) {
+        while (island <= m.island) m_islandStart[island++] = static_cast<int>(m_islandPairs.size());
+        m_islandOf[m.pair.first] = m_islandOf[m.pair.second] = m.island;
+        m_active[m.pair.first] = m_active[m.pair.second] = 0;
+        m_islandPairs.push_back(m.pair);
+        m_pairContacts.push_back(m.contact);
+        m_pairTouched.push_back(m.touched);
     }
+    m_islandStart[next] = static_cast<int>(m_islandPairs.size());
+    for (const auto& r : m_reached) m_active[r.first] = m_active[r.second] = 1;
     return true;
 }
 
-// Rect-Disk Collision
-bool ObstacleManager::checkCollision(MovableRectObstacle* rect, DiskObstacle* disk, Vec2& mtv) {
-    std::vector<Vec2> vertices;
-    rect->getVertices(vertices);
-    Vec2 diskCenter = disk->getCenter();
-    float diskRadius = disk->getRadius();
-
-    Vec2 closestPoint = diskCenter;
-    float minDistSq = std::numeric_limits<float>::max();
-
-    // Find closest point on rectangle edges to disk center
-    for(size_t i = 0; i < vertices.size(); ++i) {
-        Vec2 p1 = vertices[i];
-        Vec2 p2 = vertices[(i + 1) % vertices.size()];
-        Vec2 edge = p2 - p1;
-        Vec2 pointVec = diskCenter - p1;
-        
-        float t = edge.dot(pointVec) / edge.lenSq();
-        t = std::max(0.f, std::min(1.f, t));
-
-        Vec2 currentClosest = p1 + edge * t;
-        float distSq = (diskCenter - currentClosest).lenSq();
-        if(distSq < minDistSq) {
-            minDistSq = distSq;
-            closestPoint = currentClosest;
-        }
+// The reference for the islands: every pair with a body awake at the start of the step,
+// walked in order as one island.
+void ObstacleManager::solveAllPairs() {
+    int n = m_pool.size();
+    double overlap = 0;
+    CollisionStats& st = m_collisionStats;
+    st.islands = n > 1 ? 1 : 0;
+    for (int k = 0; k < collisionIterations; ++k) {
+        overlap = 0;
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j) {
+                if ((m_asleep[i] | m_woken[i]) && (m_asleep[j] | m_woken[j])) continue;
+                if (k == 0) ++st.pairs;
+                Vec2 mtv;
+                if (!m_pool.collide(i, j, mtv)) continue;
+                ContactCache::Contact* c = m_contacts.current(i, j);
+                bool fresh = !c;
+                if (fresh) {
+                    const ContactCache::Contact* last = m_contacts.previous(i, j);
+                    c = &m_contacts.add(i, j, last ? *last : ContactCache::Contact());
+                    if (c->impulse > 0) ++st.warm;
+                    touchBody(i);
+                    touchBody(j);
+                }
+                m_pool.resolve(i, j, mtv, *c, fresh, m_dt);
+                overlap += mtv.len();
+                ++st.contacts;
+            }
+    }
+    st.overlap = static_cast<float>(overlap);
+}
+
+// Contacts join bodies into groups; a group whose awake members have all rested for
+// sleepDelay, and still move slower than RestSpeed after the step, goes to sleep whole.
+void ObstacleManager::sleepResting() {
+    int n = m_pool.size();
+    m_parent.resize(n);
+    std::iota(m_parent.begin(), m_parent.end(), 0);
+    m_contacts.forEachCurrent([&](int a, int b, const ContactCache::Contact&) {
+        int ra = findRoot(a), rb = findRoot(b);
+        if (ra != rb) m_parent[std::max(ra, rb)] = std::min(ra, rb);
+    });
+    const float rest2 = MovableObstacle::RestSpeed * MovableObstacle::RestSpeed;
+    assignGrowing(m_groupRests, n, 1);
+    for (int b = 0; b < n; ++b) {
+        if (m_asleep[b]) continue;
+        float vx, vy;
+        m_pool.velocity(b, vx, vy);
+        if (m_bodies[b]->restTime() < sleepDelay || vx * vx + vy * vy >= rest2) m_groupRests[findRoot(b)] = 0;
     }
-    
-    // Check if the disk center is inside the rectangle (Voronoi region of the rect itself)
-    // If it is, the closest point is the disk center.
-    if (rect->contains(static_cast<int>(diskCenter.x), static_cast<int>(diskCenter.y))) {
-        closestPoint = diskCenter;
+    for (int b = 0; b < n; ++b) {
+        if (m_asleep[b] || !m_groupRests[findRoot(b)]) continue;
+        m_bodies[b]->sleep();
+        m_asleep[b] = 1;
+        m_settled[b] = 0; // the pool still has its last velocity
     }
+}
+
+void ObstacleManager::handleCollisions() {
+    collideAll(nullptr);
+}
 
-    Vec2 delta = diskCenter - closestPoint;
-    float distSq = delta.lenSq();
+void ObstacleManager::handleCollisions(ThreadPool& pool) {
+    collideAll(&pool);
+}
 
-    if (distSq >= diskRadius * diskRadius) return false;
+void ObstacleManager::collideAll(ThreadPool* pool) {
+    buildIndex(); // the bodies have moved since the last call
+    int n = static_cast<int>(m_bodies.size());
+    CollisionStats& st = m_collisionStats;
+    st = CollisionStats();
+    st.bodies = n;
+    m_contacts.beginStep();
+    assignGrowing(m_woken, n, 0);
+
+    if (broadphase) {
+        findPairs();
+        buildIslands();
+        int islands = static_cast<int>(m_islandStart.size()) - 1;
+        size_t P = m_islandPairs.size();
+        m_pairContacts.resize(P);
+        assignGrowing(m_pairTouched, P, 0);
+        assignGrowing(m_islandResults, islands, IslandResult());
+        assignGrowing(m_moved, n, 0);
+        m_newBoxes.resize(n);
+        m_sweptBoxes.resize(n);
+        m_startedAt = m_indexedAt;
+
+        m_workers = 0;
+        m_reboxed.clear();
+        m_firstMerged = islands;
+        solveIslands(pool, 0, islands);
+        for (int first = islands; mergeReached(); ) {
+            int last = static_cast<int>(m_islandStart.size()) - 1;
+            st.merged += last - first;
+            solveIslands(pool, first, last);
+            first = last;
+        }
 
-    float dist = std::sqrt(distSq);
-    float overlap = diskRadius - dist;
-    
-    if (dist > 0) {
-        mtv = (delta / dist) * overlap;
+        double overlap = 0;
+        for (int i = 0; i + 1 < static_cast<int>(m_islandStart.size()); ++i) {
+            const IslandResult& res = m_islandResults[i];
+            st.contacts += res.contacts; st.reboxed += res.reboxed; st.warm += res.warm;
+            overlap += res.overlap;
+            if (res.merged) continue; // its pairs and their contacts went to the merged island
+            ++st.islands;
+            st.pairs += m_islandStart[i + 1] - m_islandStart[i] + res.extraPairs;
+            for (int p = m_islandStart[i]; p < m_islandStart[i + 1]; ++p)
+                if (m_pairTouched[p]) m_contacts.add(m_islandPairs[p].first, m_islandPairs[p].second, m_pairContacts[p]);
+        }
+        for (int w = 0; w < m_workers; ++w) {
+            for (const auto& t : m_scratch[w].touched)
+                if (!m_islandResults[t.island].merged) m_contacts.add(t.pair.first, t.pair.second, t.contact);
+            m_scratch[w].touched.clear();
+        }
+        st.overlap = static_cast<float>(overlap);
+        for (int b = 0; b < n; ++b) {
+            Vec2 d = m_pool.position(b) - m_startedAt[b];
+            if (!m_asleep[b]) m_shift[b] = std::max(std::abs(d.x), std::abs(d.y));
+        }
     } else {
-        // Special case: disk center is exactly on the closest point. Need to find a robust normal.
-        // The normal from the rectangle's center to the disk's center is a good fallback.
-        mtv = (disk->getCenter() - rect->getCenter()).normalized() * overlap;
+        solveAllPairs();
     }
+    st.touching = m_contacts.size();
 
-    return true;
+    if (st.contacts > 0) {
+        for (int k = 0; k < n; ++k) {
+            if (m_woken[k]) {
+                m_bodies[k]->wake();
+                if (m_inRest[k]) { m_inRest[k] = 0; ++m_restStale; }
+            }
+            if (m_asleep[k]) continue;
+            float vx, vy;
+            m_pool.velocity(k, vx, vy);
+            m_bodies[k]->updatePosition(m_pool.position(k));
+            m_bodies[k]->setVelocity(vx, vy);
+        }
+        m_indexValid = false;
+    }
+    if (sleeping) sleepResting();
+    st.awake = n - static_cast<int>(std::count(m_asleep.begin(), m_asleep.end(), 1));
 }
 
+void ObstacleManager::addObstacle(std::unique_ptr<Obstacle> obstacle) {
+    m_obstacles.push_back(std::move(obstacle));
+    m_bodiesValid = false;
+    m_indexValid = false;
+}
 
 void ObstacleManager::addFixedRect(int x, int y, int w, int h) {
-    m_obstacles.push_back(std::make_unique<RectObstacle>(x, y, w, h, m_gridN));
+    addObstacle(std::make_unique<RectObstacle>(x, y, w, h, m_gridNx));
 }
 
 void ObstacleManager::addMovableRect(int x, int y, int w, int h) {
-    m_obstacles.push_back(std::make_unique<MovableRectObstacle>(x, y, w, h, m_gridN));
+    addObstacle(std::make_unique<MovableRectObstacle>(x, y, w, h, m_gridNx));
 }
 
 void ObstacleManager::addDisk(int x, int y, int r, int w, int h) {
-    m_obstacles.push_back(std::make_unique<DiskObstacle>(x, y, r, w, h, m_gridN));
+    addObstacle(std::make_unique<DiskObstacle>(x, y, r, w, h, m_gridNx));
 }
 
+// The topmost (last added) movable under the point, like a reverse scan of the list.
 MovableObstacle* ObstacleManager::findMovableAt(int x, int y) {
-    for (auto it = m_obstacles.rbegin(); it != m_obstacles.rend(); ++it) {
-        if (auto movable = dynamic_cast<MovableObstacle*>((*it).get())) {
-            if (movable->contains(x, y)) {
-                return movable;
-            }
+    if (!m_indexValid) buildIndex();
+    float fx = static_cast<float>(x), fy = static_cast<float>(y);
+    queryBodies(SpatialHash::Box{fx, fy, fx, fy}, m_hits, m_restHits);
+    for (auto it = m_hits.rbegin(); it != m_hits.rend(); ++it) {
+        MovableObstacle* movable = m_bodies[*it];
+        if (movable->contains(x, y)) {
+            return movable;
         }
     }
     return nullptr;
 }
 
-void ObstacleManager::draw() const {
-    for (const auto& obs : m_obstacles) { obs->draw(); }
+void ObstacleManager::accept(ObstacleVisitor& visitor) const {
+    for (const auto& obs : m_obstacles) { obs->accept(visitor); }
 }
 
+// The removed obstacles' cells and ids are given back at the next rasterize().
 void ObstacleManager::clear() {
+    for (const Stamp& s : m_stamps) {
+        if (s.id == 0) continue;
+        if (s.stamped) addDirty(s.rect);
+        m_released.push_back(s.id);
+    }
+    m_stamps.clear();
     m_obstacles.clear();
-}
\ No newline at end of file
+    m_contacts.clear();
+    m_bodiesValid = false;
+    m_indexValid = false;
+}
+
+void ObstacleManager::rescale(int Nx, int Ny) {
+    if (Nx == m_gridNx && Ny == m_gridNy) return;
+    float sx = float(Nx) / m_gridNx, sy = float(Ny) / m_gridNy;
+    // Cell i spans [i-1, i] in the domain, so a point at p (in cells) moves to (p-0.5)*s+0.5
+    auto point = [](float p, float s) { return (p - 0.5f) * s + 0.5f; };
+    auto size = [](float w, float s) { return std::max(1, int(std::lround(w * s))); };
+    auto moved = [&](MovableObstacle::State st, float cx, float cy) {
+        st.x = point(cx, sx); st.y = point(cy, sy);
+        st.vx *= sx; st.vy *= sy;
+        return st;
+    };
+
+    std::vector<std::unique_ptr<Obstacle>> old;
+    old.swap(m_obstacles);
+    clear();
+    m_gridNx = Nx; m_gridNy = Ny;
+    for (std::unique_ptr<Obstacle>& obs : old) {
+        switch (obs->type()) {
+            case ObstacleType::FixedRect: {
+                const RectObstacle& r = static_cast<const RectObstacle&>(*obs);
+                addFixedRect(int(std::lround((r.getX() - 1) * sx)) + 1, int(std::lround((r.getY() - 1) * sy)) + 1,
+                             size(r.getWidth(), sx), size(r.getHeight(), sy));
+                break;
+            }
+            case ObstacleType::MovableRect: {
+                const MovableRectObstacle& r = static_cast<const MovableRectObstacle&>(*obs);
+                int w = size(float(r.getWidth()), sx), h = size(float(r.getHeight()), sy);
+                Vec2 c = r.getCenter();
+                MovableObstacle::State st = moved(r.state(), c.x, c.y);
+                st.x -= w / 2.f; st.y -= h / 2.f; // the state holds the corner
+                std::unique_ptr<MovableRectObstacle> n(new MovableRectObstacle(0, 0, w, h, Nx));
+                n->setState(st);
+                addObstacle(std::move(n));
+                break;
+            }
+            case ObstacleType::Disk: {
+                const DiskObstacle& d = static_cast<const DiskObstacle&>(*obs);
+                MovableObstacle::State st = d.state();
+                std::unique_ptr<DiskObstacle> n(new DiskObstacle(0, 0, size(d.getRadius(), std::sqrt(sx * sy)), 0, 0, Nx));
+                n->setState(moved(st, st.x, st.y));
+                addObstacle(std::move(n));
+                break;
+            }
+            default:
+                addObstacle(std::move(obs));
+                break;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#include "ObstacleRenderer.h"
+#include "RectObstacle.h"
+#include "MovableRectObstacle.h"
+#include "DiskObstacle.h"
+#include "GLHeaders.h"
+#include <cmath>
+
+#define PI 3.1415926535f
+
+ObstacleRenderer::ObstacleRenderer(int gridN) : m_gridN(gridN) {}
+
+void ObstacleRenderer::visit(const RectObstacle& obs) {
+    drawFixedRect(obs.getX(), obs.getY(), obs.getWidth(), obs.getHeight());
+}
+
+void ObstacleRenderer::visit(const MovableRectObstacle& obs) {
+    drawMovableRect(obs.getCenter(), obs.getWidth(), obs.getHeight(), obs.getAngle(), obs.isSelected());
+}
+
+void ObstacleRenderer::visit(const DiskObstacle& obs) {
+    drawDisk(obs.getCenter(), obs.getRadius(), obs.isSelected());
+}
+
+void ObstacleRenderer::draw(const FieldSnapshot::Shape& s) {
+    switch (s.type) {
+    case ObstacleType::FixedRect:   drawFixedRect(s.pos.x, s.pos.y, s.w, s.h); break;
+    case ObstacleType::MovableRect: drawMovableRect(s.pos, s.w, s.h, s.angle, s.selected); break;
+    case ObstacleType::Disk:        drawDisk(s.pos, s.w, s.selected); break;
+    default: break;
+    }
+}
+
+void ObstacleRenderer::drawFixedRect(float x, float y, float w, float hgt) {
+    float h = 1.0f / m_gridN;
+    float x0 = (x - 1) * h;
+    float y0 = (y - 1) * h;
+    float x1 = (x - 1 + w) * h;
+    float y1 = (y - 1 + hgt) * h;
+    
+    glBegin(GL_QUADS);
+    glColor3f(0.2,0.5,0.3);
+    glVertex2f(x0, y0);
+    glVertex2f(x1, y0);
+    glVertex2f(x1, y1);
+    glVertex2f(x0, y1);
+    glEnd();
+}
+
+void ObstacleRenderer::drawMovableRect(const Vec2& center, float w, float hgt, float angle, bool selected) {
+    if (selected) {
+        glColor3f(0.8f, 0.8f, 0.2f); // Yellow when selected
+    } else {
+        glColor3f(0.8f, 0.5f, 0.2f); // Orange for movable
+    }
+
+    float h = 1.0f / m_gridN;
+    
+    float cx = h * center.x;
+    float cy = h * center.y;
+
+    float hw = h * (w / 2.f);
+    float hh = h * (hgt / 2.f);
+    
+    glPushMatrix();
+    glTranslatef(cx, cy, 0.f);
+    glRotatef(angle, 0.f, 0.f, 1.f);
+    
+    glBegin(GL_QUADS);
+    glVertex2f(-hw, -hh);
+    glVertex2f( hw, -hh);
+    glVertex2f( hw,  hh);
+    glVertex2f(-hw,  hh);
+    glEnd();
+
+    glPopMatrix();
+}
+
+void ObstacleRenderer::drawDisk(const Vec2& center, float radius, bool selected) {
+    if (selected) {
+        glColor3f(0.2f, 0.8f, 0.8f); // Cyan when selected
+    } else {
+        glColor3f(0.2f, 0.5f, 0.8f); // Blue for movable
+    }
+
+    float h = 1.0f / m_gridN;
+    float cx = h * center.x;
+    float cy = h * center.y;
+    float r = h * radius;
+
+    int segments = 24;
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(cx, cy); // Center of circle
+    for(int i = 0; i <= segments; i++) {
+        float angle = 2.0f * PI * static_cast<float>(i) / static_cast<float>(segments);
+        float dx = r * std::cos(angle);
+        float dy = r * std::sin(angle);
+        glVertex2f(cx + dx, cy + dy);
+    }
+    glEnd();
+}
@@ -0,0 +1,104 @@
+#include "PoissonSolver.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Runs of fluid cells row by row; a run joins every run of the row below that it touches.
+void FluidRegions::build(int Nx, int Ny, const uint16_t* solid){
+    const int N = Nx;
+    runs.clear();
+    m_parent.clear();
+    size_t below = 0, row = 0; // first run of row j-1, and of row j
+    for(int j=1;j<=Ny;++j){
+        row = runs.size();
+        const uint16_t* sr = solid + IX(0,j,N);
+        size_t scan = below;
+        for(int i=1;i<=Nx;){
+            if(sr[i]){ ++i; continue; }
+            int i0 = i;
+            while(i<=Nx && !sr[i]) ++i;
+            int k = int(runs.size());
+            runs.push_back(Run{j, i0, i-1, 0});
+            m_parent.push_back(k);
+            while(scan<row && runs[scan].i1 < i0) ++scan;
+            for(size_t b=scan;b<row && runs[b].i0 <= i-1;++b){
+                int ra = find(k), rb = find(int(b));
+                if(ra != rb) m_parent[std::max(ra,rb)] = std::min(ra,rb);
+            }
+        }
+        below = row;
+    }
+    count = 0;
+    for(size_t k=0;k<runs.size();++k){
+        int r = find(int(k));
+        runs[k].region = r == int(k) ? count++ : runs[r].region;
+    }
+}
+
+int FluidRegions::find(int k){
+    while(m_parent[k] != k){ m_parent[k] = m_parent[m_parent[k]]; k = m_parent[k]; }
+    return k;
+}
+
+FluidRegions* PoissonSolver::findRegions(int Nx, int Ny){
+    if(!m_solid) return nullptr;
+    m_regions.build(Nx,Ny,m_solid);
+    return &m_regions;
+}
+
+double PoissonSolver::removeMean(int Nx, int Ny, float* b, FluidRegions* regions){
+    const int N = Nx;
+    if(!regions){
+        double sum = 0;
+        for(int j=1;j<=Ny;++j) for(int i=1;i<=Nx;++i) sum += b[IX(i,j,N)];
+        float mean = float(sum / (double(Nx)*Ny));
+        double norm2 = 0;
+        for(int j=1;j<=Ny;++j) for(int i=1;i<=Nx;++i){
+            float& x = b[IX(i,j,N)];
+            x -= mean;
+            norm2 += double(x)*x;
+        }
+        return norm2;
+    }
+    FluidRegions& R = *regions;
+    R.sum.assign(R.count,0.0); R.cells.assign(R.count,0); R.mean.resize(R.count);
+    for(const FluidRegions::Run& r : R.runs){
+        const float* br = b + IX(0,r.j,N);
+        double sum = R.sum[r.region];
+        for(int i=r.i0;i<=r.i1;++i) sum += br[i];
+        R.sum[r.region] = sum;
+        R.cells[r.region] += r.i1 - r.i0 + 1;
+    }
+    for(int k=0;k<R.count;++k) R.mean[k] = float(R.sum[k] / double(R.cells[k]));
+    double norm2 = 0;
+    for(const FluidRegions::Run& r : R.runs){
+        float* br = b + IX(0,r.j,N);
+        float mean = R.mean[r.region];
+        for(int i=r.i0;i<=r.i1;++i){
+            br[i] -= mean;
+            norm2 += double(br[i])*br[i];
+        }
+    }
+    return norm2;
+}
+
+float PoissonSolver::relativeResidual(int Nx, int Ny, const float* p, const float* div, const uint16_t* solid){
+    const int N = Nx;
+    std::vector<float> r(fieldSize(Nx,Ny)), b(div, div+r.size());
+    auto fluid=[&](int i,int j){ return !solid || !solid[IX(i,j,N)]; };
+    for(int j=1;j<=Ny;++j) for(int i=1;i<=Nx;++i){
+        if(!fluid(i,j)) continue;
+        float sum=0; int n=0;
+        if(i>1  && fluid(i-1,j)){ sum+=p[IX(i-1,j,N)]; ++n; }
+        if(i<Nx && fluid(i+1,j)){ sum+=p[IX(i+1,j,N)]; ++n; }
+        if(j>1  && fluid(i,j-1)){ sum+=p[IX(i,j-1,N)]; ++n; }
+        if(j<Ny && fluid(i,j+1)){ sum+=p[IX(i,j+1,N)]; ++n; }
+        r[IX(i,j,N)]=div[IX(i,j,N)]-(n*p[IX(i,j,N)]-sum);
+    }
+    FluidRegions regions;
+    if(solid) regions.build(Nx,Ny,solid);
+    FluidRegions* rg = solid ? &regions : nullptr;
+    double r2=removeMean(Nx,Ny,r.data(),rg), b2=removeMean(Nx,Ny,b.data(),rg);
+    return b2>0 ? float(std::sqrt(r2/b2)) : 0.f;
+}
@@ -1,7 +1,6 @@
 #include "RectObstacle.h"
-#include "FluidGrid.h"
-#include "Util.h"
-#include <GL/glut.h>
+#include "ObstacleVisitor.h"
+#include <algorithm>
 
 RectObstacle::RectObstacle(int x, int y, int w, int h, int gridN)
     : m_x(x), m_y(y), m_w(w), m_h(h), m_gridN(gridN) {
@@ -9,23 +8,11 @@ RectObstacle::RectObstacle(int x, int y, int w, int h, int gridN)
         m_yf = static_cast<float>(m_y);
     }
 
-void RectObstacle::apply(FluidGrid& grid) const {
-    float* u = grid.u();
-    float* v = grid.v();
-    // float* dens = grid.dens(); // No longer needed here
-    int N = grid.size();
-
-    for (int i = m_x; i < m_x + m_w; ++i) {
-        for (int j = m_y; j < m_y + m_h; ++j) {
-            if (i > 0 && i <= N && j > 0 && j <= N) {
-                // Enforce a zero-velocity boundary condition.
-                // By not touching density, we allow it to be pushed by pressure.
-                u[IX(i, j, N)] = 0.f;
-                v[IX(i, j, N)] = 0.f;
-                // dens[IX(i, j, N)] = 0.f; // REMOVED: This was destroying density.
-            }
-        }
-    }
+void RectObstacle::computeCoverage(int Nx, int Ny, const PoseKey&, std::vector<CellCoverage::Run>& runs) const {
+    int i0 = std::max(1, int(m_x)), i1 = std::min(Nx, int(m_x + m_w) - 1);
+    if (i0 > i1) return;
+    for (int j = std::max(1, int(m_y)); j < std::min(Ny + 1, int(m_y + m_h)); ++j)
+        runs.push_back({j, i0, i1});
 }
 
 void RectObstacle::updateFromFluid(FluidGrid& grid, float dt) {
@@ -33,18 +20,6 @@ void RectObstacle::updateFromFluid(FluidGrid& grid, float dt) {
     // This method is required by the interface but does nothing here.
 }
 
-void RectObstacle::draw() const {
-    float h = 1.0f / m_gridN;
-    float x0 = (m_x - 1) * h;
-    float y0 = (m_y - 1) * h;
-    float x1 = (m_x - 1 + m_w) * h;
-    float y1 = (m_y - 1 + m_h) * h;
-    
-    glBegin(GL_QUADS);
-    glColor3f(0.2,0.5,0.3);
-    glVertex2f(x0, y0);
-    glVertex2f(x1, y0);
-    glVertex2f(x1, y1);
-    glVertex2f(x0, y1);
-    glEnd();
+void RectObstacle::accept(ObstacleVisitor& visitor) const {
+    visitor.visit(*this);
 }
\ No newline at end of file
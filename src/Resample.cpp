@@ -0,0 +1,89 @@
+#include "Resample.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+inline float minmod(float a, float b) {
+    if (!(a * b > 0.f)) return 0.f;
+    return std::fabs(a) < std::fabs(b) ? a : b;
+}
+
+// Destination cell m of n1 covers [m, m+1) * n0/n1 in source cells. Over the part [lo, hi]
+// of source cell k it overlaps, the reconstruction a + s*x (x from the cell's centre)
+// integrates to (hi - lo) * (a + s*c), c being the centre of [lo, hi] relative to the
+// cell's. Divided by the destination cell's width that gives the weights of a and s.
+struct Overlap { int k; float wa, ws; };
+
+void overlaps(int n0, int n1, std::vector<Overlap>& out, std::vector<int>& start) {
+    out.clear();
+    start.assign(size_t(n1) + 1, 0);
+    double width = double(n0) / n1;
+    for (int m = 0; m < n1; ++m) {
+        start[m] = int(out.size());
+        double x0 = double(m) * n0 / n1, x1 = double(m + 1) * n0 / n1;
+        for (int k = int(x0); k < n0 && k < x1; ++k) {
+            double lo = std::max(x0, double(k)), hi = std::min(x1, double(k + 1));
+            if (hi <= lo) continue;
+            double wa = (hi - lo) / width;
+            out.push_back(Overlap{k, float(wa), float(wa * (0.5 * (lo + hi) - (k + 0.5)))});
+        }
+    }
+    start[n1] = int(out.size());
+}
+
+// Limited slopes of a[0..n-1]; flat at both ends.
+void slopes(int n, const float* a, float* s) {
+    s[0] = 0.f;
+    for (int k = 1; k < n - 1; ++k) s[k] = minmod(a[k + 1] - a[k], a[k] - a[k - 1]);
+    if (n > 1) s[n - 1] = 0.f;
+}
+
+} // namespace
+
+void resampleField(int srcNx, int srcNy, const float* src, int dstNx, int dstNy, float* dst,
+                   std::vector<float>& scratch) {
+    std::vector<Overlap> ox, oy;
+    std::vector<int> sx, sy;
+    overlaps(srcNx, dstNx, ox, sx);
+    overlaps(srcNy, dstNy, oy, sy);
+
+    // Rows: srcNy rows of dstNx cells, then their slopes along y
+    const size_t plane = size_t(dstNx) * srcNy;
+    assignGrowing(scratch, 2 * plane + srcNx, 0.f);
+    float* rows = scratch.data();
+    float* rowSlopes = rows + plane;
+    float* s = rowSlopes + plane; // slopes along x of one source row
+    for (int j = 0; j < srcNy; ++j) {
+        const float* a = src + IX(1, j + 1, srcNx);
+        slopes(srcNx, a, s);
+        float* out = rows + size_t(j) * dstNx;
+        for (int m = 0; m < dstNx; ++m) {
+            float sum = 0.f;
+            for (int q = sx[m]; q < sx[m + 1]; ++q) sum += ox[q].wa * a[ox[q].k] + ox[q].ws * s[ox[q].k];
+            out[m] = sum;
+        }
+    }
+    for (int i = 0; i < dstNx; ++i) rowSlopes[i] = 0.f;
+    for (int j = 1; j < srcNy - 1; ++j) {
+        const float* below = rows + size_t(j - 1) * dstNx;
+        const float* here = below + dstNx;
+        const float* above = here + dstNx;
+        float* out = rowSlopes + size_t(j) * dstNx;
+        for (int i = 0; i < dstNx; ++i) out[i] = minmod(above[i] - here[i], here[i] - below[i]);
+    }
+    if (srcNy > 1) std::fill(rowSlopes + size_t(srcNy - 1) * dstNx, rowSlopes + plane, 0.f);
+
+    // Columns, a destination row at a time
+    for (int m = 0; m < dstNy; ++m) {
+        float* out = dst + IX(1, m + 1, dstNx);
+        std::fill(out, out + dstNx, 0.f);
+        for (int q = sy[m]; q < sy[m + 1]; ++q) {
+            const float* a = rows + size_t(oy[q].k) * dstNx;
+            const float* sl = rowSlopes + size_t(oy[q].k) * dstNx;
+            float wa = oy[q].wa, ws = oy[q].ws;
+            for (int i = 0; i < dstNx; ++i) out[i] += wa * a[i] + ws * sl[i];
+        }
+    }
+}
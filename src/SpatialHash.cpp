@@ -0,0 +1,106 @@
+#include "SpatialHash.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+// Bucket count is capped (at 4 per box) so a build never costs much more than the boxes.
+static const int kMaxBuckets = 1 << 20;
+
+
+int SpatialHash::bucketX(float x) const {
+    return std::min(m_nx - 1, std::max(0, static_cast<int>((x - m_x0) * m_inv)));
+}
+int SpatialHash::bucketY(float y) const {
+    return std::min(m_ny - 1, std::max(0, static_cast<int>((y - m_y0) * m_inv)));
+}
+
+void SpatialHash::build(const std::vector<Box>& boxes) {
+    m_boxes = boxes;
+    int n = static_cast<int>(boxes.size());
+    m_nx = m_ny = 0;
+    if (n == 0) return;
+
+    // Buckets about as large as a typical box: each box lands in a few of them.
+    float x0 = boxes[0].x0, y0 = boxes[0].y0, x1 = boxes[0].x1, y1 = boxes[0].y1;
+    double extent = 0;
+    for (const Box& b : boxes) {
+        x0 = std::min(x0, b.x0); y0 = std::min(y0, b.y0);
+        x1 = std::max(x1, b.x1); y1 = std::max(y1, b.y1);
+        extent += std::max(b.x1 - b.x0, b.y1 - b.y0);
+    }
+    float size = std::max(1e-3f, static_cast<float>(extent / n));
+    float w = std::max(x1 - x0, size), h = std::max(y1 - y0, size);
+    double cells = std::ceil(w / size) * std::ceil(h / size);
+    if (cells > std::min(kMaxBuckets, 4 * n)) size *= static_cast<float>(std::sqrt(cells / std::min(kMaxBuckets, 4 * n)));
+    m_x0 = x0; m_y0 = y0; m_inv = 1.f / size;
+    m_nx = std::max(1, static_cast<int>(std::ceil(w / size)));
+    m_ny = std::max(1, static_cast<int>(std::ceil(h / size)));
+
+    // Room for twice the bucket cap (the rounding up of the sides adds a row and a column)
+    // and for 4 entries per box, which a box no larger than a bucket covers at most, so builds
+    // over a box count seen before do not allocate.
+    m_range.resize(4 * size_t(n));
+    m_start.reserve(2 * size_t(std::min(kMaxBuckets, 4 * n)) + 1);
+    m_items.reserve(4 * size_t(n));
+    assignGrowing(m_start, size_t(m_nx) * m_ny + 1, 0);
+    for (int k = 0; k < n; ++k) {
+        const Box& b = boxes[k];
+        int* r = &m_range[4 * size_t(k)];
+        r[0] = bucketX(b.x0); r[1] = bucketY(b.y0); r[2] = bucketX(b.x1); r[3] = bucketY(b.y1);
+        for (int by = r[1]; by <= r[3]; ++by)
+            for (int bx = r[0]; bx <= r[2]; ++bx) ++m_start[bx + m_nx * by + 1];
+    }
+    for (size_t c = 1; c < m_start.size(); ++c) m_start[c] += m_start[c - 1];
+    // Boxes larger than a bucket cover more: room for twice what they cover then
+    if (size_t(m_start.back()) > m_items.capacity()) m_items.reserve(2 * size_t(m_start.back()));
+    m_items.resize(m_start.back());
+    for (int k = 0; k < n; ++k) {
+        const int* r = &m_range[4 * size_t(k)];
+        for (int by = r[1]; by <= r[3]; ++by)
+            for (int bx = r[0]; bx <= r[2]; ++bx) m_items[m_start[bx + m_nx * by]++] = k;
+    }
+    // The fill advanced every start to the next bucket's; shift them back.
+    for (size_t c = m_start.size() - 1; c > 0; --c) m_start[c] = m_start[c - 1];
+    m_start[0] = 0;
+}
+
+// A pair is reported only from the bucket holding the corner (max x0, max y0) of the two
+// boxes, which lies in both when they overlap, so no pair is seen twice.
+void SpatialHash::pairs(std::vector<std::pair<int,int>>& out) const {
+    out.clear();
+    if (m_nx == 0) return;
+    const std::vector<Box>& boxes = m_boxes;
+    for (int by = 0; by < m_ny; ++by)
+        for (int bx = 0; bx < m_nx; ++bx) {
+            int c = bx + m_nx * by, s = m_start[c], e = m_start[c + 1];
+            for (int p = s; p < e; ++p) {
+                int a = m_items[p];
+                const Box& A = boxes[a];
+                for (int q = p + 1; q < e; ++q) {
+                    int b = m_items[q];
+                    const Box& B = boxes[b];
+                    if (A.x1 < B.x0 || B.x1 < A.x0 || A.y1 < B.y0 || B.y1 < A.y0) continue;
+                    if (bucketX(std::max(A.x0, B.x0)) != bx || bucketY(std::max(A.y0, B.y0)) != by) continue;
+                    out.emplace_back(a, b);
+                }
+            }
+        }
+    std::sort(out.begin(), out.end());
+}
+
+void SpatialHash::query(float x, float y, std::vector<int>& out) const {
+    query(Box{x, y, x, y}, out);
+}
+
+void SpatialHash::query(const Box& box, std::vector<int>& out) const {
+    out.clear();
+    if (m_nx == 0) return;
+    for (int by = bucketY(box.y0); by <= bucketY(box.y1); ++by)
+        for (int bx = bucketX(box.x0); bx <= bucketX(box.x1); ++bx) {
+            int c = bx + m_nx * by;
+            for (int p = m_start[c]; p < m_start[c + 1]; ++p)
+                if (overlaps(m_boxes[m_items[p]], box)) out.push_back(m_items[p]);
+        }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
@@ -0,0 +1,295 @@
+#include "Sweep.h"
+#include "FluidGrid.h"
+#include "ObstacleManager.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+// ===== sweep spec ===========================================================
+namespace {
+
+const char* const Keys[] = {"scenario", "N", "Nx", "Ny", "steps", "bodies", "dt", "diff", "visc", "vort", "buoyancy_factor",
+                            "temp_diffusivity", "pressure"};
+
+std::string trim(const std::string& s) {
+    size_t a = s.find_first_not_of(" \t\r"), b = s.find_last_not_of(" \t\r");
+    return a == std::string::npos ? std::string() : s.substr(a, b - a + 1);
+}
+
+bool parseNumber(const std::string& s, double& x) {
+    char* end = nullptr;
+    x = std::strtod(s.c_str(), &end);
+    return !s.empty() && *end == 0 && std::isfinite(x);
+}
+
+// A value, or the values of a range first:last:count.
+bool expand(const std::string& value, std::vector<std::string>& out) {
+    size_t c1 = value.find(':');
+    if (c1 == std::string::npos) { out.push_back(value); return !value.empty(); }
+    size_t c2 = value.find(':', c1 + 1);
+    double first, last, count;
+    if (c2 == std::string::npos || !parseNumber(trim(value.substr(0, c1)), first) ||
+        !parseNumber(trim(value.substr(c1 + 1, c2 - c1 - 1)), last) || !parseNumber(trim(value.substr(c2 + 1)), count) ||
+        count < 1 || count != std::floor(count))
+        return false;
+    for (int k = 0; k < int(count); ++k) {
+        std::ostringstream s;
+        s.precision(9);
+        s << (count > 1 ? first + (last - first) * k / (count - 1) : first);
+        out.push_back(s.str());
+    }
+    return true;
+}
+
+// Sets key of r to value; false if either is unknown or out of range.
+bool setParameter(SweepRun& r, const std::string& key, const std::string& value) {
+    if (key == "scenario") {
+        if (value != "inject" && value != "plume" && value != "obstacles") return false;
+        r.scenario = value;
+        return true;
+    }
+    if (key == "pressure") {
+        if      (value == "gs") r.pressure = PressureSolverType::GaussSeidel;
+        else if (value == "mg") r.pressure = PressureSolverType::Multigrid;
+        else if (value == "cg") r.pressure = PressureSolverType::ConjugateGradient;
+        else return false;
+        return true;
+    }
+    double x;
+    if (!parseNumber(value, x)) return false;
+    int n = int(std::lround(x));
+    if      (key == "N")                { if (n < 8 || n > 4096) return false; r.N = n; }
+    else if (key == "Nx")               { if (n < 8 || n > 4096) return false; r.Nx = n; }
+    else if (key == "Ny")               { if (n < 8 || n > 4096) return false; r.Ny = n; }
+    else if (key == "steps")            { if (n < 1) return false; r.steps = n; }
+    else if (key == "bodies")           { if (n < 0) return false; r.bodies = n; }
+    else if (key == "dt")               { if (x <= 0) return false; r.dt = float(x); }
+    else if (key == "diff")             { if (x < 0) return false; r.diff = float(x); }
+    else if (key == "visc")             { if (x < 0) return false; r.visc = float(x); }
+    else if (key == "vort")             r.vort = float(x);
+    else if (key == "buoyancy_factor")  r.buoyancy_factor = float(x);
+    else if (key == "temp_diffusivity") { if (x < 0) return false; r.temp_diffusivity = float(x); }
+    else return false;
+    return true;
+}
+
+struct Key {
+    std::string name;
+    std::vector<std::string> values;
+    int line;
+};
+
+// Every combination of the block's values, the first key varying slowest.
+bool emitBlock(const std::vector<Key>& keys, std::vector<SweepRun>& runs, std::string& error) {
+    if (keys.empty()) return true;
+    std::vector<size_t> at(keys.size(), 0);
+    for (;;) {
+        SweepRun r;
+        r.id = int(runs.size());
+        for (size_t k = 0; k < keys.size(); ++k)
+            if (!setParameter(r, keys[k].name, keys[k].values[at[k]])) {
+                error = "line " + std::to_string(keys[k].line) + ": bad value '" + keys[k].values[at[k]] + "' for " + keys[k].name;
+                return false;
+            }
+        runs.push_back(r);
+        size_t k = keys.size();
+        while (k > 0 && ++at[k - 1] == keys[k - 1].values.size()) at[--k] = 0;
+        if (k == 0) return true;
+    }
+}
+
+} // namespace
+
+bool parseSweepSpec(const std::string& spec, std::vector<SweepRun>& runs, std::string& error) {
+    std::vector<SweepRun> out = runs;
+    std::vector<Key> keys;
+    std::istringstream in(spec);
+    std::string text;
+    for (int line = 1; std::getline(in, text); ++line) {
+        text = trim(text.substr(0, text.find('#')));
+        if (text.empty()) continue;
+        if (text == "---") {
+            if (!emitBlock(keys, out, error)) return false;
+            keys.clear();
+            continue;
+        }
+        size_t eq = text.find('=');
+        if (eq == std::string::npos) { error = "line " + std::to_string(line) + ": expected key = value"; return false; }
+        Key key{trim(text.substr(0, eq)), {}, line};
+        if (std::find(std::begin(Keys), std::end(Keys), key.name) == std::end(Keys)) {
+            error = "line " + std::to_string(line) + ": unknown key '" + key.name + "'";
+            return false;
+        }
+        for (const Key& k : keys)
+            if (k.name == key.name) { error = "line " + std::to_string(line) + ": " + key.name + " given twice"; return false; }
+        std::istringstream values(text.substr(eq + 1));
+        for (std::string v; std::getline(values, v, ',');)
+            if (!expand(trim(v), key.values)) {
+                error = "line " + std::to_string(line) + ": bad value '" + trim(v) + "' for " + key.name;
+                return false;
+            }
+        if (key.values.empty()) { error = "line " + std::to_string(line) + ": no value for " + key.name; return false; }
+        keys.push_back(key);
+    }
+    if (!emitBlock(keys, out, error)) return false;
+    runs.swap(out);
+    return true;
+}
+
+// ===== SweepScene ===========================================================
+
+// The sources and bodies of FluidBench's scenarios: a square source near the bottom (hot
+// smoke for plume, a dense jet otherwise) and, for obstacles, a lattice of disks and movable
+// rectangles across the upper part of the domain. Sizes follow the shorter side.
+SweepScene::SweepScene(const std::string& scenario, int N, int Ny, int bodies) : m_buoyant(scenario == "plume") {
+    int M = std::min(N, Ny);
+    int r = std::max(1, M / 32), ci = N / 2, cj = std::max(1, Ny / 8);
+    for (int j = std::max(1, cj - r); j <= std::min(Ny, cj + r); ++j)
+        for (int i = std::max(1, ci - r); i <= std::min(N, ci + r); ++i) {
+            if (m_buoyant) m_cells.push_back(Cell{IX(i, j, N), 50.f, 200.f, 0.f});
+            else           m_cells.push_back(Cell{IX(i, j, N), 100.f, 0.f, 20.f});
+        }
+    if (scenario != "obstacles") return;
+    int cols = 8, rows = (bodies + cols - 1) / cols;
+    for (int k = 0; k < bodies; ++k) {
+        int row = k / cols, col = k % cols;
+        int x = (2 * col + 1) * N / (2 * cols);
+        int y = Ny / 4 + (2 * row + 1) * (3 * Ny / 4) / (2 * rows);
+        int s = std::max(2, M / 40);
+        if (k % 2 == 0) m_bodies.push_back(Body{true, x, y, s, 0});
+        else            m_bodies.push_back(Body{false, x - s, y - s, 2 * s, 3 * s});
+    }
+}
+
+void SweepScene::inject(FluidGrid& grid) const {
+    grid.clearSources();
+    float* dens = grid.densPrev();
+    float* temp = grid.tempPrev();
+    float* v = grid.vPrev();
+    for (const Cell& c : m_cells) {
+        dens[c.index] = c.dens;
+        temp[c.index] = c.temp;
+        v[c.index] = c.v;
+    }
+}
+
+void SweepScene::placeBodies(ObstacleManager& manager) const {
+    for (const Body& b : m_bodies) {
+        if (b.disk) manager.addDisk(b.x, b.y, b.w, 2 * b.w, 2 * b.w);
+        else        manager.addMovableRect(b.x, b.y, b.w, b.h);
+    }
+}
+
+// ===== SweepRunner ==========================================================
+
+SweepRunner::SweepRunner(const SweepOptions& options)
+    : m_opt(options),
+      m_threads(options.threads > 0 ? options.threads : int(std::max(1u, std::thread::hardware_concurrency()))) {
+    if (m_opt.shareThreads) m_pool = std::make_shared<ThreadPool>(m_threads);
+}
+
+std::shared_ptr<const SweepScene> SweepRunner::scene(const SweepRun& run) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto key = std::make_tuple(run.scenario, run.width(), run.height(), run.scenario == "obstacles" ? run.bodies : 0);
+    std::shared_ptr<const SweepScene>& s = m_scenes[key];
+    if (!s) s = std::make_shared<SweepScene>(run.scenario, run.width(), run.height(), run.bodies);
+    return s;
+}
+
+void SweepRunner::run(const std::vector<SweepRun>& runs, const std::function<void(const SweepResult&)>& done) {
+    std::vector<size_t> order(runs.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    auto cost = [&](size_t k) { return double(runs[k].width()) * runs[k].height() * runs[k].steps; };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cost(a) > cost(b); });
+
+    std::atomic<size_t> next{0};
+    std::mutex doneMutex;
+    auto runner = [&](int worker) {
+        for (size_t k; (k = next.fetch_add(1)) < order.size();) {
+            SweepResult res = runOne(runs[order[k]], worker);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done(res);
+        }
+    };
+    int runners = std::min(m_threads, int(runs.size()));
+    if (m_pool) {
+        // The pool's workers are the other runners, so nothing runs beside the pool
+        ThreadPool::TaskGroup group(*m_pool);
+        for (int w = 1; w < runners; ++w) group.run([&runner, w] { runner(w); });
+        runner(0);
+        group.wait();
+    } else {
+        std::vector<std::thread> threads;
+        for (int w = 1; w < runners; ++w) threads.emplace_back(runner, w);
+        runner(0);
+        for (std::thread& t : threads) t.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scenes.clear();
+}
+
+SweepResult SweepRunner::runOne(const SweepRun& run, int worker) {
+    SweepResult res;
+    res.run = run;
+    res.worker = worker;
+
+    std::unique_ptr<FluidGrid> grid;
+    std::unique_ptr<ObstacleManager> manager;
+    std::unique_ptr<FluidSolver> solver;
+    std::shared_ptr<const SweepScene> sc;
+    {
+        ScopedTimer t(&res.setupMs);
+        sc = scene(run);
+        grid.reset(new FluidGrid(run.width(), run.height()));
+        if (sc->hasBodies()) manager.reset(new ObstacleManager(run.width(), run.height()));
+        solver.reset(new FluidSolver(*grid, manager.get()));
+        if (m_pool) solver->setThreadPool(m_pool);
+        else        solver->setThreadCount(1);
+        solver->dt = run.dt; solver->diff = run.diff; solver->visc = run.visc; solver->vort = run.vort;
+        solver->buoyancy_on = sc->buoyant();
+        solver->buoyancy_factor = run.buoyancy_factor;
+        solver->temp_diffusivity = run.temp_diffusivity;
+        solver->pressure_solver = run.pressure;
+        if (manager) sc->placeBodies(*manager);
+    }
+
+    {
+        ScopedTimer t(&res.stepMs);
+        for (int k = 0; k < run.steps; ++k) {
+            sc->inject(*grid);
+            if (manager) {
+                manager->updateObstacles(*grid, solver->dt, solver->threadPool());
+                manager->update(solver->dt);
+                manager->handleCollisions(solver->threadPool());
+            }
+            solver->step();
+        }
+    }
+
+    const int N = run.width(), Ny = run.height();
+    const float* dens = grid->dens();
+    const float* u = grid->u();
+    const float* v = grid->v();
+    double weighted = 0;
+    for (int j = 1; j <= Ny; ++j)
+        for (int i = 1; i <= N; ++i) {
+            int c = IX(i, j, N);
+            if (!std::isfinite(dens[c]) || !std::isfinite(u[c]) || !std::isfinite(v[c])) { res.finite = false; continue; }
+            double speed2 = double(u[c]) * u[c] + double(v[c]) * v[c];
+            res.mass += dens[c];
+            res.energy += 0.5 * speed2;
+            res.maxSpeed = std::max(res.maxSpeed, speed2);
+            weighted += dens[c] * ((j - 0.5) / Ny);
+        }
+    res.maxSpeed = std::sqrt(res.maxSpeed);
+    res.height = res.mass > 0 ? weighted / res.mass : 0;
+    return res;
+}
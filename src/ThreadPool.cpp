@@ -0,0 +1,161 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+// Which pool the current thread works for, and its queue there.
+thread_local const ThreadPool* t_pool  = nullptr;
+thread_local int               t_index = 0;
+}
+
+ThreadPool::ThreadPool(int threads) : m_queues(std::max(1, threads)){
+    for(int k=1;k<threads;++k) m_workers.emplace_back(&ThreadPool::workerLoop, this, k);
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto& t : m_workers) t.join();
+}
+
+int ThreadPool::self() const {
+    return t_pool == this ? t_index : 0;
+}
+
+void ThreadPool::push(const Task* tasks, int count){
+    Queue& q = m_queues[self()];
+    {
+        std::lock_guard<std::mutex> lk(q.m);
+        q.pushBack(tasks, count);
+    }
+    m_epoch.fetch_add(1);
+    if(m_sleepers.load() > 0){
+        { std::lock_guard<std::mutex> lk(m_mutex); }
+        if(count > 1) m_wake.notify_all(); else m_wake.notify_one();
+    }
+}
+
+void ThreadPool::Queue::pushBack(const Task* tasks, int n){
+    if(count + n > ring.size()){
+        size_t size = std::max<size_t>(64, ring.size());
+        while(size < count + n) size *= 2;
+        std::vector<Task> grown(size);
+        for(size_t k=0;k<count;++k) grown[k] = ring[(head + k) & (ring.size() - 1)];
+        ring.swap(grown);
+        head = 0;
+    }
+    for(int k=0;k<n;++k) ring[(head + count + k) & (ring.size() - 1)] = tasks[k];
+    count += n;
+}
+
+bool ThreadPool::pop(int q, Task& t){
+    Queue& Q = m_queues[q];
+    std::lock_guard<std::mutex> lk(Q.m);
+    if(Q.count == 0) return false;
+    t = Q.popBack();
+    return true;
+}
+
+bool ThreadPool::steal(int q, Task& t){
+    int n = size();
+    for(int k=1;k<n;++k){
+        Queue& Q = m_queues[(q + k) % n];
+        std::lock_guard<std::mutex> lk(Q.m);
+        if(Q.count == 0) continue;
+        t = Q.popFront();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& t){
+    t.invoke(t.ctx);
+    t.pending->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::helpUntilDone(std::atomic<int>& pending){
+    int q = self();
+    Task t;
+    while(pending.load(std::memory_order_acquire) > 0){
+        if(findTask(q, t)) execute(t);
+        else std::this_thread::yield();
+    }
+}
+
+void ThreadPool::workerLoop(int index){
+    t_pool = this; t_index = index;
+    Task t;
+    for(;;){
+        if(findTask(index, t)){ execute(t); continue; }
+
+        // Work arrives in bursts within a step; spin briefly before parking.
+        uint64_t epoch = m_epoch.load();
+        bool found = false;
+        for(int s = 0; s < 2000 && !found; ++s){
+            if(findTask(index, t)) found = true;
+            else std::this_thread::yield();
+        }
+        if(found){ execute(t); continue; }
+
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_sleepers.fetch_add(1);
+        m_wake.wait(lk, [&]{ return m_stop || m_epoch.load() != epoch; });
+        m_sleepers.fetch_sub(1);
+        if(m_stop) return;
+    }
+}
+
+// ===== parallelFor ==========================================================
+namespace {
+struct RangeJob {
+    const std::function<void(int, int)>* fn;
+    int begin, end, chunks;
+    std::atomic<int> next{0};
+
+    // Every task claims the next chunk when it starts, so chunks start in increasing order
+    // no matter which thread picks up which task.
+    static void run(void* ctx){
+        RangeJob& job = *static_cast<RangeJob*>(ctx);
+        int k = job.next.fetch_add(1, std::memory_order_relaxed);
+        int n = job.end - job.begin;
+        int lo = job.begin + int(int64_t(n) * k / job.chunks);
+        int hi = job.begin + int(int64_t(n) * (k + 1) / job.chunks);
+        (*job.fn)(lo, hi);
+    }
+};
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)>& fn, int grain){
+    int n = end - begin;
+    if(n <= 0) return;
+    int chunks = std::min(size(), n / std::max(1, grain));
+    if(chunks <= 1){ fn(begin, end); return; }
+
+    RangeJob job;
+    job.fn = &fn; job.begin = begin; job.end = end; job.chunks = chunks;
+    std::atomic<int> pending{chunks - 1};
+    Task tasks[64];
+    for(int k=0;k<64;++k) tasks[k] = Task{&RangeJob::run, &job, &pending};
+    for(int k=1;k<chunks;k+=64) push(tasks, std::min(64, chunks - k));
+    RangeJob::run(&job);
+    helpUntilDone(pending);
+}
+
+// ===== TaskGroup ============================================================
+static void invokeFunction(void* ctx){
+    (*static_cast<std::function<void()>*>(ctx))();
+}
+
+void ThreadPool::TaskGroup::run(std::function<void()> fn){
+    m_fns.push_back(std::move(fn));
+    m_pending.fetch_add(1);
+    Task t{&invokeFunction, &m_fns.back(), &m_pending};
+    m_pool.push(&t, 1);
+}
+
+void ThreadPool::TaskGroup::wait(){
+    m_pool.helpUntilDone(m_pending);
+    m_fns.clear();
+}
@@ -0,0 +1,62 @@
+#include "TileMap.h"
+#include <algorithm>
+
+TileMap::TileMap(int Nx,int Ny):m_Nx(Nx),m_Ny(Ny),m_Tx((Nx+Size-1)/Size),m_Ty((Ny+Size-1)/Size),
+    m_on(size_t(m_Tx)*m_Ty,1),m_spans(m_Ty){
+    update();
+}
+
+int TileMap::tileOfI(int i) const {
+    return std::min(std::max(i-1,0)/Size, m_Tx-1);
+}
+int TileMap::tileOfJ(int j) const {
+    return std::min(std::max(j-1,0)/Size, m_Ty-1);
+}
+int TileMap::lastCellI(int ti) const {
+    return std::min(m_Nx,(ti+1)*Size);
+}
+int TileMap::lastCellJ(int tj) const {
+    return std::min(m_Ny,(tj+1)*Size);
+}
+
+int TileMap::activeCount() const {
+    return int(std::count(m_on.begin(),m_on.end(),1));
+}
+
+void TileMap::update(){
+    for(int tj=0;tj<m_Ty;++tj){
+        std::vector<Span>& row=m_spans[tj];
+        row.clear();
+        for(int ti=0;ti<m_Tx;){
+            if(!active(ti,tj)){ ++ti; continue; }
+            int t0=ti;
+            while(ti<m_Tx && active(ti,tj)) ++ti;
+            row.push_back(Span{firstCell(t0),lastCellI(ti-1)});
+        }
+    }
+}
+
+void TileMap::fill(){
+    std::fill(m_on.begin(),m_on.end(),1);
+    update();
+}
+void TileMap::clear(){
+    std::fill(m_on.begin(),m_on.end(),0);
+    update();
+}
+
+// Separable: spread along the tile rows first, then along the columns.
+void TileMap::dilate(int radius){
+    if(radius<=0 || m_on.empty()) return;
+    m_tmp.assign(m_on.size(),0);
+    for(int tj=0;tj<m_Ty;++tj)
+        for(int ti=0;ti<m_Tx;++ti)
+            if(active(ti,tj))
+                for(int k=std::max(0,ti-radius);k<=std::min(m_Tx-1,ti+radius);++k) m_tmp[k+m_Tx*tj]=1;
+    std::fill(m_on.begin(),m_on.end(),0);
+    for(int tj=0;tj<m_Ty;++tj)
+        for(int ti=0;ti<m_Tx;++ti)
+            if(m_tmp[ti+m_Tx*tj])
+                for(int k=std::max(0,tj-radius);k<=std::min(m_Ty-1,tj+radius);++k) m_on[ti+m_Tx*k]=1;
+    update();
+}
@@ -1,15 +1,26 @@
 #include <GL/glut.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cmath>
 #include <algorithm>
 #include <memory>
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "FluidGrid.h"
 #include "FluidSolver.h"
 #include "ObstacleManager.h"
 #include "MovableObstacle.h" // Use the new base class
 #include "Vec2.h"
+#include "FieldRenderer.h"
+#include "ObstacleRenderer.h"
+#include "FieldSnapshot.h"
+#include "TripleBuffer.h"
+#include "SpscQueue.h"
+#include "Checkpoint.h"
+#include "FieldRecorder.h"
 
 void print(const char* str) {
     std::cout << str << std::endl;
@@ -17,7 +28,8 @@ void print(const char* str) {
 
 // --- runtime-tunable params ---
 static float dt     = 0.1f; 
-static int   N      = 64;
+static int   Nx     = 64;     // grid width and height; cells are 1/max(Nx,Ny) of the view
+static int   Ny     = 64;
 static float diff   = 0.f;
 static float visc   = 0.f;
 static float vort   = 5.f;
@@ -27,14 +39,44 @@ static float cmd_force  = 5.f;
 static float cmd_source = 100.f;
 
 // --- globals ---
-static FluidGrid   grid(N);
+static FluidGrid   grid(Nx, Ny);
 static std::unique_ptr<ObstacleManager> obstacleManager;
 static FluidSolver solver(grid, nullptr);
 
+// --- threads ---
+// The simulation runs on a thread of its own (simulate()), which owns the grid, the solver,
+// the obstacles and the interaction state below. The GLUT callbacks only forward input to
+// it through a queue and draw the latest snapshot it published, so a slow frame never holds
+// up a step and the step rate and frame rate are set independently.
+struct Command {
+    enum Kind : unsigned char { MouseButton, MouseMove, Key, Param } kind = MouseMove;
+    int a = 0, b = 0;   // button and state, the key, or the slider index
+    int x = 0, y = 0;   // simulation viewport pixels, y up
+    float value = 0.f;  // the slider's new value
+    bool shift = false;
+};
+static SpscQueue<Command> commands(1024);
+static TripleBuffer<FieldSnapshot> snapshots;
+static std::thread sim_thread;
+static std::atomic<bool> sim_quit{false};
+static long long sim_steps = 0;
+static const float step_rates[] = {0.f, 240.f, 120.f, 60.f, 30.f, 15.f}; // steps per second, 0: unlimited
+static int step_rate_idx = 0;
+static const int frame_rates[] = {15, 30, 60, 120};
+static int frame_rate_idx = 2;
+static CheckpointWriter checkpoints; // 's' saves to checkpoint_path in the background, 'l' loads it
+static const char* checkpoint_path = "fluidtoy.ckpt";
+static FieldRecorder recorder; // 'r' starts and stops recording every step to recording_path
+static const char* recording_path = "fluidtoy.rec";
+
 // --- Window sizes ---
 static int simulation_size = 512; // Size of the simulation (in pixels)
 static int ui_size = 200; // Size of the UI panel (in pixels)
 static bool showVel = false;
+static bool immediateMode = false; // draw the fields vertex by vertex instead of through field_renderer
+static FieldRenderer field_renderer;
+static const int glyph_strides[] = {1, 2, 4, 8};
+static int glyph_stride_idx = 2;
 static int  winX = simulation_size + ui_size;
 static int  winY = simulation_size;
 static int  mouseDown[3] = {0,0,0};
@@ -72,7 +114,8 @@ typedef struct {
     float N;
 } FluidParameters;
 
-FluidParameters params = {0.1f, 0.f, 0.f, 5.f, 64};
+FluidParameters params = {0.1f, 0.f, 0.f, 5.f, 64};   // what the sliders show
+static FluidParameters sim_params = params;            // what the simulation uses
 
 typedef enum {
     TYPE_INT,
@@ -95,27 +138,6 @@ Slider sliders[] = {
     {5.f,   512.f, &params.N,    "N",          TYPE_FLOAT},
 };
 
-// --- drawing helpers ---
-static void drawVelocity(){
-    int N = grid.size(); float h = 1.0f/N; glColor3f(1,1,1); glLineWidth(1.0f); glBegin(GL_LINES);
-    for(int i=1;i<=N;++i){ float x=(i-0.5f)*h; for(int j=1;j<=N;++j){ float y=(j-0.5f)*h; float u=grid.u()[IX(i,j,N)]; float v=grid.v()[IX(i,j,N)]; glVertex2f(x,y); glVertex2f(x+u, y+v); } }
-    glEnd();
-}
-static void drawDensity(){
-    int N = grid.size(); float h = 1.0f/N; glBegin(GL_QUADS);
-    for(int i=0; i<N; i++){ float x = i*h; for(int j=0; j<N; j++){ float y = j*h;
-            float d00 = grid.dens()[IX(i,j,N)],     t00 = grid.temp()[IX(i,j,N)];
-            float d10 = grid.dens()[IX(i+1,j,N)],   t10 = grid.temp()[IX(i+1,j,N)];
-            float d11 = grid.dens()[IX(i+1,j+1,N)], t11 = grid.temp()[IX(i+1,j+1,N)];
-            float d01 = grid.dens()[IX(i,j+1,N)],   t01 = grid.temp()[IX(i,j+1,N)];
-            
-            glColor3f(std::min(1.f, d00 + t00*0.5f), std::min(1.f, d00), std::max(0.f, d00 - t00*0.5f)); glVertex2f(x,y);
-            glColor3f(std::min(1.f, d10 + t10*0.5f), std::min(1.f, d10), std::max(0.f, d10 - t10*0.5f)); glVertex2f(x+h,y);
-            glColor3f(std::min(1.f, d11 + t11*0.5f), std::min(1.f, d11), std::max(0.f, d11 - t11*0.5f)); glVertex2f(x+h,y+h);
-            glColor3f(std::min(1.f, d01 + t01*0.5f), std::min(1.f, d01), std::max(0.f, d01 - t01*0.5f)); glVertex2f(x,y+h);
-    }} glEnd();
-}
-
 static void drawUI() {
     
 
@@ -135,16 +157,16 @@ static void drawUI() {
     glMatrixMode(GL_PROJECTION); glPopMatrix(); glMatrixMode(GL_MODELVIEW); glPopMatrix();
 }
 
+// Grid cell under a mouse coordinate of the simulation view (either axis; y is up).
+static int gridCell(float m){ return int((m/float(simulation_size))*std::max(Nx,Ny)+1); }
+
 static void getFromUI(){
-    std::fill(grid.m_uPrev.begin(), grid.m_uPrev.end(), 0.f); 
-    std::fill(grid.m_vPrev.begin(), grid.m_vPrev.end(), 0.f); 
-    std::fill(grid.m_densPrev.begin(), grid.m_densPrev.end(), 0.f); 
-    std::fill(grid.m_tempPrev.begin(), grid.m_tempPrev.end(), 0.f);
+    grid.clearSources();
     
     if(!mouseDown[0] && !mouseDown[2]) return;
     if(is_dragging_object || is_dragging_slider) return;
-    int i = int(( mx/float(simulation_size))*N+1), j = int((my/float(simulation_size))*N+1);
-    if(i<1||i>N||j<1||j>N) return;
+    int i = gridCell(mx), j = gridCell(my);
+    if(i<1||i>Nx||j<1||j>Ny) return;
 
     if(mouseDown[0]){ 
         float force_x = cmd_force * (mx - omx) * dt;
@@ -204,17 +226,25 @@ static void display_ui() {
     glMatrixMode(GL_PROJECTION); glPopMatrix(); glMatrixMode(GL_MODELVIEW); glPopMatrix();
 }
 
-static void display_simulation() {
+static void display_simulation(const FieldSnapshot& snapshot) {
     glMatrixMode(GL_PROJECTION); glLoadIdentity(); gluOrtho2D(0, 1, 0, 1);
-    if(showVel) drawVelocity(); else drawDensity(); 
-    if(obstacleManager) obstacleManager->draw(); 
+    if (immediateMode) {
+        if(showVel) FieldRenderer::drawVelocity(snapshot); else FieldRenderer::drawDensity(snapshot);
+    } else {
+        field_renderer.glyphStride = glyph_strides[glyph_stride_idx];
+        if(showVel) field_renderer.drawVelocityGlyphs(snapshot); else field_renderer.drawDensityTexture(snapshot);
+    }
+    ObstacleRenderer renderer(std::max(snapshot.Nx, snapshot.Ny));
+    for (const FieldSnapshot::Shape& shape : snapshot.shapes) renderer.draw(shape);
 }
 
 static void display(){ 
     glClear(GL_COLOR_BUFFER_BIT);
 
+    snapshots.acquire(); // the newest published step, if any came since the last frame
+
     glViewport(0, 0, simulation_size, simulation_size);
-    display_simulation();
+    display_simulation(snapshots.front());
 
     glViewport(simulation_size, 0, ui_size, winY);
     display_ui();
@@ -222,20 +252,25 @@ static void display(){
     glutSwapBuffers(); 
 }
 
-static void idle(){ 
-    solver.dt = params.dt;
-    solver.diff = params.diff;
-    solver.visc = params.visc;
-    solver.vort = params.vort;
+static void redisplay(int){
+    glutPostRedisplay();
+    glutTimerFunc(1000 / frame_rates[frame_rate_idx], redisplay, 0);
+}
+
+static void step_simulation(){ 
+    solver.dt = sim_params.dt;
+    solver.diff = sim_params.diff;
+    solver.visc = sim_params.visc;
+    solver.vort = sim_params.vort;
 
     getFromUI(); 
 
     if (obstacleManager) {
         if (two_way_coupling && !is_dragging_object) {
-            obstacleManager->updateObstacles(grid, dt);
+            obstacleManager->updateObstacles(grid, dt, solver.threadPool());
         }
         obstacleManager->update(dt);
-        obstacleManager->handleCollisions();
+        obstacleManager->handleCollisions(solver.threadPool());
     }
     
     solver.step();
@@ -245,14 +280,51 @@ static void idle(){
     m_hist_x[m_hist_idx] = mx;
     m_hist_y[m_hist_idx] = my;
     m_hist_idx = (m_hist_idx+1)%5;
+}
 
-    glutPostRedisplay(); 
+static void resize_simulation(int nx, int ny);
+
+// Loads checkpoint_path in place of the running simulation, at the checkpoint's grid size.
+static void load_checkpoint() {
+    checkpoints.wait(); // a save in flight may be writing the file
+    CheckpointFile file;
+    if (!file.open(checkpoint_path)) { printf("Cannot load checkpoint: %s\n", file.error().c_str()); return; }
+    int nx = file.nx(), ny = file.ny();
+    if (std::min(nx, ny) < 9 || std::max(nx, ny) > 1024) {
+        printf("Cannot load checkpoint: grid size %dx%d is out of range\n", nx, ny);
+        return;
+    }
+    if (nx != Nx || ny != Ny) resize_simulation(nx, ny);
+    if (!file.restore(grid, solver, obstacleManager.get())) { printf("Cannot load checkpoint: %s\n", file.error().c_str()); return; }
+    sim_params.dt = solver.dt; sim_params.diff = solver.diff; sim_params.visc = solver.visc; sim_params.vort = solver.vort;
+    sim_params.N = float(std::max(Nx, Ny));
+    sim_steps = file.header().step;
+    selected_obstacle = nullptr; is_dragging_object = false;
+    printf("Loaded %s: %dx%d, step %lld\n", checkpoint_path, Nx, Ny, sim_steps);
 }
 
-static void key(unsigned char c, int x, int y){
-    mx = x; my = winY - y;
-    int i = int((mx / float(simulation_size)) * N + 1);
-    int j = int((my / float(simulation_size)) * N + 1);
+static void stop_recording() {
+    if (!recorder.isOpen()) return;
+    bool ok = recorder.close();
+    RecorderStats rs = recorder.stats();
+    if (ok) printf("Recorded %d frames to %s (%llu bytes)\n", rs.frames, recording_path, (unsigned long long)rs.storedBytes);
+    else    printf("Recording failed: %s\n", recorder.error().c_str());
+}
+
+// Carries the flow and the obstacles over to an nx x ny grid (FluidSolver::resize).
+static void resize_simulation(int nx, int ny) {
+    stop_recording(); // a recording has one grid size
+    Nx = nx; Ny = ny;
+    solver.resize(Nx, Ny);
+    obstacleManager->rescale(Nx, Ny);
+    selected_obstacle = nullptr; is_dragging_object = false;
+}
+
+// Keys that act on the simulation; runs on its thread. y is up.
+static void key_simulation(unsigned char c, int x, int y){
+    mx = x; my = y;
+    int i = gridCell(mx);
+    int j = gridCell(my);
     switch(c){
         case 'c': case 'C':
             grid.reset(); if (obstacleManager) obstacleManager->clear();
@@ -262,8 +334,38 @@ static void key(unsigned char c, int x, int y){
             solver.buoyancy_on = !solver.buoyancy_on;
             printf("Buoyancy %s\n", solver.buoyancy_on ? "ON" : "OFF");
             break;
-        case 'v': case 'V': showVel=!showVel; break;
-        case 'q': case 'Q': std::exit(0); break;
+        case 'p': case 'P':
+            switch (solver.pressure_solver) {
+                case PressureSolverType::GaussSeidel:       solver.pressure_solver = PressureSolverType::Multigrid; break;
+                case PressureSolverType::Multigrid:         solver.pressure_solver = PressureSolverType::ConjugateGradient; break;
+                case PressureSolverType::ConjugateGradient: solver.pressure_solver = PressureSolverType::GaussSeidel; break;
+            }
+            printf("Pressure solver: %s\n", solver.pressure_solver == PressureSolverType::Multigrid ? "multigrid"
+                 : solver.pressure_solver == PressureSolverType::ConjugateGradient ? "conjugate gradient" : "Gauss-Seidel");
+            break;
+        case '+': case '=': case '-':
+            step_rate_idx = std::max(0, std::min(5, step_rate_idx + (c == '-' ? 1 : -1)));
+            if (step_rates[step_rate_idx] > 0.f) printf("Step rate: %g steps/s\n", step_rates[step_rate_idx]);
+            else                                 printf("Step rate: unlimited\n");
+            break;
+        case 's': case 'S':
+            if (checkpoints.save(grid, solver, obstacleManager.get(), sim_steps, checkpoint_path))
+                printf("Saving %s at step %lld\n", checkpoint_path, sim_steps);
+            else
+                printf("Still writing the last checkpoint\n");
+            break;
+        case 'l': case 'L':
+            load_checkpoint();
+            break;
+        case 'r': case 'R':
+            if (recorder.isOpen()) stop_recording();
+            else {
+                RecorderOptions ro;
+                ro.pool = &solver.threadPool();
+                if (recorder.open(recording_path, Nx, Ny, ro)) printf("Recording to %s\n", recording_path);
+                else printf("Cannot record: %s\n", recorder.error().c_str());
+            }
+            break;
         case 't':
             two_way_coupling = !two_way_coupling;
             printf("Two-way coupling set to %s\n", two_way_coupling ? "true" : "false");
@@ -312,15 +414,15 @@ static int slider_index(int x, int y) {
     return -1;
 }
 
-static void mouse_simulation(int button, int state, int x, int y) {
+static void mouse_simulation(int button, int state, int x, int y, bool shift) {
     omx = mx = x; omy = my = y;
 
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
         if (x >= slider_x - 5 && x <= slider_x + slider_w + 5 && (winY - y) >= slider_y - 10 && (winY - y) <= slider_y + 10) {
             is_dragging_slider = true;
         } else {
-            int i = int((mx / float(simulation_size)) * N + 1);
-            int j = int((my / float(simulation_size)) * N + 1);
+            int i = gridCell(mx);
+            int j = gridCell(my);
 
             selected_obstacle = obstacleManager->findMovableAt(i, j); 
             if (selected_obstacle) {
@@ -360,7 +462,7 @@ static void mouse_simulation(int button, int state, int x, int y) {
     } 
 
     if (button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN) {
-        if (glutGetModifiers() & GLUT_ACTIVE_SHIFT) {
+        if (shift) {
             current_source_type = 1;
         } else {
             current_source_type = 0;
@@ -382,9 +484,16 @@ static void mouse_ui(int button, int state, int x, int y) {
     }
 }
 
+static void send(const Command& c) {
+    commands.push(c); // dropped if the simulation is 1024 commands behind
+}
+
 static void mouse(int button, int state, int x, int y) {
     if (x < simulation_size) {
-        mouse_simulation(button, state, x, winY - y);
+        Command c;
+        c.kind = Command::MouseButton; c.a = button; c.b = state; c.x = x; c.y = winY - y;
+        c.shift = (glutGetModifiers() & GLUT_ACTIVE_SHIFT) != 0;
+        send(c);
     } else {
         mouse_ui(button, state, x - simulation_size, winY - y);
     }
@@ -396,8 +505,8 @@ static void motion_simulation(int x, int y) {
         dt = std::max(dt_min, std::min(dt_max, new_dt));
     } else if (is_dragging_object && selected_obstacle) {
         Vec2 pos = selected_obstacle->getPosition();
-        float dx_grid = (x - mx) / float(simulation_size) * N;
-        float dy_grid = (y - my) / float(simulation_size) * N;
+        float dx_grid = (x - mx) / float(simulation_size) * std::max(Nx, Ny);
+        float dy_grid = (y - my) / float(simulation_size) * std::max(Nx, Ny);
         
         pos.x += dx_grid;
         pos.y += dy_grid;
@@ -428,35 +537,114 @@ static void motion_ui(int x, int y) {
                 break;
             case TYPE_FLOAT:
                 *slider->value = slider->min_value + slider_position / (float) slider_width * (slider->max_value - slider->min_value);
-                if (slider_idx == 4) {
-                    N = (int) params.N;
-                    obstacleManager.reset(new ObstacleManager(N));
-                    grid = FluidGrid(N); 
-                    solver = FluidSolver(grid, obstacleManager.get());
-                    solver.force = cmd_force;
-                    solver.source = cmd_source;
-                }
                 break;
         }
+        Command c;
+        c.kind = Command::Param; c.a = slider_idx; c.value = *slider->value;
+        send(c);
     }
 }
 
 static void motion(int x, int y) {
     if (x < simulation_size) {
-        motion_simulation(x, winY - y);
+        Command c;
+        c.kind = Command::MouseMove; c.x = x; c.y = winY - y;
+        send(c);
     } else {
         motion_ui(x - simulation_size, winY - y);
     }
 }
 
+// Keys for the display stay on this thread, the rest go to the simulation.
+static void key(unsigned char c, int x, int y){
+    switch(c){
+        case 'v': case 'V': showVel=!showVel; return;
+        case 'm': case 'M':
+            immediateMode = !immediateMode;
+            printf("Field display: %s\n", immediateMode ? "immediate mode" : "texture");
+            return;
+        case 'g': case 'G':
+            glyph_stride_idx = (glyph_stride_idx + 1) % 4;
+            printf("Velocity glyphs every %d cells\n", glyph_strides[glyph_stride_idx]);
+            return;
+        case 'q': case 'Q': std::exit(0); return; // stop_simulation() runs at exit
+        case '[': case ']':
+            frame_rate_idx = std::max(0, std::min(3, frame_rate_idx + (c == ']' ? 1 : -1)));
+            printf("Frame rate: %d fps\n", frame_rates[frame_rate_idx]);
+            return;
+    }
+    Command cmd;
+    cmd.kind = Command::Key; cmd.a = c; cmd.x = x; cmd.y = winY - y;
+    send(cmd);
+}
+
+// Runs on the simulation thread
+static void apply(const Command& c) {
+    switch (c.kind) {
+        case Command::MouseButton: mouse_simulation(c.a, c.b, c.x, c.y, c.shift); break;
+        case Command::MouseMove:   motion_simulation(c.x, c.y); break;
+        case Command::Key:         key_simulation(static_cast<unsigned char>(c.a), c.x, c.y); break;
+        case Command::Param:
+            switch (c.a) {
+                case 0: sim_params.dt = c.value; break;
+                case 1: sim_params.diff = c.value; break;
+                case 2: sim_params.visc = c.value; break;
+                case 3: sim_params.vort = c.value; break;
+                case 4: {
+                    // The slider sets the longer side; the other keeps the aspect ratio.
+                    sim_params.N = c.value;
+                    int m = std::max(Nx, Ny), n = (int) c.value;
+                    int nx = Nx == m ? n : std::max(9, int(std::lround(double(Nx) * n / m)));
+                    int ny = Ny == m ? n : std::max(9, int(std::lround(double(Ny) * n / m)));
+                    if (nx != Nx || ny != Ny) resize_simulation(nx, ny);
+                    break;
+                }
+            }
+            break;
+    }
+}
+
+// The simulation thread: drains the commands, steps, and publishes a snapshot, at most
+// step_rates[step_rate_idx] times per second.
+static void simulate() {
+    using clock = std::chrono::steady_clock;
+    clock::time_point next = clock::now();
+    while (!sim_quit.load(std::memory_order_acquire)) {
+        Command c;
+        while (commands.pop(c)) apply(c);
+        step_simulation();
+        snapshots.back().capture(grid, obstacleManager.get(), ++sim_steps);
+        if (recorder.isOpen()) recorder.record(grid, sim_steps);
+        snapshots.publish();
+
+        float rate = step_rates[step_rate_idx];
+        if (rate <= 0.f) continue;
+        next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+        clock::time_point now = clock::now();
+        if (next < now) next = now; // behind: carry on without trying to catch up
+        else std::this_thread::sleep_until(next);
+    }
+}
+
+static void stop_simulation() {
+    sim_quit.store(true, std::memory_order_release);
+    if (sim_thread.joinable()) sim_thread.join();
+    stop_recording();
+}
+
 int main(int argc,char** argv){
-    if(argc!=1&&argc!=8){ std::fprintf(stderr, "usage: %s [N dt diff visc vort force source]\n",argv[0]); return 1; }
-    if(argc==8){ N=atoi(argv[1]); dt=atof(argv[2]); diff=atof(argv[3]); visc=atof(argv[4]); vort=atof(argv[5]); cmd_force=atof(argv[6]); cmd_source=atof(argv[7]); }
-    if(N<9||N>1024){ std::fprintf(stderr,"Error: Grid size N must be between 8 and 1024.\n"); return 1; }
-    printf("Using: N=%d dt=%g diff=%g visc=%g vort=%g force=%g source=%g\n",N,dt,diff,visc,vort,cmd_force,cmd_source);
+    if(argc!=1&&argc!=8){ std::fprintf(stderr, "usage: %s [N[xNy] dt diff visc vort force source]\n",argv[0]); return 1; }
+    if(argc==8){
+        // "256" is a square grid, "256x64" a 256 wide, 64 high one
+        if(std::sscanf(argv[1],"%dx%d",&Nx,&Ny)<2) Ny=Nx;
+        dt=atof(argv[2]); diff=atof(argv[3]); visc=atof(argv[4]); vort=atof(argv[5]); cmd_force=atof(argv[6]); cmd_source=atof(argv[7]);
+    }
+    if(std::min(Nx,Ny)<9||std::max(Nx,Ny)>1024){ std::fprintf(stderr,"Error: Grid sides must be between 9 and 1024.\n"); return 1; }
+    printf("Using: N=%dx%d dt=%g diff=%g visc=%g vort=%g force=%g source=%g\n",Nx,Ny,dt,diff,visc,vort,cmd_force,cmd_source);
+    params.N = sim_params.N = float(std::max(Nx,Ny));
 
-    obstacleManager.reset(new ObstacleManager(N));
-    grid = FluidGrid(N); 
+    obstacleManager.reset(new ObstacleManager(Nx, Ny));
+    grid = FluidGrid(Nx, Ny); 
     solver = FluidSolver(grid, obstacleManager.get());
     solver.force = cmd_force;
     solver.source = cmd_source;
@@ -464,7 +652,11 @@ int main(int argc,char** argv){
     initialize_walls();
 
     glutInit(&argc,argv); glutInitDisplayMode(GLUT_RGBA|GLUT_DOUBLE); glutInitWindowSize(winX,winY); glutCreateWindow("FluidToy – Stable Fluids Demo");
-    glutDisplayFunc(display); glutIdleFunc(idle); glutKeyboardFunc(key); glutMouseFunc(mouse); glutMotionFunc(motion);
+    glutDisplayFunc(display); glutKeyboardFunc(key); glutMouseFunc(mouse); glutMotionFunc(motion);
+    glutTimerFunc(0, redisplay, 0);
+
+    sim_thread = std::thread(simulate);
+    std::atexit(stop_simulation);
     
     puts("\nControls:\n"
               "  Left-drag   : add velocity (if not on object)\n"
@@ -478,8 +670,15 @@ int main(int argc,char** argv){
               "  3           : add a movable solid disk\n"
               "  t           : toggle two way coupling on/off\n"
               "  b           : toggle buoyancy on/off\n"
+              "  p           : cycle Gauss-Seidel / multigrid / CG pressure solver\n"
               "  v           : toggle velocity / density display\n"
+              "  m           : toggle texture / immediate-mode field drawing\n"
+              "  g           : cycle the velocity glyph spacing (1, 2, 4, 8 cells)\n"
+              "  + / -       : raise / lower the simulation step rate (unlimited at first)\n"
+              "  ] / [       : raise / lower the frame rate\n"
               "  c           : clear simulation and obstacles\n"
+              "  s / l       : save / load a checkpoint (fluidtoy.ckpt)\n"
+              "  r           : start / stop recording the fields (fluidtoy.rec)\n"
               "  q           : quit\n");
     glutMainLoop();
     return 0;